@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_APPS_BENCHMARK_BENCHMARK_HPP
+#define IPTSD_APPS_BENCHMARK_BENCHMARK_HPP
+
+#include <common/chrono.hpp>
+#include <common/histogram.hpp>
+#include <common/types.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+namespace iptsd::apps::benchmark {
+
+/*!
+ * Prevents the compiler from optimizing away the calculation of a value.
+ *
+ * @param[in] value The value that has to be calculated.
+ */
+template <class T>
+void keep(const T &value)
+{
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+/*
+ * Measures how long single calls of a function take, and writes the results to the log.
+ */
+class Benchmark {
+private:
+	using clock = chrono::steady_clock;
+
+	// How many calls are made before measuring, to warm up caches and allocations.
+	static constexpr usize WARMUP = 16;
+
+	// Only benchmarks whose name contains this string are run.
+	std::string m_filter;
+
+	// How long every benchmark is run.
+	clock::duration m_duration;
+
+public:
+	Benchmark(std::string filter, const clock::duration duration)
+		: m_filter {std::move(filter)},
+		  m_duration {duration} {};
+
+	/*!
+	 * Writes the header of the table of results to the log.
+	 */
+	static void header()
+	{
+		spdlog::info("{:<40} {:>10} {:>10} {:>10} {:>10} {:>10}",
+		             "Benchmark (ns)",
+		             "Calls",
+		             "Mean",
+		             "P50",
+		             "P99",
+		             "Min");
+	}
+
+	/*!
+	 * Runs a benchmark, unless it is excluded by the filter.
+	 *
+	 * @param[in] name The name of the benchmark.
+	 * @param[in] func The function to measure. It is called repeatedly without arguments.
+	 */
+	template <class Func>
+	void run(const std::string &name, Func &&func) const
+	{
+		this->run(name, [] {}, std::forward<Func>(func));
+	}
+
+	/*!
+	 * Runs a benchmark whose input has to be prepared before every call.
+	 *
+	 * @param[in] name The name of the benchmark.
+	 * @param[in] setup Prepares the input of the next call. It is not measured.
+	 * @param[in] func The function to measure. It is called repeatedly without arguments.
+	 */
+	template <class Setup, class Func>
+	void run(const std::string &name, Setup &&setup, Func &&func) const
+	{
+		if (name.find(m_filter) == std::string::npos)
+			return;
+
+		for (usize i = 0; i < WARMUP; i++) {
+			setup();
+			func();
+		}
+
+		common::Histogram histogram {};
+		clock::duration min = clock::duration::max();
+
+		const clock::time_point end = clock::now() + m_duration;
+
+		while (clock::now() < end) {
+			setup();
+
+			const clock::time_point start = clock::now();
+			func();
+			const clock::duration time = clock::now() - start;
+
+			histogram.record(time);
+			min = std::min(min, time);
+		}
+
+		spdlog::info("{:<40} {:>10} {:>10} {:>10} {:>10} {:>10}",
+		             name,
+		             histogram.count(),
+		             histogram.mean().count(),
+		             histogram.percentile(0.5).count(),
+		             histogram.percentile(0.99).count(),
+		             chrono::nanoseconds {min}.count());
+	}
+};
+
+} // namespace iptsd::apps::benchmark
+
+#endif // IPTSD_APPS_BENCHMARK_BENCHMARK_HPP
@@ -0,0 +1,367 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "benchmark.hpp"
+
+#include <common/casts.hpp>
+#include <common/chrono.hpp>
+#include <common/types.hpp>
+#include <contacts/contact.hpp>
+#include <contacts/detection/algorithms/cluster.hpp>
+#include <contacts/detection/algorithms/convolution.hpp>
+#include <contacts/detection/algorithms/gaussian.hpp>
+#include <contacts/detection/algorithms/kernels.hpp>
+#include <contacts/detection/algorithms/maximas.hpp>
+#include <contacts/detection/algorithms/neutral.hpp>
+#include <contacts/detection/algorithms/overlaps.hpp>
+#include <contacts/history.hpp>
+#include <contacts/tracking/tracker.hpp>
+
+#include <CLI/CLI.hpp>
+#include <fmt/format.h>
+#include <gsl/gsl>
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace iptsd::apps::benchmark {
+namespace {
+
+namespace detection = contacts::detection;
+
+/*
+ * A synthetic heatmap, and the intermediate results of processing it.
+ */
+template <class T>
+struct Scene {
+	// The heatmap as it is received from the device, including the background.
+	Image<T> raw {};
+
+	// The same heatmap as raw bytes, and the value of every byte.
+	Image<u8> bytes {};
+	std::array<T, 256> lut {};
+
+	// The heatmap after the neutral value was subtracted.
+	Image<T> neutral {};
+
+	// The heatmap after blurring.
+	Image<T> blurred {};
+
+	// The local maximas of the blurred heatmap.
+	std::vector<Point> maximas {};
+
+	// The clusters around the local maximas, extended by one pixel.
+	std::vector<Box> clusters {};
+
+	// The initial guess for fitting a gaussian onto every cluster.
+	std::vector<detection::gaussian::Parameters<T>> params {};
+
+	// Two frames of contacts that are tracked alternately.
+	std::array<std::vector<contacts::Contact<T>>, 2> frames {};
+};
+
+// The thresholds that are used for detecting contacts, the defaults of iptsd.
+constexpr i32 ACTIVATION_THRESHOLD = 24;
+constexpr i32 DEACTIVATION_THRESHOLD = 20;
+
+/*!
+ * Creates a heatmap with a number of contacts at random positions.
+ *
+ * The same arguments always create the same heatmap.
+ *
+ * @param[in] rows The height of the heatmap.
+ * @param[in] cols The width of the heatmap.
+ * @param[in] count How many contacts are placed on the heatmap.
+ * @return The heatmap and the intermediate results of processing it.
+ */
+template <class T>
+Scene<T> create_scene(const Eigen::Index rows, const Eigen::Index cols, const usize count)
+{
+	const T athresh = casts::to<T>(ACTIVATION_THRESHOLD);
+	const T dthresh = casts::to<T>(DEACTIVATION_THRESHOLD);
+
+	std::mt19937 rng {gsl::narrow_cast<u32>(rows * cols + casts::to_signed(count))};
+
+	std::uniform_real_distribution<T> noise {0, 4};
+	std::uniform_real_distribution<T> xs {2, casts::to<T>(cols - 3)};
+	std::uniform_real_distribution<T> ys {2, casts::to<T>(rows - 3)};
+	std::uniform_real_distribution<T> sigmas {1, 2};
+	std::uniform_real_distribution<T> scales {40, 80};
+	std::uniform_real_distribution<T> jitter {-1, 1};
+
+	Scene<T> scene {};
+	scene.raw.resize(rows, cols);
+
+	for (Eigen::Index i = 0; i < scene.raw.size(); i++)
+		scene.raw(i) = 10 + std::round(noise(rng));
+
+	for (usize i = 0; i < count; i++) {
+		const Vector2<T> mean {xs(rng), ys(rng)};
+		const T sigma = sigmas(rng);
+		const T scale = scales(rng);
+
+		for (Eigen::Index y = 0; y < rows; y++) {
+			for (Eigen::Index x = 0; x < cols; x++) {
+				const Vector2<T> pixel {casts::to<T>(x), casts::to<T>(y)};
+				const Vector2<T> d = pixel - mean;
+				const T exponent = -d.squaredNorm() / (2 * sigma * sigma);
+
+				scene.raw(y, x) += scale * std::exp(exponent);
+			}
+		}
+
+		const Vector2<T> size {sigma * 4, sigma * 4};
+
+		for (usize j = 0; j < scene.frames.size(); j++) {
+			const Vector2<T> moved = mean + Vector2<T> {jitter(rng), jitter(rng)};
+			scene.frames.at(j).push_back(contacts::Contact<T> {moved, size, 0, false});
+		}
+	}
+
+	scene.bytes = scene.raw.min(casts::to<T>(255)).template cast<u8>();
+
+	for (usize i = 0; i < scene.lut.size(); i++)
+		scene.lut.at(i) = casts::to<T>(i);
+
+	std::vector<T> values {};
+	const T neutral = detection::neutral::calculate(scene.raw,
+	                                                detection::neutral::Algorithm::MODE,
+	                                                casts::to<T>(0),
+	                                                0.5,
+	                                                values);
+
+	scene.neutral = (scene.raw - neutral).max(casts::to<T>(0));
+	scene.blurred.resize(rows, cols);
+
+	const auto kernel = detection::kernels::gaussian<T, 3, 3>(gsl::narrow_cast<T>(0.75));
+	detection::convolution::run(scene.neutral, kernel, scene.blurred);
+	detection::maximas::find(scene.blurred, athresh, scene.maximas);
+
+	Image<bool> visited {};
+	std::vector<detection::cluster::Step<T>> stack {};
+
+	const Point one = Point::Ones();
+	const Point dimensions {cols - 1, rows - 1};
+
+	for (const Point &point : scene.maximas) {
+		Box cluster = detection::cluster::span(scene.blurred,
+		                                       point,
+		                                       athresh,
+		                                       dthresh,
+		                                       visited,
+		                                       stack);
+
+		if (cluster.isEmpty())
+			continue;
+
+		cluster.min() = (cluster.min() - one).cwiseMax(0);
+		cluster.max() = (cluster.max() + one).cwiseMin(dimensions);
+
+		scene.clusters.push_back(cluster);
+	}
+
+	for (const Box &cluster : scene.clusters) {
+		const Point size = cluster.sizes() + one;
+
+		detection::gaussian::Parameters<T> params {};
+		params.valid = true;
+		params.scale = 1;
+		params.mean = cluster.cast<T>().center();
+		params.prec = Matrix2<T>::Identity();
+		params.bounds = cluster;
+		params.weights.resize(size.y(), size.x());
+		params.columns.resize(size.y(), 2);
+		params.columns.col(0).setConstant(cluster.min().x());
+		params.columns.col(1).setConstant(cluster.max().x());
+
+		scene.params.push_back(std::move(params));
+	}
+
+	return scene;
+}
+
+/*!
+ * Runs the benchmarks of all algorithms on one heatmap.
+ *
+ * @param[in] bench The benchmark runner.
+ * @param[in] rows The height of the heatmap.
+ * @param[in] cols The width of the heatmap.
+ * @param[in] count How many contacts are placed on the heatmap.
+ */
+template <class T>
+void run_scene(const Benchmark &bench,
+               const Eigen::Index rows,
+               const Eigen::Index cols,
+               const usize count)
+{
+	const T athresh = casts::to<T>(ACTIVATION_THRESHOLD);
+	const T dthresh = casts::to<T>(DEACTIVATION_THRESHOLD);
+
+	const char *type = std::is_same_v<T, f32> ? "f32" : "f64";
+	const Scene<T> scene = create_scene<T>(rows, cols, count);
+
+	const auto name = [&](const char *algorithm) {
+		return fmt::format("{}/{}x{}/{}/{}", algorithm, rows, cols, count, type);
+	};
+
+	std::vector<T> values {};
+
+	bench.run(name("neutral"), [&] {
+		keep(detection::neutral::calculate(scene.raw,
+		                                   detection::neutral::Algorithm::MODE,
+		                                   casts::to<T>(0),
+		                                   0.5,
+		                                   values));
+	});
+
+	bench.run(name("neutral-lut"), [&] {
+		keep(detection::neutral::calculate(scene.bytes,
+		                                   scene.lut,
+		                                   detection::neutral::Algorithm::MODE,
+		                                   casts::to<T>(0),
+		                                   0.5));
+	});
+
+	const auto kernel = detection::kernels::gaussian<T, 3, 3>(gsl::narrow_cast<T>(0.75));
+	Image<T> blurred {rows, cols};
+
+	bench.run(name("convolution"), [&] {
+		detection::convolution::run(scene.neutral, kernel, blurred);
+		keep(blurred);
+	});
+
+	std::vector<Point> maximas {};
+
+	bench.run(name("maximas"), [&] {
+		detection::maximas::find(scene.blurred, athresh, maximas);
+		keep(maximas);
+	});
+
+	Image<bool> visited {};
+	std::vector<detection::cluster::Step<T>> stack {};
+	std::vector<Box> spans {};
+
+	bench.run(name("cluster-span"), [&] {
+		spans.clear();
+
+		for (const Point &point : scene.maximas) {
+			spans.push_back(detection::cluster::span(scene.blurred,
+			                                         point,
+			                                         athresh,
+			                                         dthresh,
+			                                         visited,
+			                                         stack));
+		}
+
+		keep(spans);
+	});
+
+	detection::cluster::Labels labels {};
+
+	bench.run(name("cluster-label"), [&] {
+		detection::cluster::label(scene.blurred, athresh, dthresh, labels, spans);
+		keep(spans);
+	});
+
+	std::vector<Box> clusters {};
+	detection::overlaps::Workspace overlaps {};
+
+	const auto copy_clusters = [&] { clusters = scene.clusters; };
+
+	bench.run(name("overlaps"), copy_clusters, [&] {
+		detection::overlaps::merge(clusters, overlaps, 5);
+		keep(clusters);
+	});
+
+	std::vector<detection::gaussian::Parameters<T>> params {};
+	detection::gaussian::Workspace<T> workspace {};
+	workspace.resize(rows, cols);
+
+	const auto copy_params = [&] { params = scene.params; };
+
+	bench.run(name("gaussian"), copy_params, [&] {
+		detection::gaussian::fit(params,
+		                         scene.blurred,
+		                         workspace,
+		                         3,
+		                         casts::to<T>(0),
+		                         nullptr);
+		keep(params);
+	});
+
+	contacts::tracking::Tracker<T> tracker {contacts::tracking::Config<T> {}};
+	contacts::History<T> history {};
+	std::vector<contacts::Contact<T>> frame {};
+	usize next = 0;
+
+	const auto copy_frame = [&] {
+		frame = scene.frames.at(next);
+		next = (next + 1) % scene.frames.size();
+	};
+
+	bench.run(name("tracking"), copy_frame, [&] {
+		tracker.track(frame, history);
+		history.push(frame);
+	});
+}
+
+int run(const int argc, const char **argv)
+{
+	CLI::App app {"Micro-benchmarks for the contact detection algorithms of iptsd."};
+
+	std::string filter {};
+	app.add_option("FILTER", filter)
+		->description("Only run benchmarks whose name contains this string.");
+
+	f64 duration {};
+	app.add_option("-d,--duration", duration)
+		->description("How many seconds every benchmark is run.")
+		->check(CLI::PositiveNumber)
+		->default_val(0.2);
+
+	CLI11_PARSE(app, argc, argv);
+
+	const Benchmark bench {
+		filter,
+		chrono::duration_cast<chrono::steady_clock::duration>(seconds<f64> {duration}),
+	};
+
+	// The heatmap sizes of small and large devices, and a very large one.
+	const std::array<Point, 3> sizes {Point {64, 44}, Point {72, 48}, Point {144, 96}};
+
+	// A single finger, a hand, and both hands.
+	const std::array<usize, 3> counts {1, 5, 10};
+
+	Benchmark::header();
+
+	for (const Point &size : sizes) {
+		for (const usize count : counts) {
+			run_scene<f32>(bench, size.y(), size.x(), count);
+			run_scene<f64>(bench, size.y(), size.x(), count);
+		}
+	}
+
+	return 0;
+}
+
+} // namespace
+} // namespace iptsd::apps::benchmark
+
+int main(const int argc, const char **argv)
+{
+	spdlog::set_pattern("[%X.%e] [%^%l%$] %v");
+
+	try {
+		return iptsd::apps::benchmark::run(argc, argv);
+	} catch (const std::exception &e) {
+		spdlog::error(e.what());
+		return EXIT_FAILURE;
+	}
+}
@@ -6,6 +6,7 @@
 #include <common/buildopts.hpp>
 #include <common/casts.hpp>
 #include <common/chrono.hpp>
+#include <common/quantile.hpp>
 #include <common/types.hpp>
 #include <contacts/contact.hpp>
 #include <core/generic/application.hpp>
@@ -31,11 +32,16 @@ private:
 	using clock = chrono::system_clock;
 
 private:
-	// The sizes of all received contacts.
-	std::vector<f64> m_size {};
+	// How many contacts were received.
+	usize m_samples = 0;
 
-	// The aspect ratios of all received contacts.
-	std::vector<f64> m_aspect {};
+	// The 1st and 99th percentile of the sizes of all received contacts.
+	common::QuantileEstimator m_size_min {0.01};
+	common::QuantileEstimator m_size_max {0.99};
+
+	// The 1st and 99th percentile of the aspect ratios of all received contacts.
+	common::QuantileEstimator m_aspect_min {0.01};
+	common::QuantileEstimator m_aspect_max {0.99};
 
 	f64 m_size_sum = 0;
 	f64 m_aspect_sum = 0;
@@ -70,17 +76,19 @@ public:
 			m_size_sum += size;
 			m_aspect_sum += aspect;
 
-			m_size.push_back(size);
-			m_aspect.push_back(aspect);
+			m_size_min.add(size);
+			m_size_max.add(size);
+
+			m_aspect_min.add(aspect);
+			m_aspect_max.add(aspect);
+
+			m_samples++;
 		}
 
-		if (m_size.empty())
+		if (m_samples == 0)
 			return;
 
-		std::sort(m_size.begin(), m_size.end());
-		std::sort(m_aspect.begin(), m_aspect.end());
-
-		const f64 size = casts::to<f64>(m_size.size());
+		const f64 size = casts::to<f64>(m_samples);
 
 		const f64 avg_s = m_size_sum / size;
 		const f64 avg_a = m_aspect_sum / size;
@@ -107,6 +115,12 @@ public:
 		spdlog::info("Aspect:  {:.3f} (Min: {:.3f}; Max: {:.3f})", avg_a, min_a, max_a);
 	}
 
+	[[nodiscard]] bool wants_stylus() const override
+	{
+		// Only touch inputs are used for calibration.
+		return false;
+	}
+
 	void on_stop() override
 	{
 		const clock::duration now = clock::now().time_since_epoch();
@@ -143,24 +157,19 @@ public:
 
 	void calculate_min_max(f64 &size_min, f64 &size_max, f64 &aspect_min, f64 &aspect_max) const
 	{
-		const f64 size = casts::to<f64>(m_size.size());
-
 		// Determine 1st and 99th percentile
-		const f64 min_idx = std::max(size - 1, 0.0) * 0.01;
-		const f64 max_idx = std::max(size - 1, 0.0) * 0.99;
-
-		size_min = m_size[casts::to<usize>(std::round(min_idx))];
-		size_max = m_size[casts::to<usize>(std::round(max_idx))];
+		size_min = m_size_min.estimate();
+		size_max = m_size_max.estimate();
 
-		aspect_min = m_aspect[casts::to<usize>(std::round(min_idx))];
-		aspect_max = m_aspect[casts::to<usize>(std::round(max_idx))];
+		aspect_min = m_aspect_min.estimate();
+		aspect_max = m_aspect_max.estimate();
 	}
 
 	void write_file(const std::filesystem::path &out, const f64 slack) const
 	{
 		std::ofstream writer {out};
 
-		const f64 size = casts::to<f64>(m_size.size());
+		const f64 size = casts::to<f64>(m_samples);
 
 		f64 size_min {};
 		f64 size_max {};
@@ -3,9 +3,11 @@
 #ifndef IPTSD_APPS_DAEMON_DAEMON_HPP
 #define IPTSD_APPS_DAEMON_DAEMON_HPP
 
+#include "scheduler.hpp"
 #include "stylus.hpp"
 #include "touch.hpp"
 
+#include <common/chrono.hpp>
 #include <common/types.hpp>
 #include <contacts/contact.hpp>
 #include <core/generic/application.hpp>
@@ -14,6 +16,8 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <exception>
 #include <optional>
 #include <vector>
 
@@ -27,13 +31,32 @@ private:
 	// The stylus device.
 	StylusDevice m_stylus;
 
+	// Times the touch inputs to the display, if enabled.
+	std::optional<EmissionScheduler> m_scheduler = std::nullopt;
+
+	// Storage for the contacts after they were extrapolated to the refresh of the display.
+	std::vector<contacts::Contact<f64>> m_extrapolated {};
+
 public:
 	Daemon(const core::Config &config,
 	       const core::DeviceInfo &info,
 	       const std::optional<const ipts::Metadata> &metadata)
 		: core::Application(config, info, metadata),
 		  m_touch {config, info},
-		  m_stylus {config, info} {};
+		  m_stylus {config, info}
+	{
+		if (!config.touch_sync_to_display)
+			return;
+
+		const milliseconds<f64> margin {std::max(config.touch_sync_margin, 0.0)};
+
+		try {
+			m_scheduler.emplace(config.touch_sync_device,
+			                    chrono::duration_cast<clock::duration>(margin));
+		} catch (const std::exception &e) {
+			spdlog::warn("Touch inputs are not synced to the display: {}", e.what());
+		}
+	}
 
 	void on_start() override
 	{
@@ -53,7 +76,39 @@ public:
 		if (m_config.touch_disable_on_stylus && !m_stylus.active() && !m_touch.enabled())
 			m_touch.enable();
 
-		m_touch.update(contacts);
+		if (!m_scheduler.has_value()) {
+			m_touch.update(contacts);
+			return;
+		}
+
+		// Frames that add or lift contacts are never skipped.
+		const bool can_hold = m_touch.enabled() && m_touch.same_contacts(contacts);
+
+		const std::optional<f64> horizon =
+			m_scheduler->schedule(m_timestamp, clock::now(), can_hold);
+
+		if (!horizon.has_value())
+			return;
+
+		this->extrapolate(contacts, horizon.value());
+		m_touch.update(m_extrapolated);
+	}
+
+	[[nodiscard]] bool wants_contacts() const override
+	{
+		if (m_config.touch_disable)
+			return false;
+
+		if (m_touch.enabled())
+			return true;
+
+		// The contacts are ignored until the stylus is gone and the touchscreen is enabled.
+		return m_config.touch_disable_on_stylus && !m_stylus.active();
+	}
+
+	[[nodiscard]] bool wants_stylus() const override
+	{
+		return !m_config.stylus_disable;
 	}
 
 	void on_stylus(const ipts::StylusData &stylus) override
@@ -66,6 +121,25 @@ public:
 
 		m_stylus.update(stylus);
 	}
+
+private:
+	/*!
+	 * Moves all contacts along their velocity, and stores them in @ref m_extrapolated.
+	 *
+	 * @param[in] contacts All currently active contacts.
+	 * @param[in] frames How many frames ahead the contacts are moved.
+	 */
+	void extrapolate(const std::vector<contacts::Contact<f64>> &contacts, const f64 frames)
+	{
+		m_extrapolated.assign(contacts.cbegin(), contacts.cend());
+
+		for (contacts::Contact<f64> &contact : m_extrapolated) {
+			contact.mean += contact.velocity * frames;
+
+			if (contact.normalized)
+				contact.mean = contact.mean.cwiseMax(0).cwiseMin(1);
+		}
+	}
 };
 
 } // namespace iptsd::apps::daemon
@@ -4,6 +4,7 @@
 
 #include <common/types.hpp>
 #include <core/linux/device-runner.hpp>
+#include <core/linux/multi-runner.hpp>
 #include <core/linux/signal-handler.hpp>
 
 #include <CLI/CLI.hpp>
@@ -15,32 +16,61 @@
 #include <exception>
 #include <filesystem>
 #include <string>
+#include <vector>
 
 namespace iptsd::apps::daemon {
 namespace {
 
+/*!
+ * Runs the daemon until it is stopped by a signal, or fails.
+ *
+ * @param[in] daemon The runner that reads from the devices.
+ * @return The exit code of the process.
+ */
+template <class Runner>
+int run_daemon(Runner &daemon)
+{
+	const auto _sigterm = core::linux::signal<SIGTERM>([&](int) { daemon.stop(); });
+	const auto _sigint = core::linux::signal<SIGINT>([&](int) { daemon.stop(); });
+
+	// Don't interrupt reading from the device, the statistics are logged after the next frame.
+	const auto _sigusr1 = core::linux::signal<SIGUSR1>(
+		[&](int) { daemon.request_latency(); },
+		SA_RESTART);
+
+	// The reports are saved by the reading thread, after the next one arrives.
+	const auto _sigusr2 = core::linux::signal<SIGUSR2>(
+		[&](int) { daemon.request_recording(); },
+		SA_RESTART);
+
+	if (!daemon.run())
+		return EXIT_FAILURE;
+
+	return 0;
+}
+
 int run(const int argc, const char **argv)
 {
 	CLI::App app {"Daemon to translate touchscreen inputs to Linux input events."};
 
-	std::filesystem::path path {};
-	app.add_option("DEVICE", path)
-		->description("The hidraw device node of the touchscreen.")
+	std::vector<std::filesystem::path> paths {};
+	app.add_option("DEVICE", paths)
+		->description("The hidraw device nodes of the touchscreens. All devices are "
+		              "read from the same thread.")
 		->type_name("FILE")
 		->required();
 
 	CLI11_PARSE(app, argc, argv);
 
 	// Create a daemon application that reads from a device.
-	core::linux::DeviceRunner<Daemon> daemon {path};
-
-	const auto _sigterm = core::linux::signal<SIGTERM>([&](int) { daemon.stop(); });
-	const auto _sigint = core::linux::signal<SIGINT>([&](int) { daemon.stop(); });
-
-	if (!daemon.run())
-		return EXIT_FAILURE;
+	if (paths.size() == 1) {
+		core::linux::DeviceRunner<Daemon> daemon {paths.front()};
+		return run_daemon(daemon);
+	}
 
-	return 0;
+	// Create a daemon application for every device, and read from all of them at once.
+	core::linux::MultiDeviceRunner<Daemon> daemon {paths};
+	return run_daemon(daemon);
 }
 
 } // namespace
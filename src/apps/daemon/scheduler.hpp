@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_APPS_DAEMON_SCHEDULER_HPP
+#define IPTSD_APPS_DAEMON_SCHEDULER_HPP
+
+#include <common/chrono.hpp>
+#include <common/types.hpp>
+#include <core/linux/display-clock.hpp>
+
+#include <filesystem>
+#include <optional>
+
+namespace iptsd::apps::daemon {
+
+/*
+ * Times the frames of contacts to the refreshes of the display.
+ *
+ * The compositor only looks at the input devices once per refresh. A frame that is replaced
+ * by a newer one before that happens never reaches the screen, and emitting it only wakes
+ * up the compositor and its clients for nothing. The scheduler learns how often the device
+ * sends heatmaps, and holds back every frame that the next heatmap will replace before the
+ * deadline of the next refresh. The frames that are emitted are extrapolated to the time
+ * of the refresh, so that they show where the contacts will be when the frame is drawn.
+ */
+class EmissionScheduler {
+public:
+	using clock = chrono::steady_clock;
+
+private:
+	// Intervals longer than this are pauses between touches, not the rate of the device.
+	constexpr static clock::duration MAX_INTERVAL = 50ms;
+
+	// How fast the measured rate of the device follows changes (1 / GAIN).
+	constexpr static i32 GAIN = 8;
+
+private:
+	core::linux::DisplayClock m_display;
+
+	// How long before the refresh the compositor needs to receive the frame.
+	clock::duration m_margin;
+
+	// The time between two heatmaps, or zero if it was not measured yet.
+	clock::duration m_period {0};
+
+	// When the last heatmap was received.
+	clock::time_point m_last {};
+
+public:
+	/*!
+	 * Starts following the refreshes of a display.
+	 *
+	 * @param[in] device The DRM device of the display.
+	 * @param[in] margin How long before the refresh the compositor needs to receive a frame.
+	 */
+	EmissionScheduler(const std::filesystem::path &device, const clock::duration margin)
+		: m_display {device},
+		  m_margin {margin} {};
+
+	/*!
+	 * Decides what happens to the contacts of a heatmap.
+	 *
+	 * @param[in] received When the heatmap was received from the device.
+	 * @param[in] now When the contacts are ready to be emitted.
+	 * @param[in] can_hold Whether the contacts may be replaced by the next frame.
+	 * @return How many frames ahead the contacts should be extrapolated before they are
+	 *         emitted, or null if the next frame will replace them before the refresh.
+	 */
+	[[nodiscard]] std::optional<f64> schedule(const clock::time_point received,
+	                                          const clock::time_point now,
+	                                          const bool can_hold)
+	{
+		this->learn(received);
+		m_display.sync(now);
+
+		const std::optional<clock::time_point> refresh = m_display.next(now + m_margin);
+
+		if (!refresh.has_value() || m_period == clock::duration::zero())
+			return 0.0;
+
+		const clock::time_point deadline = refresh.value() - m_margin;
+
+		// The next heatmap may arrive a bit late, so it has to be ready well before.
+		const clock::time_point ready = now + m_period + (m_period / 4);
+
+		if (can_hold && ready < deadline)
+			return std::nullopt;
+
+		const nanoseconds<f64> ahead = refresh.value() - received;
+		const nanoseconds<f64> period = m_period;
+
+		return ahead / period;
+	}
+
+private:
+	/*!
+	 * Measures the time between two heatmaps.
+	 *
+	 * @param[in] received When the heatmap was received from the device.
+	 */
+	void learn(const clock::time_point received)
+	{
+		const clock::duration interval = received - m_last;
+		m_last = received;
+
+		if (interval <= clock::duration::zero() || interval > MAX_INTERVAL)
+			return;
+
+		if (m_period == clock::duration::zero())
+			m_period = interval;
+		else
+			m_period += (interval - m_period) / GAIN;
+	}
+};
+
+} // namespace iptsd::apps::daemon
+
+#endif // IPTSD_APPS_DAEMON_SCHEDULER_HPP
@@ -16,11 +16,10 @@
 #include <linux/input-event-codes.h>
 
 #include <algorithm>
+#include <bitset>
 #include <cmath>
-#include <iterator>
 #include <memory>
 #include <optional>
-#include <set>
 #include <vector>
 
 namespace iptsd::apps::daemon {
@@ -37,6 +36,12 @@ private:
 	 */
 	constexpr static usize DIAGONAL = 12000;
 
+	/*
+	 * A set of contact indices. Indices outside of the slots that the device announces are
+	 * discarded by the kernel, so they don't need to be stored.
+	 */
+	using Slots = std::bitset<MAX_CONTACTS + 1>;
+
 private:
 	std::shared_ptr<UinputDevice> m_uinput = std::make_shared<UinputDevice>();
 
@@ -44,13 +49,13 @@ private:
 	core::Config m_config;
 
 	// The indices of the contacts in the current frame.
-	std::set<usize> m_current {};
+	Slots m_current {};
 
 	// The indices of the contacts in the last frame.
-	std::set<usize> m_last {};
+	Slots m_last {};
 
 	// The difference between m_last and m_current.
-	std::set<usize> m_lift {};
+	Slots m_lift {};
 
 	// The index of the contact that is emitted through the singletouch API.
 	usize m_single_index = 0;
@@ -124,9 +129,9 @@ public:
 		this->lift_all();
 		this->sync();
 
-		m_current.clear();
-		m_last.clear();
-		m_lift.clear();
+		m_current.reset();
+		m_last.reset();
+		m_lift.reset();
 	}
 
 	/*!
@@ -154,38 +159,57 @@ public:
 	 */
 	[[nodiscard]] bool active() const
 	{
-		return !m_current.empty();
+		return m_current.any();
 	}
 
-private:
 	/*!
-	 * Builds the difference between the current and the last frame.
-	 * Contacts that were present in the last frame but not in this one have to be lifted.
+	 * Whether a frame contains the same contacts as the last one that was passed on.
 	 *
 	 * @param[in] contacts All currently active contacts.
+	 * @return true if the frame would neither add nor lift any contacts.
 	 */
-	void search_lifted(const std::vector<contacts::Contact<f64>> &contacts)
+	[[nodiscard]] bool same_contacts(const std::vector<contacts::Contact<f64>> &contacts) const
 	{
-		std::swap(m_current, m_last);
+		return TouchDevice::slots(contacts) == m_current;
+	}
 
-		m_current.clear();
+private:
+	/*!
+	 * Builds the set of indices of a frame.
+	 *
+	 * @param[in] contacts All currently active contacts.
+	 * @return The indices of all contacts that have one.
+	 */
+	[[nodiscard]] static Slots slots(const std::vector<contacts::Contact<f64>> &contacts)
+	{
+		Slots slots {};
 
-		// Build a set of current indices
 		for (const contacts::Contact<f64> &contact : contacts) {
 			if (!contact.index.has_value())
 				continue;
 
-			m_current.insert(contact.index.value());
+			const usize index = contact.index.value();
+
+			if (index < slots.size())
+				slots.set(index);
 		}
 
-		m_lift.clear();
+		return slots;
+	}
+
+	/*!
+	 * Builds the difference between the current and the last frame.
+	 * Contacts that were present in the last frame but not in this one have to be lifted.
+	 *
+	 * @param[in] contacts All currently active contacts.
+	 */
+	void search_lifted(const std::vector<contacts::Contact<f64>> &contacts)
+	{
+		m_last = m_current;
+		m_current = TouchDevice::slots(contacts);
 
 		// Determine all indices that were in the last frame but not in this one
-		std::set_difference(m_last.cbegin(),
-		                    m_last.cend(),
-		                    m_current.cbegin(),
-		                    m_current.cend(),
-		                    std::inserter(m_lift, m_lift.begin()));
+		m_lift = m_last & ~m_current;
 	}
 
 	/*!
@@ -247,8 +271,10 @@ private:
 			}
 		}
 
-		for (const usize &index : m_lift)
-			this->lift_multitouch(index);
+		for (usize index = 0; index < m_lift.size(); index++) {
+			if (m_lift.test(index))
+				this->lift_multitouch(index);
+		}
 
 		if (reset_singletouch) {
 			this->lift_singletouch();
@@ -322,7 +348,7 @@ private:
 	 */
 	void process_singletouch(const std::vector<contacts::Contact<f64>> &contacts)
 	{
-		const bool reset = m_lift.find(m_single_index) == m_lift.cend();
+		const bool reset = m_single_index >= m_lift.size() || !m_lift.test(m_single_index);
 
 		if (!reset) {
 			for (const contacts::Contact<f64> &contact : contacts) {
@@ -393,12 +419,18 @@ private:
 	 */
 	void lift_all() const
 	{
-		for (const usize &index : m_current) {
+		for (usize index = 0; index < m_current.size(); index++) {
+			if (!m_current.test(index))
+				continue;
+
 			m_uinput->emit(EV_ABS, ABS_MT_SLOT, casts::to<i32>(index));
 			this->lift_multitouch(index);
 		}
 
-		for (const usize &index : m_last) {
+		for (usize index = 0; index < m_last.size(); index++) {
+			if (!m_last.test(index))
+				continue;
+
 			m_uinput->emit(EV_ABS, ABS_MT_SLOT, casts::to<i32>(index));
 			this->lift_multitouch(index);
 		}
@@ -3,9 +3,12 @@
 #ifndef IPTSD_APPS_DAEMON_UINPUT_DEVICE_HPP
 #define IPTSD_APPS_DAEMON_UINPUT_DEVICE_HPP
 
+#include <common/tracing.hpp>
 #include <common/types.hpp>
 #include <core/linux/syscalls.hpp>
 
+#include <gsl/gsl>
+
 #include <linux/input.h>
 #include <linux/uinput.h>
 
@@ -13,6 +16,7 @@
 #include <fcntl.h>
 #include <string>
 #include <utility>
+#include <vector>
 
 namespace syscalls = iptsd::core::linux::syscalls;
 
@@ -28,6 +32,9 @@ private:
 	// The file descriptor of the open uinput node.
 	int m_fd;
 
+	// The events that have been emitted since the last SYN_REPORT.
+	std::vector<struct input_event> m_events {};
+
 public:
 	UinputDevice() : m_fd {syscalls::open("/dev/uinput", O_WRONLY | O_NONBLOCK)} {};
 
@@ -169,13 +176,16 @@ public:
 	/*!
 	 * Emits an event.
 	 *
+	 * Events are collected until a SYN_REPORT is emitted, and then passed to the kernel
+	 * together, so that one frame of events only needs a single write.
+	 *
 	 * Must be called after @ref create().
 	 *
 	 * @param[in] type The event type.
 	 * @param[in] key The key of the button or axis.
 	 * @param[in] value The value of the button or axis.
 	 */
-	void emit(const u16 type, const u16 key, const i32 value) const
+	void emit(const u16 type, const u16 key, const i32 value)
 	{
 		struct input_event ie {};
 
@@ -183,7 +193,23 @@ public:
 		ie.code = key;
 		ie.value = value;
 
-		syscalls::write(m_fd, ie);
+		m_events.push_back(ie);
+
+		if (type == EV_SYN && key == SYN_REPORT)
+			this->flush();
+	}
+
+private:
+	/*!
+	 * Writes all collected events to the uinput node.
+	 */
+	void flush()
+	{
+		// Don't send the events of a failed frame again with the next one.
+		const auto _clear = gsl::finally([&] { m_events.clear(); });
+		const common::tracing::Span span {"uinput"};
+
+		syscalls::write(m_fd, gsl::span<const struct input_event> {m_events});
 	}
 };
 
@@ -4,18 +4,18 @@
 #define IPTSD_APPS_DUMP_DUMP_HPP
 
 #include <common/casts.hpp>
+#include <common/chrono.hpp>
 #include <common/types.hpp>
 #include <core/generic/application.hpp>
 #include <core/generic/config.hpp>
 #include <core/generic/device.hpp>
+#include <core/linux/dump-writer.hpp>
 #include <ipts/data.hpp>
 
 #include <gsl/gsl>
+#include <spdlog/spdlog.h>
 
-#include <algorithm>
 #include <filesystem>
-#include <fstream>
-#include <iterator>
 #include <optional>
 #include <utility>
 
@@ -23,8 +23,14 @@ namespace iptsd::apps::dump {
 
 class Dump : public core::Application {
 private:
+	// The size of the blocks in which the data is written to the file.
+	constexpr static usize WRITE_BLOCK_SIZE = 1024 * 1024;
+
+	// How many blocks can wait for the disk, before frames are dropped.
+	constexpr static usize WRITE_BLOCKS = 8;
+
 	std::filesystem::path m_out;
-	std::ofstream m_writer {};
+	std::optional<core::linux::DumpWriter> m_writer = std::nullopt;
 
 public:
 	Dump(const core::Config &config,
@@ -39,39 +45,34 @@ public:
 		if (m_out.empty())
 			return;
 
-		m_writer.exceptions(std::ios::badbit | std::ios::failbit);
-		m_writer.open(m_out, std::ios::out | std::ios::binary);
-
-		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-		m_writer.write(reinterpret_cast<char *>(&m_info), sizeof(m_info));
+		// The reports are only copied here, the disk is written by a separate thread
+		m_writer.emplace(m_out, WRITE_BLOCK_SIZE, WRITE_BLOCKS);
+		m_writer->write_header(m_info, m_metadata);
+	}
 
-		const char has_meta = m_metadata.has_value() ? 1 : 0;
-		m_writer.write(&has_meta, sizeof(has_meta));
+	void on_data(const gsl::span<u8> data) override
+	{
+		if (!m_writer.has_value())
+			return;
 
-		if (m_metadata.has_value()) {
-			const ipts::Metadata m = m_metadata.value();
+		const clock::duration timestamp = m_timestamp.time_since_epoch();
+		const auto ns = chrono::duration_cast<chrono::nanoseconds>(timestamp).count();
 
-			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-			m_writer.write(reinterpret_cast<const char *>(&m), sizeof(m));
-		}
+		m_writer->write_frame(data, casts::to<u64>(ns));
 	}
 
-	void on_data(const gsl::span<u8> data) override
+	void on_stop() override
 	{
-		if (m_out.empty())
+		if (!m_writer.has_value())
 			return;
 
-		const u64 size = casts::to<u64>(data.size());
-
-		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-		m_writer.write(reinterpret_cast<const char *>(&size), sizeof(size));
+		m_writer->finish();
 
-		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-		m_writer.write(reinterpret_cast<char *>(data.data()),
-		               casts::to<std::streamsize>(size));
+		const usize overflows = m_writer->overflows();
+		m_writer.reset();
 
-		// Pad the data with zeros, so that we always write a full buffer.
-		std::fill_n(std::ostream_iterator<u8>(m_writer), m_info.buffer_size - size, '\0');
+		if (overflows > 0)
+			spdlog::warn("Dropped {} reports, the output was too slow", overflows);
 	}
 };
 
@@ -8,6 +8,7 @@
 
 #include <CLI/CLI.hpp>
 #include <gsl/gsl>
+#include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 
 #include <csignal>
@@ -31,12 +32,16 @@ int run(const int argc, const char **argv)
 
 	std::filesystem::path output {};
 	app.add_option("OUTPUT", output)
-		->description("The file in which the data will be saved.")
+		->description("The file in which the data will be saved, or - for standard output.")
 		->type_name("FILE")
 		->required();
 
 	CLI11_PARSE(app, argc, argv);
 
+	// Keep the standard output free for the data.
+	if (output == "-")
+		spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+
 	// Create a dumping application that reads from a device.
 	core::linux::DeviceRunner<Dump> dump {path, output};
 
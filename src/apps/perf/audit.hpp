@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_APPS_PERF_AUDIT_HPP
+#define IPTSD_APPS_PERF_AUDIT_HPP
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+#include <core/linux/syscalls.hpp>
+
+#include <sys/resource.h>
+
+namespace iptsd::apps::perf::audit {
+
+/*
+ * What the calling thread allocated, and how often it had to wait for memory to be mapped.
+ *
+ * After the first run, processing a report should neither allocate nor touch new pages,
+ * because all buffers have grown to their final size. Anything else costs time on every
+ * frame, and makes the latency depend on the allocator and the kernel.
+ */
+struct Usage {
+	// How often memory was allocated through operator new.
+	u64 allocations = 0;
+
+	// How many bytes were requested by these allocations.
+	u64 bytes = 0;
+
+	// Page faults that were resolved without reading from disk, and those that were not.
+	u64 minor_faults = 0;
+	u64 major_faults = 0;
+
+	Usage &operator+=(const Usage &other)
+	{
+		allocations += other.allocations;
+		bytes += other.bytes;
+		minor_faults += other.minor_faults;
+		major_faults += other.major_faults;
+
+		return *this;
+	}
+
+	Usage operator-(const Usage &other) const
+	{
+		return Usage {
+			allocations - other.allocations,
+			bytes - other.bytes,
+			minor_faults - other.minor_faults,
+			major_faults - other.major_faults,
+		};
+	}
+};
+
+namespace impl {
+
+// The allocations of the calling thread, updated by the replaced operator new.
+inline thread_local u64 allocations = 0;
+inline thread_local u64 bytes = 0;
+
+} // namespace impl
+
+/*!
+ * Counts one allocation of the calling thread.
+ *
+ * This has to be called by every replacement of the global operator new. Replacements can
+ * only exist once per program, so they are defined next to the main function.
+ *
+ * @param[in] size How many bytes were requested.
+ */
+inline void count(const usize size) noexcept
+{
+	impl::allocations++;
+	impl::bytes += size;
+}
+
+/*!
+ * Reads the counters of the calling thread.
+ *
+ * Reading the page faults takes a system call, so it should not be measured.
+ *
+ * @return Everything the thread has allocated and faulted in since it was started.
+ */
+[[nodiscard]] inline Usage sample()
+{
+	struct rusage usage {};
+	core::linux::syscalls::getrusage(RUSAGE_THREAD, usage);
+
+	return Usage {
+		impl::allocations,
+		impl::bytes,
+		casts::to<u64>(usage.ru_minflt),
+		casts::to<u64>(usage.ru_majflt),
+	};
+}
+
+} // namespace iptsd::apps::perf::audit
+
+#endif // IPTSD_APPS_PERF_AUDIT_HPP
@@ -1,34 +1,762 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include "audit.hpp"
 #include "perf.hpp"
+#include "verify.hpp"
 
 #include <common/casts.hpp>
 #include <common/chrono.hpp>
+#include <common/histogram.hpp>
+#include <common/thread-pool.hpp>
 #include <common/types.hpp>
+#include <contacts/timings.hpp>
 #include <core/linux/file-runner.hpp>
+#include <core/linux/perf-counters.hpp>
 #include <core/linux/signal-handler.hpp>
+#include <core/linux/stream-runner.hpp>
+#include <ipts/protocol/dft.hpp>
 
 #include <CLI/CLI.hpp>
+#include <fmt/format.h>
 #include <gsl/gsl>
+#include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
-#include <cmath>
+#include <atomic>
+#include <cstddef>
 #include <cstdlib>
 #include <exception>
 #include <filesystem>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace iptsd::apps::perf {
 namespace {
 
+/*!
+ * Converts a duration to nanoseconds for printing.
+ *
+ * @param[in] duration The duration to convert.
+ * @return The number of nanoseconds.
+ */
+i64 ns(const chrono::nanoseconds duration)
+{
+	return duration.count();
+}
+
+/*!
+ * A name for a type of DFT window, for printing.
+ *
+ * @param[in] type The type of the window.
+ * @return The name of the type, or its value if it is unknown.
+ */
+std::string dft_name(const ipts::protocol::dft::Type type)
+{
+	using ipts::protocol::dft::Type;
+
+	switch (type) {
+	case Type::Position:
+		return "position";
+	case Type::PositionMPP_2:
+		return "position_mpp_2";
+	case Type::Button:
+		return "button";
+	case Type::BinaryMPP_2:
+		return "binary_mpp_2";
+	case Type::Pressure:
+		return "pressure";
+	default:
+		return fmt::format("0x{:02x}", static_cast<u8>(type));
+	}
+}
+
+/*!
+ * Writes the hardware events per report of one type of input to the log, if counted.
+ *
+ * @param[in] name The type of input.
+ * @param[in] perf The application that collected the measurements.
+ * @param[in] measurement The events that were counted.
+ */
+void log_counters(const std::string &name, const Perf &perf, const Measurement &measurement)
+{
+	using Counters = core::linux::PerfCounters;
+
+	if (!perf.counters().has_value() || measurement.count == 0)
+		return;
+
+	if (!perf.counters()->scheduled()) {
+		spdlog::warn("{}: Hardware counters were never scheduled, no events were counted",
+		             name);
+		return;
+	}
+
+	if (perf.counters()->multiplexed())
+		spdlog::warn("{}: Hardware counters were multiplexed, the events are scaled", name);
+
+	std::string line {};
+	auto out = std::back_inserter(line);
+
+	for (usize i = 0; i < Counters::COUNTERS; i++) {
+		const auto counter = static_cast<Counters::Counter>(i);
+
+		if (!perf.counters()->available(counter))
+			continue;
+
+		fmt::format_to(out,
+		               "{}{} {:.0f}",
+		               line.empty() ? "" : ", ",
+		               Counters::name(counter),
+		               measurement.per_report(counter));
+	}
+
+	spdlog::info("{} events per report: {}, IPC {:.2f}", name, line, measurement.ipc());
+}
+
+/*!
+ * Writes the allocations and page faults per report of one type of input to the log, if audited.
+ *
+ * @param[in] name The type of input.
+ * @param[in] perf The application that collected the measurements.
+ * @param[in] measurement The allocations and page faults that were counted.
+ */
+void log_usage(const std::string &name, const Perf &perf, const Measurement &measurement)
+{
+	const audit::Usage &usage = measurement.usage;
+
+	if (!perf.audited() || measurement.count == 0)
+		return;
+
+	spdlog::info("{} per report: {:.2f} allocations, {:.1f} bytes, {:.2f} minor faults, "
+	             "{:.2f} major faults",
+	             name,
+	             measurement.average(usage.allocations),
+	             measurement.average(usage.bytes),
+	             measurement.average(usage.minor_faults),
+	             measurement.average(usage.major_faults));
+}
+
+/*!
+ * Writes the distribution of one type of input to the log, if it was measured.
+ *
+ * @param[in] name The type of input.
+ * @param[in] perf The application that collected the measurements.
+ * @param[in] measurement The durations that were measured.
+ */
+void log_measurement(const std::string &name, const Perf &perf, const Measurement &measurement)
+{
+	const common::Histogram &histogram = measurement.histogram;
+
+	if (measurement.count == 0)
+		return;
+
+	spdlog::info("{}: {} reports, Mean {:.2f}μs, Standard Deviation {:.2f}μs, P50 {}ns, "
+	             "P90 {}ns, P99 {}ns, P99.9 {}ns, Max {}ns",
+	             name,
+	             measurement.count,
+	             measurement.mean() / 1000,
+	             measurement.stddev() / 1000,
+	             ns(histogram.percentile(0.5)),
+	             ns(histogram.percentile(0.9)),
+	             ns(histogram.percentile(0.99)),
+	             ns(histogram.percentile(0.999)),
+	             ns(measurement.max));
+
+	log_counters(name, perf, measurement);
+	log_usage(name, perf, measurement);
+}
+
+/*!
+ * Formats the hardware events per report of one type of input as JSON.
+ *
+ * @param[in] perf The application that collected the measurements.
+ * @param[in] measurement The events that were counted.
+ * @return A JSON member, or nothing if the events were not counted.
+ */
+std::string format_counters(const Perf &perf, const Measurement &measurement)
+{
+	using Counters = core::linux::PerfCounters;
+
+	if (!perf.counters().has_value())
+		return "";
+
+	std::string json {};
+	auto out = std::back_inserter(json);
+
+	fmt::format_to(out, ", \"counters\": {{\"ipc\": {:.3f}", measurement.ipc());
+
+	for (usize i = 0; i < Counters::COUNTERS; i++) {
+		const auto counter = static_cast<Counters::Counter>(i);
+
+		if (!perf.counters()->available(counter))
+			continue;
+
+		fmt::format_to(out,
+		               ", \"{}\": {:.1f}",
+		               Counters::name(counter),
+		               measurement.per_report(counter));
+	}
+
+	fmt::format_to(out, "}}");
+	return json;
+}
+
+/*!
+ * Formats the allocations and page faults per report of one type of input as JSON.
+ *
+ * @param[in] perf The application that collected the measurements.
+ * @param[in] measurement The allocations and page faults that were counted.
+ * @return A JSON member, or nothing if the reports were not audited.
+ */
+std::string format_usage(const Perf &perf, const Measurement &measurement)
+{
+	const audit::Usage &usage = measurement.usage;
+
+	if (!perf.audited())
+		return "";
+
+	std::string json {};
+	auto out = std::back_inserter(json);
+
+	fmt::format_to(out, ", \"audit\": {{");
+	fmt::format_to(out, "\"allocations\": {:.3f}", measurement.average(usage.allocations));
+	fmt::format_to(out, ", \"bytes\": {:.1f}", measurement.average(usage.bytes));
+	fmt::format_to(out, ", \"minor_faults\": {:.3f}", measurement.average(usage.minor_faults));
+	fmt::format_to(out, ", \"major_faults\": {:.3f}", measurement.average(usage.major_faults));
+	fmt::format_to(out, "}}");
+
+	return json;
+}
+
+/*!
+ * Formats the distribution of one type of input as a JSON object.
+ *
+ * @param[in] perf The application that collected the measurements.
+ * @param[in] measurement The durations that were measured.
+ * @return The JSON object, with all durations in nanoseconds.
+ */
+std::string format_measurement(const Perf &perf, const Measurement &measurement)
+{
+	const common::Histogram &histogram = measurement.histogram;
+
+	const auto max = measurement.count > 0 ? measurement.max : chrono::nanoseconds::zero();
+
+	std::string json {};
+	auto out = std::back_inserter(json);
+
+	fmt::format_to(out, "{{\"frames\": {}", measurement.count);
+	fmt::format_to(out, ", \"mean\": {:.1f}", measurement.mean());
+	fmt::format_to(out, ", \"stddev\": {:.1f}", measurement.stddev());
+	fmt::format_to(out, ", \"p50\": {}", ns(histogram.percentile(0.5)));
+	fmt::format_to(out, ", \"p90\": {}", ns(histogram.percentile(0.9)));
+	fmt::format_to(out, ", \"p99\": {}", ns(histogram.percentile(0.99)));
+	fmt::format_to(out, ", \"p99.9\": {}", ns(histogram.percentile(0.999)));
+	fmt::format_to(out, ", \"max\": {}", ns(max));
+	fmt::format_to(out, "{}", format_counters(perf, measurement));
+	fmt::format_to(out, "{}}}", format_usage(perf, measurement));
+
+	return json;
+}
+
+/*!
+ * Writes the results of the benchmark to the log.
+ *
+ * @param[in] perf The application that collected the measurements.
+ * @param[in] allocations How often the storage for gaussian fitting grew after the first run.
+ */
+void log_results(const Perf &perf, const usize allocations)
+{
+	const Measurement &heatmap = perf.heatmap;
+	const common::Histogram &histogram = heatmap.histogram;
+
+	const auto min = heatmap.count > 0 ? heatmap.min : chrono::nanoseconds::zero();
+	const auto max = heatmap.count > 0 ? heatmap.max : chrono::nanoseconds::zero();
+
+	spdlog::info("Ran {} times", heatmap.count);
+	spdlog::info("Total: {:.0f}μs", heatmap.total / 1000);
+	spdlog::info("Mean: {:.2f}μs", heatmap.mean() / 1000);
+	spdlog::info("Standard Deviation: {:.2f}μs", heatmap.stddev() / 1000);
+	spdlog::info("Minimum: {:.3f}μs", chrono::duration_cast<microseconds<f64>>(min).count());
+	spdlog::info("Maximum: {:.3f}μs", chrono::duration_cast<microseconds<f64>>(max).count());
+
+	spdlog::info("Percentiles: P50 {}ns, P90 {}ns, P99 {}ns, P99.9 {}ns",
+	             ns(histogram.percentile(0.5)),
+	             ns(histogram.percentile(0.9)),
+	             ns(histogram.percentile(0.99)),
+	             ns(histogram.percentile(0.999)));
+
+	log_counters("Heatmap", perf, heatmap);
+	log_usage("Heatmap", perf, heatmap);
+	log_measurement("Stylus", perf, perf.stylus);
+
+	for (const auto &[type, measurement] : perf.dft)
+		log_measurement(fmt::format("DFT {}", dft_name(type)), perf, measurement);
+
+	if (const std::optional<f64> energy = perf.energy(); energy.has_value()) {
+		const f64 reports = casts::to<f64>(std::max(perf.reports(), usize {1}));
+
+		spdlog::info("Energy: {:.3f}J, {:.1f}μJ per report",
+		             energy.value(),
+		             energy.value() / reports * 1e6);
+	}
+
+	spdlog::info("Fitting allocations after the first run: {}", allocations);
+
+	if constexpr (!contacts::Timings::ENABLED) {
+		spdlog::info("Stage timers are disabled, build with -Dstage_timers=true to enable");
+		return;
+	}
+
+	const f64 n = casts::to<f64>(std::max(heatmap.count, usize {1}));
+
+	for (usize i = 0; i < contacts::Timings::STAGES; i++) {
+		const auto stage = static_cast<contacts::Stage>(i);
+		const auto total = chrono::duration_cast<microseconds<f64>>(perf.stage(stage));
+
+		spdlog::info("Stage {:<10} Total: {:.0f}μs, Mean: {:.3f}μs",
+		             contacts::Timings::name(stage),
+		             total.count(),
+		             total.count() / n);
+	}
+}
+
+/*!
+ * Writes the results of the benchmark to the standard output as a JSON object.
+ *
+ * All durations are in nanoseconds. The top level describes the reports containing a
+ * heatmap, the other types of input have their own objects. The mean time of every stage
+ * of the contact finder is only included if the stage timers were compiled in.
+ *
+ * @param[in] perf The application that collected the measurements.
+ * @param[in] allocations How often the storage for gaussian fitting grew after the first run.
+ */
+void print_json(const Perf &perf, const usize allocations)
+{
+	const Measurement &heatmap = perf.heatmap;
+	const common::Histogram &histogram = heatmap.histogram;
+
+	const auto min = heatmap.count > 0 ? heatmap.min : chrono::nanoseconds::zero();
+	const auto max = heatmap.count > 0 ? heatmap.max : chrono::nanoseconds::zero();
+
+	std::string json {};
+	auto out = std::back_inserter(json);
+
+	fmt::format_to(out, "{{\"frames\": {}", heatmap.count);
+	fmt::format_to(out, ", \"total\": {:.0f}", heatmap.total);
+	fmt::format_to(out, ", \"mean\": {:.1f}", heatmap.mean());
+	fmt::format_to(out, ", \"stddev\": {:.1f}", heatmap.stddev());
+	fmt::format_to(out, ", \"min\": {}", ns(min));
+	fmt::format_to(out, ", \"max\": {}", ns(max));
+	fmt::format_to(out, ", \"p50\": {}", ns(histogram.percentile(0.5)));
+	fmt::format_to(out, ", \"p90\": {}", ns(histogram.percentile(0.9)));
+	fmt::format_to(out, ", \"p99\": {}", ns(histogram.percentile(0.99)));
+	fmt::format_to(out, ", \"p99.9\": {}", ns(histogram.percentile(0.999)));
+	fmt::format_to(out, ", \"fitting_allocations\": {}", allocations);
+	fmt::format_to(out, "{}", format_counters(perf, heatmap));
+	fmt::format_to(out, "{}", format_usage(perf, heatmap));
+
+	if (const std::optional<f64> energy = perf.energy(); energy.has_value()) {
+		const f64 reports = casts::to<f64>(std::max(perf.reports(), usize {1}));
+
+		fmt::format_to(out, ", \"energy\": {:.6f}", energy.value());
+		fmt::format_to(out, ", \"energy_per_report\": {:.9f}", energy.value() / reports);
+	}
+
+	fmt::format_to(out, ", \"stylus\": {}", format_measurement(perf, perf.stylus));
+	fmt::format_to(out, ", \"dft\": {{");
+
+	for (auto it = perf.dft.begin(); it != perf.dft.end(); it++) {
+		fmt::format_to(out,
+		               "{}\"{}\": {}",
+		               it != perf.dft.begin() ? ", " : "",
+		               dft_name(it->first),
+		               format_measurement(perf, it->second));
+	}
+
+	fmt::format_to(out, "}}");
+
+	if constexpr (contacts::Timings::ENABLED) {
+		const f64 n = casts::to<f64>(std::max(heatmap.count, usize {1}));
+
+		fmt::format_to(out, ", \"stages\": {{");
+
+		for (usize i = 0; i < contacts::Timings::STAGES; i++) {
+			const auto stage = static_cast<contacts::Stage>(i);
+			const f64 total = casts::to<f64>(ns(perf.stage(stage)));
+
+			fmt::format_to(out,
+			               "{}\"{}\": {:.1f}",
+			               i > 0 ? ", " : "",
+			               contacts::Timings::name(stage),
+			               total / n);
+		}
+
+		fmt::format_to(out, "}}");
+	}
+
+	fmt::print("{}}}\n", json);
+}
+
+template <class Runner>
+int benchmark(Runner &perf,
+              const usize runs,
+              const usize warmup,
+              const bool json,
+              const bool strict = false)
+{
+	const auto _sigterm = core::linux::signal<SIGTERM>([&](int) { perf.stop(); });
+	const auto _sigint = core::linux::signal<SIGINT>([&](int) { perf.stop(); });
+
+	Perf &papp = perf.application();
+
+	bool should_stop = false;
+
+	// How many allocations the first run needed to warm up.
+	usize allocations = 0;
+
+	for (usize i = 0; i < warmup + runs; i++) {
+		should_stop = perf.run();
+
+		if (i == 0)
+			allocations = papp.fitting_allocations();
+
+		// Discard everything that was measured while warming up.
+		if (i + 1 == warmup)
+			papp.clear();
+
+		if (should_stop)
+			break;
+
+		papp.reset();
+	}
+
+	allocations = papp.fitting_allocations() - allocations;
+
+	if (json)
+		print_json(papp, allocations);
+	else
+		log_results(papp, allocations);
+
+	if (!should_stop)
+		return EXIT_FAILURE;
+
+	// After warming up, processing a report should not allocate anymore.
+	if (const u64 steady = papp.usage().allocations; strict && steady > 0) {
+		spdlog::error("{} allocations after warming up", steady);
+		return EXIT_FAILURE;
+	}
+
+	return 0;
+}
+
+/*
+ * The measurements of one thread in throughput mode.
+ */
+struct Worker {
+	// The distribution of the time it took to process a heatmap.
+	common::Histogram histogram {};
+
+	// How many captures the thread has processed.
+	usize captures = 0;
+};
+
+/*!
+ * Writes the results of the throughput mode to the log.
+ *
+ * @param[in] workers The measurements of every thread.
+ * @param[in] elapsed How long it took to process all captures.
+ */
+void log_throughput(const std::vector<Worker> &workers, const chrono::nanoseconds elapsed)
+{
+	usize captures = 0;
+	usize frames = 0;
+
+	for (const Worker &worker : workers) {
+		captures += worker.captures;
+		frames += worker.histogram.count();
+	}
+
+	const f64 time = chrono::duration_cast<seconds<f64>>(elapsed).count();
+
+	spdlog::info("Processed {} captures on {} threads in {:.3f}s",
+	             captures,
+	             workers.size(),
+	             time);
+
+	spdlog::info("Throughput: {:.0f} frames per second", casts::to<f64>(frames) / time);
+
+	for (usize i = 0; i < workers.size(); i++) {
+		const Worker &worker = workers[i];
+		const common::Histogram &histogram = worker.histogram;
+
+		spdlog::info("Thread {}: {} captures, {} frames, Mean {}ns, P50 {}ns, P90 {}ns, "
+		             "P99 {}ns, P99.9 {}ns",
+		             i,
+		             worker.captures,
+		             histogram.count(),
+		             ns(histogram.mean()),
+		             ns(histogram.percentile(0.5)),
+		             ns(histogram.percentile(0.9)),
+		             ns(histogram.percentile(0.99)),
+		             ns(histogram.percentile(0.999)));
+	}
+}
+
+/*!
+ * Writes the results of the throughput mode to the standard output as a JSON object.
+ *
+ * @param[in] workers The measurements of every thread.
+ * @param[in] elapsed How long it took to process all captures.
+ */
+void print_throughput_json(const std::vector<Worker> &workers, const chrono::nanoseconds elapsed)
+{
+	usize frames = 0;
+
+	for (const Worker &worker : workers)
+		frames += worker.histogram.count();
+
+	const f64 time = chrono::duration_cast<seconds<f64>>(elapsed).count();
+
+	std::string json {};
+	auto out = std::back_inserter(json);
+
+	fmt::format_to(out, "{{\"threads\": {}", workers.size());
+	fmt::format_to(out, ", \"frames\": {}", frames);
+	fmt::format_to(out, ", \"elapsed\": {}", ns(elapsed));
+	fmt::format_to(out, ", \"fps\": {:.1f}", casts::to<f64>(frames) / time);
+	fmt::format_to(out, ", \"workers\": [");
+
+	for (usize i = 0; i < workers.size(); i++) {
+		const Worker &worker = workers[i];
+		const common::Histogram &histogram = worker.histogram;
+
+		fmt::format_to(out, "{}{{\"captures\": {}", i > 0 ? ", " : "", worker.captures);
+		fmt::format_to(out, ", \"frames\": {}", histogram.count());
+		fmt::format_to(out, ", \"mean\": {}", ns(histogram.mean()));
+		fmt::format_to(out, ", \"p50\": {}", ns(histogram.percentile(0.5)));
+		fmt::format_to(out, ", \"p90\": {}", ns(histogram.percentile(0.9)));
+		fmt::format_to(out, ", \"p99\": {}", ns(histogram.percentile(0.99)));
+		fmt::format_to(out, ", \"p99.9\": {}", ns(histogram.percentile(0.999)));
+		fmt::format_to(out, ", \"max\": {}}}", ns(histogram.max()));
+	}
+
+	fmt::print("{}]}}\n", json);
+}
+
+/*!
+ * Collects the captures that are processed in throughput mode.
+ *
+ * @param[in] path A capture, or a directory containing captures.
+ * @param[in] threads How many threads the captures are processed on.
+ * @return All files in the directory, or the capture once for every thread.
+ */
+std::vector<std::filesystem::path> find_captures(const std::filesystem::path &path,
+                                                 const usize threads)
+{
+	if (!std::filesystem::is_directory(path))
+		return std::vector<std::filesystem::path>(threads, path);
+
+	std::vector<std::filesystem::path> captures {};
+
+	for (const std::filesystem::directory_entry &entry :
+	     std::filesystem::directory_iterator {path}) {
+		if (entry.is_regular_file())
+			captures.push_back(entry.path());
+	}
+
+	std::sort(captures.begin(), captures.end());
+	return captures;
+}
+
+/*!
+ * Processes many captures in parallel, to measure how well processing scales.
+ *
+ * Every capture gets its own runner and application, like multiple devices in one process.
+ * The threads take the captures one after another, and only share the list of captures.
+ * All captures are warmed up before the measurement starts, so that no thread is still
+ * warming up while the others are already measured.
+ *
+ * @param[in] captures The captures to process.
+ * @param[in] threads How many threads process captures at the same time.
+ * @param[in] runs How many times every capture is processed.
+ * @param[in] warmup How many additional runs are done first and not measured.
+ * @param[in] realtime Whether to process frames with the same timing as they were recorded.
+ * @param[in] parse_only Whether to only parse the reports, without processing them.
+ * @param[in] json Whether to print the results as JSON.
+ */
+int throughput(const std::vector<std::filesystem::path> &captures,
+               const usize threads,
+               const usize runs,
+               const usize warmup,
+               const bool realtime,
+               const bool parse_only,
+               const bool json)
+{
+	using clock = chrono::steady_clock;
+	using Runner = core::linux::FileRunner<Perf>;
+
+	if (captures.empty()) {
+		spdlog::error("No captures found");
+		return EXIT_FAILURE;
+	}
+
+	std::vector<std::unique_ptr<Runner>> runners {};
+
+	for (const std::filesystem::path &capture : captures) {
+		runners.push_back(std::make_unique<Runner>(capture, parse_only));
+		runners.back()->set_realtime(realtime);
+	}
+
+	std::atomic_bool should_stop = false;
+
+	const auto stop = [&](int) {
+		should_stop = true;
+
+		for (const std::unique_ptr<Runner> &runner : runners)
+			runner->stop();
+	};
+
+	const auto _sigterm = core::linux::signal<SIGTERM>(stop);
+	const auto _sigint = core::linux::signal<SIGINT>(stop);
+
+	common::ThreadPool pool {threads - 1, false};
+	std::vector<Worker> workers(pool.size());
+
+	pool.run(runners.size(), [&](const usize task, const usize /* unused */) {
+		Perf &papp = runners[task]->application();
+
+		for (usize i = 0; i < warmup && !should_stop; i++) {
+			runners[task]->run();
+			papp.reset();
+		}
+
+		papp.clear();
+	});
+
+	const clock::time_point start = clock::now();
+
+	pool.run(runners.size(), [&](const usize task, const usize thread) {
+		Perf &papp = runners[task]->application();
+
+		for (usize i = 0; i < runs && !should_stop; i++) {
+			runners[task]->run();
+			papp.reset();
+		}
+
+		workers[thread].histogram.add(papp.heatmap.histogram);
+		workers[thread].captures++;
+	});
+
+	const clock::duration elapsed = clock::now() - start;
+
+	if (json)
+		print_throughput_json(workers, elapsed);
+	else
+		log_throughput(workers, elapsed);
+
+	return 0;
+}
+
+/*!
+ * Compares the contacts of the configured fast paths against the reference implementation.
+ *
+ * Every capture is processed twice, once with the loaded configuration and once with all
+ * optional fast paths disabled (see @ref Recorder::reference). Synthetic data can be
+ * verified the same way, by first writing it to a capture with iptsd-synth.
+ *
+ * @param[in] captures The captures to process.
+ * @param[in] tolerance The largest difference of position, size or orientation that passes.
+ * @param[in] json Whether to print the results as JSON.
+ * @return Whether all captures have passed.
+ */
+int verify(const std::vector<std::filesystem::path> &captures, const f64 tolerance, const bool json)
+{
+	using Runner = core::linux::FileRunner<Recorder>;
+
+	if (captures.empty()) {
+		spdlog::error("No captures found");
+		return EXIT_FAILURE;
+	}
+
+	bool passed = true;
+
+	std::string results {};
+	auto out = std::back_inserter(results);
+
+	for (const std::filesystem::path &capture : captures) {
+		Runner reference {capture, true};
+		Runner optimized {capture, false};
+
+		reference.run();
+		optimized.run();
+
+		const Deviation deviation = compare(reference.application().frames,
+		                                    optimized.application().frames);
+
+		const bool ok = deviation.count_mismatches == 0 && deviation.index_mismatches == 0 &&
+		                deviation.mean <= tolerance && deviation.size <= tolerance &&
+		                deviation.orientation <= tolerance;
+
+		passed = passed && ok;
+
+		if (json) {
+			fmt::format_to(out,
+			               "{}{{\"capture\": \"{}\"",
+			               results.empty() ? "" : ", ",
+			               capture.string());
+			fmt::format_to(out, ", \"frames\": {}", deviation.frames);
+			fmt::format_to(out, ", \"contacts\": {}", deviation.contacts);
+			fmt::format_to(out,
+			               ", \"count_mismatches\": {}",
+			               deviation.count_mismatches);
+			fmt::format_to(out,
+			               ", \"index_mismatches\": {}",
+			               deviation.index_mismatches);
+			fmt::format_to(out, ", \"mean\": {:.3e}", deviation.mean);
+			fmt::format_to(out, ", \"size\": {:.3e}", deviation.size);
+			fmt::format_to(out, ", \"orientation\": {:.3e}", deviation.orientation);
+			fmt::format_to(out, ", \"passed\": {}}}", ok);
+			continue;
+		}
+
+		spdlog::info("{}: {} frames, {} contacts compared",
+		             capture.string(),
+		             deviation.frames,
+		             deviation.contacts);
+
+		spdlog::info("Maximum deviation: Mean {:.3e} (frame {}), Size {:.3e}, "
+		             "Orientation {:.3e}",
+		             deviation.mean,
+		             deviation.worst_frame,
+		             deviation.size,
+		             deviation.orientation);
+
+		spdlog::info("Mismatches: {} contact counts, {} tracking indices",
+		             deviation.count_mismatches,
+		             deviation.index_mismatches);
+
+		if (!ok)
+			spdlog::error("{} deviates from the reference", capture.string());
+	}
+
+	if (json)
+		fmt::print("{{\"passed\": {}, \"captures\": [{}]}}\n", passed, results);
+
+	return passed ? 0 : EXIT_FAILURE;
+}
+
 int run(const int argc, const char **argv)
 {
 	CLI::App app {"Utility for performance testing of iptsd."};
 
 	std::filesystem::path path {};
 	app.add_option("DATA", path)
-		->description("A binary data file containing touch reports.")
+		->description("A binary data file containing touch reports, a directory of such "
+		             "files, or - for standard input.")
 		->type_name("FILE")
 		->required();
 
@@ -38,63 +766,281 @@ int run(const int argc, const char **argv)
 		->check(CLI::PositiveNumber)
 		->default_val(10);
 
-	CLI11_PARSE(app, argc, argv);
+	usize warmup {};
+	app.add_option("--warmup", warmup)
+		->description("How many additional runs are done first and not measured.")
+		->default_val(1);
 
-	// Create a performance testing application that reads from a file.
-	core::linux::FileRunner<Perf> perf {path};
+	bool realtime = false;
+	app.add_flag("--realtime", realtime)
+		->description("Process frames with the same timing as they were recorded.");
 
-	const auto _sigterm = core::linux::signal<SIGTERM>([&](int) { perf.stop(); });
-	const auto _sigint = core::linux::signal<SIGINT>([&](int) { perf.stop(); });
+	bool json = false;
+	app.add_flag("--json", json)
+		->description("Print the results as JSON to the standard output.");
 
-	using clock = std::chrono::steady_clock;
+	usize threads {};
+	app.add_option("-t,--threads", threads)
+		->description("Process captures on this many threads and report the throughput.")
+		->check(CLI::PositiveNumber)
+		->default_val(1);
 
-	usize total = 0;
-	usize total_of_squares = 0;
-	usize count = 0;
+	bool parse_only = false;
+	app.add_flag("--parse-only", parse_only)
+		->description("Only measure how long it takes to parse the reports.");
 
-	clock::duration min = clock::duration::max();
-	clock::duration max = clock::duration::min();
+	bool counters = false;
+	app.add_flag("--counters", counters)
+		->description("Count hardware events and measure energy, if supported.");
 
-	bool should_stop = false;
+	bool audit = false;
+	app.add_flag("--audit", audit)
+		->description("Count the allocations and page faults of every report.");
 
-	for (usize i = 0; i < runs; i++) {
-		should_stop = perf.run();
+	bool strict = false;
+	app.add_flag("--fail-on-allocations", strict)
+		->description("Fail if reports still allocate after warming up. Implies --audit, "
+		              "needs --warmup of at least 1.");
 
-		Perf &papp = perf.application();
+	bool check = false;
+	app.add_flag("--verify", check)
+		->description("Compare the contacts of the configured fast paths to the reference.");
 
-		total += papp.total;
-		total_of_squares += papp.total_of_squares;
-		count += papp.count;
+	f64 tolerance {};
+	app.add_option("--tolerance", tolerance)
+		->description("The largest deviation of the contacts that passes verification.")
+		->check(CLI::NonNegativeNumber)
+		->default_val(1e-3);
 
-		min = std::min(min, papp.min);
-		max = std::max(max, papp.max);
+	CLI11_PARSE(app, argc, argv);
 
-		if (should_stop)
-			break;
+	audit = audit || strict;
 
-		papp.reset();
+	// The first run always allocates, so it has to be discarded.
+	if (strict && path == "-") {
+		spdlog::error("Standard input is only processed once, it can't be checked for "
+		              "allocations after warming up");
+		return EXIT_FAILURE;
 	}
 
-	const f64 n = casts::to<f64>(count);
-	const f64 mean = casts::to<f64>(total) / n;
-	const f64 stddev = std::sqrt(casts::to<f64>(total_of_squares) / n - mean * mean);
+	if (strict && warmup == 0) {
+		spdlog::error("Checking for allocations needs at least one warm up run");
+		return EXIT_FAILURE;
+	}
 
-	spdlog::info("Ran {} times", count);
-	spdlog::info("Total: {}μs", total);
-	spdlog::info("Mean: {:.2f}μs", mean);
-	spdlog::info("Standard Deviation: {:.2f}μs", stddev);
-	spdlog::info("Minimum: {:.3f}μs", chrono::duration_cast<microseconds<f64>>(min).count());
-	spdlog::info("Maximum: {:.3f}μs", chrono::duration_cast<microseconds<f64>>(max).count());
+	// Keep the standard output free for the results.
+	if (json)
+		spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
 
-	if (!should_stop)
-		return EXIT_FAILURE;
+	if (check) {
+		if (path == "-") {
+			spdlog::error("Verification can't read from standard input");
+			return EXIT_FAILURE;
+		}
 
-	return 0;
+		return verify(find_captures(path, 1), tolerance, json);
+	}
+
+	if (path == "-") {
+		// A stream can only be processed once.
+		if (runs > 1 || app.count("--warmup") > 0)
+			spdlog::warn("Reading from standard input, data will only be processed once");
+
+		// Create a performance testing application that reads from a pipe.
+		core::linux::StreamRunner<Perf> perf {path, parse_only, counters, audit};
+		return benchmark(perf, 1, 0, json, strict);
+	}
+
+	// Multiple captures, or one capture on multiple threads, are processed in parallel.
+	if (std::filesystem::is_directory(path) || app.count("--threads") > 0) {
+		const auto captures = find_captures(path, threads);
+
+		if (counters)
+			spdlog::warn("Hardware counters are only measured for a single capture");
+
+		if (audit)
+			spdlog::warn("Allocations are only audited for a single capture");
+
+		return throughput(captures, threads, runs, warmup, realtime, parse_only, json);
+	}
+
+	// Create a performance testing application that reads from a file.
+	core::linux::FileRunner<Perf> perf {path, parse_only, counters, audit};
+	perf.set_realtime(realtime);
+
+	return benchmark(perf, runs, warmup, json, strict);
 }
 
 } // namespace
 } // namespace iptsd::apps::perf
 
+/*
+ * Replacements of the global allocation functions, to count allocations for --audit.
+ *
+ * Replacing operator new replaces it for the whole program, including the standard library,
+ * so every other form has to be replaced as well, and the memory has to be freed the same way.
+ */
+
+// NOLINTBEGIN(cppcoreguidelines-no-malloc, cppcoreguidelines-owning-memory)
+namespace {
+
+void *allocate(const std::size_t size, const std::size_t alignment) noexcept
+{
+	// Allocations of zero bytes still have to return a unique pointer.
+	const std::size_t bytes = std::max(size, std::size_t {1});
+	void *ptr = nullptr;
+
+	if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+		ptr = std::malloc(bytes);
+	} else {
+		// The size has to be a multiple of the alignment.
+		ptr = std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment);
+	}
+
+	if (ptr != nullptr)
+		iptsd::apps::perf::audit::count(size);
+
+	return ptr;
+}
+
+void *allocate_or_throw(const std::size_t size, const std::size_t alignment)
+{
+	while (true) {
+		void *ptr = allocate(size, alignment);
+
+		if (ptr != nullptr)
+			return ptr;
+
+		// Give the program a chance to free some memory, like the default operator new.
+		const std::new_handler handler = std::get_new_handler();
+
+		if (handler == nullptr)
+			throw std::bad_alloc {};
+
+		handler();
+	}
+}
+
+std::size_t to_size(const std::align_val_t alignment)
+{
+	return static_cast<std::size_t>(alignment);
+}
+
+} // namespace
+
+void *operator new(const std::size_t size)
+{
+	return allocate_or_throw(size, 0);
+}
+
+void *operator new[](const std::size_t size)
+{
+	return allocate_or_throw(size, 0);
+}
+
+void *operator new(const std::size_t size, const std::align_val_t alignment)
+{
+	return allocate_or_throw(size, to_size(alignment));
+}
+
+void *operator new[](const std::size_t size, const std::align_val_t alignment)
+{
+	return allocate_or_throw(size, to_size(alignment));
+}
+
+void *operator new(const std::size_t size, const std::nothrow_t & /* unused */) noexcept
+{
+	return allocate(size, 0);
+}
+
+void *operator new[](const std::size_t size, const std::nothrow_t & /* unused */) noexcept
+{
+	return allocate(size, 0);
+}
+
+void *operator new(const std::size_t size,
+                   const std::align_val_t alignment,
+                   const std::nothrow_t & /* unused */) noexcept
+{
+	return allocate(size, to_size(alignment));
+}
+
+void *operator new[](const std::size_t size,
+                     const std::align_val_t alignment,
+                     const std::nothrow_t & /* unused */) noexcept
+{
+	return allocate(size, to_size(alignment));
+}
+
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::size_t /* unused */) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::size_t /* unused */) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::align_val_t /* unused */) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::align_val_t /* unused */) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr,
+                     const std::size_t /* unused */,
+                     const std::align_val_t /* unused */) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr,
+                       const std::size_t /* unused */,
+                       const std::align_val_t /* unused */) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t & /* unused */) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t & /* unused */) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr,
+                     const std::align_val_t /* unused */,
+                     const std::nothrow_t & /* unused */) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr,
+                       const std::align_val_t /* unused */,
+                       const std::nothrow_t & /* unused */) noexcept
+{
+	std::free(ptr);
+}
+// NOLINTEND(cppcoreguidelines-no-malloc, cppcoreguidelines-owning-memory)
+
 int main(const int argc, const char **argv)
 {
 	spdlog::set_pattern("[%X.%e] [%^%l%$] %v");
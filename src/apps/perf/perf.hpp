@@ -3,42 +3,292 @@
 #ifndef IPTSD_APPS_PERF_PERF_HPP
 #define IPTSD_APPS_PERF_PERF_HPP
 
+#include "audit.hpp"
+
+#include <common/casts.hpp>
 #include <common/chrono.hpp>
+#include <common/histogram.hpp>
 #include <common/types.hpp>
 #include <contacts/finder.hpp>
+#include <contacts/timings.hpp>
 #include <core/generic/application.hpp>
 #include <core/generic/config.hpp>
+#include <core/linux/energy-meter.hpp>
+#include <core/linux/perf-counters.hpp>
 #include <ipts/data.hpp>
+#include <ipts/parser.hpp>
+#include <ipts/protocol/dft.hpp>
 
 #include <gsl/gsl>
+#include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <cmath>
+#include <exception>
+#include <map>
 #include <optional>
 #include <utility>
 #include <vector>
 
 namespace iptsd::apps::perf {
 
-class Perf : public core::Application {
-private:
+/*
+ * The distribution of the time it took to process one type of input.
+ */
+struct Measurement {
 	using clock = chrono::steady_clock;
+	using Counter = core::linux::PerfCounters::Counter;
+	using Values = core::linux::PerfCounters::Values;
+
+	common::Histogram histogram {};
+
+	// The sum of all durations and their squares, in nanoseconds.
+	f64 total = 0;
+	f64 total_of_squares = 0;
 
-public:
-	usize total = 0;
-	usize total_of_squares = 0;
 	usize count = 0;
 
 	clock::duration min = clock::duration::max();
 	clock::duration max = clock::duration::min();
 
+	// The sum of the hardware events of all reports, if they were counted.
+	Values events {};
+
+	// The sum of the allocations and page faults of all reports, if they were audited.
+	audit::Usage usage {};
+
+	/*!
+	 * Adds the time it took to process one report.
+	 *
+	 * @param[in] x_ns The duration to add.
+	 * @param[in] events The hardware events that happened while processing the report.
+	 * @param[in] usage The allocations and page faults of processing the report.
+	 */
+	void record(const clock::duration x_ns, const Values &events, const audit::Usage &usage)
+	{
+		// Sum up as floating point because x**2 would overflow an integer
+		const f64 x = casts::to<f64>(chrono::nanoseconds {x_ns}.count());
+
+		histogram.record(x_ns);
+
+		total += x;
+		total_of_squares += x * x;
+
+		min = std::min(min, x_ns);
+		max = std::max(max, x_ns);
+
+		for (usize i = 0; i < events.size(); i++)
+			this->events[i] += events[i];
+
+		this->usage += usage;
+
+		++count;
+	}
+
+	/*!
+	 * Discards all durations.
+	 */
+	void clear()
+	{
+		histogram.clear();
+
+		total = 0;
+		total_of_squares = 0;
+		count = 0;
+
+		min = clock::duration::max();
+		max = clock::duration::min();
+
+		events.fill(0);
+		usage = audit::Usage {};
+	}
+
+	/*!
+	 * The average time it took to process a report.
+	 *
+	 * @return The average duration in nanoseconds, or 0 if no report was processed.
+	 */
+	[[nodiscard]] f64 mean() const
+	{
+		if (count == 0)
+			return 0;
+
+		return total / casts::to<f64>(count);
+	}
+
+	/*!
+	 * The standard deviation of the time it took to process a report.
+	 *
+	 * @return The standard deviation in nanoseconds, or 0 if no report was processed.
+	 */
+	[[nodiscard]] f64 stddev() const
+	{
+		if (count == 0)
+			return 0;
+
+		const f64 mean = this->mean();
+		const f64 variance = total_of_squares / casts::to<f64>(count) - mean * mean;
+
+		// Rounding errors can make the variance slightly negative
+		return std::sqrt(std::max(variance, 0.0));
+	}
+
+	/*!
+	 * How often a hardware event happened while processing a report, on average.
+	 *
+	 * @param[in] counter The event to query.
+	 * @return The average count, or 0 if no report was processed.
+	 */
+	[[nodiscard]] f64 per_report(const Counter counter) const
+	{
+		if (count == 0)
+			return 0;
+
+		return casts::to<f64>(events.at(counter)) / casts::to<f64>(count);
+	}
+
+	/*!
+	 * How many instructions were executed per cycle while processing the reports.
+	 *
+	 * @return The instructions per cycle, or 0 if no cycles were counted.
+	 */
+	[[nodiscard]] f64 ipc() const
+	{
+		const u64 cycles = events.at(Counter::Cycles);
+
+		if (cycles == 0)
+			return 0;
+
+		return casts::to<f64>(events.at(Counter::Instructions)) / casts::to<f64>(cycles);
+	}
+
+	/*!
+	 * How much the processing of a report allocated and faulted in, on average.
+	 *
+	 * @param[in] total A sum of @ref usage.
+	 * @return The average per report, or 0 if no report was processed.
+	 */
+	[[nodiscard]] f64 average(const u64 total) const
+	{
+		if (count == 0)
+			return 0;
+
+		return casts::to<f64>(total) / casts::to<f64>(count);
+	}
+};
+
+/*
+ * Finds out which types of input a report contains, without processing them.
+ *
+ * It receives the same data from the parser as the application does, so that parsing
+ * a report costs the same amount of time in both.
+ */
+class Inspector : public ipts::BasicParser<Inspector> {
+public:
+	bool heatmap = false;
+	bool stylus = false;
+
+	// The type of the first DFT window of the report.
+	std::optional<ipts::protocol::dft::Type> dft = std::nullopt;
+
+public:
+	void operator()(const ipts::Heatmap & /* unused */)
+	{
+		heatmap = true;
+	}
+
+	void operator()(const gsl::span<const ipts::StylusData> /* unused */)
+	{
+		stylus = true;
+	}
+
+	void operator()(const ipts::DftWindow &data)
+	{
+		if (!dft.has_value())
+			dft = data.type;
+	}
+
+	/*!
+	 * Forgets the inputs of the previous report.
+	 */
+	void reset()
+	{
+		heatmap = false;
+		stylus = false;
+		dft = std::nullopt;
+	}
+};
+
+class Perf : public core::Application {
+private:
+	using clock = chrono::steady_clock;
+	using Values = core::linux::PerfCounters::Values;
+
+public:
+	// The time it took to process reports containing a heatmap.
+	Measurement heatmap {};
+
+	// The time it took to process reports containing stylus samples.
+	Measurement stylus {};
+
+	// The time it took to process reports containing DFT windows, for every window type.
+	std::map<ipts::protocol::dft::Type, Measurement> dft {};
+
 private:
+	// Whether only the time of parsing the reports is measured.
+	bool m_parse_only;
+
+	// Whether the allocations and page faults of every report are counted.
+	bool m_audit;
+
 	bool m_had_heatmap {};
 
+	Inspector m_inspector {};
+
+	// The hardware events and energy that are measured, if they are available.
+	std::optional<core::linux::PerfCounters> m_counters = std::nullopt;
+	std::optional<core::linux::EnergyMeter> m_energy = std::nullopt;
+
+	// The time the contact finder spent in every stage before the measurements were cleared.
+	contacts::Timings m_cleared {};
+
 public:
+	/*!
+	 * Creates the application.
+	 *
+	 * Hardware events are counted on the thread that creates the application, so it has
+	 * to be the same thread that processes the reports.
+	 *
+	 * @param[in] parse_only Whether to only parse the reports, without processing them.
+	 * @param[in] counters Whether to measure hardware events and energy, if available.
+	 * @param[in] audit Whether to count the allocations and page faults of every report.
+	 */
 	Perf(const core::Config &config,
 	     const core::DeviceInfo &info,
-	     const std::optional<const ipts::Metadata> &metadata)
-		: core::Application(config, info, metadata) {};
+	     const std::optional<const ipts::Metadata> &metadata,
+	     const bool parse_only = false,
+	     const bool counters = false,
+	     const bool audit = false)
+		: core::Application(config, info, metadata),
+		  m_parse_only {parse_only},
+		  m_audit {audit}
+	{
+		if (!counters)
+			return;
+
+		try {
+			m_counters.emplace();
+		} catch (const std::exception &e) {
+			spdlog::warn("Hardware counters are not available: {}", e.what());
+		}
+
+		m_energy.emplace();
+
+		if (!m_energy->available()) {
+			spdlog::warn("Energy counters are not available");
+			m_energy.reset();
+		}
+	}
 
 	void on_contacts(const std::vector<contacts::Contact<f64>> & /* unused */) override
 	{
@@ -47,28 +297,46 @@ public:
 
 	void on_data(const gsl::span<u8> data) override
 	{
+		m_inspector.reset();
+
+		// Counting events takes a system call, so it is done outside of the measurement.
+		const audit::Usage used = this->sample_usage();
+		const Values before = this->count_events();
+
 		// Take start time
 		const clock::time_point start = clock::now();
 
-		// Send the report to the finder through the parser for processing
-		core::Application::on_data(data);
+		if (m_parse_only) {
+			m_inspector.parse(data);
+		} else {
+			// Send the report to the finder through the parser for processing
+			core::Application::on_data(data);
+		}
+
+		// Take end time
+		const clock::time_point end = clock::now();
+		const clock::duration x_ns = end - start;
 
-		if (std::exchange(m_had_heatmap, false)) {
-			// Take end time
-			const clock::time_point end = clock::now();
-			const clock::duration x_ns = end - start;
+		Values events = this->count_events();
 
-			// Divide early for x and x**2 because they are overflowing
-			const usize x_us = chrono::duration_cast<microseconds<usize>>(x_ns).count();
+		for (usize i = 0; i < events.size(); i++)
+			events[i] -= before[i];
 
-			total += x_us;
-			total_of_squares += x_us * x_us;
+		const audit::Usage usage = this->sample_usage() - used;
 
-			min = std::min(min, x_ns);
-			max = std::max(max, x_ns);
+		const bool had_heatmap = std::exchange(m_had_heatmap, false);
 
-			++count;
-		}
+		// The parser doesn't modify the report, so its contents can be checked afterwards.
+		if (!m_parse_only && !had_heatmap)
+			m_inspector.parse(data);
+
+		// Heatmaps are only measured if they produced contacts, or when only parsing.
+		if (had_heatmap || (m_parse_only && m_inspector.heatmap))
+			heatmap.record(x_ns, events, usage);
+		else if (m_inspector.dft.has_value())
+			dft[m_inspector.dft.value()].record(x_ns, events, usage);
+		else if (m_inspector.stylus)
+			stylus.record(x_ns, events, usage);
 	}
 
 	/*!
@@ -79,14 +347,118 @@ public:
 	 */
 	void reset()
 	{
-		m_finder.reset();
+		this->reset_finder();
+	}
 
-		total = 0;
-		total_of_squares = 0;
-		count = 0;
+	/*!
+	 * Discards all measurements, for example after the warm-up runs.
+	 */
+	void clear()
+	{
+		heatmap.clear();
+		stylus.clear();
+		dft.clear();
 
-		min = clock::duration::max();
-		max = clock::duration::min();
+		m_cleared = this->stage_timings();
+
+		if (m_energy.has_value())
+			m_energy->start();
+	}
+
+	/*!
+	 * The hardware counters, if they are measured.
+	 */
+	[[nodiscard]] const std::optional<core::linux::PerfCounters> &counters() const
+	{
+		return m_counters;
+	}
+
+	/*!
+	 * Whether the allocations and page faults of every report are counted.
+	 */
+	[[nodiscard]] bool audited() const
+	{
+		return m_audit;
+	}
+
+	/*!
+	 * How much energy the CPU used since the measurements were cleared.
+	 *
+	 * This includes everything that ran on the CPU, not only the processing of reports.
+	 *
+	 * @return The energy in joules, or null if it is not measured.
+	 */
+	[[nodiscard]] std::optional<f64> energy() const
+	{
+		if (!m_energy.has_value())
+			return std::nullopt;
+
+		return m_energy->joules();
+	}
+
+	/*!
+	 * How many reports were measured, of all types.
+	 */
+	[[nodiscard]] usize reports() const
+	{
+		usize count = heatmap.count + stylus.count;
+
+		for (const auto &[type, measurement] : dft)
+			count += measurement.count;
+
+		return count;
+	}
+
+	/*!
+	 * How much all measured reports allocated and faulted in, of all types.
+	 */
+	[[nodiscard]] audit::Usage usage() const
+	{
+		audit::Usage usage = heatmap.usage;
+		usage += stylus.usage;
+
+		for (const auto &[type, measurement] : dft)
+			usage += measurement.usage;
+
+		return usage;
+	}
+
+	/*!
+	 * How much time the contact finder spent in a stage since the measurements were cleared.
+	 *
+	 * @param[in] stage The stage to query.
+	 * @return The total time, or zero if the stage timers were not compiled in.
+	 */
+	[[nodiscard]] clock::duration stage(const contacts::Stage stage) const
+	{
+		return this->stage_timings().get(stage) - m_cleared.get(stage);
+	}
+
+private:
+	/*!
+	 * Reads the hardware counters.
+	 *
+	 * @return The current values, or zero if the counters are not measured.
+	 */
+	[[nodiscard]] Values count_events()
+	{
+		if (!m_counters.has_value())
+			return Values {};
+
+		return m_counters->read();
+	}
+
+	/*!
+	 * Reads the allocation and page fault counters of the processing thread.
+	 *
+	 * @return The current values, or zero if the reports are not audited.
+	 */
+	[[nodiscard]] audit::Usage sample_usage() const
+	{
+		if (!m_audit)
+			return audit::Usage {};
+
+		return audit::sample();
 	}
 };
 
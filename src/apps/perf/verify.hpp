@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_APPS_PERF_VERIFY_HPP
+#define IPTSD_APPS_PERF_VERIFY_HPP
+
+#include <common/types.hpp>
+#include <contacts/contact.hpp>
+#include <core/generic/application.hpp>
+#include <core/generic/config.hpp>
+#include <ipts/data.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace iptsd::apps::perf {
+
+/*
+ * Stores the contacts of every heatmap, to compare them between two configurations.
+ */
+class Recorder : public core::Application {
+public:
+	// The contacts of every heatmap that was processed.
+	std::vector<std::vector<contacts::Contact<f64>>> frames {};
+
+public:
+	/*!
+	 * Creates a recorder.
+	 *
+	 * @param[in] reference Whether to disable all optional fast paths of the configuration.
+	 */
+	Recorder(const core::Config &config,
+	         const core::DeviceInfo &info,
+	         const std::optional<const ipts::Metadata> &metadata,
+	         const bool reference)
+		: core::Application(reference ? Recorder::reference(config) : config,
+		                    info,
+		                    metadata)
+	{
+	}
+
+	void on_contacts(const std::vector<contacts::Contact<f64>> &contacts) override
+	{
+		frames.push_back(contacts);
+	}
+
+	/*!
+	 * Disables everything that makes processing faster, but can change the results.
+	 *
+	 * The contacts are then found in double precision on one thread, every heatmap is
+	 * processed completely, and gaussians are fitted to every cluster, starting from scratch
+	 * and running all iterations. Clusters are spanned one by one, and all pixels of their
+	 * bounds are sampled. Every step uses its scalar implementation: the heatmap is mapped
+	 * before its neutral value is calculated, the blur and the search for local maximas
+	 * use the generic code, and every system of the fitting is solved on its own.
+	 *
+	 * @param[in] config The configuration to change.
+	 * @return The configuration of the reference implementation.
+	 */
+	[[nodiscard]] static core::Config reference(core::Config config)
+	{
+		config.contacts_precision = "double";
+		config.contacts_clustering = "span";
+		config.contacts_warm_start = false;
+		config.contacts_fitting_tolerance = 0;
+		config.contacts_fitting_mask = false;
+		config.contacts_palm_size = 0;
+		config.contacts_fitting_threads = 0;
+		config.contacts_strip_threshold = 0;
+		config.contacts_pyramid_threshold = 0;
+		config.contacts_incremental_tile_size = 0;
+		config.contacts_reference = true;
+		config.runner_pipelined = false;
+
+		return config;
+	}
+};
+
+/*
+ * How much the contacts found by two configurations differ.
+ */
+struct Deviation {
+	// How many heatmaps were compared.
+	usize frames = 0;
+
+	// How many pairs of contacts were compared.
+	usize contacts = 0;
+
+	// How many heatmaps produced a different number of contacts.
+	usize count_mismatches = 0;
+
+	// How many pairs of contacts were assigned a different tracking index.
+	usize index_mismatches = 0;
+
+	// The largest differences of a pair of contacts.
+	f64 mean = 0;
+	f64 size = 0;
+	f64 orientation = 0;
+
+	// The heatmap where the position differed the most.
+	usize worst_frame = 0;
+};
+
+/*!
+ * Compares the contacts that two configurations found on the same heatmaps.
+ *
+ * Every contact is compared to the closest contact of the reference that was not compared
+ * yet, so that the order of the contacts does not matter.
+ *
+ * @param[in] reference The contacts of the reference configuration.
+ * @param[in] optimized The contacts of the configuration that is being verified.
+ * @return The differences between the contacts.
+ */
+inline Deviation compare(const std::vector<std::vector<contacts::Contact<f64>>> &reference,
+                         const std::vector<std::vector<contacts::Contact<f64>>> &optimized)
+{
+	const usize frames = std::min(reference.size(), optimized.size());
+
+	Deviation deviation {};
+	deviation.frames = frames;
+
+	// Heatmaps that only one of the configurations has processed
+	deviation.count_mismatches = std::max(reference.size(), optimized.size()) - frames;
+
+	std::vector<bool> used {};
+
+	for (usize i = 0; i < deviation.frames; i++) {
+		const std::vector<contacts::Contact<f64>> &expected = reference[i];
+		const std::vector<contacts::Contact<f64>> &actual = optimized[i];
+
+		// The contacts can't be paired reliably if one of them is missing.
+		if (expected.size() != actual.size()) {
+			deviation.count_mismatches++;
+			continue;
+		}
+
+		used.assign(expected.size(), false);
+
+		for (const contacts::Contact<f64> &contact : actual) {
+			std::optional<usize> closest = std::nullopt;
+			f64 distance = std::numeric_limits<f64>::infinity();
+
+			for (usize j = 0; j < expected.size(); j++) {
+				const f64 d = (expected[j].mean - contact.mean).norm();
+
+				if (used[j] || d >= distance)
+					continue;
+
+				closest = j;
+				distance = d;
+			}
+
+			if (!closest.has_value())
+				continue;
+
+			used[closest.value()] = true;
+
+			const contacts::Contact<f64> &other = expected[closest.value()];
+
+			// The orientation wraps around, 0 and 1 are the same.
+			const f64 turn = std::abs(other.orientation - contact.orientation);
+			const f64 orientation = std::min(turn, 1.0 - turn);
+
+			if (distance > deviation.mean) {
+				deviation.mean = distance;
+				deviation.worst_frame = i;
+			}
+
+			const f64 size = (other.size - contact.size).norm();
+
+			deviation.size = std::max(deviation.size, size);
+			deviation.orientation = std::max(deviation.orientation, orientation);
+
+			if (other.index != contact.index)
+				deviation.index_mismatches++;
+
+			deviation.contacts++;
+		}
+	}
+
+	return deviation;
+}
+
+} // namespace iptsd::apps::perf
+
+#endif // IPTSD_APPS_PERF_VERIFY_HPP
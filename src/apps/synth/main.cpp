@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+#include <core/generic/device.hpp>
+#include <core/linux/dump-writer.hpp>
+#include <ipts/data.hpp>
+#include <ipts/synthetic.hpp>
+
+#include <CLI/CLI.hpp>
+#include <gsl/gsl>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <vector>
+
+namespace iptsd::apps::synth {
+namespace {
+
+int run(const int argc, const char **argv)
+{
+	CLI::App app {"Utility for generating binary data files with synthetic touch reports."};
+
+	std::filesystem::path output {};
+	app.add_option("OUTPUT", output)
+		->description("The file in which the data will be saved, or - for standard output.")
+		->type_name("FILE")
+		->required();
+
+	usize frames {};
+	app.add_option("FRAMES", frames)
+		->description("How many heatmaps will be generated.")
+		->check(CLI::PositiveNumber)
+		->default_val(1000);
+
+	ipts::synthetic::Config config {};
+
+	usize rows {};
+	app.add_option("--rows", rows)
+		->description("The height of the heatmap.")
+		->check(CLI::Range(2, 255))
+		->default_val(config.rows);
+
+	usize columns {};
+	app.add_option("--columns", columns)
+		->description("The width of the heatmap.")
+		->check(CLI::Range(2, 255))
+		->default_val(config.columns);
+
+	app.add_option("-c,--contacts", config.contacts)
+		->description("How many fingers are touching the screen.")
+		->default_val(config.contacts);
+
+	app.add_option("-p,--palms", config.palms)
+		->description("How many palms are touching the screen.")
+		->default_val(config.palms);
+
+	app.add_option("--noise", config.noise)
+		->description("The standard deviation of the noise on every pixel (Range 0 - 255).")
+		->check(CLI::NonNegativeNumber)
+		->default_val(config.noise);
+
+	app.add_option("--baseline", config.baseline)
+		->description("The signal of the background (Range 0 - 255).")
+		->check(CLI::NonNegativeNumber)
+		->default_val(config.baseline);
+
+	app.add_option("--drift", config.drift)
+		->description("How far the background drifts up and down (Range 0 - 255).")
+		->check(CLI::NonNegativeNumber)
+		->default_val(config.drift);
+
+	app.add_option("--drift-period", config.drift_period)
+		->description("How many frames one cycle of the background drift takes.")
+		->check(CLI::PositiveNumber)
+		->default_val(config.drift_period);
+
+	app.add_option("--speed", config.speed)
+		->description("How many pixels fingers move per frame.")
+		->check(CLI::NonNegativeNumber)
+		->default_val(config.speed);
+
+	app.add_option("--seed", config.seed)
+		->description("The seed for the random number generator.")
+		->default_val(config.seed);
+
+	f64 fps {};
+	app.add_option("--fps", fps)
+		->description("How many heatmaps are generated per second.")
+		->check(CLI::PositiveNumber)
+		->default_val(60);
+
+	f64 width {};
+	app.add_option("--width", width)
+		->description("The physical width of the screen, in millimeters.")
+		->check(CLI::PositiveNumber)
+		->default_val(260);
+
+	f64 height {};
+	app.add_option("--height", height)
+		->description("The physical height of the screen, in millimeters.")
+		->check(CLI::PositiveNumber)
+		->default_val(173);
+
+	u16 vendor {};
+	app.add_option("--vendor", vendor)
+		->description("The vendor ID that is stored in the file, for loading configs.")
+		->default_val(0x045E);
+
+	u16 product {};
+	app.add_option("--product", product)
+		->description("The product ID that is stored in the file, for loading configs.")
+		->default_val(0);
+
+	CLI11_PARSE(app, argc, argv);
+
+	// Keep the standard output free for the data.
+	if (output == "-")
+		spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+
+	config.rows = casts::to<u8>(rows);
+	config.columns = casts::to<u8>(columns);
+
+	ipts::synthetic::Generator generator {config};
+
+	std::vector<u8> buffer {};
+
+	// Every report has the same size, so the size of the first one is the buffer size.
+	generator.next();
+	generator.encode(buffer);
+
+	core::DeviceInfo info {};
+	info.vendor = vendor;
+	info.product = product;
+	info.buffer_size = buffer.size();
+
+	ipts::Metadata metadata {};
+	metadata.dimensions.rows = config.rows;
+	metadata.dimensions.columns = config.columns;
+	metadata.dimensions.width = gsl::narrow_cast<u32>(width * 100);
+	metadata.dimensions.height = gsl::narrow_cast<u32>(height * 100);
+	metadata.transform.xx = gsl::narrow_cast<f32>(width * 100 / config.columns);
+	metadata.transform.yy = gsl::narrow_cast<f32>(height * 100 / config.rows);
+
+	core::linux::DumpWriter writer {output};
+	writer.write_header(info, metadata);
+
+	const f64 interval = 1e9 / fps;
+
+	for (usize i = 0; i < frames; i++) {
+		const auto timestamp = gsl::narrow_cast<u64>(casts::to<f64>(i) * interval);
+		writer.write_frame(buffer, timestamp);
+
+		generator.next();
+		generator.encode(buffer);
+	}
+
+	writer.finish();
+
+	spdlog::info("Generated {} frames with {} contacts and {} palms",
+	             frames,
+	             config.contacts,
+	             config.palms);
+
+	return 0;
+}
+
+} // namespace
+} // namespace iptsd::apps::synth
+
+int main(const int argc, const char **argv)
+{
+	spdlog::set_pattern("[%X.%e] [%^%l%$] %v");
+
+	try {
+		return iptsd::apps::synth::run(argc, argv);
+	} catch (const std::exception &e) {
+		spdlog::error(e.what());
+		return EXIT_FAILURE;
+	}
+}
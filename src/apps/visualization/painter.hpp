@@ -0,0 +1,339 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_APPS_VISUALIZATION_PAINTER_HPP
+#define IPTSD_APPS_VISUALIZATION_PAINTER_HPP
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+#include <contacts/contact.hpp>
+#include <core/generic/config.hpp>
+#include <ipts/data.hpp>
+
+#include <cairomm/cairomm.h>
+#include <fmt/format.h>
+
+#include <cmath>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace iptsd::apps::visualization {
+
+/*
+ * Everything that is drawn for one frame.
+ */
+struct Scene {
+	// The last heatmap, in greyscale ARGB.
+	Image<u32> heatmap {};
+
+	// The contacts that were found on the last heatmap.
+	std::vector<contacts::Contact<f64>> contacts {};
+
+	// The last 50 states of the stylus, oldest first.
+	std::deque<ipts::StylusData> stylus {};
+};
+
+/*
+ * Draws scenes with cairo.
+ *
+ * The painter doesn't hold any state of its own, so one instance can be used by
+ * multiple threads at the same time, as long as each of them uses its own context.
+ */
+class Painter {
+private:
+	// The size of the surface that is drawn to.
+	Vector2<i32> m_size;
+
+	// Whether the heatmap is mirrored.
+	bool m_invert_x;
+	bool m_invert_y;
+
+public:
+	Painter(const core::Config &config, Vector2<i32> size)
+		: m_size {std::move(size)},
+		  m_invert_x {config.invert_x},
+		  m_invert_y {config.invert_y} {};
+
+	/*!
+	 * Draws everything in a scene.
+	 *
+	 * @param[in] cairo The context to draw with.
+	 * @param[in] scene The scene to draw.
+	 */
+	void draw(const Cairo::RefPtr<Cairo::Context> &cairo, const Scene &scene) const
+	{
+		// Draw the raw heatmap
+		this->draw_heatmap(cairo, scene.heatmap);
+
+		// Draw everything else on top of it
+		this->draw_overlay(cairo, scene);
+	}
+
+	/*!
+	 * Draws everything in a scene except for the heatmap.
+	 *
+	 * @param[in] cairo The context to draw with.
+	 * @param[in] scene The scene to draw.
+	 */
+	void draw_overlay(const Cairo::RefPtr<Cairo::Context> &cairo, const Scene &scene) const
+	{
+		// Draw the contacts
+		this->draw_contacts(cairo, scene.contacts);
+
+		// Draw the position of the stylus
+		this->draw_stylus(cairo, scene.stylus);
+
+		// Draw a line through the last 50 positions of the stylus
+		this->draw_stylus_stroke(cairo, scene.stylus);
+	}
+
+	/*!
+	 * Draws a heatmap, scaled to the whole surface.
+	 *
+	 * @param[in] cairo The context to draw with.
+	 * @param[in] heatmap The heatmap in greyscale ARGB.
+	 */
+	void draw_heatmap(const Cairo::RefPtr<Cairo::Context> &cairo,
+	                  const Image<u32> &heatmap) const
+	{
+		if (heatmap.size() == 0) {
+			cairo->set_source_rgb(0, 0, 0);
+			cairo->paint();
+			return;
+		}
+
+		const i32 cols = casts::to<i32>(heatmap.cols());
+		const i32 rows = casts::to<i32>(heatmap.rows());
+
+		constexpr auto format = Cairo::FORMAT_ARGB32;
+		const auto stride = Cairo::ImageSurface::format_stride_for_width(format, cols);
+
+		// Cairo only reads from the source surface.
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+		auto *pixels = const_cast<u32 *>(heatmap.data());
+
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+		auto *data = reinterpret_cast<u8 *>(pixels);
+
+		// Create Cairo surface based on data buffer.
+		const Cairo::RefPtr<Cairo::ImageSurface> source =
+			Cairo::ImageSurface::create(data, format, cols, rows, stride);
+
+		const f64 wx = casts::to<f64>(m_size.x());
+		const f64 wy = casts::to<f64>(m_size.y());
+
+		f64 sx = casts::to<f64>(cols) / wx;
+		f64 sy = casts::to<f64>(rows) / wy;
+
+		f64 tx = 0;
+		f64 ty = 0;
+
+		if (m_invert_x) {
+			sx = -sx;
+			tx = cols;
+		}
+
+		if (m_invert_y) {
+			sy = -sy;
+			ty = rows;
+		}
+
+		Cairo::Matrix matrix = Cairo::identity_matrix();
+		matrix.translate(tx, ty);
+		matrix.scale(sx, sy);
+
+		// Upscale surface to window dimensions
+		const auto pattern = Cairo::SurfacePattern::create(source);
+		pattern->set_matrix(matrix);
+		pattern->set_filter(Cairo::FILTER_NEAREST);
+
+		// Copy source into output
+		cairo->set_source(pattern);
+		cairo->rectangle(0, 0, wx, wy);
+		cairo->fill();
+	}
+
+	/*!
+	 * Draws the outlines and indices of contacts.
+	 *
+	 * @param[in] cairo The context to draw with.
+	 * @param[in] contacts The contacts to draw.
+	 */
+	void draw_contacts(const Cairo::RefPtr<Cairo::Context> &cairo,
+	                   const std::vector<contacts::Contact<f64>> &contacts) const
+	{
+		const f64 diag = m_size.cast<f64>().hypotNorm();
+
+		// Select Font
+		cairo->select_font_face("monospace",
+		                        Cairo::FONT_SLANT_NORMAL,
+		                        Cairo::FONT_WEIGHT_NORMAL);
+		cairo->set_font_size(24.0);
+
+		for (const auto &contact : contacts) {
+			/*
+			 * Red: Invalid
+			 * Yellow: Unstable
+			 * Green: OK
+			 */
+			if (!contact.valid.value_or(true))
+				cairo->set_source_rgb(1, 0, 0);
+			else if (!contact.stable.value_or(true))
+				cairo->set_source_rgb(1, 1, 0);
+			else
+				cairo->set_source_rgb(0, 1, 0);
+
+			const std::string index = fmt::format("{:02}", contact.index.value_or(0));
+
+			Cairo::TextExtents extends {};
+			cairo->get_text_extents(index, extends);
+
+			const Vector2<f64> mean = contact.mean.cwiseProduct(m_size.cast<f64>());
+			const f64 orientation = contact.orientation * M_PI;
+
+			const Vector2<f64> size = (contact.size.array() * diag).matrix();
+
+			// Center the text at the mean point of the contact
+			cairo->move_to(mean.x() - (extends.x_bearing + extends.width / 2),
+			               mean.y() - (extends.y_bearing + extends.height / 2));
+			cairo->save();
+
+			cairo->show_text(index);
+			cairo->restore();
+			cairo->stroke();
+
+			cairo->move_to(mean.x(), mean.y());
+			cairo->save();
+
+			cairo->translate(mean.x(), mean.y());
+			cairo->rotate(-orientation);
+			cairo->scale(size.maxCoeff(), size.minCoeff());
+			cairo->begin_new_sub_path();
+			cairo->arc(0, 0, 1, 0, 2 * M_PI);
+
+			cairo->restore();
+			cairo->stroke();
+		}
+	}
+
+	/*!
+	 * Draws the current state of the stylus.
+	 *
+	 * @param[in] cairo The context to draw with.
+	 * @param[in] history The last states of the stylus, oldest first.
+	 */
+	void draw_stylus(const Cairo::RefPtr<Cairo::Context> &cairo,
+	                 const std::deque<ipts::StylusData> &history) const
+	{
+		if (history.empty())
+			return;
+
+		const ipts::StylusData &stylus = history.back();
+
+		if (!stylus.proximity)
+			return;
+
+		constexpr f64 RADIUS = 50;
+
+		const f64 sx = stylus.x * (m_size.x() - 1);
+		const f64 sy = stylus.y * (m_size.y() - 1);
+
+		cairo->set_source_rgb(0, 1, 0.5);
+
+		// Draw a cross for pen, a box for rubber, and a triangle for the side button
+		if (!stylus.rubber && !stylus.button) {
+			cairo->move_to(sx - RADIUS, sy);
+			cairo->line_to(sx + RADIUS, sy);
+			cairo->stroke();
+
+			cairo->move_to(sx, sy - RADIUS);
+			cairo->line_to(sx, sy + RADIUS);
+			cairo->stroke();
+		} else if (stylus.rubber && !stylus.button) {
+			cairo->move_to(sx - RADIUS, sy - RADIUS);
+			cairo->line_to(sx + RADIUS, sy - RADIUS);
+			cairo->stroke();
+
+			cairo->move_to(sx - RADIUS, sy + RADIUS);
+			cairo->line_to(sx + RADIUS, sy + RADIUS);
+			cairo->stroke();
+
+			cairo->move_to(sx - RADIUS, sy - RADIUS);
+			cairo->line_to(sx - RADIUS, sy + RADIUS);
+			cairo->stroke();
+
+			cairo->move_to(sx + RADIUS, sy - RADIUS);
+			cairo->line_to(sx + RADIUS, sy + RADIUS);
+			cairo->stroke();
+		} else if (!stylus.rubber && stylus.button) {
+			cairo->move_to(sx - RADIUS, sy - RADIUS);
+			cairo->line_to(sx + RADIUS, sy - RADIUS);
+			cairo->stroke();
+
+			cairo->move_to(sx - RADIUS, sy - RADIUS);
+			cairo->line_to(sx, sy + RADIUS);
+			cairo->stroke();
+
+			cairo->move_to(sx + RADIUS, sy - RADIUS);
+			cairo->line_to(sx, sy + RADIUS);
+			cairo->stroke();
+		}
+
+		if (!stylus.contact)
+			return;
+
+		cairo->set_source_rgb(1, 0.5, 0);
+
+		cairo->arc(sx, sy, RADIUS * stylus.pressure, 0, 2 * M_PI);
+		cairo->stroke();
+
+		const f64 ox = RADIUS * std::cos(stylus.azimuth) * std::sin(stylus.altitude);
+		const f64 oy = -RADIUS * std::sin(stylus.azimuth) * std::sin(stylus.altitude);
+
+		cairo->move_to(sx, sy);
+		cairo->line_to(sx + ox, sy + oy);
+		cairo->stroke();
+	}
+
+	/*!
+	 * Draws a line through the last positions of the stylus.
+	 *
+	 * @param[in] cairo The context to draw with.
+	 * @param[in] history The last states of the stylus, oldest first.
+	 */
+	void draw_stylus_stroke(const Cairo::RefPtr<Cairo::Context> &cairo,
+	                        const std::deque<ipts::StylusData> &history) const
+	{
+		if (history.empty())
+			return;
+
+		for (usize i = 0; i < history.size() - 1; i++) {
+			const ipts::StylusData &from = history[i];
+			const ipts::StylusData &to = history[i + 1];
+
+			if (!from.proximity || !to.proximity)
+				continue;
+
+			if (!from.contact || !to.contact)
+				cairo->set_source_rgba(0.5, 0, 1.0, 0.5);
+			else
+				cairo->set_source_rgba(0.5, 0, 1.0, 1.0);
+
+			const f64 fx = from.x * (m_size.x() - 1);
+			const f64 fy = from.y * (m_size.y() - 1);
+
+			cairo->move_to(fx, fy);
+
+			const f64 tx = to.x * (m_size.x() - 1);
+			const f64 ty = to.y * (m_size.y() - 1);
+
+			cairo->line_to(tx, ty);
+			cairo->stroke();
+		}
+	}
+};
+
+} // namespace iptsd::apps::visualization
+
+#endif // IPTSD_APPS_VISUALIZATION_PAINTER_HPP
@@ -35,10 +35,46 @@ int run(const int argc, const char **argv)
 		->type_name("DIR")
 		->required();
 
+	RenderOptions options {};
+
+	app.add_option("--first", options.first)
+		->description("The index of the first frame that is rendered.")
+		->default_val(0);
+
+	app.add_option("--count", options.count)
+		->description("How many frames are rendered at most.")
+		->check(CLI::PositiveNumber);
+
+	app.add_option("--stride", options.stride)
+		->description("Only render every n-th frame.")
+		->check(CLI::PositiveNumber)
+		->default_val(1);
+
+	app.add_option("-t,--threads", options.threads)
+		->description("Render frames on this many additional threads.")
+		->default_val(0);
+
 	CLI11_PARSE(app, argc, argv);
 
 	// Create a plotting application that reads from a file.
-	core::linux::FileRunner<VisualizePNG> visualize {path, output};
+	core::linux::FileRunner<VisualizePNG> visualize {path, output, options};
+
+	// Stop after the last selected frame, if the file has an index to tell where it is.
+	if (app.count("--count") > 0 && visualize.frames() > 0) {
+		const usize steps = options.count - 1;
+		const usize frames = visualize.frames();
+
+		/*
+		 * The last frame is only calculated if that can't overflow. Otherwise, it would be
+		 * past the end of the file anyways, so all remaining frames are processed.
+		 */
+		if (options.first < frames && steps <= (frames - options.first) / options.stride) {
+			const usize last = options.first + (steps * options.stride);
+
+			if (last < frames)
+				visualize.seek(0, last + 1);
+		}
+	}
 
 	const auto _sigterm = core::linux::signal<SIGTERM>([&](int) { visualize.stop(); });
 	const auto _sigint = core::linux::signal<SIGINT>([&](int) { visualize.stop(); });
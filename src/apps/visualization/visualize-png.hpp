@@ -3,9 +3,12 @@
 #ifndef IPTSD_APPS_VISUALIZATION_VISUALIZE_PNG_HPP
 #define IPTSD_APPS_VISUALIZATION_VISUALIZE_PNG_HPP
 
+#include "painter.hpp"
 #include "visualize.hpp"
 
 #include <common/casts.hpp>
+#include <common/thread-pool.hpp>
+#include <common/types.hpp>
 #include <core/generic/config.hpp>
 #include <core/generic/device.hpp>
 #include <ipts/data.hpp>
@@ -13,27 +16,79 @@
 #include <cairomm/cairomm.h>
 #include <gsl/gsl>
 
+#include <algorithm>
 #include <cmath>
 #include <filesystem>
+#include <limits>
 #include <optional>
 #include <utility>
+#include <vector>
 
 namespace iptsd::apps::visualization {
 
+/*
+ * Which frames are rendered, and how.
+ */
+struct RenderOptions {
+	// The index of the first frame that is rendered.
+	usize first = 0;
+
+	// How many frames are rendered at most.
+	usize count = std::numeric_limits<usize>::max();
+
+	// Only every n-th frame is rendered.
+	usize stride = 1;
+
+	// How many threads render frames in addition to the one that processes them.
+	usize threads = 0;
+};
+
 class VisualizePNG : public Visualize {
+private:
+	/*
+	 * A frame that is waiting to be rendered.
+	 */
+	struct Job {
+		Scene scene {};
+		usize frame = 0;
+	};
+
+	/*
+	 * The surface that one thread draws to.
+	 */
+	struct Canvas {
+		Cairo::RefPtr<Cairo::ImageSurface> surface {};
+		Cairo::RefPtr<Cairo::Context> cairo {};
+	};
+
 private:
 	std::filesystem::path m_output;
-	Cairo::RefPtr<Cairo::ImageSurface> m_tex {};
+	RenderOptions m_options;
 
+	// The index of the next frame.
 	usize m_counter = 0;
 
+	// The threads that render frames, if enabled.
+	std::optional<common::ThreadPool> m_pool = std::nullopt;
+
+	// One canvas for every thread that renders frames.
+	std::vector<Canvas> m_canvases {};
+
+	// The frames that are waiting to be rendered.
+	std::vector<Job> m_jobs {};
+
 public:
 	VisualizePNG(const core::Config &config,
 	             const core::DeviceInfo &info,
 	             const std::optional<const ipts::Metadata> &metadata,
-	             std::filesystem::path output)
+	             std::filesystem::path output,
+	             const RenderOptions &options = {})
 		: Visualize(config, info, metadata),
-		  m_output {std::move(output)} {};
+		  m_output {std::move(output)},
+		  m_options {options}
+	{
+		m_options.stride = std::max(m_options.stride, usize {1});
+	}
 
 	void on_start() override
 	{
@@ -46,11 +101,22 @@ public:
 		m_size.x() = casts::to<i32>(std::round(x));
 		m_size.y() = casts::to<i32>(std::round(y));
 
-		// Create a texture for drawing.
-		m_tex = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, m_size.x(), m_size.y());
+		if (m_options.threads > 0 && !m_pool.has_value())
+			m_pool.emplace(m_options.threads, false);
+
+		const usize threads = m_pool.has_value() ? m_pool->size() : 1;
+
+		// Create a texture for drawing, and a context for issuing draw commands.
+		m_canvases.resize(threads);
+
+		for (Canvas &canvas : m_canvases) {
+			canvas.surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32,
+			                                             m_size.x(),
+			                                             m_size.y());
+			canvas.cairo = Cairo::Context::create(canvas.surface);
+		}
 
-		// Create context for issuing draw commands.
-		m_cairo = Cairo::Context::create(m_tex);
+		m_cairo = m_canvases.front().cairo;
 
 		std::filesystem::create_directories(m_output);
 	}
@@ -59,10 +125,84 @@ public:
 	{
 		Visualize::on_data(data);
 
-		this->draw();
+		const usize frame = m_counter++;
+
+		if (!this->selected(frame))
+			return;
+
+		if (!m_pool.has_value()) {
+			this->draw();
+
+			// Save the texture to a png file
+			m_canvases.front().surface->write_to_png(this->filename(frame));
+			return;
+		}
+
+		/*
+		 * Processing the frames has to stay in order, but drawing and encoding them
+		 * doesn't. The state that is needed for drawing is copied, and the frames
+		 * are rendered in batches, one per thread at a time.
+		 */
+		this->update_argb();
+		m_jobs.push_back(Job {this->scene(), frame});
+
+		if (m_jobs.size() >= m_pool->size() * 4)
+			this->flush();
+	}
+
+	void on_stop() override
+	{
+		this->flush();
+	}
+
+private:
+	/*!
+	 * Whether a frame is rendered, according to the options.
+	 *
+	 * @param[in] frame The index of the frame.
+	 */
+	[[nodiscard]] bool selected(const usize frame) const
+	{
+		if (frame < m_options.first)
+			return false;
+
+		const usize offset = frame - m_options.first;
+
+		if (offset % m_options.stride != 0)
+			return false;
+
+		return offset / m_options.stride < m_options.count;
+	}
+
+	/*!
+	 * The path of the file that a frame is saved to.
+	 *
+	 * @param[in] frame The index of the frame.
+	 */
+	[[nodiscard]] std::filesystem::path filename(const usize frame) const
+	{
+		return m_output / fmt::format("{:05}.png", frame);
+	}
+
+	/*!
+	 * Renders all waiting frames and saves them.
+	 */
+	void flush()
+	{
+		if (m_jobs.empty() || !m_pool.has_value())
+			return;
+
+		const Painter painter = this->painter();
+
+		m_pool->run(m_jobs.size(), [&](const usize task, const usize thread) {
+			const Job &job = m_jobs[task];
+			const Canvas &canvas = m_canvases[thread];
+
+			painter.draw(canvas.cairo, job.scene);
+			canvas.surface->write_to_png(this->filename(job.frame));
+		});
 
-		// Save the texture to a png file
-		m_tex->write_to_png(m_output / fmt::format("{:05}.png", m_counter++));
+		m_jobs.clear();
 	}
 };
 
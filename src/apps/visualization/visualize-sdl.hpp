@@ -7,7 +7,9 @@
 
 #include <common/casts.hpp>
 #include <common/chrono.hpp>
+#include <common/triple-buffer.hpp>
 #include <common/types.hpp>
+#include <contacts/contact.hpp>
 #include <core/generic/config.hpp>
 #include <core/generic/device.hpp>
 #include <ipts/data.hpp>
@@ -16,34 +18,155 @@
 #include <cairomm/cairomm.h>
 #include <gsl/gsl>
 
-#include <cstring>
+#include <algorithm>
+#include <atomic>
 #include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace iptsd::apps::visualization {
 
+/*
+ * Renders inputs in real time, on a thread of its own.
+ *
+ * Processing the inputs never waits for the screen. After every report that changed
+ * something, the frame is copied into a triple buffer. The render thread picks up the
+ * latest frame once per refresh of the display, and skips all frames in between.
+ */
 class VisualizeSDL : public Visualize {
 private:
 	using clock = std::chrono::steady_clock;
 
+	// How often the screen is redrawn, if the refresh rate of the display is unknown.
+	constexpr static int DEFAULT_REFRESH_RATE = 60;
+
 private:
+	// Everything from here until the triple buffer is only used by the render thread.
 	SDL_Window *m_window = nullptr;
 	SDL_Renderer *m_renderer = nullptr;
 
-	SDL_Texture *m_rtex = nullptr;
-	Cairo::RefPtr<Cairo::ImageSurface> m_tex {};
+	// The heatmap at its original size. It is scaled to the window when it is rendered.
+	SDL_Texture *m_heatmap = nullptr;
+	Vector2<i32> m_heatmap_size {};
+
+	// The heatmap in greyscale ARGB, and the number of the heatmap that was uploaded.
+	Image<u32> m_argb {};
+	std::optional<u64> m_uploaded = std::nullopt;
+
+	// The contacts and the stylus, which cairo draws directly into the locked texture.
+	SDL_Texture *m_overlay = nullptr;
+
+	// Passes the latest frame from the input thread to the render thread.
+	common::TripleBuffer<Snapshot> m_frames {};
+
+	// Whether the last report changed anything that is drawn. Only used by the input thread.
+	bool m_changed = false;
 
-	clock::time_point m_last_draw {};
+	std::atomic_bool m_should_stop = false;
+	std::thread m_thread {};
 
 public:
 	VisualizeSDL(const core::Config &config,
 	             const core::DeviceInfo &info,
 	             const std::optional<const ipts::Metadata> &metadata)
-		: Visualize(config, info, metadata)
+		: Visualize(config, info, metadata) {};
+
+	VisualizeSDL(const VisualizeSDL &) = delete;
+	VisualizeSDL &operator=(const VisualizeSDL &) = delete;
+
+	~VisualizeSDL() override
 	{
-		SDL_Init(SDL_INIT_VIDEO);
+		this->on_stop();
 	}
 
 	void on_start() override
+	{
+		m_should_stop = false;
+		m_thread = std::thread {[this] { this->render(); }};
+	}
+
+	void on_contacts(const std::vector<contacts::Contact<f64>> &contacts) override
+	{
+		Visualize::on_contacts(contacts);
+		m_changed = true;
+	}
+
+	void on_stylus(const ipts::StylusData &data) override
+	{
+		Visualize::on_stylus(data);
+		m_changed = true;
+	}
+
+	void on_data(const gsl::span<u8> data) override
+	{
+		Visualize::on_data(data);
+
+		if (!std::exchange(m_changed, false))
+			return;
+
+		this->snapshot(m_frames.back());
+		m_frames.publish();
+	}
+
+	void on_stop() override
+	{
+		m_should_stop = true;
+
+		if (m_thread.joinable())
+			m_thread.join();
+	}
+
+private:
+	/*!
+	 * The loop of the render thread.
+	 *
+	 * All calls to SDL happen on this thread, from creating the window to destroying it.
+	 */
+	void render()
+	{
+		SDL_Init(SDL_INIT_VIDEO);
+		this->create_window();
+
+		SDL_DisplayMode mode {};
+		int rate = DEFAULT_REFRESH_RATE;
+
+		if (SDL_GetWindowDisplayMode(m_window, &mode) == 0 && mode.refresh_rate > 0)
+			rate = mode.refresh_rate;
+
+		const clock::duration interval = clock::duration {1000ms} / rate;
+		clock::time_point next = clock::now();
+
+		while (!m_should_stop.load()) {
+			// Handle window events, such as the X11_NET_WM_PING
+			// event that is used to detect stuck programs.
+			SDL_PumpEvents();
+
+			std::this_thread::sleep_until(next);
+			next = std::max(next + interval, clock::now());
+
+			if (!m_frames.update())
+				continue;
+
+			const Snapshot &frame = m_frames.front();
+
+			SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 255);
+			SDL_RenderClear(m_renderer);
+
+			this->render_heatmap(frame);
+			this->render_overlay(frame);
+
+			SDL_RenderPresent(m_renderer);
+		}
+
+		this->destroy_window();
+		SDL_Quit();
+	}
+
+	/*!
+	 * Creates a fullscreen window, and the texture that is rendered on top of the heatmap.
+	 */
+	void create_window()
 	{
 		// Create an SDL window
 		constexpr u32 flags = SDL_WINDOW_FULLSCREEN_DESKTOP | SDL_WINDOW_ALLOW_HIGHDPI;
@@ -52,62 +175,125 @@ public:
 		// Get the screen size.
 		SDL_GetRendererOutputSize(m_renderer, &m_size.x(), &m_size.y());
 
-		// Create a texture that will be rendered later
-		m_rtex = SDL_CreateTexture(m_renderer,
-		                           SDL_PIXELFORMAT_ARGB8888,
-		                           SDL_TEXTUREACCESS_STREAMING,
-		                           m_size.x(),
-		                           m_size.y());
+		// Create a texture that will be rendered on top of the heatmap
+		m_overlay = SDL_CreateTexture(m_renderer,
+		                              SDL_PIXELFORMAT_ARGB8888,
+		                              SDL_TEXTUREACCESS_STREAMING,
+		                              m_size.x(),
+		                              m_size.y());
 
-		// Create a texture for drawing.
-		m_tex = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, m_size.x(), m_size.y());
+		// Cairo draws with premultiplied alpha.
+		constexpr SDL_BlendFactor one = SDL_BLENDFACTOR_ONE;
+		constexpr SDL_BlendFactor inverse = SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA;
+		constexpr SDL_BlendOperation add = SDL_BLENDOPERATION_ADD;
 
-		// Create context for issuing draw commands.
-		m_cairo = Cairo::Context::create(m_tex);
+		const SDL_BlendMode blend =
+			SDL_ComposeCustomBlendMode(one, inverse, add, one, inverse, add);
+
+		SDL_SetTextureBlendMode(m_overlay, blend);
 	}
 
-	void on_data(const gsl::span<u8> data) override
+	/*!
+	 * Destroys the textures, the renderer and the window.
+	 */
+	void destroy_window()
 	{
-		Visualize::on_data(data);
-
-		// Handle window events, such as the X11_NET_WM_PING
-		// event that is used to detect stuck programs.
-		SDL_PumpEvents();
+		if (m_heatmap != nullptr)
+			SDL_DestroyTexture(m_heatmap);
 
-		constexpr usize FPS = 60;
+		SDL_DestroyTexture(m_overlay);
+		SDL_DestroyRenderer(m_renderer);
+		SDL_DestroyWindow(m_window);
 
-		// Limit how many times per seconds the screen is redrawn.
-		const clock::time_point now = clock::now();
-		const clock::time_point next = m_last_draw + (1000ms / FPS);
+		m_heatmap = nullptr;
+		m_uploaded = std::nullopt;
+	}
 
-		if (now < next)
+	/*!
+	 * Uploads the heatmap if it changed, and lets the GPU scale it to the window.
+	 *
+	 * @param[in] frame The frame that is rendered.
+	 */
+	void render_heatmap(const Snapshot &frame)
+	{
+		if (frame.pixels.size() == 0)
 			return;
 
-		this->draw();
+		const bool changed = m_uploaded != frame.heatmap;
 
-		void *pixels = nullptr;
-		int pitch = 0;
+		// Heatmaps arrive faster than they are drawn, so they are converted only here.
+		if (changed)
+			Visualize::convert(frame.pixels, frame.palette, m_argb);
+
+		const i32 cols = casts::to<i32>(m_argb.cols());
+		const i32 rows = casts::to<i32>(m_argb.rows());
 
-		// Copy drawtex to rendertex
-		SDL_LockTexture(m_rtex, nullptr, &pixels, &pitch);
-		std::memcpy(pixels, m_tex->get_data(), casts::to_unsigned(m_size.prod() * 4L));
-		SDL_UnlockTexture(m_rtex);
+		const Vector2<i32> size {cols, rows};
 
-		// Display rendertex
-		SDL_RenderClear(m_renderer);
-		SDL_RenderCopy(m_renderer, m_rtex, nullptr, nullptr);
-		SDL_RenderPresent(m_renderer);
+		if (m_heatmap == nullptr || m_heatmap_size != size) {
+			if (m_heatmap != nullptr)
+				SDL_DestroyTexture(m_heatmap);
 
-		m_last_draw = now;
+			m_heatmap = SDL_CreateTexture(m_renderer,
+			                              SDL_PIXELFORMAT_ARGB8888,
+			                              SDL_TEXTUREACCESS_STREAMING,
+			                              size.x(),
+			                              size.y());
+
+			SDL_SetTextureScaleMode(m_heatmap, SDL_ScaleModeNearest);
+			m_heatmap_size = size;
+		}
+
+		if (changed) {
+			SDL_UpdateTexture(m_heatmap, nullptr, m_argb.data(), size.x() * 4);
+			m_uploaded = frame.heatmap;
+		}
+
+		int flip = SDL_FLIP_NONE;
+
+		if (m_config.invert_x)
+			flip |= SDL_FLIP_HORIZONTAL;
+
+		if (m_config.invert_y)
+			flip |= SDL_FLIP_VERTICAL;
+
+		const auto mode = static_cast<SDL_RendererFlip>(flip);
+		SDL_RenderCopyEx(m_renderer, m_heatmap, nullptr, nullptr, 0, nullptr, mode);
 	}
 
-	void on_stop() override
+	/*!
+	 * Draws the contacts and the stylus into the overlay texture and renders it.
+	 *
+	 * @param[in] frame The frame that is rendered.
+	 */
+	void render_overlay(const Snapshot &frame)
 	{
-		SDL_DestroyTexture(m_rtex);
-		SDL_DestroyRenderer(m_renderer);
-		SDL_DestroyWindow(m_window);
+		void *pixels = nullptr;
+		int pitch = 0;
 
-		SDL_Quit();
+		if (SDL_LockTexture(m_overlay, nullptr, &pixels, &pitch) != 0)
+			return;
+
+		const Cairo::RefPtr<Cairo::ImageSurface> surface =
+			Cairo::ImageSurface::create(static_cast<u8 *>(pixels),
+			                            Cairo::FORMAT_ARGB32,
+			                            m_size.x(),
+			                            m_size.y(),
+			                            pitch);
+
+		m_cairo = Cairo::Context::create(surface);
+
+		// The contents of a locked texture are undefined.
+		m_cairo->set_operator(Cairo::OPERATOR_CLEAR);
+		m_cairo->paint();
+		m_cairo->set_operator(Cairo::OPERATOR_OVER);
+
+		this->painter().draw_overlay(m_cairo, frame.scene);
+
+		surface->flush();
+		SDL_UnlockTexture(m_overlay);
+
+		SDL_RenderCopy(m_renderer, m_overlay, nullptr, nullptr);
 	}
 };
 
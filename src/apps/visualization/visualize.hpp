@@ -3,6 +3,8 @@
 #ifndef IPTSD_APPS_VISUALIZATION_VISUALIZE_HPP
 #define IPTSD_APPS_VISUALIZATION_VISUALIZE_HPP
 
+#include "painter.hpp"
+
 #include <common/casts.hpp>
 #include <common/types.hpp>
 #include <contacts/contact.hpp>
@@ -15,21 +17,46 @@
 #include <gsl/gsl>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <array>
 #include <cmath>
-#include <deque>
 #include <limits>
 #include <optional>
-#include <string>
+#include <utility>
 #include <vector>
 
 namespace iptsd::apps::visualization {
 
+/*
+ * The state of a frame before its heatmap is converted, for drawing it on another thread.
+ */
+struct Snapshot {
+	// The raw values of the heatmap, and the color of every possible value.
+	Image<u8> pixels {};
+	std::array<u32, 256> palette {};
+
+	// The number of the heatmap, to find out whether it changed.
+	u64 heatmap = 0;
+
+	// The contacts and the stylus. The heatmap is left empty, see @ref Visualize::convert.
+	Scene scene {};
+};
+
 class Visualize : public core::Application {
 private:
-	Image<u32> m_argb {};
+	// The raw values of the last heatmap, and whether they changed since they were converted.
+	Image<u8> m_pixels {};
+	bool m_pixels_changed = false;
+
+	// How many heatmaps were received.
+	u64 m_heatmaps = 0;
 
-	// The last known state of the stylus.
-	std::deque<ipts::StylusData> m_history {};
+	// The greyscale ARGB color of every possible raw value, and the range it was built for.
+	std::array<u32, 256> m_palette {};
+	std::optional<std::pair<u8, u8>> m_palette_range = std::nullopt;
+
+	// Everything that is drawn for the current frame.
+	Scene m_scene {};
 
 protected:
 	// The size of the texture we are drawing to.
@@ -44,272 +71,142 @@ public:
 	          const std::optional<const ipts::Metadata> &metadata)
 		: core::Application(config, info, metadata) {};
 
-	void on_contacts(const std::vector<contacts::Contact<f64>> & /* unused */) override
+	void on_contacts(const std::vector<contacts::Contact<f64>> &contacts) override
 	{
-		const Eigen::Index cols = m_heatmap.cols();
-		const Eigen::Index rows = m_heatmap.rows();
-
-		if (m_argb.rows() != rows || m_argb.cols() != cols)
-			m_argb.conservativeResize(rows, cols);
+		const ipts::Heatmap &raw = this->raw_heatmap();
 
-		// Convert floating point values of range [0, 1] to greyscale ARGB.
-		for (Eigen::Index y = 0; y < rows; y++) {
-			for (Eigen::Index x = 0; x < cols; x++) {
-				const f64 value = m_heatmap(y, x);
+		const Eigen::Index rows = casts::to_eigen(raw.rows);
+		const Eigen::Index cols = casts::to_eigen(raw.columns);
 
-				constexpr u8 max = std::numeric_limits<u8>::max();
-				const u8 v = casts::to<u8>(std::round(value * max));
+		/*
+		 * Heatmaps usually arrive faster than they are drawn, so only the raw values
+		 * are kept here. They are converted when they are drawn, see @ref update_argb.
+		 */
+		m_pixels = Eigen::Map<const Image<u8>> {raw.data.data(), rows, cols};
+		m_pixels_changed = true;
+		m_heatmaps++;
 
-				constexpr u32 a = max;
-				const u32 r = v;
-				const u32 g = v;
-				const u32 b = v;
+		const std::pair<u8, u8> range {raw.min, raw.max};
 
-				m_argb(y, x) = (a << 24) + (r << 16) + (g << 8) + b;
-			}
+		if (m_palette_range != range) {
+			this->update_palette();
+			m_palette_range = range;
 		}
+
+		m_scene.contacts = contacts;
 	}
 
 	void on_stylus(const ipts::StylusData &data) override
 	{
+		std::deque<ipts::StylusData> &history = m_scene.stylus;
+
 		if (!data.proximity) {
-			m_history.clear();
+			history.clear();
 			return;
 		}
 
-		m_history.push_back(data);
+		history.push_back(data);
 
-		if (m_history.size() < 50)
+		if (history.size() < 50)
 			return;
 
-		m_history.pop_front();
+		history.pop_front();
 	}
 
 	void draw()
 	{
-		// Draw the raw heatmap
-		this->draw_heatmap();
-
-		// Draw the contacts
-		this->draw_contacts();
-
-		// Draw the position of the stylus
-		this->draw_stylus();
-
-		// Draw a line through the last 50 positions of the stylus
-		this->draw_stylus_stroke();
+		this->update_argb();
+		this->painter().draw(m_cairo, m_scene);
 	}
 
-	void draw_heatmap()
+	/*!
+	 * Converts the last heatmap to greyscale ARGB, if it wasn't converted already.
+	 *
+	 * @return Whether a new heatmap was converted since the last call.
+	 */
+	bool update_argb()
 	{
-		if (m_argb.size() == 0) {
-			m_cairo->set_source_rgb(0, 0, 0);
-			m_cairo->paint();
-			return;
-		}
-
-		const i32 cols = casts::to<i32>(m_argb.cols());
-		const i32 rows = casts::to<i32>(m_argb.rows());
-
-		constexpr auto format = Cairo::FORMAT_ARGB32;
-		const auto stride = Cairo::ImageSurface::format_stride_for_width(format, cols);
-
-		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-		auto *data = reinterpret_cast<u8 *>(m_argb.data());
+		if (!m_pixels_changed)
+			return false;
 
-		// Create Cairo surface based on data buffer.
-		const Cairo::RefPtr<Cairo::ImageSurface> source =
-			Cairo::ImageSurface::create(data, format, cols, rows, stride);
-
-		const f64 wx = casts::to<f64>(m_size.x());
-		const f64 wy = casts::to<f64>(m_size.y());
-
-		f64 sx = casts::to<f64>(cols) / wx;
-		f64 sy = casts::to<f64>(rows) / wy;
-
-		f64 tx = 0;
-		f64 ty = 0;
-
-		if (m_config.invert_x) {
-			sx = -sx;
-			tx = cols;
-		}
+		Visualize::convert(m_pixels, m_palette, m_scene.heatmap);
+		m_pixels_changed = false;
 
-		if (m_config.invert_y) {
-			sy = -sy;
-			ty = rows;
-		}
-
-		Cairo::Matrix matrix = Cairo::identity_matrix();
-		matrix.translate(tx, ty);
-		matrix.scale(sx, sy);
-
-		// Upscale surface to window dimensions
-		const auto pattern = Cairo::SurfacePattern::create(source);
-		pattern->set_matrix(matrix);
-		pattern->set_filter(Cairo::FILTER_NEAREST);
-
-		// Copy source into output
-		m_cairo->set_source(pattern);
-		m_cairo->rectangle(0, 0, wx, wy);
-		m_cairo->fill();
+		return true;
 	}
 
-	void draw_contacts() const
+	/*!
+	 * Everything that is drawn for the current frame.
+	 *
+	 * The heatmap is the one from the last call to @ref update_argb.
+	 */
+	[[nodiscard]] const Scene &scene() const
 	{
-		const f64 diag = m_size.cast<f64>().hypotNorm();
-
-		// Select Font
-		m_cairo->select_font_face("monospace",
-		                          Cairo::FONT_SLANT_NORMAL,
-		                          Cairo::FONT_WEIGHT_NORMAL);
-		m_cairo->set_font_size(24.0);
-
-		for (const auto &contact : m_contacts) {
-			/*
-			 * Red: Invalid
-			 * Yellow: Unstable
-			 * Green: OK
-			 */
-			if (!contact.valid.value_or(true))
-				m_cairo->set_source_rgb(1, 0, 0);
-			else if (!contact.stable.value_or(true))
-				m_cairo->set_source_rgb(1, 1, 0);
-			else
-				m_cairo->set_source_rgb(0, 1, 0);
-
-			const std::string index = fmt::format("{:02}", contact.index.value_or(0));
-
-			Cairo::TextExtents extends {};
-			m_cairo->get_text_extents(index, extends);
-
-			const Vector2<f64> mean = contact.mean.cwiseProduct(m_size.cast<f64>());
-			const f64 orientation = contact.orientation * M_PI;
-
-			const Vector2<f64> size = (contact.size.array() * diag).matrix();
-
-			// Center the text at the mean point of the contact
-			m_cairo->move_to(mean.x() - (extends.x_bearing + extends.width / 2),
-			                 mean.y() - (extends.y_bearing + extends.height / 2));
-			m_cairo->save();
-
-			m_cairo->show_text(index);
-			m_cairo->restore();
-			m_cairo->stroke();
-
-			m_cairo->move_to(mean.x(), mean.y());
-			m_cairo->save();
-
-			m_cairo->translate(mean.x(), mean.y());
-			m_cairo->rotate(-orientation);
-			m_cairo->scale(size.maxCoeff(), size.minCoeff());
-			m_cairo->begin_new_sub_path();
-			m_cairo->arc(0, 0, 1, 0, 2 * M_PI);
-
-			m_cairo->restore();
-			m_cairo->stroke();
-		}
+		return m_scene;
 	}
 
-	void draw_stylus()
+	/*!
+	 * Copies everything that is drawn for the current frame.
+	 *
+	 * The heatmap is only copied if the snapshot doesn't contain it already. Because the
+	 * snapshot keeps its memory, copying into the same one again does not allocate.
+	 *
+	 * @param[out] snapshot Where to copy the frame to.
+	 */
+	void snapshot(Snapshot &snapshot) const
 	{
-		if (m_history.empty())
-			return;
-
-		const ipts::StylusData &stylus = m_history.back();
-
-		if (!stylus.proximity)
-			return;
-
-		constexpr f64 RADIUS = 50;
-
-		const f64 sx = stylus.x * (m_size.x() - 1);
-		const f64 sy = stylus.y * (m_size.y() - 1);
-
-		m_cairo->set_source_rgb(0, 1, 0.5);
-
-		// Draw a cross for pen, a box for rubber, and a triangle for the side button
-		if (!stylus.rubber && !stylus.button) {
-			m_cairo->move_to(sx - RADIUS, sy);
-			m_cairo->line_to(sx + RADIUS, sy);
-			m_cairo->stroke();
-
-			m_cairo->move_to(sx, sy - RADIUS);
-			m_cairo->line_to(sx, sy + RADIUS);
-			m_cairo->stroke();
-		} else if (stylus.rubber && !stylus.button) {
-			m_cairo->move_to(sx - RADIUS, sy - RADIUS);
-			m_cairo->line_to(sx + RADIUS, sy - RADIUS);
-			m_cairo->stroke();
-
-			m_cairo->move_to(sx - RADIUS, sy + RADIUS);
-			m_cairo->line_to(sx + RADIUS, sy + RADIUS);
-			m_cairo->stroke();
-
-			m_cairo->move_to(sx - RADIUS, sy - RADIUS);
-			m_cairo->line_to(sx - RADIUS, sy + RADIUS);
-			m_cairo->stroke();
-
-			m_cairo->move_to(sx + RADIUS, sy - RADIUS);
-			m_cairo->line_to(sx + RADIUS, sy + RADIUS);
-			m_cairo->stroke();
-		} else if (!stylus.rubber && stylus.button) {
-			m_cairo->move_to(sx - RADIUS, sy - RADIUS);
-			m_cairo->line_to(sx + RADIUS, sy - RADIUS);
-			m_cairo->stroke();
-
-			m_cairo->move_to(sx - RADIUS, sy - RADIUS);
-			m_cairo->line_to(sx, sy + RADIUS);
-			m_cairo->stroke();
-
-			m_cairo->move_to(sx + RADIUS, sy - RADIUS);
-			m_cairo->line_to(sx, sy + RADIUS);
-			m_cairo->stroke();
+		if (snapshot.heatmap != m_heatmaps) {
+			snapshot.pixels = m_pixels;
+			snapshot.palette = m_palette;
+			snapshot.heatmap = m_heatmaps;
 		}
 
-		if (!stylus.contact)
-			return;
-
-		m_cairo->set_source_rgb(1, 0.5, 0);
-
-		m_cairo->arc(sx, sy, RADIUS * stylus.pressure, 0, 2 * M_PI);
-		m_cairo->stroke();
-
-		const f64 ox = RADIUS * std::cos(stylus.azimuth) * std::sin(stylus.altitude);
-		const f64 oy = -RADIUS * std::sin(stylus.azimuth) * std::sin(stylus.altitude);
-
-		m_cairo->move_to(sx, sy);
-		m_cairo->line_to(sx + ox, sy + oy);
-		m_cairo->stroke();
+		snapshot.scene.contacts = m_scene.contacts;
+		snapshot.scene.stylus = m_scene.stylus;
 	}
 
-	void draw_stylus_stroke()
+	/*!
+	 * Converts raw heatmap values to greyscale ARGB.
+	 *
+	 * @param[in] pixels The raw values of the heatmap.
+	 * @param[in] palette The color of every possible raw value.
+	 * @param[out] argb The converted heatmap.
+	 */
+	static void convert(const Image<u8> &pixels,
+	                    const std::array<u32, 256> &palette,
+	                    Image<u32> &argb)
 	{
-		if (m_history.empty())
-			return;
-
-		for (usize i = 0; i < m_history.size() - 1; i++) {
-			const ipts::StylusData &from = m_history[i];
-			const ipts::StylusData &to = m_history[i + 1];
+		argb = pixels.unaryExpr([&](const u8 v) { return palette.at(v); });
+	}
 
-			if (!from.proximity || !to.proximity)
-				continue;
+	/*!
+	 * A painter for drawing scenes onto the texture.
+	 */
+	[[nodiscard]] Painter painter() const
+	{
+		return Painter {m_config, m_size};
+	}
 
-			if (!from.contact || !to.contact)
-				m_cairo->set_source_rgba(0.5, 0, 1.0, 0.5);
-			else
-				m_cairo->set_source_rgba(0.5, 0, 1.0, 1.0);
+private:
+	/*!
+	 * Builds the color of every possible raw value from the normalization table.
+	 */
+	void update_palette()
+	{
+		const std::array<f64, 256> &lut = this->lut();
 
-			const f64 fx = from.x * (m_size.x() - 1);
-			const f64 fy = from.y * (m_size.y() - 1);
+		for (usize i = 0; i < m_palette.size(); i++) {
+			const f64 value = std::clamp(lut.at(i), 0.0, 1.0);
 
-			m_cairo->move_to(fx, fy);
+			constexpr u8 max = std::numeric_limits<u8>::max();
+			const u8 v = casts::to<u8>(std::round(value * max));
 
-			const f64 tx = to.x * (m_size.x() - 1);
-			const f64 ty = to.y * (m_size.y() - 1);
+			constexpr u32 a = max;
+			const u32 r = v;
+			const u32 g = v;
+			const u32 b = v;
 
-			m_cairo->line_to(tx, ty);
-			m_cairo->stroke();
+			m_palette.at(i) = (a << 24) + (r << 16) + (g << 8) + b;
 		}
 	}
 };
@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_COMMON_BUFFER_POOL_HPP
+#define IPTSD_COMMON_BUFFER_POOL_HPP
+
+#include "types.hpp"
+
+#include <gsl/gsl>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace iptsd::common {
+
+/*
+ * A fixed set of equally sized buffers, that are shared through reference counted handles.
+ *
+ * A buffer is taken from the pool using @ref acquire, and goes back to the pool once the
+ * last handle referring to it is destroyed. This allows data that was parsed from a buffer
+ * to keep referring to it, without copying, for as long as it is needed.
+ *
+ * All buffers are allocated when the pool is created. Acquiring and releasing a buffer
+ * never takes a lock, so handles can be passed between threads. The pool must outlive
+ * all of its handles.
+ */
+class BufferPool {
+public:
+	/*
+	 * A reference to one buffer of a pool.
+	 */
+	class Handle {
+	private:
+		BufferPool *m_pool = nullptr;
+		usize m_index = 0;
+
+	public:
+		Handle() = default;
+
+		Handle(BufferPool *pool, const usize index) : m_pool {pool}, m_index {index} {}
+
+		Handle(const Handle &other) : m_pool {other.m_pool}, m_index {other.m_index}
+		{
+			if (m_pool != nullptr)
+				m_pool->retain(m_index);
+		}
+
+		Handle(Handle &&other) noexcept
+			: m_pool {std::exchange(other.m_pool, nullptr)},
+			  m_index {other.m_index}
+		{
+		}
+
+		Handle &operator=(Handle other) noexcept
+		{
+			std::swap(m_pool, other.m_pool);
+			std::swap(m_index, other.m_index);
+
+			return *this;
+		}
+
+		~Handle()
+		{
+			this->reset();
+		}
+
+		/*!
+		 * Gives up the reference to the buffer.
+		 */
+		void reset()
+		{
+			if (m_pool != nullptr)
+				m_pool->release(m_index);
+
+			m_pool = nullptr;
+		}
+
+		/*!
+		 * Whether the handle refers to a buffer.
+		 */
+		explicit operator bool() const
+		{
+			return m_pool != nullptr;
+		}
+
+		/*!
+		 * The buffer the handle refers to, or an empty span if it doesn't refer to one.
+		 */
+		[[nodiscard]] gsl::span<u8> data() const
+		{
+			if (m_pool == nullptr)
+				return {};
+
+			return m_pool->m_buffers[m_index];
+		}
+
+		/*!
+		 * Whether some data is stored in the buffer the handle refers to.
+		 *
+		 * @param[in] data The data to check.
+		 */
+		[[nodiscard]] bool contains(const gsl::span<const u8> data) const
+		{
+			const gsl::span<u8> buffer = this->data();
+
+			if (buffer.empty() || data.empty())
+				return false;
+
+			const std::less_equal<> le {};
+			const u8 *front = &buffer.front();
+			const u8 *back = &buffer.back();
+
+			return le(front, &data.front()) && le(&data.back(), back);
+		}
+	};
+
+private:
+	std::vector<std::vector<u8>> m_buffers;
+
+	// How many handles refer to every buffer.
+	std::unique_ptr<std::atomic<u32>[]> m_references; // NOLINT(modernize-avoid-c-arrays)
+
+	// Where the search for a free buffer starts.
+	usize m_next = 0;
+
+public:
+	/*!
+	 * Allocates the buffers of the pool.
+	 *
+	 * @param[in] count How many buffers the pool has.
+	 * @param[in] size The size of every buffer.
+	 */
+	BufferPool(const usize count, const usize size)
+		: m_buffers(count, std::vector<u8>(size)),
+		  m_references {std::make_unique<std::atomic<u32>[]>(count)} // NOLINT
+	{
+	}
+
+	BufferPool(const BufferPool &) = delete;
+	BufferPool &operator=(const BufferPool &) = delete;
+
+	/*!
+	 * How many buffers the pool has.
+	 */
+	[[nodiscard]] usize size() const
+	{
+		return m_buffers.size();
+	}
+
+	/*!
+	 * Writes to every page of all buffers, so that using them later doesn't fault.
+	 *
+	 * This must not be called while a handle refers to a buffer.
+	 *
+	 * @param[in] stride The page size, or any smaller value.
+	 */
+	void prefault(const usize stride)
+	{
+		for (std::vector<u8> &buffer : m_buffers) {
+			for (usize i = 0; i < buffer.size(); i += stride)
+				buffer[i] = 0;
+		}
+	}
+
+	/*!
+	 * Takes a buffer from the pool, that is not referred to by any handle.
+	 *
+	 * Only one thread may acquire buffers, but they can be released on any thread.
+	 *
+	 * @return A handle to the buffer, or an empty handle if all buffers are in use.
+	 */
+	[[nodiscard]] Handle acquire()
+	{
+		for (usize i = 0; i < m_buffers.size(); i++) {
+			const usize index = (m_next + i) % m_buffers.size();
+			std::atomic<u32> &references = m_references[index];
+
+			// Only this thread can increment a count of zero, so no exchange is needed.
+			if (references.load(std::memory_order_acquire) != 0)
+				continue;
+
+			references.store(1, std::memory_order_relaxed);
+			m_next = index + 1;
+
+			return Handle {this, index};
+		}
+
+		return Handle {};
+	}
+
+private:
+	void retain(const usize index)
+	{
+		m_references[index].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void release(const usize index)
+	{
+		m_references[index].fetch_sub(1, std::memory_order_acq_rel);
+	}
+};
+
+} // namespace iptsd::common
+
+#endif // IPTSD_COMMON_BUFFER_POOL_HPP
@@ -32,19 +32,39 @@ constexpr std::string_view ConfigDir = IPTSD_CONFIG_DIR;
  */
 constexpr std::string_view PresetDir = IPTSD_PRESET_DIR;
 
+/*!
+ * The directory where iptsd caches information about devices to speed up startup.
+ */
+constexpr std::string_view CacheDir = IPTSD_CACHE_DIR;
+
 /*!
  * If this option is true, iptsd will do access checks even in the performance critical parts
  * of the touch processing library where they are currently bypassed.
  */
 constexpr bool ForceAccessChecks = IPTSD_FORCE_ACCESS_CHECKS;
 
+/*!
+ * If this option is true, the contact finder measures how long every stage of processing
+ * a heatmap takes. Otherwise the timers are compiled out and cost nothing.
+ */
+constexpr bool StageTimers = IPTSD_STAGE_TIMERS;
+
+/*!
+ * If this option is true, the processing of every frame is written to the ftrace marker
+ * file as a series of spans. Otherwise the tracepoints are compiled out and cost nothing.
+ */
+constexpr bool Tracing = IPTSD_TRACING;
+
 /*
  * Make sure that nothing uses the defines directly.
  */
 #undef IPTSD_CONFIG_DIR
 #undef IPTSD_CONFIG_FILE
 #undef IPTSD_PRESET_DIR
+#undef IPTSD_CACHE_DIR
 #undef IPTSD_FORCE_ACCESS_CHECKS
+#undef IPTSD_STAGE_TIMERS
+#undef IPTSD_TRACING
 
 } // namespace iptsd::common::buildopts
 
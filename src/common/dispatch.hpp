@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_COMMON_DISPATCH_HPP
+#define IPTSD_COMMON_DISPATCH_HPP
+
+/*
+ * Compiles a function multiple times for different generations of CPUs.
+ *
+ * If iptsd is built with CPU dispatching, the hot loops of the contact finder are compiled
+ * once for the baseline of the architecture, and once for CPUs with AVX2 and FMA. Which
+ * version is used is decided once by the dynamic linker, depending on the CPU the program
+ * runs on. This allows distributions to ship one binary that runs everywhere, without
+ * giving up AVX2 where it is available.
+ *
+ * There is no AVX-512 version, because it was slower than the AVX2 version. The loops
+ * are too short for 512 bit vectors. On aarch64, NEON is part of the baseline, so no
+ * additional versions are needed. Function multiversioning of templates is only supported
+ * by GCC.
+ */
+#if defined(IPTSD_CPU_DISPATCH) && defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define IPTSD_DISPATCH [[gnu::target_clones("arch=x86-64-v3", "default")]]
+#else
+#define IPTSD_DISPATCH
+#endif
+
+#endif // IPTSD_COMMON_DISPATCH_HPP
@@ -0,0 +1,228 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_COMMON_HISTOGRAM_HPP
+#define IPTSD_COMMON_HISTOGRAM_HPP
+
+#include "casts.hpp"
+#include "chrono.hpp"
+#include "types.hpp"
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+namespace iptsd::common {
+
+/*
+ * A histogram of durations that can be updated and read by different threads without locking.
+ *
+ * Durations are counted in nanoseconds. The buckets are exact below 32ns, and above that
+ * every power of two is split into 32 buckets, so that every bucket is at most ~3% wide.
+ * Durations above ~137 seconds are counted in the last bucket.
+ */
+class Histogram {
+private:
+	// How many bits below the highest bit of a duration select its bucket.
+	static constexpr usize PRECISION = 5;
+
+	// How many buckets every power of two is split into.
+	static constexpr usize SUBBUCKETS = usize {1} << PRECISION;
+
+	// The largest power of two that has its own buckets.
+	static constexpr usize MAX_EXPONENT = 36;
+
+	static constexpr usize BUCKETS = SUBBUCKETS * (MAX_EXPONENT - PRECISION + 2);
+
+	// How many durations were counted in every bucket.
+	std::array<std::atomic<u64>, BUCKETS> m_buckets {};
+
+	// How many durations were counted in total.
+	std::atomic<u64> m_count = 0;
+
+	// The sum of all counted durations, in nanoseconds.
+	std::atomic<u64> m_sum = 0;
+
+	// The longest counted duration, in nanoseconds.
+	std::atomic<u64> m_max = 0;
+
+public:
+	/*!
+	 * Counts a duration.
+	 *
+	 * @param[in] duration The duration to count. Negative durations are counted as 0.
+	 */
+	void record(const chrono::nanoseconds duration)
+	{
+		const auto ns = duration.count();
+		const u64 value = ns > 0 ? casts::to_unsigned(ns) : 0;
+
+		m_buckets[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+
+		m_count.fetch_add(1, std::memory_order_relaxed);
+		m_sum.fetch_add(value, std::memory_order_relaxed);
+
+		u64 max = m_max.load(std::memory_order_relaxed);
+
+		while (value > max &&
+		       !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+		}
+	}
+
+	/*!
+	 * Counts all durations of another histogram.
+	 *
+	 * @param[in] other The histogram whose durations are added to this one.
+	 */
+	void add(const Histogram &other)
+	{
+		for (usize i = 0; i < BUCKETS; i++) {
+			const u64 count = other.m_buckets[i].load(std::memory_order_relaxed);
+			m_buckets[i].fetch_add(count, std::memory_order_relaxed);
+		}
+
+		m_count.fetch_add(other.m_count.load(std::memory_order_relaxed),
+		                  std::memory_order_relaxed);
+		m_sum.fetch_add(other.m_sum.load(std::memory_order_relaxed),
+		                std::memory_order_relaxed);
+
+		const u64 value = other.m_max.load(std::memory_order_relaxed);
+		u64 max = m_max.load(std::memory_order_relaxed);
+
+		while (value > max &&
+		       !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+		}
+	}
+
+	/*!
+	 * Removes all counted durations.
+	 *
+	 * This is not atomic as a whole, durations that are counted at the same time can be lost.
+	 */
+	void clear()
+	{
+		for (std::atomic<u64> &bucket : m_buckets)
+			bucket.store(0, std::memory_order_relaxed);
+
+		m_count.store(0, std::memory_order_relaxed);
+		m_sum.store(0, std::memory_order_relaxed);
+		m_max.store(0, std::memory_order_relaxed);
+	}
+
+	/*!
+	 * How many durations were counted.
+	 */
+	[[nodiscard]] u64 count() const
+	{
+		return m_count.load(std::memory_order_relaxed);
+	}
+
+	/*!
+	 * The average of all counted durations.
+	 *
+	 * @return The average duration, or 0 if nothing was counted.
+	 */
+	[[nodiscard]] chrono::nanoseconds mean() const
+	{
+		const u64 count = this->count();
+
+		if (count == 0)
+			return chrono::nanoseconds::zero();
+
+		return to_duration(m_sum.load(std::memory_order_relaxed) / count);
+	}
+
+	/*!
+	 * The longest counted duration.
+	 */
+	[[nodiscard]] chrono::nanoseconds max() const
+	{
+		return to_duration(m_max.load(std::memory_order_relaxed));
+	}
+
+	/*!
+	 * Estimates a percentile of the counted durations.
+	 *
+	 * @param[in] fraction Which percentile to estimate (Range 0 - 1).
+	 * @return The upper limit of the bucket that contains the percentile.
+	 */
+	[[nodiscard]] chrono::nanoseconds percentile(const f64 fraction) const
+	{
+		const u64 count = this->count();
+
+		if (count == 0)
+			return chrono::nanoseconds::zero();
+
+		const f64 rank = fraction * casts::to<f64>(count - 1);
+		const u64 target = gsl::narrow_cast<u64>(rank) + 1;
+
+		const u64 max = m_max.load(std::memory_order_relaxed);
+
+		u64 seen = 0;
+
+		for (usize i = 0; i < BUCKETS; i++) {
+			seen += m_buckets[i].load(std::memory_order_relaxed);
+
+			if (seen >= target)
+				return to_duration(std::min(upper(i), max));
+		}
+
+		return to_duration(max);
+	}
+
+private:
+	/*!
+	 * Converts a counted value back into a duration.
+	 *
+	 * @param[in] value The duration in nanoseconds.
+	 * @return The duration.
+	 */
+	static chrono::nanoseconds to_duration(const u64 value)
+	{
+		return chrono::nanoseconds {casts::to_signed(value)};
+	}
+
+	/*!
+	 * Calculates which bucket a duration is counted in.
+	 *
+	 * @param[in] value The duration in nanoseconds.
+	 * @return The index of the bucket.
+	 */
+	static usize bucket(const u64 value)
+	{
+		if (value < SUBBUCKETS)
+			return value;
+
+		// The position of the highest bit, at least PRECISION since value >= SUBBUCKETS.
+		// This also means that value is never zero, for which __builtin_clzll is undefined.
+		const usize exponent = 63 - casts::to<usize>(__builtin_clzll(value));
+
+		if (exponent > MAX_EXPONENT)
+			return BUCKETS - 1;
+
+		const usize sub = (value >> (exponent - PRECISION)) & (SUBBUCKETS - 1);
+		return SUBBUCKETS * (exponent - PRECISION + 1) + sub;
+	}
+
+	/*!
+	 * Calculates the largest duration that is counted in a bucket.
+	 *
+	 * @param[in] index The index of the bucket.
+	 * @return The duration in nanoseconds.
+	 */
+	static u64 upper(const usize index)
+	{
+		if (index < SUBBUCKETS)
+			return index;
+
+		const usize exponent = index / SUBBUCKETS + PRECISION - 1;
+		const usize sub = index % SUBBUCKETS;
+
+		return ((SUBBUCKETS + sub + 1) << (exponent - PRECISION)) - 1;
+	}
+};
+
+} // namespace iptsd::common
+
+#endif // IPTSD_COMMON_HISTOGRAM_HPP
@@ -0,0 +1,253 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_COMMON_QUANTILE_HPP
+#define IPTSD_COMMON_QUANTILE_HPP
+
+#include "casts.hpp"
+#include "types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace iptsd::common {
+
+/*
+ * Estimates a quantile of a stream of values, without storing all of the values.
+ *
+ * This implements the P² algorithm by Jain and Chlamtac. Five markers track the minimum,
+ * the maximum, the quantile itself and two points halfway to it. Every new value moves the
+ * markers closer to where they would be if all values were sorted. Their heights are then
+ * adjusted by fitting a parabola through neighbouring markers.
+ *
+ * The first values are kept sorted, and the quantile is exact until they fill the buffer.
+ * The markers are then placed on these values, which makes them converge much faster for
+ * quantiles close to 0 or 1. Adding a value and reading the estimate take constant time.
+ */
+class QuantileEstimator {
+private:
+	static constexpr usize MARKERS = 5;
+
+	// How many values are stored before switching to the markers.
+	static constexpr usize BUFFER = 128;
+
+	// The quantile that is estimated (Range 0 - 1).
+	f64 m_quantile;
+
+	// How many values were added.
+	usize m_count = 0;
+
+	// The first values in ascending order.
+	std::array<f64, BUFFER> m_buffer {};
+
+	// The heights of the markers.
+	std::array<f64, MARKERS> m_heights {};
+
+	// The actual and the desired positions of the markers, counting from 0.
+	std::array<f64, MARKERS> m_positions {};
+	std::array<f64, MARKERS> m_desired {};
+
+	// How much the desired positions move with every value.
+	std::array<f64, MARKERS> m_increments {};
+
+public:
+	/*!
+	 * Creates an estimator for a quantile.
+	 *
+	 * @param[in] quantile The quantile that is estimated (Range 0 - 1).
+	 */
+	explicit QuantileEstimator(const f64 quantile) : m_quantile {std::clamp(quantile, 0.0, 1.0)}
+	{
+		const f64 q = m_quantile;
+		m_increments = {0, q / 2, q, (1 + q) / 2, 1};
+	}
+
+	/*!
+	 * Adds a value.
+	 *
+	 * @param[in] value The new value.
+	 */
+	void add(const f64 value)
+	{
+		if (m_count < BUFFER) {
+			const auto end = m_buffer.begin() + casts::to_signed(m_count);
+			const auto pos = std::upper_bound(m_buffer.begin(), end, value);
+
+			std::move_backward(pos, end, end + 1);
+			*pos = value;
+
+			if (++m_count == BUFFER)
+				this->place_markers();
+
+			return;
+		}
+
+		m_count++;
+
+		// Find the cell that the value falls into, and extend the outer markers if needed.
+		usize cell = 0;
+
+		if (value < m_heights[0]) {
+			m_heights[0] = value;
+		} else if (value >= m_heights[4]) {
+			m_heights[4] = value;
+			cell = 3;
+		} else {
+			while (value >= m_heights.at(cell + 1))
+				cell++;
+		}
+
+		for (usize i = cell + 1; i < MARKERS; i++)
+			m_positions.at(i) += 1;
+
+		for (usize i = 0; i < MARKERS; i++)
+			m_desired.at(i) += m_increments.at(i);
+
+		for (usize i = 1; i < MARKERS - 1; i++)
+			this->adjust(i);
+	}
+
+	/*!
+	 * How many values were added.
+	 */
+	[[nodiscard]] usize count() const
+	{
+		return m_count;
+	}
+
+	/*!
+	 * The current estimate of the quantile.
+	 *
+	 * @return The estimate, or 0 if no values were added.
+	 */
+	[[nodiscard]] f64 estimate() const
+	{
+		if (m_count == 0)
+			return 0;
+
+		if (m_count >= BUFFER)
+			return this->interpolate(m_desired[2]);
+
+		const f64 rank = std::round(casts::to<f64>(m_count - 1) * m_quantile);
+		return m_buffer.at(casts::to<usize>(rank));
+	}
+
+private:
+	/*!
+	 * Places the markers on the stored values, where the estimated points are.
+	 */
+	void place_markers()
+	{
+		const f64 last = casts::to<f64>(BUFFER - 1);
+
+		for (usize i = 0; i < MARKERS; i++) {
+			const f64 desired = last * m_increments.at(i);
+
+			// The markers must not share a position.
+			const f64 lowest = i == 0 ? 0 : m_positions.at(i - 1) + 1;
+			const f64 highest = last - casts::to<f64>(MARKERS - 1 - i);
+
+			const f64 position = std::clamp(std::round(desired), lowest, highest);
+
+			m_desired.at(i) = desired;
+			m_positions.at(i) = position;
+			m_heights.at(i) = m_buffer.at(casts::to<usize>(position));
+		}
+	}
+
+	/*!
+	 * Interpolates the height of the markers at a position.
+	 *
+	 * The middle marker lags behind its desired position by up to one value, which would
+	 * otherwise be noticeable for quantiles close to 0 or 1.
+	 *
+	 * @param[in] position The position, counting from 0.
+	 * @return The interpolated height.
+	 */
+	[[nodiscard]] f64 interpolate(const f64 position) const
+	{
+		usize i = 0;
+
+		while (i < MARKERS - 2 && m_positions.at(i + 1) < position)
+			i++;
+
+		const f64 from = m_positions.at(i);
+		const f64 to = m_positions.at(i + 1);
+
+		const f64 t = std::clamp((position - from) / (to - from), 0.0, 1.0);
+		const f64 a = m_heights.at(i);
+		const f64 b = m_heights.at(i + 1);
+
+		return a + t * (b - a);
+	}
+
+	/*!
+	 * Moves a marker by one position, if it is too far away from where it should be.
+	 *
+	 * @param[in] i The index of the marker.
+	 */
+	void adjust(const usize i)
+	{
+		const f64 offset = m_desired.at(i) - m_positions.at(i);
+
+		const f64 next = m_positions.at(i + 1) - m_positions.at(i);
+		const f64 prev = m_positions.at(i - 1) - m_positions.at(i);
+
+		if (!(offset >= 1 && next > 1) && !(offset <= -1 && prev < -1))
+			return;
+
+		const f64 d = offset > 0 ? 1 : -1;
+		const f64 height = this->parabolic(i, d);
+
+		if (m_heights.at(i - 1) < height && height < m_heights.at(i + 1))
+			m_heights.at(i) = height;
+		else
+			m_heights.at(i) = this->linear(i, d);
+
+		m_positions.at(i) += d;
+	}
+
+	/*!
+	 * Predicts the height of a marker after moving it, using its two neighbours.
+	 *
+	 * @param[in] i The index of the marker.
+	 * @param[in] d The direction that the marker is moved in (+1 or -1).
+	 * @return The new height of the marker.
+	 */
+	[[nodiscard]] f64 parabolic(const usize i, const f64 d) const
+	{
+		const f64 q = m_heights.at(i);
+		const f64 qp = m_heights.at(i + 1);
+		const f64 qm = m_heights.at(i - 1);
+
+		const f64 n = m_positions.at(i);
+		const f64 np = m_positions.at(i + 1);
+		const f64 nm = m_positions.at(i - 1);
+
+		const f64 upper = (n - nm + d) * (qp - q) / (np - n);
+		const f64 lower = (np - n - d) * (q - qm) / (n - nm);
+
+		return q + (d / (np - nm) * (upper + lower));
+	}
+
+	/*!
+	 * Predicts the height of a marker after moving it, using the neighbour it moves towards.
+	 *
+	 * @param[in] i The index of the marker.
+	 * @param[in] d The direction that the marker is moved in (+1 or -1).
+	 * @return The new height of the marker.
+	 */
+	[[nodiscard]] f64 linear(const usize i, const f64 d) const
+	{
+		const usize j = d > 0 ? i + 1 : i - 1;
+
+		const f64 height = m_heights.at(j) - m_heights.at(i);
+		const f64 distance = m_positions.at(j) - m_positions.at(i);
+
+		return m_heights.at(i) + (d * height / distance);
+	}
+};
+
+} // namespace iptsd::common
+
+#endif // IPTSD_COMMON_QUANTILE_HPP
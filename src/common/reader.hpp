@@ -3,6 +3,7 @@
 #ifndef IPTSD_COMMON_READER_HPP
 #define IPTSD_COMMON_READER_HPP
 
+#include "buildopts.hpp"
 #include "error.hpp"
 #include "types.hpp"
 
@@ -49,11 +50,8 @@ public:
 	 */
 	void read(const gsl::span<u8> dest)
 	{
-		if (dest.size() > this->size())
-			throw common::Error<Error::EndOfBuffer> {dest.size(), this->size()};
-
-		const gsl::span<u8> src = this->subspan<u8>(dest.size());
-		std::copy(src.begin(), src.end(), dest.begin());
+		this->require(dest.size());
+		this->read_unchecked(dest);
 	}
 
 	/*!
@@ -63,9 +61,7 @@ public:
 	 */
 	void skip(const usize size)
 	{
-		if (size > this->size())
-			throw common::Error<Error::EndOfBuffer> {size, this->size()};
-
+		this->require(size);
 		m_index += size;
 	}
 
@@ -79,6 +75,33 @@ public:
 		return m_data.size() - m_index;
 	}
 
+	/*!
+	 * Makes sure that enough data is left for reading a certain amount of bytes.
+	 *
+	 * Once the size of a structure has been validated like this, it can be read using
+	 * the unchecked functions, without checking the bounds of every single field again.
+	 *
+	 * @param[in] size How many bytes have to be available.
+	 */
+	void require(const usize size) const
+	{
+		if (!this->fits(size))
+			throw common::Error<Error::EndOfBuffer> {size, this->size()};
+	}
+
+	/*!
+	 * Whether enough data is left for reading a certain amount of bytes.
+	 *
+	 * This is the non-throwing version of @ref require, for data that is expected to be
+	 * malformed sometimes.
+	 *
+	 * @param[in] size How many bytes have to be available.
+	 */
+	[[nodiscard]] bool fits(const usize size) const
+	{
+		return size <= this->size();
+	}
+
 	/*!
 	 * Takes a chunk of bytes from the current position and splits it off.
 	 *
@@ -88,44 +111,117 @@ public:
 	template <class T>
 	gsl::span<T> subspan(const usize size)
 	{
-		if (size > this->size())
-			throw common::Error<Error::EndOfBuffer> {size, this->size()};
+		this->require(size * sizeof(T));
+		return this->subspan_unchecked<T>(size);
+	}
 
+	/*!
+	 * Takes a chunk of bytes from the current position and splits it off.
+	 *
+	 * @param[in] size How many bytes to take.
+	 * @return A new reader instance for the chunk of data.
+	 */
+	Reader sub(const usize size)
+	{
+		return Reader {this->subspan<u8>(size)};
+	}
+
+	/*!
+	 * Reads an object from the current position.
+	 *
+	 * @tparam T The type (and size) of the object to read.
+	 * @return The object that was read.
+	 */
+	template <class T>
+	T read()
+	{
+		this->require(sizeof(T));
+		return this->read_unchecked<T>();
+	}
+
+	/*!
+	 * Fills a buffer with the data at the current position, without checking the bounds.
+	 *
+	 * The caller must have checked that enough data is left, using @ref require.
+	 *
+	 * @param[in] dest The destination and size of the data.
+	 */
+	void read_unchecked(const gsl::span<u8> dest)
+	{
+		const gsl::span<u8> src = this->subspan_unchecked<u8>(dest.size());
+		std::copy(src.begin(), src.end(), dest.begin());
+	}
+
+	/*!
+	 * Moves the current position forward, without checking the bounds.
+	 *
+	 * The caller must have checked that enough data is left, using @ref require.
+	 *
+	 * @param[in] size How many bytes to skip.
+	 */
+	void skip_unchecked(const usize size)
+	{
+		if constexpr (common::buildopts::ForceAccessChecks)
+			this->require(size);
+
+		m_index += size;
+	}
+
+	/*!
+	 * Takes a chunk of bytes from the current position, without checking the bounds.
+	 *
+	 * The caller must have checked that enough data is left, using @ref require.
+	 *
+	 * @param[in] size How many objects of type T to take.
+	 * @return The raw chunk of data.
+	 */
+	template <class T>
+	gsl::span<T> subspan_unchecked(const usize size)
+	{
 		const usize bytes = size * sizeof(T);
-		const gsl::span<u8> sub = m_data.subspan(m_index, bytes);
 
-		this->skip(bytes);
+		if constexpr (common::buildopts::ForceAccessChecks)
+			this->require(bytes);
+
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		u8 *data = m_data.data() + m_index;
+		m_index += bytes;
 
 		// We have to break type safety here, since all we have is a bytestream.
 		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-		return gsl::span<T> {reinterpret_cast<T *>(sub.data()), size};
+		return gsl::span<T> {reinterpret_cast<T *>(data), size};
 	}
 
 	/*!
-	 * Takes a chunk of bytes from the current position and splits it off.
+	 * Takes a chunk of bytes from the current position and splits it off, without checking
+	 * the bounds.
+	 *
+	 * The caller must have checked that enough data is left, using @ref require or @ref fits.
 	 *
 	 * @param[in] size How many bytes to take.
 	 * @return A new reader instance for the chunk of data.
 	 */
-	Reader sub(const usize size)
+	Reader sub_unchecked(const usize size)
 	{
-		return Reader {this->subspan<u8>(size)};
+		return Reader {this->subspan_unchecked<u8>(size)};
 	}
 
 	/*!
-	 * Reads an object from the current position.
+	 * Reads an object from the current position, without checking the bounds.
+	 *
+	 * The caller must have checked that enough data is left, using @ref require.
 	 *
 	 * @tparam T The type (and size) of the object to read.
 	 * @return The object that was read.
 	 */
 	template <class T>
-	T read()
+	T read_unchecked()
 	{
 		T value {};
 
 		// We have to break type safety here, since all we have is a bytestream.
 		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-		this->read(gsl::span {reinterpret_cast<u8 *>(&value), sizeof(value)});
+		this->read_unchecked(gsl::span {reinterpret_cast<u8 *>(&value), sizeof(value)});
 
 		return value;
 	}
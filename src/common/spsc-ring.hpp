@@ -0,0 +1,179 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_COMMON_SPSC_RING_HPP
+#define IPTSD_COMMON_SPSC_RING_HPP
+
+#include "types.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace iptsd::common {
+
+/*
+ * A fixed size, lock-free ring buffer for passing data from one producer thread
+ * to one consumer thread.
+ *
+ * All slots are allocated when the ring is created and then reused. The producer fills
+ * the slot returned by @ref acquire and publishes it using @ref commit, the consumer
+ * processes the slot returned by @ref front and hands it back using @ref pop.
+ *
+ * The data path never takes a lock. A mutex is only used to put the consumer to sleep
+ * while the ring is empty, see @ref wait_for.
+ */
+template <class T>
+class SpscRing {
+private:
+	// Preallocated storage for all slots.
+	std::vector<T> m_slots;
+
+	// The amount of slots that have been consumed. Only written by the consumer.
+	alignas(64) std::atomic<usize> m_head = 0;
+
+	// The amount of slots that have been produced. Only written by the producer.
+	alignas(64) std::atomic<usize> m_tail = 0;
+
+	// Whether the consumer is currently sleeping in wait_for.
+	alignas(64) std::atomic_bool m_waiting = false;
+
+	std::mutex m_mutex {};
+	std::condition_variable m_cond {};
+
+public:
+	/*!
+	 * Creates a new ring buffer.
+	 *
+	 * @param[in] capacity How many slots the ring buffer has.
+	 * @param[in] prototype The initial value of every slot.
+	 */
+	SpscRing(const usize capacity, const T &prototype = {}) : m_slots(capacity, prototype) {}
+
+	/*!
+	 * The total amount of slots in the ring.
+	 */
+	[[nodiscard]] usize capacity() const
+	{
+		return m_slots.size();
+	}
+
+	/*!
+	 * How many slots are currently filled and waiting for the consumer.
+	 *
+	 * This is only a snapshot and can be called from any thread.
+	 */
+	[[nodiscard]] usize size() const
+	{
+		const usize tail = m_tail.load(std::memory_order_acquire);
+		const usize head = m_head.load(std::memory_order_acquire);
+
+		return tail - head;
+	}
+
+	/*!
+	 * Whether the ring currently contains no filled slots.
+	 */
+	[[nodiscard]] bool empty() const
+	{
+		return this->size() == 0;
+	}
+
+	/*!
+	 * Producer: Returns the next free slot.
+	 *
+	 * The slot is not visible to the consumer until @ref commit is called.
+	 *
+	 * @return A pointer to the free slot, or nullptr if the ring is full.
+	 */
+	[[nodiscard]] T *acquire()
+	{
+		const usize tail = m_tail.load(std::memory_order_relaxed);
+		const usize head = m_head.load(std::memory_order_acquire);
+
+		if (tail - head >= m_slots.size())
+			return nullptr;
+
+		return &m_slots[tail % m_slots.size()];
+	}
+
+	/*!
+	 * Producer: Publishes the slot that was returned by @ref acquire.
+	 */
+	void commit()
+	{
+		m_tail.fetch_add(1, std::memory_order_seq_cst);
+
+		if (!m_waiting.load(std::memory_order_seq_cst))
+			return;
+
+		// Taking the lock ensures the consumer is either waiting or will see the new slot.
+		{
+			const std::lock_guard lock {m_mutex};
+		}
+
+		m_cond.notify_one();
+	}
+
+	/*!
+	 * Consumer: Returns the oldest filled slot.
+	 *
+	 * @return A pointer to the slot, or nullptr if the ring is empty.
+	 */
+	[[nodiscard]] T *front()
+	{
+		const usize head = m_head.load(std::memory_order_relaxed);
+		const usize tail = m_tail.load(std::memory_order_acquire);
+
+		if (head == tail)
+			return nullptr;
+
+		return &m_slots[head % m_slots.size()];
+	}
+
+	/*!
+	 * Consumer: Hands the slot returned by @ref front back to the producer.
+	 */
+	void pop()
+	{
+		m_head.fetch_add(1, std::memory_order_release);
+	}
+
+	/*!
+	 * Consumer: Waits until the ring is not empty anymore.
+	 *
+	 * @param[in] timeout How long to wait for the producer at most.
+	 * @return Whether the ring contains a filled slot.
+	 */
+	template <class Rep, class Period>
+	bool wait_for(const std::chrono::duration<Rep, Period> &timeout)
+	{
+		if (!this->empty())
+			return true;
+
+		std::unique_lock lock {m_mutex};
+		m_waiting.store(true, std::memory_order_seq_cst);
+
+		const bool filled = m_cond.wait_for(lock, timeout, [&] { return !this->empty(); });
+		m_waiting.store(false, std::memory_order_relaxed);
+
+		return filled;
+	}
+
+	/*!
+	 * Wakes up the consumer, e.g. because it should stop waiting for new data.
+	 */
+	void notify()
+	{
+		{
+			const std::lock_guard lock {m_mutex};
+		}
+
+		m_cond.notify_one();
+	}
+};
+
+} // namespace iptsd::common
+
+#endif // IPTSD_COMMON_SPSC_RING_HPP
@@ -0,0 +1,240 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_COMMON_THREAD_POOL_HPP
+#define IPTSD_COMMON_THREAD_POOL_HPP
+
+#include "types.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace iptsd::common {
+
+/*
+ * A small pool of persistent worker threads, for splitting work into independent tasks.
+ *
+ * The threads are created once, together with the pool, and then sleep until work is
+ * submitted using @ref run. The calling thread takes part in the work, so a pool with
+ * n threads runs up to n + 1 tasks at the same time.
+ *
+ * Only one thread may submit work at a time.
+ */
+class ThreadPool {
+private:
+	using Invoke = void (*)(const void *, usize, usize);
+
+	std::vector<std::thread> m_threads {};
+
+	std::mutex m_mutex {};
+
+	// Wakes up the workers when new work was submitted, or the pool is stopped.
+	std::condition_variable m_start {};
+
+	// Wakes up the submitting thread when all workers are done.
+	std::condition_variable m_done {};
+
+	// How often work was submitted.
+	u64 m_generation = 0;
+
+	// Whether the workers should exit.
+	bool m_stop = false;
+
+	// How many workers have not finished the current work yet.
+	usize m_active = 0;
+
+	// The function that runs a task, and the object it is called on.
+	Invoke m_invoke = nullptr;
+	const void *m_context = nullptr;
+
+	// The number of tasks of the current work.
+	usize m_count = 0;
+
+	// The next task that has not been started yet.
+	std::atomic<usize> m_next = 0;
+
+	// The first exception that was thrown by a task.
+	std::exception_ptr m_error = nullptr;
+
+public:
+	/*!
+	 * Starts the worker threads.
+	 *
+	 * @param[in] threads How many threads to start in addition to the calling thread.
+	 * @param[in] pin Whether every thread is bound to a different CPU core.
+	 */
+	ThreadPool(const usize threads, const bool pin)
+	{
+		const usize cpus = std::thread::hardware_concurrency();
+
+		for (usize i = 0; i < threads; i++) {
+			m_threads.emplace_back([this, i] { this->wait(i + 1); });
+
+			if (!pin || cpus == 0)
+				continue;
+
+			// The calling thread usually runs on the first core, so start with the next one.
+			cpu_set_t set {};
+			CPU_ZERO(&set);
+			CPU_SET((i + 1) % cpus, &set);
+
+			// Pinning is only an optimization, if it fails the thread is used as it is.
+			pthread_setaffinity_np(m_threads.back().native_handle(), sizeof(set), &set);
+		}
+	}
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	~ThreadPool()
+	{
+		{
+			const std::lock_guard lock {m_mutex};
+			m_stop = true;
+		}
+
+		m_start.notify_all();
+
+		for (std::thread &thread : m_threads)
+			thread.join();
+	}
+
+	/*!
+	 * How many threads can run tasks at the same time, including the calling thread.
+	 */
+	[[nodiscard]] usize size() const
+	{
+		return m_threads.size() + 1;
+	}
+
+	/*!
+	 * Runs a number of tasks and waits until all of them are done.
+	 *
+	 * Besides the index of the task, the function receives the index of the thread that
+	 * is running it. The calling thread has the index 0. This can be used to give every
+	 * thread its own temporary storage.
+	 *
+	 * If a task throws an exception, the remaining tasks are still run, and the first
+	 * exception is rethrown afterwards.
+	 *
+	 * @param[in] count How many tasks to run.
+	 * @param[in] func The function that runs the task, taking the task and thread index.
+	 */
+	template <class Func>
+	void run(const usize count, const Func &func)
+	{
+		if (m_threads.empty() || count <= 1) {
+			for (usize i = 0; i < count; i++)
+				func(i, 0);
+
+			return;
+		}
+
+		{
+			const std::lock_guard lock {m_mutex};
+
+			m_invoke = [](const void *context, const usize task, const usize thread) {
+				(*static_cast<const Func *>(context))(task, thread);
+			};
+
+			m_context = &func;
+			m_count = count;
+			m_next = 0;
+			m_active = m_threads.size();
+			m_generation++;
+		}
+
+		m_start.notify_all();
+
+		this->work(0);
+
+		std::exception_ptr error = nullptr;
+
+		{
+			std::unique_lock lock {m_mutex};
+			m_done.wait(lock, [&] { return m_active == 0; });
+
+			m_invoke = nullptr;
+			m_context = nullptr;
+
+			error = std::exchange(m_error, nullptr);
+		}
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+private:
+	/*!
+	 * Runs tasks of the current work until none are left.
+	 *
+	 * @param[in] thread The index of the calling thread.
+	 */
+	void work(const usize thread)
+	{
+		while (true) {
+			const usize task = m_next.fetch_add(1);
+
+			if (task >= m_count)
+				break;
+
+			try {
+				m_invoke(m_context, task, thread);
+			} catch (...) {
+				const std::lock_guard lock {m_mutex};
+
+				if (!m_error)
+					m_error = std::current_exception();
+			}
+		}
+	}
+
+	/*!
+	 * The loop of a worker thread, that waits for work until the pool is stopped.
+	 *
+	 * @param[in] thread The index of the worker thread.
+	 */
+	void wait(const usize thread)
+	{
+		u64 generation = 0;
+
+		while (true) {
+			{
+				std::unique_lock lock {m_mutex};
+
+				m_start.wait(lock, [&] {
+					return m_stop || m_generation != generation;
+				});
+
+				if (m_stop)
+					return;
+
+				generation = m_generation;
+			}
+
+			this->work(thread);
+
+			{
+				const std::lock_guard lock {m_mutex};
+
+				m_active--;
+
+				if (m_active > 0)
+					continue;
+			}
+
+			m_done.notify_one();
+		}
+	}
+};
+
+} // namespace iptsd::common
+
+#endif // IPTSD_COMMON_THREAD_POOL_HPP
@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_COMMON_TRACING_HPP
+#define IPTSD_COMMON_TRACING_HPP
+
+#include "buildopts.hpp"
+#include "types.hpp"
+
+#include <fmt/format.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+namespace iptsd::common::tracing {
+
+/*
+ * Tracepoints that put the processing of frames on the same timeline as kernel events.
+ *
+ * Spans are written to the ftrace marker file in the format used by atrace ("B|pid|name"
+ * and "E|pid"), which is understood by Perfetto, trace-cmd / KernelShark and anything else
+ * that reads ftrace data. Every span carries the ID of the frame that is being processed.
+ *
+ * The tracepoints only exist if iptsd was built with the tracing option. Otherwise all
+ * functions are empty, and the compiler removes the calls to them entirely.
+ */
+
+// Whether the tracepoints were compiled in.
+constexpr bool ENABLED = buildopts::Tracing;
+
+namespace impl {
+
+/*!
+ * Opens the ftrace marker file once.
+ *
+ * @return The file descriptor, or -1 if tracing is not available.
+ */
+inline int marker()
+{
+	static const int fd = [] {
+		const int ret = ::open("/sys/kernel/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+
+		if (ret >= 0)
+			return ret;
+
+		// Older kernels only provide tracefs as part of debugfs.
+		return ::open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+	}();
+
+	return fd;
+}
+
+/*!
+ * The process ID, which atrace uses to group spans.
+ */
+inline int pid()
+{
+	static const int pid = ::getpid();
+	return pid;
+}
+
+// The ID of the frame that the current thread is processing.
+inline thread_local u64 current = 0;
+
+/*!
+ * Writes a formatted line to the marker file.
+ *
+ * Tracing must never interfere with processing, so errors are ignored.
+ *
+ * @param[in] format The format string.
+ * @param[in] args The values to format.
+ */
+template <class... Args>
+void write(fmt::format_string<Args...> format, Args &&...args)
+{
+	const int fd = marker();
+
+	if (fd < 0)
+		return;
+
+	std::array<char, 128> buffer {};
+	const auto result = fmt::format_to_n(buffer.data(),
+	                                     buffer.size(),
+	                                     format,
+	                                     std::forward<Args>(args)...);
+
+	const usize size = std::min(result.size, buffer.size());
+	[[maybe_unused]] const isize ret = ::write(fd, buffer.data(), size);
+}
+
+} // namespace impl
+
+/*!
+ * Sets the ID of the frame that the current thread is processing.
+ *
+ * @param[in] frame The ID of the frame. Spans without an explicit ID will use it.
+ */
+inline void set_frame([[maybe_unused]] const u64 frame)
+{
+	if constexpr (ENABLED)
+		impl::current = frame;
+}
+
+/*!
+ * The ID of the frame that the current thread is processing.
+ */
+inline u64 frame()
+{
+	if constexpr (ENABLED)
+		return impl::current;
+	else
+		return 0;
+}
+
+/*
+ * Marks the time between its creation and destruction as a span on the trace.
+ */
+class Span {
+public:
+	/*!
+	 * Begins a span for the frame that the current thread is processing.
+	 *
+	 * @param[in] name The name of the span. Must be a string literal.
+	 */
+	explicit Span(const char *name) : Span(name, tracing::frame()) {}
+
+	/*!
+	 * Begins a span for a frame.
+	 *
+	 * @param[in] name The name of the span. Must be a string literal.
+	 * @param[in] frame The ID of the frame.
+	 */
+	Span([[maybe_unused]] const char *name, [[maybe_unused]] const u64 frame)
+	{
+		if constexpr (ENABLED)
+			impl::write("B|{}|{} #{}", impl::pid(), name, frame);
+	}
+
+	Span(const Span &) = delete;
+	Span &operator=(const Span &) = delete;
+
+	~Span()
+	{
+		if constexpr (ENABLED)
+			impl::write("E|{}", impl::pid());
+	}
+};
+
+} // namespace iptsd::common::tracing
+
+#endif // IPTSD_COMMON_TRACING_HPP
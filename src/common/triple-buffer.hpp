@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_COMMON_TRIPLE_BUFFER_HPP
+#define IPTSD_COMMON_TRIPLE_BUFFER_HPP
+
+#include "types.hpp"
+
+#include <array>
+#include <atomic>
+
+namespace iptsd::common {
+
+/*
+ * A lock-free triple buffer, for passing the latest state from one producer thread to one
+ * consumer thread.
+ *
+ * Unlike a queue, the producer never has to wait for the consumer. It fills the slot
+ * returned by @ref back and publishes it using @ref publish, replacing any state that the
+ * consumer has not picked up yet. The consumer switches to the latest state using
+ * @ref update and reads it through @ref front, which stays valid until the next update.
+ *
+ * The slots are reused, so the producer has to overwrite the entire state every time.
+ */
+template <class T>
+class TripleBuffer {
+private:
+	// Marks the shared slot as containing a state that the consumer has not seen yet.
+	static constexpr u8 FRESH = 0b100;
+	static constexpr u8 INDEX = 0b011;
+
+	std::array<T, 3> m_slots {};
+
+	// The slot that is passed between the threads, and whether it is fresh.
+	alignas(64) std::atomic<u8> m_middle = 1;
+
+	// The slot that the producer writes to. Only used by the producer.
+	alignas(64) u8 m_back = 0;
+
+	// The slot that the consumer reads from. Only used by the consumer.
+	alignas(64) u8 m_front = 2;
+
+public:
+	/*!
+	 * The slot that the producer fills with the next state.
+	 */
+	[[nodiscard]] T &back()
+	{
+		return m_slots.at(m_back);
+	}
+
+	/*!
+	 * Makes the state in @ref back available to the consumer.
+	 *
+	 * Only called by the producer.
+	 */
+	void publish()
+	{
+		const u8 old = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel);
+		m_back = old & INDEX;
+	}
+
+	/*!
+	 * Switches to the latest published state, if there is a new one.
+	 *
+	 * Only called by the consumer.
+	 *
+	 * @return Whether @ref front changed.
+	 */
+	bool update()
+	{
+		if ((m_middle.load(std::memory_order_relaxed) & FRESH) == 0)
+			return false;
+
+		const u8 old = m_middle.exchange(m_front, std::memory_order_acq_rel);
+		m_front = old & INDEX;
+
+		return true;
+	}
+
+	/*!
+	 * The latest state that the consumer switched to.
+	 */
+	[[nodiscard]] const T &front() const
+	{
+		return m_slots.at(m_front);
+	}
+};
+
+} // namespace iptsd::common
+
+#endif // IPTSD_COMMON_TRIPLE_BUFFER_HPP
@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_COMMON_WORKER_HPP
+#define IPTSD_COMMON_WORKER_HPP
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace iptsd::common {
+
+/*
+ * A persistent thread that runs the same job in the background whenever it is started.
+ *
+ * Unlike @ref ThreadPool, the thread that starts the job does not wait for it, and can do
+ * other work in the meantime. The job is started with @ref start and collected with
+ * @ref wait. Only one job can be in flight, so a job must be collected before the next
+ * one is started. This bounds how far the background thread can run ahead.
+ *
+ * Only one thread may start and collect the job.
+ */
+class Worker {
+private:
+	std::function<void()> m_job;
+
+	std::mutex m_mutex {};
+
+	// Wakes up the thread when the job was started, or the worker is stopped.
+	std::condition_variable m_start {};
+
+	// Wakes up the waiting thread when the job is done.
+	std::condition_variable m_done {};
+
+	// Whether the job was started, but has not finished yet.
+	bool m_busy = false;
+
+	// Whether the thread should exit.
+	bool m_stop = false;
+
+	// The exception that was thrown by the job.
+	std::exception_ptr m_error = nullptr;
+
+	// Must be created last, because it immediately accesses the other members.
+	std::thread m_thread;
+
+public:
+	/*!
+	 * Starts the background thread.
+	 *
+	 * @param[in] job The function that runs whenever the worker is started.
+	 */
+	explicit Worker(std::function<void()> job)
+		: m_job {std::move(job)},
+		  m_thread {[this] { this->loop(); }}
+	{
+	}
+
+	Worker(const Worker &) = delete;
+	Worker &operator=(const Worker &) = delete;
+
+	~Worker()
+	{
+		{
+			const std::lock_guard lock {m_mutex};
+			m_stop = true;
+		}
+
+		m_start.notify_one();
+		m_thread.join();
+	}
+
+	/*!
+	 * Runs the job on the background thread.
+	 *
+	 * The job from the previous call must have been collected using @ref wait.
+	 */
+	void start()
+	{
+		{
+			const std::lock_guard lock {m_mutex};
+			m_busy = true;
+		}
+
+		m_start.notify_one();
+	}
+
+	/*!
+	 * Waits until the job that was started last is done.
+	 *
+	 * If the job threw an exception, it is rethrown here.
+	 */
+	void wait()
+	{
+		std::exception_ptr error = nullptr;
+
+		{
+			std::unique_lock lock {m_mutex};
+			m_done.wait(lock, [&] { return !m_busy; });
+
+			error = std::exchange(m_error, nullptr);
+		}
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+private:
+	/*!
+	 * The loop of the background thread, that runs the job until the worker is stopped.
+	 */
+	void loop()
+	{
+		while (true) {
+			{
+				std::unique_lock lock {m_mutex};
+				m_start.wait(lock, [&] { return m_stop || m_busy; });
+
+				if (m_stop)
+					return;
+			}
+
+			std::exception_ptr error = nullptr;
+
+			try {
+				m_job();
+			} catch (...) {
+				error = std::current_exception();
+			}
+
+			{
+				const std::lock_guard lock {m_mutex};
+
+				m_error = error;
+				m_busy = false;
+			}
+
+			m_done.notify_one();
+		}
+	}
+};
+
+} // namespace iptsd::common
+
+#endif // IPTSD_COMMON_WORKER_HPP
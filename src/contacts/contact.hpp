@@ -58,18 +58,35 @@ public:
 	 */
 	std::optional<bool> stable = std::nullopt;
 
+	/*
+	 * How far the contact moves every frame, as estimated by the tracker.
+	 *
+	 * Range: The same as @ref mean, but relative to it.
+	 */
+	Vector2<T> velocity = Vector2<T>::Zero();
+
 public:
-	static std::optional<Contact<T>> find_in_frame(const usize index,
-	                                               const std::vector<Contact<T>> &frame)
+	/*!
+	 * Converts the contact to a different floating point type.
+	 *
+	 * @tparam U The floating point type of the new contact.
+	 * @return A copy of the contact, using the new type.
+	 */
+	template <class U>
+	[[nodiscard]] Contact<U> cast() const
 	{
-		for (const Contact<T> &contact : frame) {
-			if (contact.index != index)
-				continue;
-
-			return contact;
-		}
-
-		return std::nullopt;
+		Contact<U> contact {};
+
+		contact.mean = this->mean.template cast<U>();
+		contact.size = this->size.template cast<U>();
+		contact.orientation = gsl::narrow_cast<U>(this->orientation);
+		contact.normalized = this->normalized;
+		contact.index = this->index;
+		contact.valid = this->valid;
+		contact.stable = this->stable;
+		contact.velocity = this->velocity.template cast<U>();
+
+		return contact;
 	}
 };
 
@@ -3,159 +3,440 @@
 #ifndef IPTSD_CONTACTS_DETECTION_ALGORITHMS_CLUSTER_HPP
 #define IPTSD_CONTACTS_DETECTION_ALGORITHMS_CLUSTER_HPP
 
+#include <common/casts.hpp>
+#include <common/thread-pool.hpp>
 #include <common/types.hpp>
 
+#include <algorithm>
 #include <limits>
+#include <vector>
 
 namespace iptsd::contacts::detection::cluster {
 
-namespace impl {
+/*
+ * The algorithm that will be used to build clusters from the local maxima of a heatmap.
+ */
+enum class Algorithm : u8 {
+	// A separate search is started at every local maximum, see @ref span.
+	SPAN,
 
-template <class Derived>
-class RecursionState {
-private:
-	using T = typename DenseBase<Derived>::Scalar;
+	// All clusters are labeled at once, see @ref label.
+	LABEL,
+};
+
+/*
+ * A pixel that still has to be checked while spanning a cluster.
+ */
+template <class T>
+struct Step {
+	// The pixel of the heatmap that will be checked.
+	Point position;
 
-public:
-	// The heatmap that is being processed.
-	std::reference_wrapper<const DenseBase<Derived>> heatmap;
-
-	T activation_threshold;
-	T deactivation_threshold;
-
-	// The cluster that is being spanned.
-	std::reference_wrapper<Box> cluster;
-
-	// Whether a point has been visited before.
-	std::reference_wrapper<Image<bool>> visited;
-
-public:
-	RecursionState(const DenseBase<Derived> &heatmap,
-	               const T activation_threshold,
-	               const T deactivation_threshold,
-	               Box &cluster,
-	               Image<bool> &visited)
-		: heatmap {heatmap},
-		  activation_threshold {activation_threshold},
-		  deactivation_threshold {deactivation_threshold},
-		  cluster {cluster},
-		  visited {visited} {};
+	// The value of the pixel that it was reached from.
+	T previous;
 };
 
 /*!
  * Spans a cluster of points on a heatmap.
  *
- * The recursive worker function for finding clusters.
- * Do not call this directly, call @ref iptsd::contacts::detection::clusters::span()
+ * The function will begin at the starting position and expand in all directions.
+ * Pixels that are above the deactiviation threshold will be added to the cluster.
+ * If a pixel is encountered that is below the threshold, or a pixel that has been visited
+ * before, the search will not continue in that direction.
+ *
+ * Once the value of a pixel has fallen below the activation threshold, it is not allowed
+ * to raise again, to prevent connecting two contacts into one cluster.
+ *
+ * The pixels are searched depth first, in the same order as a recursive search would do.
+ * Instead of recursing, the pixels that still have to be checked are stored on a stack.
  *
- * @param[in] state The state struct for passing constant data to each recursion step.
- * @param[in] position The pixel of the heatmap that will be checked in this step.
- * @param[in] previous The value of the pixel that was checked in the step before.
+ * @param[in] heatmap The heatmap to build a cluster from.
+ * @param[in] position The starting position of the cluster (e.g. the local maxima).
+ * @param[in] activation_threshold The activation threshold for searching.
+ * @param[in] deactivation_threshold The deactivation threshold for searching.
+ * @param[in,out] visited Whether a pixel has been visited. All pixels have to be false.
+ * @param[out] stack Temporary storage for the pixels that still have to be checked.
+ * @return The bounding box of the spanned cluster.
  */
 template <class Derived>
-void span_recursive(const RecursionState<Derived> state,
-                    const Point &position,
-                    const typename DenseBase<Derived>::Scalar previous)
+Box span(const DenseBase<Derived> &heatmap,
+         const Point &position,
+         const typename DenseBase<Derived>::Scalar activation_threshold,
+         const typename DenseBase<Derived>::Scalar deactivation_threshold,
+         Image<bool> &visited,
+         std::vector<Step<typename DenseBase<Derived>::Scalar>> &stack)
 {
 	using T = typename DenseBase<Derived>::Scalar;
 
-	const DenseBase<Derived> &heatmap = state.heatmap;
+	Box cluster {};
+	cluster.setEmpty();
 
 	const Eigen::Index cols = heatmap.cols();
 	const Eigen::Index rows = heatmap.rows();
 
-	const Eigen::Index x = position.x();
-	const Eigen::Index y = position.y();
+	if (position.x() < 0 || position.x() >= cols)
+		return cluster;
+
+	if (position.y() < 0 || position.y() >= rows)
+		return cluster;
+
+	if (visited.rows() != rows || visited.cols() != cols)
+		visited.setConstant(rows, cols, false);
+
+	stack.clear();
+	stack.push_back({position, std::numeric_limits<T>::max()});
+
+	while (!stack.empty()) {
+		const Step<T> step = stack.back();
+		stack.pop_back();
+
+		const Eigen::Index x = step.position.x();
+		const Eigen::Index y = step.position.y();
+
+		const T value = heatmap(y, x);
+
+		if (value <= deactivation_threshold)
+			continue;
 
-	const T value = heatmap(y, x);
+		// Don't allow the value to increase outside of the activation area
+		if (step.previous <= activation_threshold && value > step.previous)
+			continue;
 
-	if (value <= state.deactivation_threshold)
-		return;
+		bool &seen = visited(y, x);
 
-	// Don't allow the value to increase outside of the activation area
-	if (previous <= state.activation_threshold && value > previous)
-		return;
+		if (seen)
+			continue;
 
-	bool &visited = state.visited(y, x);
-	Box &cluster = state.cluster;
+		seen = true;
 
-	if (visited)
-		return;
+		if (!cluster.contains(step.position))
+			cluster.extend(step.position);
 
-	visited = true;
+		// Pushed in reverse, so that the right neighbour is checked first.
+		if (y > 0)
+			stack.push_back({{x + 0, y - 1}, value});
 
-	if (!cluster.contains(position))
-		cluster.extend(position);
+		if (y < rows - 1)
+			stack.push_back({{x + 0, y + 1}, value});
 
-	if (x < cols - 1)
-		span_recursive(state, {x + 1, y + 0}, value);
+		if (x > 0)
+			stack.push_back({{x - 1, y + 0}, value});
 
-	if (x > 0)
-		span_recursive(state, {x - 1, y + 0}, value);
+		if (x < cols - 1)
+			stack.push_back({{x + 1, y + 0}, value});
+	}
 
-	if (y < rows - 1)
-		span_recursive(state, {x + 0, y + 1}, value);
+	// Every visited pixel is part of the cluster, so only its bounding box has to be reset.
+	if (!cluster.isEmpty()) {
+		const Point size = cluster.sizes() + Point::Ones();
 
-	if (y > 0)
-		span_recursive(state, {x + 0, y - 1}, value);
+		visited.block(cluster.min().y(), cluster.min().x(), size.y(), size.x())
+			.setConstant(false);
+	}
+
+	return cluster;
 }
 
-} // namespace impl
+/*
+ * Temporary storage for labeling clusters.
+ */
+struct Labels {
+	// Marks pixels that are not part of any cluster.
+	static constexpr usize NONE = std::numeric_limits<usize>::max();
+
+	// For every pixel, another pixel of the same cluster, or NONE.
+	std::vector<usize> parents {};
+
+	// For the first pixel of every cluster, the index of the cluster.
+	std::vector<usize> clusters {};
+
+	// For every cluster, whether it contains a pixel above the activation threshold.
+	std::vector<bool> active {};
+
+	// For every row, whether it contains any pixels above the deactivation threshold.
+	// Not a std::vector<bool>, so that multiple threads can fill in different rows.
+	std::vector<u8> rows {};
+};
+
+namespace impl {
 
 /*!
- * Spans a cluster of points on a heatmap.
+ * Finds the pixel that represents the cluster of another pixel.
  *
- * The function will begin at the starting position and recursively expand in all directions.
- * Pixels that are above the deactiviation threshold will be added to the cluster.
- * If a pixel is encountered that is below the threshold, or a pixel that has been visited
- * before, that recursion branch will terminate.
+ * @param[in,out] parents The parent of every pixel.
+ * @param[in] index The pixel whose cluster is searched.
+ * @return The first pixel of the cluster.
+ */
+inline usize find_root(std::vector<usize> &parents, usize index)
+{
+	while (parents[index] != index) {
+		// Path halving, this keeps the trees flat
+		parents[index] = parents[parents[index]];
+		index = parents[index];
+	}
+
+	return index;
+}
+
+/*!
+ * Merges the clusters of two pixels.
  *
- * Once the value of a pixel has fallen below the activation threshold, it is not allowed
- * to raise again, to prevent connecting two contacts into one cluster.
+ * @param[in,out] parents The parent of every pixel.
+ * @param[in] a The first pixel.
+ * @param[in] b The second pixel.
+ */
+inline void unite(std::vector<usize> &parents, const usize a, const usize b)
+{
+	const usize ra = find_root(parents, a);
+	const usize rb = find_root(parents, b);
+
+	// The first pixel in row-major order always stays the root
+	if (ra < rb)
+		parents[rb] = ra;
+	else if (rb < ra)
+		parents[ra] = rb;
+}
+
+/*!
+ * Connects the pixels of some rows with their neighbours, see @ref label.
  *
- * @param[in] heatmap The heatmap to build a cluster from.
- * @param[in] position The starting position of the cluster (e.g. the local maxima).
+ * @param[in] heatmap The heatmap to build clusters from.
  * @param[in] activation_threshold The activation threshold for searching.
  * @param[in] deactivation_threshold The deactivation threshold for searching.
- * @return The bounding box of the spanned cluster.
+ * @param[in,out] labels The labels, whose parents were initialized for all rows.
+ * @param[in] first The first row whose pixels are connected.
+ * @param[in] last The row after the last row whose pixels are connected.
+ * @param[in] accept Whether a pixel in a row is connected with a pixel in another row.
  */
-template <class Derived>
-Box span(const DenseBase<Derived> &heatmap,
-         const Point &position,
-         const typename DenseBase<Derived>::Scalar activation_threshold,
-         const typename DenseBase<Derived>::Scalar deactivation_threshold)
+template <class Derived, class Filter>
+void connect(const DenseBase<Derived> &heatmap,
+             const typename DenseBase<Derived>::Scalar activation_threshold,
+             const typename DenseBase<Derived>::Scalar deactivation_threshold,
+             Labels &labels,
+             const Eigen::Index first,
+             const Eigen::Index last,
+             const Filter &accept)
 {
 	using T = typename DenseBase<Derived>::Scalar;
 
-	Box cluster {};
-	cluster.setEmpty();
+	const Eigen::Index cols = heatmap.cols();
+	const Eigen::Index rows = heatmap.rows();
+
+	const auto index = [&](const Eigen::Index x, const Eigen::Index y) {
+		return casts::to_unsigned(y * cols + x);
+	};
+
+	std::vector<usize> &parents = labels.parents;
+
+	for (Eigen::Index y = first; y < last; y++) {
+		if (labels.rows[casts::to_unsigned(y)] == 0)
+			continue;
+
+		for (Eigen::Index x = 0; x < cols; x++) {
+			const T value = heatmap(y, x);
+
+			if (value <= deactivation_threshold)
+				continue;
+
+			if (value > activation_threshold) {
+				const bool left = x > 0 && heatmap(y, x - 1) > activation_threshold;
+				const bool above = y > 0 && heatmap(y - 1, x) > activation_threshold;
+
+				// The neighbours to the right and below will connect themselves
+				if (left && accept(y, y))
+					unite(parents, index(x, y), index(x - 1, y));
+
+				if (above && accept(y, y - 1))
+					unite(parents, index(x, y), index(x, y - 1));
+
+				continue;
+			}
 
+			Point highest = {x, y};
+			T max = value;
+
+			const auto check = [&](const Eigen::Index nx, const Eigen::Index ny) {
+				const T neighbour = heatmap(ny, nx);
+
+				if (neighbour >= max) {
+					max = neighbour;
+					highest = {nx, ny};
+				}
+			};
+
+			// Same order as in span
+			if (x < cols - 1)
+				check(x + 1, y);
+
+			if (x > 0)
+				check(x - 1, y);
+
+			if (y < rows - 1)
+				check(x, y + 1);
+
+			if (y > 0)
+				check(x, y - 1);
+
+			if (accept(y, highest.y()))
+				unite(parents, index(x, y), index(highest.x(), highest.y()));
+		}
+	}
+}
+
+} // namespace impl
+
+/*!
+ * Builds all clusters of a heatmap at once.
+ *
+ * Unlike @ref span, which searches separately for every local maximum, this labels the
+ * whole heatmap using union-find, so the cost doesn't depend on the number of maxima.
+ *
+ * Pixels above the activation threshold are connected with all of their neighbours that
+ * are also above it. Pixels between the deactivation and the activation threshold are
+ * connected only with their largest neighbour, if it is not smaller than themselves.
+ * This follows the rule of @ref span that values are not allowed to raise again once they
+ * have fallen below the activation threshold: A pixel in the valley between two contacts
+ * is added to one of them, instead of connecting both. Clusters that have no pixel above
+ * the activation threshold are dropped.
+ *
+ * With multiple threads, the heatmap is split into horizontal strips that are connected
+ * in parallel. Pixels are only connected within their own strip, so every thread only
+ * touches the pixels of its strip. Afterwards, the pixels next to the borders between the
+ * strips are connected across them. Every cluster is represented by its first pixel in
+ * row-major order, no matter in which order pixels were connected, so the clusters are
+ * the same as when labeling on a single thread.
+ *
+ * @param[in] heatmap The heatmap to build clusters from.
+ * @param[in] activation_threshold The activation threshold for searching.
+ * @param[in] deactivation_threshold The deactivation threshold for searching.
+ * @param[in,out] labels Temporary storage for labeling.
+ * @param[out] clusters The bounding boxes of all clusters.
+ * @param[in] pool The threads that label the strips, or null to use the calling thread.
+ */
+template <class Derived>
+void label(const DenseBase<Derived> &heatmap,
+           const typename DenseBase<Derived>::Scalar activation_threshold,
+           const typename DenseBase<Derived>::Scalar deactivation_threshold,
+           Labels &labels,
+           std::vector<Box> &clusters,
+           common::ThreadPool *pool = nullptr)
+{
 	const Eigen::Index cols = heatmap.cols();
 	const Eigen::Index rows = heatmap.rows();
 
-	const Eigen::Index x = position.x();
-	const Eigen::Index y = position.y();
+	const auto index = [&](const Eigen::Index x, const Eigen::Index y) {
+		return casts::to_unsigned(y * cols + x);
+	};
 
-	if (x < 0 || x >= cols)
-		return cluster;
+	std::vector<usize> &parents = labels.parents;
 
-	if (y < 0 || y >= rows)
-		return cluster;
+	parents.resize(casts::to_unsigned(heatmap.size()));
+	labels.clusters.resize(parents.size());
+	labels.active.clear();
+
+	clusters.clear();
+
+	labels.rows.resize(casts::to_unsigned(rows));
+
+	const usize threads = pool != nullptr ? pool->size() : 1;
+
+	// Split the rows evenly, a heatmap without rows still has one empty strip
+	const Eigen::Index parts = casts::to_eigen(threads);
+	const Eigen::Index height = std::max((rows + parts - 1) / parts, Eigen::Index {1});
+
+	const usize strips = std::max(casts::to_unsigned((rows + height - 1) / height), usize {1});
+
+	const auto strip = [&](const usize task, const usize /* unused */) {
+		const Eigen::Index first = casts::to_eigen(task) * height;
+		const Eigen::Index last = std::min(first + height, rows);
+
+		for (Eigen::Index y = first; y < last; y++) {
+			const bool active = heatmap.row(y).maxCoeff() > deactivation_threshold;
+			labels.rows[casts::to_unsigned(y)] = active ? 1 : 0;
+
+			for (Eigen::Index x = 0; x < cols; x++) {
+				const bool inside = active && heatmap(y, x) > deactivation_threshold;
+				parents[index(x, y)] = inside ? index(x, y) : Labels::NONE;
+			}
+		}
 
-	Image<bool> visited {rows, cols};
-	visited.setConstant(false);
+		// The other rows belong to strips that are initialized by other threads
+		const auto inside = [&](const Eigen::Index /* unused */, const Eigen::Index y) {
+			return y >= first && y < last;
+		};
 
-	const impl::RecursionState<Derived> state {
-		heatmap,
-		activation_threshold,
-		deactivation_threshold,
-		cluster,
-		visited,
+		impl::connect(heatmap,
+		              activation_threshold,
+		              deactivation_threshold,
+		              labels,
+		              first,
+		              last,
+		              inside);
 	};
 
-	impl::span_recursive(state, position, std::numeric_limits<T>::max());
+	if (pool != nullptr && strips > 1) {
+		// The parents of every strip are initialized before it is connected, so the
+		// connections that cross the borders have to wait until all strips are done
+		pool->run(strips, strip);
+	} else {
+		strip(0, 0);
+	}
 
-	return cluster;
+	for (usize i = 1; i < strips; i++) {
+		const Eigen::Index border = casts::to_eigen(i) * height;
+
+		const auto crosses = [&](const Eigen::Index from, const Eigen::Index to) {
+			return (from < border) != (to < border);
+		};
+
+		impl::connect(heatmap,
+		              activation_threshold,
+		              deactivation_threshold,
+		              labels,
+		              border - 1,
+		              border + 1,
+		              crosses);
+	}
+
+	for (Eigen::Index y = 0; y < rows; y++) {
+		if (labels.rows[casts::to_unsigned(y)] == 0)
+			continue;
+
+		for (Eigen::Index x = 0; x < cols; x++) {
+			const usize i = index(x, y);
+
+			if (parents[i] == Labels::NONE)
+				continue;
+
+			const usize root = impl::find_root(parents, i);
+
+			// The root is the first pixel of the cluster that is encountered
+			if (root == i) {
+				labels.clusters[i] = clusters.size();
+				labels.active.push_back(false);
+
+				Box &cluster = clusters.emplace_back();
+				cluster.setEmpty();
+			}
+
+			const usize cluster = labels.clusters[root];
+
+			clusters[cluster].extend(Point {x, y});
+
+			if (heatmap(y, x) > activation_threshold)
+				labels.active[cluster] = true;
+		}
+	}
+
+	// Drop clusters that don't contain a local maximum above the activation threshold
+	usize kept = 0;
+
+	for (usize i = 0; i < clusters.size(); i++) {
+		if (labels.active[i])
+			clusters[kept++] = clusters[i];
+	}
+
+	clusters.resize(kept);
 }
 
 } // namespace iptsd::contacts::detection::cluster
@@ -4,9 +4,10 @@
 #define IPTSD_CONTACTS_DETECTION_ALGORITHMS_CONVOLUTION_HPP
 
 #include "optimized/convolution.3x3-extend.hpp"
-#include "optimized/convolution.5x5-extend.hpp"
+#include "optimized/convolution.nxm-extend.hpp"
 
 #include <common/casts.hpp>
+#include <common/dispatch.hpp>
 #include <common/types.hpp>
 
 namespace iptsd::contacts::detection::convolution {
@@ -66,13 +67,26 @@ void run_generic(const DenseBase<DerivedData> &in,
 	}
 }
 
+/*!
+ * The region that contains all pixels of a collection.
+ *
+ * @param[in] data The collection.
+ * @return A box from the first to the last pixel of the collection.
+ */
+template <class Derived>
+inline Box whole(const DenseBase<Derived> &data)
+{
+	return Box {Point {0, 0}, Point {data.cols() - 1, data.rows() - 1}};
+}
+
 } // namespace impl
 
 /*!
  * Runs a 2D convolution of a collection and a kernel.
  *
- * If the passed kernel has a size of 3x3 or 5x5 an optimized convolution routine
- * will be used. Otherwise a generic implementation gets used.
+ * If the passed kernel has a size of 3x3, a hand optimized convolution routine will be used.
+ * Other kernels with an odd size that is known at compile time use a generated routine.
+ * Otherwise a generic implementation gets used.
  *
  * The borders of the input data will be extended to prevent overflowing indices.
  *
@@ -81,27 +95,116 @@ void run_generic(const DenseBase<DerivedData> &in,
  * @param[out] out A reference to the matrix where the results of the convolution are stored.
  */
 template <class DerivedData, class DerivedKernel>
+IPTSD_DISPATCH
 inline void run(const DenseBase<DerivedData> &in,
                 const DenseBase<DerivedKernel> &kernel,
                 DenseBase<DerivedData> &out)
 {
-	constexpr usize Rows = DerivedKernel::RowsAtCompileTime;
-	constexpr usize Cols = DerivedKernel::ColsAtCompileTime;
+	constexpr int Rows = DerivedKernel::RowsAtCompileTime;
+	constexpr int Cols = DerivedKernel::ColsAtCompileTime;
 
 	if constexpr (Rows == 3 && Cols == 3) {
 		impl::run_3x3(in, kernel, out);
-	} else if constexpr (Rows == 5 && Cols == 5) {
-		impl::run_5x5(in, kernel, out);
+	} else if constexpr (Rows != Eigen::Dynamic && Cols != Eigen::Dynamic) {
+		static_assert(Rows % 2 == 1 && Cols % 2 == 1);
+		impl::run_nxm<Rows, Cols>(in, kernel, out, impl::whole(in));
 	} else {
 		if (kernel.rows() == 3 && kernel.cols() == 3)
 			impl::run_3x3(in, kernel, out);
 		else if (kernel.rows() == 5 && kernel.cols() == 5)
-			impl::run_5x5(in, kernel, out);
+			impl::run_nxm<5, 5>(in, kernel, out, impl::whole(in));
 		else
 			impl::run_generic(in, kernel, out);
 	}
 }
 
+/*!
+ * Runs a 2D convolution of a collection and a kernel, but only for some rows of the output.
+ *
+ * This allows processing the output while the rows that were just calculated are still
+ * in the cache. The kernel must have an odd size that is known at compile time.
+ *
+ * @param[in] in The input data.
+ * @param[in] kernel The kernel that is applied to the input data.
+ * @param[out] out A reference to the matrix where the results of the convolution are stored.
+ * @param[in] first The first row of the output that is calculated.
+ * @param[in] last The row after the last row of the output that is calculated.
+ */
+template <class DerivedData, class DerivedKernel>
+IPTSD_DISPATCH
+inline void run_rows(const DenseBase<DerivedData> &in,
+                     const DenseBase<DerivedKernel> &kernel,
+                     DenseBase<DerivedData> &out,
+                     const Eigen::Index first,
+                     const Eigen::Index last)
+{
+	constexpr int Rows = DerivedKernel::RowsAtCompileTime;
+	constexpr int Cols = DerivedKernel::ColsAtCompileTime;
+
+	static_assert(Rows != Eigen::Dynamic && Cols != Eigen::Dynamic);
+	static_assert(Rows % 2 == 1 && Cols % 2 == 1);
+
+	const Box region {Point {0, first}, Point {in.cols() - 1, last - 1}};
+
+	impl::run_nxm<Rows, Cols>(in, kernel, out, region);
+}
+
+/*!
+ * Runs a 2D convolution of a collection and a kernel, but only for a block of the output.
+ *
+ * This allows updating the parts of the output whose input has changed. The pixels have the
+ * same values as if the whole output was calculated using @ref run_rows. The kernel must
+ * have an odd size that is known at compile time.
+ *
+ * @param[in] in The input data.
+ * @param[in] kernel The kernel that is applied to the input data.
+ * @param[out] out A reference to the matrix where the results of the convolution are stored.
+ * @param[in] region The pixels of the output that are calculated.
+ */
+template <class DerivedData, class DerivedKernel>
+IPTSD_DISPATCH
+inline void run_block(const DenseBase<DerivedData> &in,
+                      const DenseBase<DerivedKernel> &kernel,
+                      DenseBase<DerivedData> &out,
+                      const Box &region)
+{
+	constexpr int Rows = DerivedKernel::RowsAtCompileTime;
+	constexpr int Cols = DerivedKernel::ColsAtCompileTime;
+
+	static_assert(Rows != Eigen::Dynamic && Cols != Eigen::Dynamic);
+	static_assert(Rows % 2 == 1 && Cols % 2 == 1);
+
+	impl::run_nxm<Rows, Cols>(in, kernel, out, region);
+}
+
+/*!
+ * Runs a 2D convolution of a collection and a separable kernel.
+ *
+ * A kernel is separable if it is the product of a column and a row vector, like the
+ * gaussian kernels from @ref kernels::gaussian. Instead of applying the full kernel, the
+ * rows are convolved with the row vector first, and the result with the column vector.
+ * This needs N + M instead of N * M multiplications per pixel.
+ *
+ * @param[in] in The input data.
+ * @param[in] vertical The column vector of the kernel.
+ * @param[in] horizontal The row vector of the kernel, stored as a column vector.
+ * @param[in] temp Temporary storage with the same size as the input data.
+ * @param[out] out A reference to the matrix where the results of the convolution are stored.
+ */
+template <class DerivedData, class T, int Rows, int Cols>
+IPTSD_DISPATCH
+inline void run_separable(const DenseBase<DerivedData> &in,
+                          const Vector<T, Rows> &vertical,
+                          const Vector<T, Cols> &horizontal,
+                          DenseBase<DerivedData> &temp,
+                          DenseBase<DerivedData> &out)
+{
+	const Matrix<T, 1, Cols> row = horizontal.transpose();
+
+	impl::run_nxm<1, Cols>(in, row, temp, impl::whole(in));
+	impl::run_nxm<Rows, 1>(temp, vertical, out, impl::whole(in));
+}
+
 } // namespace iptsd::contacts::detection::convolution
 
 #endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_CONVOLUTION_HPP
@@ -11,8 +11,8 @@ namespace iptsd::contacts::detection {
 
 enum class Error : u8 {
 	InvalidNeutralMode,
-	InvalidClusterOverlap,
 	FailedToMergeClusters,
+	InvalidHeatmapSize,
 };
 
 inline std::string format_as(Error err)
@@ -20,10 +20,10 @@ inline std::string format_as(Error err)
 	switch (err) {
 	case Error::InvalidNeutralMode:
 		return "contacts: Invalid neutral mode!";
-	case Error::InvalidClusterOverlap:
-		return "contacts: Calculated invalid cluster overlap!";
 	case Error::FailedToMergeClusters:
 		return "contacts: Failed to merge overlapping clusters!";
+	case Error::InvalidHeatmapSize:
+		return "contacts: Heatmap size does not match the detector!";
 	default:
 		return "contacts: Invalid error code!";
 	}
@@ -4,12 +4,19 @@
 #define IPTSD_CONTACTS_DETECTION_ALGORITHMS_GAUSSIAN_HPP
 
 #include <common/casts.hpp>
+#include <common/dispatch.hpp>
+#include <common/thread-pool.hpp>
 #include <common/types.hpp>
 
 #include <gsl/gsl>
 #include <gsl/util>
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace iptsd::contacts::detection::gaussian {
 
@@ -30,8 +37,94 @@ struct Parameters {
 	// local bounds for sampling
 	Box bounds;
 
-	// local weights for sampling
+	// local weights for sampling, can be larger than the bounds
 	Matrix<T> weights;
+
+	// first and last sampled column of every row of the bounds, can have more rows
+	Image<Eigen::Index, Eigen::Dynamic, 2> columns;
+};
+
+/*
+ * Temporary storage for processing the rows of a single cluster.
+ */
+template <class T>
+struct Scratch {
+	// The powers of the x coordinate of every column in the bounds.
+	Image<T, 5, Eigen::Dynamic> xs {};
+
+	// The weighted values of a row of the bounds.
+	Array<T> dd {};
+	Array<T> vv {};
+
+	// The distance of every column in the bounds from the mean.
+	Array<T> dx {};
+
+	/*!
+	 * Prepares the storage for clusters of a heatmap with a certain width.
+	 *
+	 * @param[in] cols The width of the heatmap.
+	 */
+	void resize(const Eigen::Index cols)
+	{
+		// Zeroing the buffers makes sure that their pages are already mapped.
+		xs.setZero(5, cols);
+		dd.setZero(cols);
+		vv.setZero(cols);
+		dx.setZero(cols);
+	}
+};
+
+/*
+ * Temporary storage for gaussian fitting, that can be reused between frames.
+ */
+template <class T>
+struct Workspace {
+	// The sum of the weights of all parameters.
+	Image<T> total {};
+
+	// Temporary storage for every thread that is assembling systems.
+	std::vector<Scratch<T>> scratch = std::vector<Scratch<T>>(1);
+
+	// The system of linear equations of every parameter.
+	std::vector<Matrix6<T>> systems {};
+	std::vector<Vector6<T>> rhs {};
+
+	// The parameters whose systems are assembled together, and those that are too large.
+	std::vector<usize> batched {};
+	std::vector<usize> single {};
+
+	/*!
+	 * Prepares the storage for fitting on a heatmap of a certain size.
+	 *
+	 * @param[in] rows The height of the heatmap.
+	 * @param[in] cols The width of the heatmap.
+	 */
+	void resize(const Eigen::Index rows, const Eigen::Index cols)
+	{
+		total.setZero(rows, cols);
+
+		for (Scratch<T> &s : scratch)
+			s.resize(cols);
+	}
+
+	/*!
+	 * Prepares the storage for fitting a certain number of parameters.
+	 *
+	 * @param[in] count How many parameters are fitted.
+	 * @return Whether the storage had to grow.
+	 */
+	bool reserve(const usize count)
+	{
+		if (systems.size() >= count)
+			return false;
+
+		systems.resize(count);
+		rhs.resize(count);
+		batched.reserve(count);
+		single.reserve(count);
+
+		return true;
+	}
 };
 
 namespace impl {
@@ -40,27 +133,88 @@ template <class T>
 constexpr T EPS = std::is_same_v<T, f32> ? gsl::narrow_cast<T>(1E-20) : gsl::narrow_cast<T>(1E-40);
 
 /*!
- * 2D Gaussian probability density function without normalization.
+ * How many systems of linear equations are assembled and solved at once.
+ *
+ * This is the number of values that fit into a 256 bit SIMD register.
+ */
+template <class T>
+constexpr Eigen::Index LANES = std::is_same_v<T, f32> ? 8 : 4;
+
+/*!
+ * The largest width and height of a cluster whose system is assembled together with others.
+ *
+ * Fingers are much smaller than this. Larger clusters, like palms, would make the padded
+ * window of the other clusters too large, so their systems are assembled on their own.
+ */
+constexpr Eigen::Index WINDOW = 16;
+
+/*!
+ * Fills in a system of linear equations from the distinct moments of a cluster.
  *
- * @param[in] x Position at which to evaluate the function.
- * @param[in] mean Mean of the Gaussian.
- * @param[in] prec Precision matrix, i.e. the invariance of the covariance matrix.
+ * @param[in] moments The sums of d^2 * x^i * y^j, for i + j <= 4.
+ * @param[in] values The sums of v * x^i * y^j, for i + j <= 2.
+ * @param[out] m The system matrix.
+ * @param[out] rhs The right-hand-side vector.
  */
 template <class T>
-T gaussian_like(const Vector2<T> &x, const Vector2<T> &mean, const Matrix2<T> &prec)
+void fill_system(const Matrix5<T> &moments,
+                 const Matrix3<T> &values,
+                 Matrix6<T> &m,
+                 Vector6<T> &rhs)
 {
-	const Vector2<T> vec = x - mean;
-	const T vtmv = vec.transpose() * prec * vec;
+	// The exponents of x and y in every monomial
+	constexpr std::array<std::array<Eigen::Index, 2>, 6> exponents {{
+		{2, 0},
+		{1, 1},
+		{0, 2},
+		{1, 0},
+		{0, 1},
+		{0, 0},
+	}};
+
+	for (usize r = 0; r < exponents.size(); r++) {
+		const auto [rx, ry] = exponents.at(r);
+
+		rhs(casts::to_eigen(r)) = values(rx, ry);
+
+		for (usize c = 0; c < exponents.size(); c++) {
+			const auto [cx, cy] = exponents.at(c);
+			m(casts::to_eigen(r), casts::to_eigen(c)) = moments(rx + cx, ry + cy);
+		}
+	}
 
-	return std::exp(-vtmv) / casts::to<T>(2);
+	// The exponent of the gaussian contains 2xy, so the second monomial is doubled
+	m.row(1) *= 2;
+	m.col(1) *= 2;
+	rhs(1) *= 2;
 }
 
+/*!
+ * Assembles the system of linear equations for fitting a gaussian to a cluster.
+ *
+ * The system consists of the weighted moments d^2 * x^i * y^j of the cluster, where every
+ * entry is the product of two of the monomials (x^2, 2xy, y^2, x, y, 1). Of the 36 entries,
+ * only 15 are distinct. Instead of summing up every entry for every pixel, the sums over
+ * x^i are calculated for a whole row at once, and then multiplied with y^j to update the
+ * distinct moments. The matrix is only filled in at the end.
+ *
+ * @param[out] m The system matrix.
+ * @param[out] rhs The right-hand-side vector.
+ * @param[in] b The bounds of the cluster.
+ * @param[in] data The heatmap.
+ * @param[in] w The weight of every pixel in the bounds.
+ * @param[in] columns The first and last column of every row of the bounds that is sampled.
+ * @param[in] ws Temporary storage for the sums, sized for the width of the heatmap.
+ */
 template <class T, class DerivedData>
+IPTSD_DISPATCH
 void assemble_system(Matrix6<T> &m,
                      Vector6<T> &rhs,
                      const Box &b,
                      const DenseBase<DerivedData> &data,
-                     const Matrix<T> &w)
+                     const Matrix<T> &w,
+                     const Image<Eigen::Index, Eigen::Dynamic, 2> &columns,
+                     Scratch<T> &ws)
 {
 	const Eigen::Index cols = data.cols();
 	const Eigen::Index rows = data.rows();
@@ -70,74 +224,208 @@ void assemble_system(Matrix6<T> &m,
 		casts::to<T>(2) / casts::to<T>(rows),
 	};
 
-	m.setZero();
-	rhs.setZero();
-
 	const Point &bmin = b.min();
 	const Point &bmax = b.max();
 
+	const Eigen::Index width = bmax.x() - bmin.x() + 1;
+
+	// The powers of the x coordinate of every column in the bounds
+	auto xs = ws.xs.leftCols(width);
+
+	for (Eigen::Index ix = 0; ix < width; ix++) {
+		const T x = casts::to<T>(bmin.x() + ix) * scale.x() - 1;
+
+		xs(0, ix) = 1;
+		xs(1, ix) = x;
+		xs(2, ix) = x * x;
+		xs(3, ix) = x * x * x;
+		xs(4, ix) = x * x * x * x;
+	}
+
+	// moments(i, j) is the sum of d^2 * x^i * y^j, values(i, j) the sum of v * x^i * y^j
+	Matrix5<T> moments = Matrix5<T>::Zero();
+	Matrix3<T> values = Matrix3<T>::Zero();
+
 	for (Eigen::Index iy = bmin.y(); iy <= bmax.y(); iy++) {
 		const T y = casts::to<T>(iy) * scale.y() - 1;
+		const std::array<T, 5> ys {1, y, y * y, y * y * y, y * y * y * y};
+
+		const Eigen::Index first = columns(iy - bmin.y(), 0);
+		const Eigen::Index count = columns(iy - bmin.y(), 1) - first + 1;
+		const Eigen::Index offset = first - bmin.x();
+
+		if (count <= 0)
+			continue;
+
+		const auto d = w.row(iy - bmin.y()).segment(offset, count).array() *
+		               data.derived().row(iy).segment(first, count).template cast<T>();
+
+		auto dd = ws.dd.head(count);
+		auto vv = ws.vv.head(count);
+
+		dd = d * d;
+		vv = (d + EPS<T>).log() * dd;
 
-		for (Eigen::Index ix = bmin.x(); ix <= bmax.x(); ix++) {
-			const T x = casts::to<T>(ix) * scale.x() - 1;
-
-			const T d =
-				w(iy - bmin.y(), ix - bmin.x()) * gsl::narrow_cast<T>(data(iy, ix));
-			const T v = std::log(d + EPS<T>) * d * d;
-
-			rhs(0) += v * x * x;
-			rhs(1) += v * x * y;
-			rhs(2) += v * y * y;
-			rhs(3) += v * x;
-			rhs(4) += v * y;
-			rhs(5) += v;
-
-			m(0, 0) += d * d * x * x * x * x;
-			m(0, 1) += d * d * x * x * x * y;
-			m(0, 2) += d * d * x * x * y * y;
-			m(0, 3) += d * d * x * x * x;
-			m(0, 4) += d * d * x * x * y;
-			m(0, 5) += d * d * x * x;
-
-			m(1, 0) += d * d * x * x * x * y;
-			m(1, 1) += d * d * x * x * y * y;
-			m(1, 2) += d * d * x * y * y * y;
-			m(1, 3) += d * d * x * x * y;
-			m(1, 4) += d * d * x * y * y;
-			m(1, 5) += d * d * x * y;
-
-			m(2, 0) += d * d * x * x * y * y;
-			m(2, 1) += d * d * x * y * y * y;
-			m(2, 2) += d * d * y * y * y * y;
-			m(2, 3) += d * d * x * y * y;
-			m(2, 4) += d * d * y * y * y;
-			m(2, 5) += d * d * y * y;
-
-			m(3, 0) += d * d * x * x * x;
-			m(3, 1) += d * d * x * x * y;
-			m(3, 2) += d * d * x * y * y;
-			m(3, 3) += d * d * x * x;
-			m(3, 4) += d * d * x * y;
-			m(3, 5) += d * d * x;
-
-			m(4, 0) += d * d * x * x * y;
-			m(4, 1) += d * d * x * y * y;
-			m(4, 2) += d * d * y * y * y;
-			m(4, 3) += d * d * x * y;
-			m(4, 4) += d * d * y * y;
-			m(4, 5) += d * d * y;
-
-			m(5, 0) += d * d * x * x;
-			m(5, 1) += d * d * x * y;
-			m(5, 2) += d * d * y * y;
-			m(5, 3) += d * d * x;
-			m(5, 4) += d * d * y;
-			m(5, 5) += d * d;
+		for (Eigen::Index i = 0; i < 5; i++) {
+			const T sum = (dd * xs.row(i).segment(offset, count)).sum();
+
+			for (Eigen::Index j = 0; j < 5 - i; j++)
+				moments(i, j) += sum * ys.at(casts::to_unsigned(j));
+		}
+
+		for (Eigen::Index i = 0; i < 3; i++) {
+			const T sum = (vv * xs.row(i).segment(offset, count)).sum();
+
+			for (Eigen::Index j = 0; j < 3 - i; j++)
+				values(i, j) += sum * ys.at(casts::to_unsigned(j));
 		}
 	}
 
-	m.row(1) *= 2;
+	impl::fill_system(moments, values, m, rhs);
+}
+
+/*!
+ * Assembles the systems of linear equations for fitting gaussians to multiple clusters.
+ *
+ * This calculates the same moments as @ref assemble_system, but for one cluster per SIMD
+ * lane. The clusters are padded to a common window, that is as large as the largest of
+ * them. Pixels of the window that are outside of a cluster, or that are not sampled, have
+ * a value of zero, so that they don't change its moments.
+ *
+ * @param[in] params The parameters of all clusters.
+ * @param[in] batch The indices of the clusters, at most one per lane. Their bounds must
+ *                  not be larger than @ref WINDOW.
+ * @param[in] data The heatmap.
+ * @param[out] systems The system matrix of every cluster.
+ * @param[out] rhs The right-hand-side vector of every cluster.
+ */
+template <class T, class DerivedData>
+IPTSD_DISPATCH
+void assemble_batch(const std::vector<Parameters<T>> &params,
+                    const gsl::span<const usize> batch,
+                    const DenseBase<DerivedData> &data,
+                    std::vector<Matrix6<T>> &systems,
+                    std::vector<Vector6<T>> &rhs)
+{
+	constexpr int lanes = LANES<T>;
+
+	const Eigen::Index cols = data.cols();
+	const Eigen::Index rows = data.rows();
+
+	const auto scale = Vector2<T> {
+		casts::to<T>(2) / casts::to<T>(cols),
+		casts::to<T>(2) / casts::to<T>(rows),
+	};
+
+	const Eigen::Index size = casts::to_eigen(batch.size());
+
+	const auto cluster = [&](const Eigen::Index l) -> const Parameters<T> & {
+		return params[batch[casts::to_unsigned(l)]];
+	};
+
+	Eigen::Index width = 0;
+	Eigen::Index height = 0;
+
+	for (Eigen::Index l = 0; l < size; l++) {
+		const Point sizes = cluster(l).bounds.sizes() + Point::Ones();
+
+		width = std::max(width, sizes.x());
+		height = std::max(height, sizes.y());
+	}
+
+	// The powers of the x coordinate of every column of the window, for every cluster
+	std::array<Image<T, 5, lanes>, WINDOW> xs {};
+
+	for (Eigen::Index ix = 0; ix < width; ix++) {
+		Image<T, 5, lanes> &powers = xs.at(casts::to_unsigned(ix));
+		powers.setZero();
+
+		for (Eigen::Index l = 0; l < size; l++) {
+			const T x = casts::to<T>(cluster(l).bounds.min().x() + ix) * scale.x() - 1;
+
+			powers(0, l) = 1;
+			powers(1, l) = x;
+			powers(2, l) = x * x;
+			powers(3, l) = x * x * x;
+			powers(4, l) = x * x * x * x;
+		}
+	}
+
+	// moments(i * 5 + j) is the sum of d^2 * x^i * y^j, values(i * 3 + j) of v * x^i * y^j
+	Image<T, 25, lanes> moments = Image<T, 25, lanes>::Zero();
+	Image<T, 9, lanes> values = Image<T, 9, lanes>::Zero();
+
+	for (Eigen::Index iy = 0; iy < height; iy++) {
+		Image<T, 5, lanes> ys = Image<T, 5, lanes>::Zero();
+
+		for (Eigen::Index l = 0; l < size; l++) {
+			const T y = casts::to<T>(cluster(l).bounds.min().y() + iy) * scale.y() - 1;
+
+			ys(0, l) = 1;
+			ys(1, l) = y;
+			ys(2, l) = y * y;
+			ys(3, l) = y * y * y;
+			ys(4, l) = y * y * y * y;
+		}
+
+		// The sums of the row over x^i
+		Image<T, 5, lanes> sd = Image<T, 5, lanes>::Zero();
+		Image<T, 3, lanes> sv = Image<T, 3, lanes>::Zero();
+
+		for (Eigen::Index ix = 0; ix < width; ix++) {
+			Array<T, lanes> d = Array<T, lanes>::Zero();
+
+			for (Eigen::Index l = 0; l < size; l++) {
+				const Parameters<T> &p = cluster(l);
+				const Point &bmin = p.bounds.min();
+
+				if (iy > p.bounds.max().y() - bmin.y())
+					continue;
+
+				const Eigen::Index first = p.columns(iy, 0) - bmin.x();
+				const Eigen::Index last = p.columns(iy, 1) - bmin.x();
+
+				if (ix < first || ix > last)
+					continue;
+
+				d(l) = p.weights(iy, ix) *
+				       casts::to<T>(data.derived()(bmin.y() + iy, bmin.x() + ix));
+			}
+
+			const Array<T, lanes> dd = d * d;
+			const Array<T, lanes> vv = (d + EPS<T>).log() * dd;
+
+			const Image<T, 5, lanes> &powers = xs.at(casts::to_unsigned(ix));
+
+			for (Eigen::Index i = 0; i < 5; i++)
+				sd.row(i) += dd * powers.row(i);
+
+			for (Eigen::Index i = 0; i < 3; i++)
+				sv.row(i) += vv * powers.row(i);
+		}
+
+		for (Eigen::Index i = 0; i < 5; i++) {
+			for (Eigen::Index j = 0; j < 5 - i; j++)
+				moments.row(i * 5 + j) += sd.row(i) * ys.row(j);
+		}
+
+		for (Eigen::Index i = 0; i < 3; i++) {
+			for (Eigen::Index j = 0; j < 3 - i; j++)
+				values.row(i * 3 + j) += sv.row(i) * ys.row(j);
+		}
+	}
+
+	for (Eigen::Index l = 0; l < size; l++) {
+		const usize j = batch[casts::to_unsigned(l)];
+
+		const auto mc = moments.col(l).matrix();
+		const auto vc = values.col(l).matrix();
+
+		const Matrix5<T> m = mc.template reshaped<Eigen::RowMajor>(5, 5);
+		const Matrix3<T> v = vc.template reshaped<Eigen::RowMajor>(3, 3);
+
+		impl::fill_system(m, v, systems[j], rhs[j]);
+	}
 }
 
 template <class T>
@@ -159,23 +447,41 @@ bool extract_params(const Vector6<T> &chi, T &scale, Vector2<T> &mean, Matrix2<T
 	return true;
 }
 
-template <class Derived>
-void update_weight_maps(std::vector<Parameters<typename DenseBase<Derived>::Scalar>> &params,
-                        DenseBase<Derived> &total)
+/*!
+ * Evaluates the gaussians in their bounds, and normalizes them by their sum.
+ *
+ * Only the sampled pixels in the bounds of a gaussian are evaluated, and the total is
+ * only cleared where it is used. Computing the weights and adding them up happens in a
+ * single pass over the rows of the bounds, using the vectorized exponential function of
+ * Eigen, whose error is within a few ULPs of std::exp.
+ *
+ * @param[in,out] params The gaussians whose weights are updated.
+ * @param[in] ws Temporary storage, sized for the heatmap.
+ */
+template <class T>
+IPTSD_DISPATCH
+void update_weight_maps(std::vector<Parameters<T>> &params, Workspace<T> &ws)
 {
-	using T = typename DenseBase<Derived>::Scalar;
-
-	const Eigen::Index cols = total.cols();
-	const Eigen::Index rows = total.rows();
+	const Eigen::Index cols = ws.total.cols();
+	const Eigen::Index rows = ws.total.rows();
 
 	const auto scale = Vector2<T> {
 		casts::to<T>(2) / casts::to<T>(cols),
 		casts::to<T>(2) / casts::to<T>(rows),
 	};
 
-	total.setZero();
+	// clear total in sample windows
+	for (const auto &p : params) {
+		if (!p.valid)
+			continue;
+
+		const Point bmin = p.bounds.min();
+		const Point size = p.bounds.sizes() + Point::Ones();
+
+		ws.total.block(bmin.y(), bmin.x(), size.y(), size.x()).setZero();
+	}
 
-	// compute individual Gaussians in sample windows
+	// compute individual Gaussians in sample windows and sum up total
 	for (auto &p : params) {
 		if (!p.valid)
 			continue;
@@ -183,19 +489,40 @@ void update_weight_maps(std::vector<Parameters<typename DenseBase<Derived>::Scal
 		const Point bmin = p.bounds.min();
 		const Point bmax = p.bounds.max();
 
+		const Eigen::Index width = bmax.x() - bmin.x() + 1;
+
+		// (x - mu)^T * prec * (x - mu) = a * dx^2 + b * dx * dy + c * dy^2
+		const T a = p.prec(0, 0);
+		const T b = p.prec(0, 1) + p.prec(1, 0);
+		const T c = p.prec(1, 1);
+
+		const T factor = p.scale / casts::to<T>(2);
+
+		auto dx = ws.scratch.front().dx.head(width);
+
+		for (Eigen::Index ix = 0; ix < width; ix++)
+			dx(ix) = casts::to<T>(bmin.x() + ix) * scale.x() - 1 - p.mean.x();
+
 		for (Eigen::Index iy = bmin.y(); iy <= bmax.y(); iy++) {
-			const T y = casts::to<T>(iy) * scale.y() - 1;
+			const T dy = casts::to<T>(iy) * scale.y() - 1 - p.mean.y();
 
-			for (Eigen::Index ix = bmin.x(); ix <= bmax.x(); ix++) {
-				const T x = casts::to<T>(ix) * scale.x() - 1;
+			const Eigen::Index first = p.columns(iy - bmin.y(), 0);
+			const Eigen::Index count = p.columns(iy - bmin.y(), 1) - first + 1;
 
-				const T v = p.scale * gaussian_like({x, y}, p.mean, p.prec);
-				p.weights(iy - bmin.y(), ix - bmin.x()) = v;
-			}
+			const Eigen::Index offset = first - bmin.x();
+
+			if (count <= 0)
+				continue;
+
+			const auto x = dx.segment(offset, count);
+			auto w = p.weights.row(iy - bmin.y()).segment(offset, count).array();
+
+			w = (-(x * (a * x + b * dy) + c * dy * dy)).exp() * factor;
+			ws.total.row(iy).segment(first, count) += w;
 		}
 	}
 
-	// sum up total
+	// normalize weights
 	for (auto &p : params) {
 		if (!p.valid)
 			continue;
@@ -203,45 +530,111 @@ void update_weight_maps(std::vector<Parameters<typename DenseBase<Derived>::Scal
 		const Point bmin = p.bounds.min();
 		const Point bmax = p.bounds.max();
 
-		for (Eigen::Index y = bmin.y(); y <= bmax.y(); y++) {
-			for (Eigen::Index x = bmin.x(); x <= bmax.x(); x++)
-				total(y, x) += p.weights(y - bmin.y(), x - bmin.x());
+		for (Eigen::Index iy = bmin.y(); iy <= bmax.y(); iy++) {
+			const Eigen::Index first = p.columns(iy - bmin.y(), 0);
+			const Eigen::Index count = p.columns(iy - bmin.y(), 1) - first + 1;
+
+			const Eigen::Index offset = first - bmin.x();
+
+			if (count <= 0)
+				continue;
+
+			const auto t = ws.total.row(iy).segment(first, count);
+			auto w = p.weights.row(iy - bmin.y()).segment(offset, count).array();
+
+			w = (t > casts::to<T>(0)).select(w / t, w);
 		}
 	}
+}
 
-	// normalize weights
-	for (auto &p : params) {
-		if (!p.valid)
-			continue;
+/*!
+ * Solves multiple symmetric systems of linear equations via LDL^T decomposition.
+ *
+ * Every system matrix is decomposed into A = L * D * L^T, where L is a lower triangular
+ * matrix with ones on the diagonal, and D is a diagonal matrix. Unlike Gaussian
+ * elimination, no pivoting is required, because the systems are positive definite.
+ *
+ * The systems are stored as structure of arrays: Every row holds one entry of the
+ * systems, and every column is one system. This way, all systems are solved together
+ * using SIMD instructions. Systems that are singular continue with a pivot of one, so
+ * that they don't produce invalid values, but are reported as unsolved.
+ *
+ * The systems are not copied, instead the matrices are overwritten with the decomposition.
+ *
+ * @param[in,out] a The symmetric system matrices A, in row-major order. Only the lower
+ *                  triangles are used.
+ * @param[in] b The right-hand-side vectors b.
+ * @param[out] x The vectors to solve for.
+ * @return Which of the systems could be solved.
+ */
+template <class T, int Lanes>
+IPTSD_DISPATCH
+Eigen::Array<bool, 1, Lanes> ldlt_solve(Image<T, 36, Lanes> &a,
+                                        const Image<T, 6, Lanes> &b,
+                                        Image<T, 6, Lanes> &x)
+{
+	constexpr Eigen::Index n = 6;
 
-		const Point bmin = p.bounds.min();
-		const Point bmax = p.bounds.max();
+	const auto at = [&](const Eigen::Index i, const Eigen::Index j) {
+		return a.row(i * n + j);
+	};
 
-		for (Eigen::Index y = bmin.y(); y <= bmax.y(); y++) {
-			for (Eigen::Index x = bmin.x(); x <= bmax.x(); x++) {
-				const T t = total(y, x);
+	Eigen::Array<bool, 1, Lanes> solved = Eigen::Array<bool, 1, Lanes>::Constant(true);
 
-				if (t > casts::to<T>(0))
-					p.weights(y - bmin.y(), x - bmin.x()) /= t;
-			}
+	// step 1: decomposition, L is stored below and D on the diagonal of the matrix
+	for (Eigen::Index k = 0; k < n; k++) {
+		// mark the system as unsolved if it is singular
+		solved = solved && (at(k, k).abs() > EPS<T>);
+		at(k, k) = solved.select(at(k, k), casts::to<T>(1));
+
+		const Array<T, Lanes> d = at(k, k);
+
+		for (Eigen::Index j = k + 1; j < n; j++) {
+			const Array<T, Lanes> ljk = at(j, k) / d;
+
+			// A[j:, j] = A[j:, j] - L[j, k] * D[k] * L[j:, k]
+			for (Eigen::Index i = j; i < n; i++)
+				at(i, j) -= at(i, k) * ljk;
+
+			at(j, k) = ljk;
 		}
 	}
+
+	// step 2: forward substitution, solve L * y = b
+	for (Eigen::Index i = 0; i < n; i++) {
+		x.row(i) = b.row(i);
+
+		for (Eigen::Index k = 0; k < i; k++)
+			x.row(i) -= at(i, k) * x.row(k);
+	}
+
+	// step 3: solve D * z = y
+	for (Eigen::Index i = 0; i < n; i++)
+		x.row(i) /= at(i, i);
+
+	// step 4: backwards substitution, solve L^T * x = z
+	for (Eigen::Index i = n - 1; i >= 0; i--) {
+		for (Eigen::Index k = i + 1; k < n; k++)
+			x.row(i) -= at(k, i) * x.row(k);
+	}
+
+	return solved;
 }
 
-/**
- * ge_solve() - Solve a system of linear equations via Gaussian elimination.
- * @a: The system matrix A.
- * @b: The right-hand-side vector b.
- * @x: The vector to solve for.
+/*!
+ * Solves a system of linear equations via Gaussian elimination with partial pivoting.
+ *
+ * This solves one system at a time, without SIMD instructions. It is the reference for
+ * @ref ldlt_solve, and is used when the fitting is verified.
  *
- * Solves the system of linear equations Ax = b using Gaussian elimination
- * with partial pivoting.
+ * @param[in] a The system matrix A.
+ * @param[in] b The right-hand-side vector b.
+ * @param[out] x The vector to solve for.
+ * @return Whether the system could be solved.
  */
 template <class T>
 bool ge_solve(Matrix6<T> a, Vector6<T> b, Vector6<T> &x)
 {
-	// TODO: optimize/unroll?
-
 	// step 1: Gaussian elimination
 	for (Eigen::Index c = 0; c < 6 - 1; ++c) {
 		// partial pivoting for current column:
@@ -291,38 +684,52 @@ bool ge_solve(Matrix6<T> a, Vector6<T> b, Vector6<T> &x)
 		return false;
 
 	// step 2: backwards substitution
-	x[5] = b[5];
-	x[5] /= a(5, 5);
+	for (Eigen::Index i = 5; i >= 0; i--) {
+		x[i] = b[i];
 
-	x[4] = b[4] - a(5, 4) * x[5];
-	x[4] /= a(4, 4);
+		for (Eigen::Index k = i + 1; k < 6; k++)
+			x[i] -= a(k, i) * x[k];
 
-	x[3] = b[3] - a(5, 3) * x[5] - a(4, 3) * x[4];
-	x[3] /= a(3, 3);
-
-	x[2] = b[2] - a(5, 2) * x[5] - a(4, 2) * x[4] - a(3, 2) * x[3];
-	x[2] /= a(2, 2);
-
-	x[1] = b[1] - a(5, 1) * x[5] - a(4, 1) * x[4] - a(3, 1) * x[3] - a(2, 1) * x[2];
-	x[1] /= a(1, 1);
-
-	x[0] = b[0] - a(5, 0) * x[5] - a(4, 0) * x[4] - a(3, 0) * x[3] - a(2, 0) * x[2] -
-	       a(1, 0) * x[1];
-	x[0] /= a(0, 0);
+		x[i] /= a(i, i);
+	}
 
 	return true;
 }
 
 } // namespace impl
 
-template <class Derived, class DerivedData>
-void fit(std::vector<Parameters<typename DenseBase<Derived>::Scalar>> &params,
+/*!
+ * Fits gaussians to the clusters of a heatmap.
+ *
+ * The systems of clusters that fit into @ref impl::WINDOW are assembled and solved in
+ * batches of @ref impl::LANES. Larger clusters are assembled on their own, but still
+ * solved together with the others.
+ *
+ * The fitting stops early once no gaussian changes significantly anymore. This is
+ * the case when all means moved by less than the tolerance (in pixels), and all
+ * precision matrices changed by less than the tolerance relative to their norm.
+ *
+ * @param[in,out] params The initial guess for every gaussian, and the fitted gaussians.
+ * @param[in] data The heatmap.
+ * @param[in] ws Temporary storage, sized for the heatmap.
+ * @param[in] iterations The maximum number of iterations.
+ * @param[in] tolerance How much the gaussians can change before they are converged.
+ *                      A value of 0 always runs all iterations.
+ * @param[in] pool The threads that assemble the systems, or null to use the calling thread.
+ *                 The workspace needs temporary storage for every thread of the pool.
+ * @param[in] reference Whether to assemble and solve every system on its own, without SIMD
+ *                      instructions.
+ */
+template <class T, class DerivedData>
+IPTSD_DISPATCH
+void fit(std::vector<Parameters<T>> &params,
          const DenseBase<DerivedData> &data,
-         DenseBase<Derived> &tmp,
-         const usize iterations)
+         Workspace<T> &ws,
+         const usize iterations,
+         const T tolerance,
+         common::ThreadPool *pool,
+         const bool reference = false)
 {
-	using T = typename DenseBase<Derived>::Scalar;
-
 	const Eigen::Index cols = data.cols();
 	const Eigen::Index rows = data.rows();
 
@@ -346,31 +753,161 @@ void fit(std::vector<Parameters<typename DenseBase<Derived>::Scalar>> &params,
 		p.prec.col(1) /= scale.y();
 	}
 
+	ws.reserve(params.size());
+
+	constexpr int lanes = impl::LANES<T>;
+
+	// The systems of up to one batch of parameters, as structure of arrays
+	Image<T, 36, lanes> sys {};
+	Image<T, 6, lanes> rhs {};
+	Image<T, 6, lanes> chi {};
+
+	std::array<Parameters<T> *, lanes> batch {};
+	Eigen::Index size = 0;
+
+	// Whether all parameters of the current iteration have converged
+	bool converged = true;
+
+	// Extracts the fitted gaussian from the solution of its system
+	const auto update = [&](Parameters<T> &p, const Vector6<T> &x) {
+		const Vector2<T> mean = p.mean;
+		const Matrix2<T> prec = p.prec;
+
+		// get parameters
+		p.valid = impl::extract_params(x, p.scale, p.mean, p.prec);
+		if (!p.valid)
+			return;
+
+		// check how far the gaussian has moved, in pixels
+		const T dmean = ((p.mean - mean).array() / scale.array()).abs().maxCoeff();
+		const T dprec = (p.prec - prec).norm();
+
+		if (!(dmean < tolerance && dprec < tolerance * prec.norm()))
+			converged = false;
+	};
+
+	const auto solve = [&]() {
+		const Matrix6<T> identity = Matrix6<T>::Identity();
+
+		// fill unused lanes with a system that can be solved
+		for (Eigen::Index l = size; l < lanes; l++) {
+			sys.col(l) = identity.template reshaped<Eigen::RowMajor>().array();
+			rhs.col(l).setZero();
+		}
+
+		const Eigen::Array<bool, 1, lanes> solved = impl::ldlt_solve(sys, rhs, chi);
+
+		for (Eigen::Index l = 0; l < size; l++) {
+			Parameters<T> &p = *batch.at(casts::to_unsigned(l));
+
+			p.valid = solved(l);
+			if (!p.valid)
+				continue;
+
+			update(p, chi.col(l));
+		}
+
+		size = 0;
+	};
+
 	// perform iterations
 	for (usize i = 0; i < iterations; ++i) {
+		converged = true;
+
 		// update weights
-		impl::update_weight_maps(params, tmp);
+		impl::update_weight_maps(params, ws);
 
-		// fit individual parameters
-		for (auto &p : params) {
-			Matrix6<T> sys {};
-			Vector6<T> rhs {};
-			Vector6<T> chi {};
+		ws.batched.clear();
+		ws.single.clear();
+
+		// small clusters are assembled in batches, one cluster per lane
+		for (usize j = 0; j < params.size(); j++) {
+			const Parameters<T> &p = params[j];
 
 			if (!p.valid)
 				continue;
 
-			// assemble system of linear equations
-			impl::assemble_system(sys, rhs, p.bounds, data, p.weights);
+			const Point sizes = p.bounds.sizes() + Point::Ones();
+			const bool small = (sizes.array() <= impl::WINDOW).all();
+
+			if (small && !reference)
+				ws.batched.push_back(j);
+			else
+				ws.single.push_back(j);
+		}
+
+		const usize lanes_used = casts::to_unsigned(lanes);
+		const usize batches = (ws.batched.size() + lanes_used - 1) / lanes_used;
+
+		// assemble systems of linear equations, they are independent of each other
+		const auto assemble = [&](const usize task, const usize thread) {
+			if (task < batches) {
+				const usize first = task * lanes_used;
+				const usize count = std::min(lanes_used, ws.batched.size() - first);
+
+				const gsl::span<const usize> batch {ws.batched};
+				impl::assemble_batch(params,
+				                     batch.subspan(first, count),
+				                     data,
+				                     ws.systems,
+				                     ws.rhs);
+				return;
+			}
+
+			const usize j = ws.single[task - batches];
+			const Parameters<T> &p = params[j];
+
+			impl::assemble_system(ws.systems[j],
+			                      ws.rhs[j],
+			                      p.bounds,
+			                      data,
+			                      p.weights,
+			                      p.columns,
+			                      ws.scratch[thread]);
+		};
+
+		const usize tasks = batches + ws.single.size();
+
+		if (pool != nullptr) {
+			pool->run(tasks, assemble);
+		} else {
+			for (usize task = 0; task < tasks; task++)
+				assemble(task, 0);
+		}
+
+		// fit individual parameters
+		for (usize j = 0; j < params.size(); j++) {
+			Parameters<T> &p = params[j];
 
-			// solve systems
-			p.valid = impl::ge_solve(sys, rhs, chi);
 			if (!p.valid)
 				continue;
 
-			// get parameters
-			p.valid = impl::extract_params(chi, p.scale, p.mean, p.prec);
+			if (reference) {
+				Vector6<T> x {};
+
+				p.valid = impl::ge_solve(ws.systems[j], ws.rhs[j], x);
+				if (p.valid)
+					update(p, x);
+
+				continue;
+			}
+
+			sys.col(size) = ws.systems[j].template reshaped<Eigen::RowMajor>().array();
+			rhs.col(size) = ws.rhs[j];
+
+			batch.at(casts::to_unsigned(size)) = &p;
+			size++;
+
+			// solve the systems once all lanes are used
+			if (size == lanes)
+				solve();
 		}
+
+		if (size > 0)
+			solve();
+
+		if (converged)
+			break;
 	}
 
 	// undo down-scaling
@@ -49,6 +49,39 @@ Matrix<T, Rows, Cols> gaussian(const T sigma)
 	return kernel;
 }
 
+/*!
+ * Generates one dimension of a gaussian kernel.
+ *
+ * The product of a column and a row vector generated by this is the same as the two
+ * dimensional gaussian kernel, which can be used to run a separable convolution.
+ *
+ * @tparam Size How many elements the kernel will have.
+ * @param[in] sigma The strength of the kernel.
+ * @return A gaussian kernel with the given size and strength.
+ */
+template <class T, int Size>
+Vector<T, Size> gaussian(const T sigma)
+{
+	static_assert(Size % 2 == 1);
+
+	T sum {};
+	Vector<T, Size> kernel {};
+
+	const Eigen::Index size = kernel.size();
+
+	for (Eigen::Index i = 0; i < size; i++) {
+		const T v = casts::to<T>(i) - casts::to<T>(size - 1) / casts::to<T>(2);
+		const T val = std::exp(gsl::narrow_cast<T>(-0.5) * (v / sigma) * (v / sigma));
+
+		kernel(i) = val;
+		sum += val;
+	}
+
+	kernel.array() /= sum;
+
+	return kernel;
+}
+
 } // namespace iptsd::contacts::detection::kernels
 
 #endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_KERNELS_HPP
@@ -3,90 +3,287 @@
 #ifndef IPTSD_CONTACTS_DETECTION_ALGORITHMS_MAXIMAS_HPP
 #define IPTSD_CONTACTS_DETECTION_ALGORITHMS_MAXIMAS_HPP
 
+#include <common/casts.hpp>
+#include <common/dispatch.hpp>
 #include <common/types.hpp>
 
 #include <vector>
 
 namespace iptsd::contacts::detection::maximas {
 
+/*
+ * We use the following kernel to compare entries:
+ *
+ *   [< ] [< ] [<=]
+ *   [< ] [  ] [<=]
+ *   [< ] [<=] [<=]
+ *
+ * Half of the entries use "less or equal", the other half "less than" as
+ * operators to ensure that we don't either discard any local maximas or
+ * report some multiple times.
+ */
+
+namespace impl {
+
 /*!
- * Searches for all local maxima in the given data.
+ * Checks whether a pixel is a local maximum, taking the borders of the data into account.
  *
  * @param[in] data The data to process.
- * @param[in] threshold Only return local maxima whose value is above this threshold.
- * @param[out] maximas A reference to the vector where the found points will be stored.
+ * @param[in] threshold Only local maxima whose value is above this threshold are accepted.
+ * @param[in] y The row of the pixel.
+ * @param[in] x The column of the pixel.
+ * @return Whether the pixel is a local maximum.
  */
 template <class Derived>
-void find(const DenseBase<Derived> &data,
-          typename DenseBase<Derived>::Scalar threshold,
-          std::vector<Point> &maximas)
+bool is_maximum(const DenseBase<Derived> &data,
+                const typename DenseBase<Derived>::Scalar threshold,
+                const Eigen::Index y,
+                const Eigen::Index x)
 {
 	using T = typename DenseBase<Derived>::Scalar;
 
-	/*
-	 * We use the following kernel to compare entries:
-	 *
-	 *   [< ] [< ] [< ]
-	 *   [< ] [  ] [<=]
-	 *   [<=] [<=] [<=]
-	 *
-	 * Half of the entries use "less or equal", the other half "less than" as
-	 * operators to ensure that we don't either discard any local maximas or
-	 * report some multiple times.
-	 */
-
 	const Eigen::Index cols = data.cols();
 	const Eigen::Index rows = data.rows();
 
-	maximas.clear();
+	const T value = data(y, x);
+
+	if (value <= threshold)
+		return false;
+
+	bool max = true;
+
+	const bool can_up = y > 0;
+	const bool can_down = y < rows - 1;
+	const bool can_left = x > 0;
+	const bool can_right = x < cols - 1;
+
+	if (can_left)
+		max &= data(y, x - 1) < value;
+
+	if (can_right)
+		max &= data(y, x + 1) <= value;
+
+	if (can_up) {
+		max &= data(y - 1, x) < value;
+
+		if (can_left)
+			max &= data(y - 1, x - 1) < value;
+
+		if (can_right)
+			max &= data(y - 1, x + 1) <= value;
+	}
+
+	if (can_down) {
+		max &= data(y + 1, x) <= value;
+
+		if (can_left)
+			max &= data(y + 1, x - 1) < value;
+
+		if (can_right)
+			max &= data(y + 1, x + 1) <= value;
+	}
+
+	return max;
+}
+
+/*!
+ * Checks whether a pixel that is not on the border of the data is a local maximum.
+ *
+ * This is the same as @ref is_maximum, but without any branches, so that the compiler
+ * can check multiple pixels at once.
+ *
+ * @param[in] data The data to process.
+ * @param[in] threshold Only local maxima whose value is above this threshold are accepted.
+ * @param[in] y The row of the pixel.
+ * @param[in] x The column of the pixel.
+ * @return Whether the pixel is a local maximum.
+ */
+template <class Derived>
+bool is_interior_maximum(const DenseBase<Derived> &data,
+                         const typename DenseBase<Derived>::Scalar threshold,
+                         const Eigen::Index y,
+                         const Eigen::Index x)
+{
+	using T = typename DenseBase<Derived>::Scalar;
+
+	const T value = data(y, x);
+
+	// clang-format off
+
+	return (value > threshold) &
+	       (data(y - 1, x - 1) <  value) &
+	       (data(y - 1, x + 0) <  value) &
+	       (data(y - 1, x + 1) <= value) &
+	       (data(y + 0, x - 1) <  value) &
+	       (data(y + 0, x + 1) <= value) &
+	       (data(y + 1, x - 1) <  value) &
+	       (data(y + 1, x + 0) <= value) &
+	       (data(y + 1, x + 1) <= value);
+
+	// clang-format on
+}
+
+/*!
+ * Searches for local maxima in a row of the data, checking every pixel separately.
+ *
+ * @param[in] data The data to process.
+ * @param[in] threshold Only return local maxima whose value is above this threshold.
+ * @param[in] y The row to search.
+ * @param[out] maximas A reference to the vector where the found points will be stored.
+ */
+template <class Derived>
+void find_border(const DenseBase<Derived> &data,
+                 const typename DenseBase<Derived>::Scalar threshold,
+                 const Eigen::Index y,
+                 std::vector<Point> &maximas)
+{
+	const Eigen::Index cols = data.cols();
+
+	for (Eigen::Index x = 0; x < cols; x++) {
+		if (is_maximum(data, threshold, y, x))
+			maximas.emplace_back(x, y);
+	}
+}
 
-	for (Eigen::Index y = 0; y < rows; y++) {
-		const bool can_up = y > 0;
-		const bool can_down = y < rows - 1;
+/*!
+ * Searches for local maxima in a row of the data that is not the first or the last row.
+ *
+ * The pixels between the first and the last column are checked in groups. Groups without
+ * any pixels above the threshold are skipped, for the others a mask of the local maxima
+ * in the group is built without branches. Only if the mask is not empty, the pixels have
+ * to be looked at separately.
+ *
+ * @param[in] data The data to process.
+ * @param[in] threshold Only return local maxima whose value is above this threshold.
+ * @param[in] y The row to search.
+ * @param[out] maximas A reference to the vector where the found points will be stored.
+ */
+template <class Derived>
+void find_interior(const DenseBase<Derived> &data,
+                   const typename DenseBase<Derived>::Scalar threshold,
+                   const Eigen::Index y,
+                   std::vector<Point> &maximas)
+{
+	constexpr Eigen::Index lanes = 8;
 
-		for (Eigen::Index x = 0; x < cols; x++) {
-			const T value = data(y, x);
+	const Eigen::Index cols = data.cols();
 
-			if (value <= threshold)
-				continue;
+	// Most rows have no pixels above the threshold and can be skipped entirely.
+	if (data.row(y).maxCoeff() <= threshold)
+		return;
 
-			bool max = true;
+	if (is_maximum(data, threshold, y, 0))
+		maximas.emplace_back(0, y);
 
-			const bool can_left = x > 0;
-			const bool can_right = x < cols - 1;
+	Eigen::Index x = 1;
 
-			if (can_left)
-				max &= data(y, x - 1) < value;
+	for (; x + lanes <= cols - 1; x += lanes) {
+		// Groups of pixels below the threshold can be skipped quickly.
+		if (data.row(y).template segment<lanes>(x).maxCoeff() <= threshold)
+			continue;
 
-			if (can_right)
-				max &= data(y, x + 1) <= value;
+		u32 mask = 0;
 
-			if (can_up) {
-				max &= data(y - 1, x) < value;
+		for (Eigen::Index i = 0; i < lanes; i++) {
+			const auto bit = casts::to<u32>(is_interior_maximum(data, threshold, y, x + i));
+			mask |= bit << casts::to<u32>(i);
+		}
+
+		if (mask == 0)
+			continue;
+
+		for (Eigen::Index i = 0; i < lanes; i++) {
+			if ((mask & (1U << casts::to<u32>(i))) != 0)
+				maximas.emplace_back(x + i, y);
+		}
+	}
 
-				if (can_left)
-					max &= data(y - 1, x - 1) < value;
+	for (; x < cols - 1; x++) {
+		if (is_interior_maximum(data, threshold, y, x))
+			maximas.emplace_back(x, y);
+	}
 
-				if (can_right)
-					max &= data(y - 1, x + 1) <= value;
-			}
+	if (is_maximum(data, threshold, y, cols - 1))
+		maximas.emplace_back(cols - 1, y);
+}
 
-			if (can_down) {
-				max &= data(y + 1, x) <= value;
+} // namespace impl
 
-				if (can_left)
-					max &= data(y + 1, x - 1) < value;
+/*!
+ * Searches for local maxima in a single row of the data.
+ *
+ * This only needs the row itself and the rows above and below it.
+ *
+ * @param[in] data The data to process.
+ * @param[in] threshold Only return local maxima whose value is above this threshold.
+ * @param[in] y The row to search.
+ * @param[out] maximas A reference to the vector where the found points will be appended.
+ */
+template <class Derived>
+IPTSD_DISPATCH
+void find_row(const DenseBase<Derived> &data,
+              typename DenseBase<Derived>::Scalar threshold,
+              const Eigen::Index y,
+              std::vector<Point> &maximas)
+{
+	const Eigen::Index cols = data.cols();
+	const Eigen::Index rows = data.rows();
 
-				if (can_right)
-					max &= data(y + 1, x + 1) <= value;
-			}
+	// Without an interior, every pixel is on the border.
+	if (y == 0 || y == rows - 1 || cols < 3)
+		impl::find_border(data, threshold, y, maximas);
+	else
+		impl::find_interior(data, threshold, y, maximas);
+}
 
-			if (max)
+/*!
+ * Searches for local maxima in a block of the data.
+ *
+ * The pixels are checked one by one, so this is meant for small blocks.
+ *
+ * @param[in] data The data to process.
+ * @param[in] threshold Only return local maxima whose value is above this threshold.
+ * @param[in] block The pixels to search.
+ * @param[out] maximas A reference to the vector where the found points will be appended.
+ */
+template <class Derived>
+IPTSD_DISPATCH
+void find_block(const DenseBase<Derived> &data,
+                typename DenseBase<Derived>::Scalar threshold,
+                const Box &block,
+                std::vector<Point> &maximas)
+{
+	for (Eigen::Index y = block.min().y(); y <= block.max().y(); y++) {
+		for (Eigen::Index x = block.min().x(); x <= block.max().x(); x++) {
+			if (impl::is_maximum(data, threshold, y, x))
 				maximas.emplace_back(x, y);
 		}
 	}
 }
 
+/*!
+ * Searches for all local maxima in the given data.
+ *
+ * The points are stored in row-major order.
+ *
+ * @param[in] data The data to process.
+ * @param[in] threshold Only return local maxima whose value is above this threshold.
+ * @param[out] maximas A reference to the vector where the found points will be stored.
+ */
+template <class Derived>
+IPTSD_DISPATCH
+void find(const DenseBase<Derived> &data,
+          typename DenseBase<Derived>::Scalar threshold,
+          std::vector<Point> &maximas)
+{
+	const Eigen::Index rows = data.rows();
+
+	maximas.clear();
+
+	for (Eigen::Index y = 0; y < rows; y++)
+		find_row(data, threshold, y, maximas);
+}
+
 } // namespace iptsd::contacts::detection::maximas
 
 #endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_MAXIMAS_HPP
@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CONTACTS_DETECTION_ALGORITHMS_MOMENTS_HPP
+#define IPTSD_CONTACTS_DETECTION_ALGORITHMS_MOMENTS_HPP
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <gsl/gsl>
+
+namespace iptsd::contacts::detection::moments {
+
+/*!
+ * Calculates the mean and covariance of the pixels in a part of an image.
+ *
+ * Every pixel is weighted by its value, so for a cluster that contains a single gaussian,
+ * this approximates the gaussian in one pass, without fitting it. The pixels outside of the
+ * bounds are not included, so the covariance is usually smaller than that of the gaussian.
+ *
+ * @param[in] image The image whose pixels are used.
+ * @param[in] bounds The pixels of the image that are used.
+ * @param[out] mean The weighted mean of the pixel positions.
+ * @param[out] cov The weighted covariance of the pixel positions.
+ * @return Whether the pixels have a positive weight, and the outputs are valid.
+ */
+template <class T, class Derived>
+bool calculate(const DenseBase<Derived> &image,
+               const Box &bounds,
+               Vector2<T> &mean,
+               Matrix2<T> &cov)
+{
+	const Point bmin = bounds.min();
+	const Point bmax = bounds.max();
+
+	T sum = 0;
+	T sx = 0;
+	T sy = 0;
+	T sxx = 0;
+	T sxy = 0;
+	T syy = 0;
+
+	// The positions are relative to the corner of the bounds, to keep the sums small
+	for (Eigen::Index x = bmin.x(); x <= bmax.x(); x++) {
+		const T dx = casts::to<T>(x - bmin.x());
+
+		for (Eigen::Index y = bmin.y(); y <= bmax.y(); y++) {
+			const T dy = casts::to<T>(y - bmin.y());
+			const T w = gsl::narrow_cast<T>(image.coeff(y, x));
+
+			sum += w;
+			sx += w * dx;
+			sy += w * dy;
+			sxx += w * dx * dx;
+			sxy += w * dx * dy;
+			syy += w * dy * dy;
+		}
+	}
+
+	if (sum <= 0)
+		return false;
+
+	const T mx = sx / sum;
+	const T my = sy / sum;
+
+	mean = Vector2<T> {casts::to<T>(bmin.x()) + mx, casts::to<T>(bmin.y()) + my};
+
+	cov(0, 0) = sxx / sum - mx * mx;
+	cov(0, 1) = sxy / sum - mx * my;
+	cov(1, 0) = cov(0, 1);
+	cov(1, 1) = syy / sum - my * my;
+
+	return true;
+}
+
+} // namespace iptsd::contacts::detection::moments
+
+#endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_MOMENTS_HPP
@@ -5,9 +5,17 @@
 
 #include "errors.hpp"
 
+#include <common/casts.hpp>
 #include <common/error.hpp>
 #include <common/types.hpp>
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <type_traits>
+#include <vector>
+
 namespace iptsd::contacts::detection::neutral {
 
 namespace impl {
@@ -46,6 +54,159 @@ typename DenseBase<Derived>::Scalar statistical_mode(const DenseBase<Derived> &d
 	return max_element;
 }
 
+/*!
+ * Calculates a percentile of a data set.
+ *
+ * @param[in] data: The input data set.
+ * @param[in] percentile: The percentile to calculate (Range 0 - 1).
+ * @param[out] values: Temporary storage for sorting the data set.
+ * @return The value below which the given fraction of the data set lies.
+ */
+template <class Derived>
+typename DenseBase<Derived>::Scalar
+percentile(const DenseBase<Derived> &data,
+           const f64 percentile,
+           std::vector<typename DenseBase<Derived>::Scalar> &values)
+{
+	const Eigen::Index size = data.size();
+
+	values.resize(casts::to_unsigned(size));
+
+	for (Eigen::Index i = 0; i < size; i++)
+		values[casts::to_unsigned(i)] = data.coeff(i);
+
+	const auto rank = casts::to<usize>(std::floor(percentile * casts::to<f64>(size - 1)));
+	const auto nth = values.begin() + casts::to_signed(rank);
+
+	std::nth_element(values.begin(), nth, values.end());
+	return *nth;
+}
+
+/*!
+ * Counts how often each value occurs in a data set of bytes.
+ *
+ * The bytes are counted into multiple interleaved histograms that are merged at the end.
+ * Consecutive equal bytes (which are very common in a heatmap without contacts) then
+ * increment different counters, so that the increments don't have to wait for each other.
+ *
+ * @param[in] data: The input data set.
+ * @param[out] counts: How often each value occurs in the data set.
+ */
+template <class Derived>
+void histogram(const DenseBase<Derived> &data, std::array<u32, 256> &counts)
+{
+	static_assert(std::is_same_v<typename DenseBase<Derived>::Scalar, u8>);
+
+	constexpr Eigen::Index lanes = 4;
+
+	std::array<std::array<u32, 256>, lanes> partial {};
+
+	const Eigen::Index size = data.size();
+	const Eigen::Index end = size - (size % lanes);
+
+	for (Eigen::Index i = 0; i < end; i += lanes) {
+		partial[0][data.coeff(i + 0)]++;
+		partial[1][data.coeff(i + 1)]++;
+		partial[2][data.coeff(i + 2)]++;
+		partial[3][data.coeff(i + 3)]++;
+	}
+
+	for (Eigen::Index i = end; i < size; i++)
+		partial[0][data.coeff(i)]++;
+
+	for (usize i = 0; i < counts.size(); i++)
+		counts[i] = partial[0][i] + partial[1][i] + partial[2][i] + partial[3][i];
+}
+
+/*!
+ * Finds the most common byte in a histogram.
+ *
+ * If multiple bytes are equally common, the one that reaches that count first when going
+ * through the data set row by row is returned, like in @ref statistical_mode. This only
+ * needs a second pass over the data set if there is a tie.
+ *
+ * @param[in] data: The data set that the histogram was built from.
+ * @param[in] counts: How often each value occurs in the data set.
+ * @return The statistical mode of the data set.
+ */
+template <class Derived>
+u8 histogram_mode(const DenseBase<Derived> &data, const std::array<u32, 256> &counts)
+{
+	usize max_element = 0;
+	usize ties = 0;
+
+	for (usize i = 1; i < counts.size(); i++) {
+		if (counts[i] > counts[max_element]) {
+			max_element = i;
+			ties = 0;
+		} else if (counts[i] == counts[max_element]) {
+			ties++;
+		}
+	}
+
+	if (ties == 0)
+		return casts::to<u8>(max_element);
+
+	const u32 max_count = counts[max_element];
+
+	std::array<u32, 256> seen {};
+
+	for (Eigen::Index y = 0; y < data.rows(); y++) {
+		for (Eigen::Index x = 0; x < data.cols(); x++) {
+			const u8 value = data(y, x);
+
+			if (++seen[value] == max_count)
+				return value;
+		}
+	}
+
+	return casts::to<u8>(max_element);
+}
+
+/*!
+ * Finds the byte at a percentile of a histogram.
+ *
+ * The bytes are mapped to values by a table, which has to be monotonic.
+ * The percentile refers to the mapped values, not to the bytes.
+ *
+ * @param[in] counts: How often each value occurs in the data set.
+ * @param[in] lut: The value of each byte.
+ * @param[in] percentile: The percentile to calculate (Range 0 - 1).
+ * @return The byte whose value is at the given percentile of the data set.
+ */
+template <class T>
+u8 histogram_percentile(const std::array<u32, 256> &counts,
+                        const std::array<T, 256> &lut,
+                        const f64 percentile)
+{
+	u64 size = 0;
+
+	for (const u32 count : counts)
+		size += count;
+
+	if (size == 0)
+		return 0;
+
+	// Same rank as in the generic implementation
+	const auto rank = casts::to<u64>(std::floor(percentile * casts::to<f64>(size - 1)));
+
+	// If the table is decreasing, the smallest value belongs to the largest byte.
+	const bool ascending = lut.front() <= lut.back();
+
+	u64 seen = 0;
+
+	for (usize i = 0; i < counts.size(); i++) {
+		const usize byte = ascending ? i : counts.size() - 1 - i;
+
+		seen += counts[byte];
+
+		if (seen > rank)
+			return casts::to<u8>(byte);
+	}
+
+	return ascending ? 255 : 0;
+}
+
 } // namespace impl
 
 /*
@@ -60,8 +221,35 @@ enum class Algorithm : u8 {
 
 	// A constant value will be used.
 	CONSTANT,
+
+	// A percentile of all elements (e.g. the median) will be used.
+	PERCENTILE,
+
+	// A running estimate for every pixel will be used, see @ref track_baseline.
+	BASELINE,
 };
 
+/*!
+ * Subtracts the estimated neutral value from a pixel and updates the estimate.
+ *
+ * The estimate is an exponential moving average of the pixel. It is only updated while
+ * the pixel is close to the estimate, so that contacts are not absorbed into it.
+ *
+ * @param[in] value: The value of the pixel.
+ * @param[in,out] baseline: The estimated neutral value of the pixel.
+ * @param[in] threshold: How far the pixel can be above the estimate while it is updated.
+ * @param[in] smoothing: How fast the estimate follows the pixel (Range 0 - 1).
+ * @return The value of the pixel with the previous estimate subtracted.
+ */
+template <class T>
+T track_baseline(const T value, T &baseline, const T threshold, const T smoothing)
+{
+	const T delta = value - baseline;
+
+	baseline += delta < threshold ? smoothing * delta : casts::to<T>(0);
+	return delta;
+}
+
 /*!
  * Calculates the neutral value of a heatmap.
  *
@@ -71,12 +259,17 @@ enum class Algorithm : u8 {
  * @param[in] heatmap: The input heatmap.
  * @param[in] algorithm: The algorithm to use for calculating the neutral value.
  * @param[in] offset: The offset to add to the calculated value.
+ * @param[in] percentile: The percentile to use if algorithm is PERCENTILE (Range 0 - 1).
+ * @param[out] values: Temporary storage for calculating a percentile.
  * @return The neutral value of all values in the heatmap.
  */
 template <class Derived>
-typename DenseBase<Derived>::Scalar calculate(const DenseBase<Derived> &heatmap,
-                                              const Algorithm algorithm,
-                                              const typename DenseBase<Derived>::Scalar offset)
+typename DenseBase<Derived>::Scalar
+calculate(const DenseBase<Derived> &heatmap,
+          const Algorithm algorithm,
+          const typename DenseBase<Derived>::Scalar offset,
+          const f64 percentile,
+          std::vector<typename DenseBase<Derived>::Scalar> &values)
 {
 	switch (algorithm) {
 	case Algorithm::MODE:
@@ -85,6 +278,53 @@ typename DenseBase<Derived>::Scalar calculate(const DenseBase<Derived> &heatmap,
 		return heatmap.mean() + offset;
 	case Algorithm::CONSTANT:
 		return offset;
+	case Algorithm::PERCENTILE:
+		return impl::percentile(heatmap, percentile, values) + offset;
+	default:
+		throw common::Error<Error::InvalidNeutralMode> {};
+	}
+}
+
+/*!
+ * Calculates the neutral value of a heatmap of bytes that are mapped to values by a table.
+ *
+ * Instead of looking at every value, this builds a histogram of the raw bytes and derives
+ * the neutral value from it. This needs no allocations and is cheap enough to run for
+ * every frame. The table has to be monotonic.
+ *
+ * @param[in] heatmap: The input heatmap.
+ * @param[in] lut: The value of each byte.
+ * @param[in] algorithm: The algorithm to use for calculating the neutral value.
+ * @param[in] offset: The offset to add to the calculated value.
+ * @param[in] percentile: The percentile to use if algorithm is PERCENTILE (Range 0 - 1).
+ * @return The neutral value of all mapped values in the heatmap.
+ */
+template <class Derived, class T>
+T calculate(const DenseBase<Derived> &heatmap,
+            const std::array<T, 256> &lut,
+            const Algorithm algorithm,
+            const T offset,
+            const f64 percentile)
+{
+	if (algorithm == Algorithm::CONSTANT)
+		return offset;
+
+	std::array<u32, 256> counts {};
+	impl::histogram(heatmap, counts);
+
+	switch (algorithm) {
+	case Algorithm::MODE:
+		return lut.at(impl::histogram_mode(heatmap, counts)) + offset;
+	case Algorithm::PERCENTILE:
+		return lut.at(impl::histogram_percentile(counts, lut, percentile)) + offset;
+	case Algorithm::AVERAGE: {
+		T sum = casts::to<T>(0);
+
+		for (usize i = 0; i < counts.size(); i++)
+			sum += casts::to<T>(counts.at(i)) * lut.at(i);
+
+		return sum / casts::to<T>(heatmap.size()) + offset;
+	}
 	default:
 		throw common::Error<Error::InvalidNeutralMode> {};
 	}
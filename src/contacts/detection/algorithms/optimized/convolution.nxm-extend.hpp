@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <common/buildopts.hpp>
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <algorithm>
+#include <array>
+#include <type_traits>
+
+namespace iptsd::contacts::detection::convolution::impl {
+
+/*!
+ * Runs a 2D convolution of a matrix and a kernel.
+ *
+ * This is the optimized implementation for kernels with an odd size that is known at
+ * compile time. Pixels are computed in groups that fill multiple SIMD registers, which stay
+ * in the registers until all elements of the kernel have been applied. The borders are
+ * extended by clamping the indices. For groups that touch the left or right border, the
+ * extended rows are copied into a small buffer first, so that the indices don't have to be
+ * clamped for every element of the kernel.
+ *
+ * Only the pixels of a region of the output are calculated. The groups are always aligned
+ * the same way, so every pixel has the same value, no matter which region it was part of.
+ *
+ * Do not call this directly, use @ref iptsd::contacts::detection::convolution::run(),
+ * @ref iptsd::contacts::detection::convolution::run_rows() or
+ * @ref iptsd::contacts::detection::convolution::run_block().
+ *
+ * @tparam KRows The height of the kernel.
+ * @tparam KCols The width of the kernel.
+ * @param[in] in The input data.
+ * @param[in] kernel The kernel that is applied to the input data.
+ * @param[out] out A reference to the matrix where the results of the convolution are stored.
+ * @param[in] region The pixels of the output that are calculated.
+ */
+template <int KRows, int KCols, class DerivedData, class DerivedKernel>
+inline void run_nxm(const DenseBase<DerivedData> &in,
+                    const DenseBase<DerivedKernel> &kernel,
+                    DenseBase<DerivedData> &out,
+                    const Box &region)
+{
+	static_assert(KRows % 2 == 1);
+	static_assert(KCols % 2 == 1);
+
+	using T = typename DenseBase<DerivedData>::Scalar;
+	using S = typename DenseBase<DerivedKernel>::Scalar;
+
+	constexpr Eigen::Index dy = KRows / 2;
+	constexpr Eigen::Index dx = KCols / 2;
+
+	const Eigen::Index cols = in.cols();
+	const Eigen::Index rows = in.rows();
+
+	const Point rmin = region.min();
+	const Point rmax = region.max();
+
+	// access helpers
+	const auto k = [&](const Eigen::Index y, const Eigen::Index x) -> S {
+		if constexpr (common::buildopts::ForceAccessChecks) {
+			return kernel(y, x);
+		} else {
+			return kernel.coeff(y, x);
+		}
+	};
+
+	const auto d = [&](const Eigen::Index y, const Eigen::Index x) -> T {
+		const Eigen::Index cy = std::clamp(y, Eigen::Index {0}, rows - 1);
+		const Eigen::Index cx = std::clamp(x, Eigen::Index {0}, cols - 1);
+
+		if constexpr (common::buildopts::ForceAccessChecks) {
+			return in(cy, cx);
+		} else {
+			return in.coeff(cy, cx);
+		}
+	};
+
+	const auto extended = [&](const Eigen::Index y, const Eigen::Index x) {
+		auto v = casts::to<T>(0);
+
+		for (Eigen::Index ky = 0; ky < KRows; ky++) {
+			for (Eigen::Index kx = 0; kx < KCols; kx++)
+				v += d(y + ky - dy, x + kx - dx) * k(ky, kx);
+		}
+
+		out(y, x) = v;
+	};
+
+	// How many pixels are computed at once
+	constexpr Eigen::Index lanes = std::is_same_v<T, f32> ? 16 : 8;
+
+	// Rows that are too narrow for a single group are processed pixel by pixel
+	if (cols < lanes) {
+		for (Eigen::Index y = rmin.y(); y <= rmax.y(); y++) {
+			for (Eigen::Index x = rmin.x(); x <= rmax.x(); x++)
+				extended(y, x);
+		}
+
+		return;
+	}
+
+	// The rows of the data that are used for the current row of the output
+	std::array<Eigen::Index, KRows> iy {};
+
+	// The rows of the data around a group of pixels at the border, extended by clamping
+	std::array<Array<T, lanes + KCols - 1>, KRows> strips {};
+
+	// A group of pixels that only needs data from inside the matrix
+	const auto inner = [&](const Eigen::Index y, const Eigen::Index x) {
+		Array<T, lanes> v = Array<T, lanes>::Zero();
+
+		for (usize i = 0; i < KRows; i++) {
+			const Eigen::Index ky = casts::to_eigen(i);
+			const auto row = in.derived().row(iy[i]);
+
+			for (Eigen::Index kx = 0; kx < KCols; kx++)
+				v += row.template segment<lanes>(x + kx - dx) * k(ky, kx);
+		}
+
+		out.derived().row(y).template segment<lanes>(x) = v;
+	};
+
+	// A group of pixels that touches the left or right border
+	const auto border = [&](const Eigen::Index y, const Eigen::Index x) {
+		Array<T, lanes> v = Array<T, lanes>::Zero();
+
+		for (usize i = 0; i < KRows; i++) {
+			const Eigen::Index ky = casts::to_eigen(i);
+			const auto row = in.derived().row(iy[i]);
+
+			for (Eigen::Index j = 0; j < lanes + KCols - 1; j++) {
+				const Eigen::Index ix = std::clamp(x + j - dx, Eigen::Index {0}, cols - 1);
+				strips[i](j) = row.coeff(ix);
+			}
+
+			for (Eigen::Index kx = 0; kx < KCols; kx++)
+				v += strips[i].template segment<lanes>(kx) * k(ky, kx);
+		}
+
+		out.derived().row(y).template segment<lanes>(x) = v;
+	};
+
+	const auto group = [&](const Eigen::Index y, const Eigen::Index x) {
+		if (x >= dx && x + lanes + dx <= cols)
+			inner(y, x);
+		else
+			border(y, x);
+	};
+
+	for (Eigen::Index y = rmin.y(); y <= rmax.y(); y++) {
+		// The top and bottom border is extended by reusing the first or last row
+		for (usize i = 0; i < KRows; i++) {
+			const Eigen::Index ky = casts::to_eigen(i);
+			iy[i] = std::clamp(y + ky - dy, Eigen::Index {0}, rows - 1);
+		}
+
+		/*
+		 * The last group overlaps with the previous one if the width is not a multiple.
+		 * Groups that start inside of the region can calculate some pixels outside of it.
+		 */
+		for (Eigen::Index x = rmin.x() - rmin.x() % lanes; x <= rmax.x(); x += lanes)
+			group(y, std::min(x, cols - lanes));
+	}
+}
+
+} // namespace iptsd::contacts::detection::convolution::impl
@@ -11,10 +11,29 @@
 
 #include <gsl/gsl>
 
+#include <algorithm>
+#include <numeric>
 #include <vector>
 
 namespace iptsd::contacts::detection::overlaps {
 
+/*
+ * Temporary storage for merging overlapping clusters, that can be reused between frames.
+ */
+struct Workspace {
+	// The clusters that are kept after an iteration.
+	std::vector<Box> temp {};
+
+	// The pairs of overlapping clusters.
+	std::vector<Vector2<usize>> overlaps {};
+
+	// The indices of the clusters, sorted by their left edge.
+	std::vector<usize> order {};
+
+	// Which clusters are dropped in an iteration.
+	std::vector<bool> dropped {};
+};
+
 namespace impl {
 
 /*!
@@ -32,23 +51,22 @@ inline isize area(const Box &box)
 }
 
 /*!
- * Calculates by how many percent two clusters overlap.
+ * Checks whether two clusters overlap by at least 50%.
+ *
+ * The overlap is the area of the intersection divided by the area of the union of both
+ * clusters. Instead of dividing, the areas are compared directly, which is exact.
  *
  * @param[in] a The first cluster.
  * @param[in] b The second cluster.
- * @return The percentage of overlap between both clusters (range 0-1).
+ * @return Whether the intersection is at least half as large as the union of both clusters.
  */
-inline f64 overlap(const Box &a, const Box &b)
+inline bool overlaps(const Box &a, const Box &b)
 {
-	// Check if the two boxes are identical
-	if (a.isApprox(b))
-		return 1.0;
-
 	const Box intersection = a.intersection(b);
 
 	// Check if the two boxes overlap
 	if (intersection.isEmpty())
-		return 0.0;
+		return false;
 
 	// Compute the area of both bounding boxes
 	const isize area_a = area(a);
@@ -56,51 +74,58 @@ inline f64 overlap(const Box &a, const Box &b)
 
 	const isize area_i = area(intersection);
 
-	// Compute the intersection over union by taking the intersection area and dividing it
-	// by the sum of both bounding box areas minus the intersection area
-	const f64 iou = casts::to<f64>(area_i) / casts::to<f64>(area_a + area_b - area_i);
-
-	if (iou < 0.0 || iou > 1.0)
-		throw common::Error<Error::InvalidClusterOverlap> {};
-
-	return iou;
+	// The union is the sum of both bounding box areas minus the intersection area
+	return 2 * area_i >= area_a + area_b - area_i;
 }
 
 /*!
  * Searches for overlaps in a list of clusters.
  *
+ * The clusters are sorted by their left edge. When looking for clusters that overlap with
+ * a cluster, the search can stop at the first one that starts right of the cluster.
+ *
  * @param[in] clusters The list of clusters to check for overlaps.
+ * @param[out] order Temporary storage for the sorted cluster indices.
  * @param[out] overlaps A reference to the vector where overlapping pairs are stored.
  * @return Whether any overlaps have been found.
  */
-inline bool search(const std::vector<Box> &clusters, std::vector<Vector2<usize>> &overlaps)
+inline bool search(const std::vector<Box> &clusters,
+                   std::vector<usize> &order,
+                   std::vector<Vector2<usize>> &overlaps)
 {
-	bool found_overlap = false;
 	const usize size = clusters.size();
 
 	overlaps.clear();
 
+	order.resize(size);
+	std::iota(order.begin(), order.end(), 0);
+
+	std::sort(order.begin(), order.end(), [&](const usize a, const usize b) {
+		return clusters[a].min().x() < clusters[b].min().x();
+	});
+
 	for (usize i = 0; i < size; i++) {
-		const Box &a = clusters[i];
+		const usize a = order[i];
+		const Box &box_a = clusters[a];
 
-		// We only need to check all clusters, only the ones that weren't checked yet.
 		for (usize j = i + 1; j < size; j++) {
-			const Box &b = clusters[j];
+			const usize b = order[j];
+			const Box &box_b = clusters[b];
+
+			// All following clusters start right of this one
+			if (box_b.min().x() > box_a.max().x())
+				break;
 
 			// Ignore clusters that overlap by less than 50%
-			if (overlap(a, b) < 0.5)
+			if (!impl::overlaps(box_a, box_b))
 				continue;
 
-			found_overlap = true;
-
-			// Because of how this look is structured, j will always be larger than i.
-			// This means that if we iterate over the clusters the same way, by the
-			// time we have reached j, i has already been merged and j can be dropped.
-			overlaps.emplace_back(i, j);
+			// The smaller index is always stored first
+			overlaps.emplace_back(std::min(a, b), std::max(a, b));
 		}
 	}
 
-	return found_overlap;
+	return !overlaps.empty();
 }
 
 } // namespace impl
@@ -113,48 +138,42 @@ inline bool search(const std::vector<Box> &clusters, std::vector<Vector2<usize>>
  * one of the overlapping clusters will be extended, and the other one will be
  * dropped. If no overlaps were found in one iteration, the function returns.
  *
+ * Of every overlapping pair, the cluster that comes first in the list is extended and the
+ * other one is dropped. Clusters that are dropped are not extended in the same iteration.
+ *
  * @param[in,out] clusters The list of clusters to check for overlaps.
- * @param[in] temp A temporary buffer for storing the result of an iteration.
+ * @param[in] ws Temporary storage, which only has to grow when there are more clusters.
  * @param[in] iterations How many times the function will try to merge overlaps before aborting.
  */
-inline void merge(std::vector<Box> &clusters, std::vector<Box> &temp, const usize iterations)
+inline void merge(std::vector<Box> &clusters, Workspace &ws, const usize iterations)
 {
-	std::vector<Vector2<usize>> overlaps {clusters.size()};
+	std::vector<Vector2<usize>> &overlaps = ws.overlaps;
+	std::vector<bool> &dropped = ws.dropped;
+	std::vector<Box> &temp = ws.temp;
 
 	temp.clear();
 
 	// Repeat the merging process until no new overlaps were detected
 	for (usize j = 0; j < iterations; j++) {
-		const usize size = clusters.size();
-
-		if (!impl::search(clusters, overlaps))
+		if (!impl::search(clusters, ws.order, overlaps))
 			break;
 
-		for (usize i = 0; i < size; i++) {
-			Box &cluster = clusters[i];
-			bool drop_cluster = false;
-
-			for (const Vector2<usize> &pair : overlaps) {
-				const usize a = pair.x();
-				const usize b = pair.y();
-
-				// If b is the current cluster, it has already been merged
-				if (b == i) {
-					drop_cluster = true;
-					break;
-				}
+		dropped.assign(clusters.size(), false);
 
-				// Is this an entry for the current cluster?
-				if (a != i)
-					continue;
+		for (const Vector2<usize> &pair : overlaps)
+			dropped[pair.y()] = true;
 
-				cluster = cluster.merged(clusters[b]);
-			}
+		for (const Vector2<usize> &pair : overlaps) {
+			const usize a = pair.x();
+			const usize b = pair.y();
 
-			if (drop_cluster)
-				continue;
+			if (!dropped[a])
+				clusters[a] = clusters[a].merged(clusters[b]);
+		}
 
-			temp.push_back(std::move(cluster));
+		for (usize i = 0; i < clusters.size(); i++) {
+			if (!dropped[i])
+				temp.push_back(clusters[i]);
 		}
 
 		std::swap(clusters, temp);
@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CONTACTS_DETECTION_ALGORITHMS_TILES_HPP
+#define IPTSD_CONTACTS_DETECTION_ALGORITHMS_TILES_HPP
+
+#include <common/types.hpp>
+
+#include <algorithm>
+
+namespace iptsd::contacts::detection::tiles {
+
+/*!
+ * Calculates how many tiles are needed to cover a heatmap.
+ *
+ * The tiles at the right and bottom border can be smaller than the others.
+ *
+ * @param[in] rows The height of the heatmap.
+ * @param[in] cols The width of the heatmap.
+ * @param[in] size The width and height of a tile.
+ * @return How many rows (y) and columns (x) of tiles cover the heatmap.
+ */
+inline Point count(const Eigen::Index rows, const Eigen::Index cols, const Eigen::Index size)
+{
+	return Point {(cols + size - 1) / size, (rows + size - 1) / size};
+}
+
+/*!
+ * Calculates which pixels of a heatmap belong to a tile.
+ *
+ * @param[in] tile The column (x) and row (y) of the tile.
+ * @param[in] rows The height of the heatmap.
+ * @param[in] cols The width of the heatmap.
+ * @param[in] size The width and height of a tile.
+ * @return The bounding box of the pixels of the tile.
+ */
+inline Box pixels(const Point &tile,
+                  const Eigen::Index rows,
+                  const Eigen::Index cols,
+                  const Eigen::Index size)
+{
+	const Point min = tile * size;
+	const Point max = (min.array() + size - 1).min(Point {cols - 1, rows - 1}.array());
+
+	return Box {min, max};
+}
+
+/*!
+ * Downsamples a heatmap by storing the largest pixel of every tile.
+ *
+ * @tparam Size The width and height of a tile.
+ * @param[in] heatmap The heatmap to downsample.
+ * @param[out] out The largest pixel of every tile.
+ */
+template <Eigen::Index Size, class Derived>
+void maximum(const DenseBase<Derived> &heatmap, Image<typename DenseBase<Derived>::Scalar> &out)
+{
+	using T = typename DenseBase<Derived>::Scalar;
+
+	const Eigen::Index cols = heatmap.cols();
+	const Eigen::Index rows = heatmap.rows();
+
+	const Point tiles = count(rows, cols, Size);
+
+	out.resize(tiles.y(), tiles.x());
+
+	// The tiles are small, so they are reduced pixel by pixel instead of as Eigen blocks
+	for (Eigen::Index tx = 0; tx < tiles.x(); tx++) {
+		const Eigen::Index x0 = tx * Size;
+		const Eigen::Index x1 = std::min(x0 + Size, cols);
+
+		for (Eigen::Index ty = 0; ty < tiles.y(); ty++) {
+			const Eigen::Index y0 = ty * Size;
+			const Eigen::Index y1 = y0 + Size;
+
+			T value = heatmap.coeff(y0, x0);
+
+			for (Eigen::Index x = x0; x < x1; x++) {
+				if (y1 <= rows) {
+					// Full tiles have a fixed height, so the loop is unrolled
+					for (Eigen::Index y = y0; y < y1; y++)
+						value = std::max(value, heatmap.coeff(y, x));
+				} else {
+					for (Eigen::Index y = y0; y < rows; y++)
+						value = std::max(value, heatmap.coeff(y, x));
+				}
+			}
+
+			out.coeffRef(ty, tx) = value;
+		}
+	}
+}
+
+/*!
+ * Stores the largest value of every tile and its neighbours, including diagonal ones.
+ *
+ * @param[in] in The value of every tile.
+ * @param[out] temp Storage for the largest value of every tile and its horizontal neighbours.
+ * @param[out] out The largest value around every tile.
+ */
+template <class T>
+void spread(const Image<T> &in, Image<T> &temp, Image<T> &out)
+{
+	const Eigen::Index cols = in.cols();
+	const Eigen::Index rows = in.rows();
+
+	temp.resize(rows, cols);
+	out.resize(rows, cols);
+
+	for (Eigen::Index x = 0; x < cols; x++) {
+		const Eigen::Index left = std::max(x - 1, Eigen::Index {0});
+		const Eigen::Index right = std::min(x + 1, cols - 1);
+
+		for (Eigen::Index y = 0; y < rows; y++) {
+			const T value = std::max(in.coeff(y, left), in.coeff(y, right));
+			temp.coeffRef(y, x) = std::max(value, in.coeff(y, x));
+		}
+	}
+
+	for (Eigen::Index x = 0; x < cols; x++) {
+		for (Eigen::Index y = 0; y < rows; y++) {
+			const Eigen::Index top = std::max(y - 1, Eigen::Index {0});
+			const Eigen::Index bottom = std::min(y + 1, rows - 1);
+
+			const T value = std::max(temp.coeff(top, x), temp.coeff(bottom, x));
+			out.coeffRef(y, x) = std::max(value, temp.coeff(y, x));
+		}
+	}
+}
+
+/*!
+ * Marks the tiles of a heatmap that are different from another heatmap.
+ *
+ * @param[in] current The new heatmap.
+ * @param[in] previous The heatmap to compare against, with the same size.
+ * @param[in] size The width and height of a tile.
+ * @param[out] dirty Whether a tile has changed, for every tile.
+ * @return Whether any of the tiles has changed.
+ */
+template <class Derived>
+bool diff(const DenseBase<Derived> &current,
+          const DenseBase<Derived> &previous,
+          const Eigen::Index size,
+          Image<bool> &dirty)
+{
+	const Eigen::Index cols = current.cols();
+	const Eigen::Index rows = current.rows();
+
+	const Point tiles = count(rows, cols, size);
+
+	dirty.resize(tiles.y(), tiles.x());
+
+	bool changed = false;
+
+	for (Eigen::Index ty = 0; ty < tiles.y(); ty++) {
+		for (Eigen::Index tx = 0; tx < tiles.x(); tx++) {
+			const Box box = pixels(Point {tx, ty}, rows, cols, size);
+
+			const Point min = box.min();
+			const Point extent = box.sizes() + Point::Ones();
+
+			const Eigen::Index x = min.x();
+			const Eigen::Index y = min.y();
+
+			const auto a = current.derived().block(y, x, extent.y(), extent.x());
+			const auto b = previous.derived().block(y, x, extent.y(), extent.x());
+
+			const bool different = (a != b).any();
+
+			dirty(ty, tx) = different;
+			changed |= different;
+		}
+	}
+
+	return changed;
+}
+
+/*!
+ * Marks all tiles that are next to a marked tile, including diagonal neighbours.
+ *
+ * @param[in] in The marked tiles.
+ * @param[out] out The marked tiles and their neighbours.
+ */
+inline void dilate(const Image<bool> &in, Image<bool> &out)
+{
+	const Eigen::Index cols = in.cols();
+	const Eigen::Index rows = in.rows();
+
+	out.setConstant(rows, cols, false);
+
+	for (Eigen::Index y = 0; y < rows; y++) {
+		for (Eigen::Index x = 0; x < cols; x++) {
+			if (!in(y, x))
+				continue;
+
+			const Eigen::Index y0 = std::max(y - 1, Eigen::Index {0});
+			const Eigen::Index x0 = std::max(x - 1, Eigen::Index {0});
+			const Eigen::Index y1 = std::min(y + 1, rows - 1);
+			const Eigen::Index x1 = std::min(x + 1, cols - 1);
+
+			out.block(y0, x0, y1 - y0 + 1, x1 - x0 + 1).setConstant(true);
+		}
+	}
+}
+
+/*!
+ * Checks whether a box of pixels touches any marked tile.
+ *
+ * Parts of the box that are outside of the tiles are ignored.
+ *
+ * @param[in] marked The marked tiles.
+ * @param[in] size The width and height of a tile.
+ * @param[in] box The pixels to check.
+ * @return Whether any pixel of the box is part of a marked tile.
+ */
+inline bool touches(const Image<bool> &marked, const Eigen::Index size, const Box &box)
+{
+	const Point last {marked.cols() - 1, marked.rows() - 1};
+
+	const Point min = (box.min() / size).cwiseMax(0).cwiseMin(last);
+	const Point max = (box.max() / size).cwiseMax(0).cwiseMin(last);
+
+	const Point extent = max - min + Point::Ones();
+
+	return marked.block(min.y(), min.x(), extent.y(), extent.x()).any();
+}
+
+} // namespace iptsd::contacts::detection::tiles
+
+#endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_TILES_HPP
@@ -3,11 +3,18 @@
 #ifndef IPTSD_CONTACTS_DETECTION_CONFIG_HPP
 #define IPTSD_CONTACTS_DETECTION_CONFIG_HPP
 
+#include "algorithms/cluster.hpp"
 #include "algorithms/neutral.hpp"
 
 #include <common/casts.hpp>
+#include <common/thread-pool.hpp>
 #include <common/types.hpp>
 
+#include <gsl/gsl>
+
+#include <memory>
+#include <optional>
+
 namespace iptsd::contacts::detection {
 
 template <class T>
@@ -32,12 +39,32 @@ public:
 	 */
 	T neutral_value_offset = casts::to<T>(0);
 
+	/*
+	 * Which percentile of the heatmap is used if neutral_value_algorithm is set to PERCENTILE.
+	 * A value of 0.5 means that the median is used.
+	 */
+	f64 neutral_value_percentile = 0.5;
+
+	/*
+	 * How fast the estimate for every pixel follows the heatmap if neutral_value_algorithm
+	 * is set to BASELINE. A value of 1 means that the last frame is used directly.
+	 */
+	T neutral_value_smoothing = gsl::narrow_cast<T>(0.05);
+
 	/*
 	 * How many frames to wait before recalculating the neutral value.
 	 * A value of 1 means to recalculate the neutral value every frame.
+	 *
+	 * Heatmaps of raw bytes always recalculate the neutral value, since that only requires
+	 * a cheap histogram.
 	 */
 	usize neutral_value_backoff = 1;
 
+	/*
+	 * How clusters are built from the local maxima of the heatmap.
+	 */
+	enum cluster::Algorithm cluster_algorithm = cluster::Algorithm::SPAN;
+
 	/*
 	 * If a pixel of the input data is larger than this value plus the neutral value
 	 * it is marked as a contact and a recursive cluster search is started.
@@ -49,6 +76,77 @@ public:
 	 * the recursive cluster search will stop once it reaches it.
 	 */
 	T deactivation_threshold = casts::to<T>(20);
+
+	/*
+	 * Whether gaussian fitting starts from the contacts of the previous frame, instead of
+	 * the center of the cluster. Slowly moving contacts need less iterations to converge.
+	 */
+	bool fitting_warm_start = false;
+
+	/*
+	 * Gaussian fitting stops once the means of all contacts move less than this many
+	 * pixels in one iteration, and their precision matrices change by less than this
+	 * fraction of their norm. A value of 0 means to always run all iterations.
+	 */
+	T fitting_tolerance = casts::to<T>(0);
+
+	/*
+	 * Whether gaussian fitting only samples the pixels of a cluster that are above the
+	 * deactivation threshold and their neighbours, instead of the whole bounding box.
+	 */
+	bool fitting_mask = false;
+
+	/*
+	 * Clusters whose contact is certainly larger than this are not fitted. Their contact is
+	 * estimated from the moments of their pixels instead, and marked as invalid. Uses the
+	 * same unit as the size of the contacts. If not set, all clusters are fitted.
+	 */
+	std::optional<T> palm_size = std::nullopt;
+
+	/*
+	 * How many threads are started in addition to the calling thread to fit gaussians
+	 * to multiple clusters in parallel. A value of 0 means to only use the calling thread.
+	 */
+	usize fitting_threads = 0;
+
+	/*
+	 * Threads that are shared with other detectors, used instead of starting new ones.
+	 * All detectors that share the threads must run on the same thread.
+	 */
+	std::shared_ptr<common::ThreadPool> fitting_pool = nullptr;
+
+	/*
+	 * How many clusters a heatmap needs to have before gaussians are fitted in parallel.
+	 */
+	usize fitting_thread_threshold = 4;
+
+	/*
+	 * How many pixels a heatmap needs to have before blurring it, searching it for local
+	 * maximas and building clusters is split into strips that are processed by the threads
+	 * for gaussian fitting. A value of 0 means to always process it on the calling thread.
+	 */
+	usize strip_threshold = 0;
+
+	/*
+	 * How many pixels a heatmap needs to have before it is processed coarse to fine. The
+	 * warm parts of the heatmap are found on a downsampled copy, and only the windows around
+	 * them are blurred and searched. A value of 0 means to always process the whole heatmap.
+	 */
+	usize pyramid_threshold = 0;
+
+	/*
+	 * The size of the tiles that are compared against the previous heatmap, to only process
+	 * the parts of the heatmap that have changed. Must be at least 2 if enabled.
+	 * A value of 0 means to process the whole heatmap every frame.
+	 */
+	usize incremental_tile_size = 0;
+
+	/*
+	 * Whether to use the scalar implementation of every step, instead of the ones that
+	 * process multiple pixels or systems at once. This is slow, and only meant to verify
+	 * that the optimized implementations find the same contacts.
+	 */
+	bool reference = false;
 };
 
 } // namespace iptsd::contacts::detection
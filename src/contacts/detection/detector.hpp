@@ -4,135 +4,1538 @@
 #define IPTSD_CONTACTS_DETECTION_DETECTOR_HPP
 
 #include "../contact.hpp"
+#include "../timings.hpp"
 #include "algorithms/cluster.hpp"
 #include "algorithms/convolution.hpp"
 #include "algorithms/ellipse.hpp"
+#include "algorithms/errors.hpp"
 #include "algorithms/gaussian.hpp"
 #include "algorithms/kernels.hpp"
 #include "algorithms/maximas.hpp"
+#include "algorithms/moments.hpp"
 #include "algorithms/neutral.hpp"
 #include "algorithms/overlaps.hpp"
+#include "algorithms/tiles.hpp"
 #include "config.hpp"
 
 #include <common/casts.hpp>
+#include <common/error.hpp>
+#include <common/thread-pool.hpp>
 #include <common/types.hpp>
 
 #include <gsl/gsl>
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <optional>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace iptsd::contacts::detection {
 
-template <class T, class TFit = T>
+/*
+ * If the size of the heatmaps is known at compile time, it can be passed as Rows and Cols.
+ * The buffers for the heatmap are then stored inside of the detector, and the loops over
+ * them can be unrolled. The detector can then only process heatmaps of that size.
+ */
+template <class T, class TFit = T, int Rows = Eigen::Dynamic, int Cols = Eigen::Dynamic>
 class Detector {
 public:
 	static_assert(std::is_floating_point_v<T>);
 	static_assert(std::is_floating_point_v<TFit>);
+	static_assert((Rows == Eigen::Dynamic) == (Cols == Eigen::Dynamic));
+
+private:
+	/*
+	 * A gaussian that was fitted to a cluster, which the next frame can reuse.
+	 */
+	struct Fitted {
+		// The pixels of the heatmap that the gaussian was fitted to.
+		Box bounds;
+
+		// Whether the cluster was not overlapping any other clusters.
+		bool isolated;
+
+		// Whether the fitting was successful.
+		bool valid;
+
+		// The fitted gaussian.
+		TFit scale;
+		Vector2<TFit> mean;
+		Matrix2<TFit> prec;
+	};
 
 private:
 	Config<T> m_config;
 
-	// The diagonal of the heatmap.
-	T m_input_diagonal = casts::to<T>(0);
+	// The diagonal of the heatmap.
+	T m_input_diagonal = casts::to<T>(0);
+
+	// The size of the heatmap that the internal buffers are prepared for.
+	Point m_size = Point::Zero();
+
+	// The heatmap with the neutral value subtracted.
+	Image<T, Rows, Cols> m_img_neutral {};
+
+	// The blurred heatmap.
+	Image<T, Rows, Cols> m_img_blurred {};
+
+	// The mapped heatmap of raw bytes, if the reference implementation is used.
+	Image<T, Rows, Cols> m_img_mapped {};
+
+	// The kernel that is used for blurring.
+	Matrix3<T> m_kernel_blur = kernels::gaussian<T, 3, 3>(gsl::narrow_cast<T>(0.75));
+
+	// The list of local maximas.
+	std::vector<Point> m_maximas {};
+
+	// The list of spanned clusters.
+	std::vector<Box> m_clusters {};
+
+	// Temporary storage for merging overlapping clusters.
+	overlaps::Workspace m_overlaps {};
+
+	// Which pixels have been visited while spanning a cluster.
+	Image<bool> m_visited {};
+
+	// The pixels that still have to be checked while spanning a cluster.
+	std::vector<cluster::Step<T>> m_span_stack {};
+
+	// Temporary storage for labeling clusters.
+	cluster::Labels m_labels {};
+
+	// The clusters before they are checked and merged.
+	std::vector<Box> m_spans {};
+
+	// Input parameters for gaussian fitting.
+	// Entries are reused between frames, unused entries are marked as invalid.
+	std::vector<gaussian::Parameters<TFit>> m_fitting_params {};
+
+	// Temporary storage for gaussian fitting.
+	gaussian::Workspace<TFit> m_fitting_temp {};
+
+	// How often the storage for gaussian fitting had to grow.
+	usize m_fitting_allocations = 0;
+
+	// How much time was spent in every stage of detection.
+	Timings m_timings {};
+
+	// The threads that fit gaussians in parallel, if enabled.
+	std::shared_ptr<common::ThreadPool> m_fitting_pool = nullptr;
+
+	// For every row of the heatmap, how far it is from the next row that contains a pixel above
+	// the deactivation threshold. Empty if all rows are processed.
+	std::vector<Eigen::Index> m_row_distance {};
+
+	// The smallest or largest byte of every row of a heatmap of raw bytes.
+	Eigen::Array<u8, Eigen::Dynamic, 1> m_row_bytes {};
+
+	// The ranges of rows that are mapped from a heatmap of raw bytes.
+	std::vector<std::pair<Eigen::Index, Eigen::Index>> m_row_runs {};
+
+	// For every row of the blurred heatmap, how many pixels are above the activation threshold.
+	std::vector<Eigen::Index> m_row_active {};
+
+	// The local maximas of every strip, when the heatmap is processed in strips.
+	std::vector<std::vector<Point>> m_strip_maximas {};
+
+	// Temporary storage for cluster spanning, for every thread of the pool.
+	std::vector<Image<bool>> m_strip_visited {};
+	std::vector<std::vector<cluster::Step<T>>> m_strip_stacks {};
+
+	// The gaussians that were fitted in the previous frame, to start the next fitting from.
+	std::vector<std::pair<Vector2<TFit>, Matrix2<TFit>>> m_fitting_seeds {};
+
+	// How many frames are left before the neutral value has to be recalculated.
+	usize m_counter = 0;
+
+	// The cached neutral value of the heatmap.
+	T m_neutral = casts::to<T>(0);
+
+	// Temporary storage for calculating a percentile of the heatmap.
+	std::vector<T> m_neutral_values {};
+
+	// The heatmap of the previous frame with the neutral value subtracted.
+	Image<T, Rows, Cols> m_img_previous {};
+
+	// Whether the next frame can be compared against the previous one.
+	bool m_incremental = false;
+
+	// The tiles of the heatmap that are different from the previous frame.
+	Image<bool> m_tiles_dirty {};
+
+	// The tiles of the heatmap whose blurred pixels and local maximas can have changed.
+	Image<bool> m_tiles_changed {};
+
+	// The local maximas of the previous frame.
+	std::vector<Point> m_maximas_last {};
+
+	// The clusters of the previous frame that were spanned from its local maximas.
+	std::vector<Box> m_spans_last {};
+
+	// The gaussians of the previous frame, for every cluster.
+	std::vector<Fitted> m_fitted {};
+
+	// For every cluster, whether it doesn't overlap any other cluster.
+	std::vector<bool> m_isolated {};
+
+	// For every cluster, which gaussian of the previous frame is reused.
+	std::vector<std::optional<usize>> m_reused {};
+
+	// For every cluster, whether it is too large to be fitted and its contact is invalid.
+	std::vector<bool> m_palms {};
+
+	// The estimated neutral value of every pixel.
+	Image<T> m_baseline {};
+
+	// The largest pixel of every tile of the heatmap, for coarse to fine detection.
+	Image<T> m_img_coarse {};
+
+	// The largest pixel of every tile and its neighbours. Tiles whose value is above the
+	// cold threshold are blurred and searched.
+	Image<T> m_img_around {};
+
+	// Temporary storage for spreading the tiles to their neighbours.
+	Image<T> m_coarse_temp {};
+
+	// The largest pixel around any tile in every row of tiles.
+	Image<T, Eigen::Dynamic, 1> m_coarse_rows {};
+
+	// The pixels of every run of tiles that is blurred and searched.
+	std::vector<Box> m_windows {};
+
+	// The width and height of a tile for coarse to fine detection.
+	constexpr static Eigen::Index PYRAMID_SCALE = 2;
+
+public:
+	Detector(Config<T> config) : m_config {std::move(config)}
+	{
+		const usize threads = m_config.fitting_threads;
+
+		if (m_config.fitting_pool != nullptr)
+			m_fitting_pool = m_config.fitting_pool;
+		else if (threads > 0)
+			m_fitting_pool = std::make_shared<common::ThreadPool>(threads, true);
+
+		if (m_fitting_pool == nullptr)
+			return;
+
+		m_fitting_temp.scratch.resize(m_fitting_pool->size());
+
+		m_strip_maximas.resize(m_fitting_pool->size());
+		m_strip_visited.resize(m_fitting_pool->size());
+		m_strip_stacks.resize(m_fitting_pool->size());
+	}
+
+	/*!
+	 * Search for contacts in a capacitive heatmap.
+	 *
+	 * This function uses a threshold based recursive descent to build
+	 * a list of connected clusters based on the (pre-processed) heatmap,
+	 * and then uses gaussian fitting to fit an ellipse onto these clusters.
+	 *
+	 * @param[in] heatmap The heatmap to process.
+	 * @param[out] contacts The list of detected contacts.
+	 */
+	template <int HRows, int HCols>
+	void detect(const ImageBase<T, HRows, HCols> &heatmap, std::vector<Contact<T>> &contacts)
+	{
+		this->resize(heatmap.rows(), heatmap.cols());
+		m_timings.start();
+
+		m_row_distance.clear();
+
+		if (m_config.neutral_value_algorithm == neutral::Algorithm::BASELINE) {
+			if (m_baseline.rows() != heatmap.rows() || m_baseline.cols() != heatmap.cols()) {
+				const T mode = neutral::calculate(heatmap,
+				                                  neutral::Algorithm::MODE,
+				                                  casts::to<T>(0),
+				                                  m_config.neutral_value_percentile,
+				                                  m_neutral_values);
+
+				m_baseline.setConstant(heatmap.rows(), heatmap.cols(), mode);
+			}
+
+			m_timings.lap(Stage::NEUTRAL);
+
+			const T max = this->subtract_baseline(heatmap, [&](const Eigen::Index i) {
+				return heatmap.coeff(i);
+			});
+
+			m_timings.lap(Stage::NORMALIZE);
+
+			// Without any pixels above the activation threshold there are no contacts
+			if (max <= m_config.activation_threshold) {
+				this->detect_empty(contacts);
+				return;
+			}
+
+			this->detect_neutral(contacts);
+			return;
+		}
+
+		// Recalculate the neutral value if neccessary
+		if (m_counter == 0) {
+			m_neutral = neutral::calculate(heatmap,
+			                               m_config.neutral_value_algorithm,
+			                               m_config.neutral_value_offset,
+			                               m_config.neutral_value_percentile,
+			                               m_neutral_values);
+		}
+
+		// Update counter
+		m_counter = (m_counter + 1) % m_config.neutral_value_backoff;
+		m_timings.lap(Stage::NEUTRAL);
+
+		/*
+		 * The blur can't raise a pixel above the largest pixel of the heatmap. If that
+		 * one isn't above the activation threshold, there can't be any contacts, and
+		 * neither the neutral value has to be subtracted nor the heatmap blurred.
+		 */
+		if (heatmap.maxCoeff() - m_neutral <= m_config.activation_threshold) {
+			m_timings.lap(Stage::NORMALIZE);
+			this->detect_empty(contacts);
+			return;
+		}
+
+		// Subtract the neutral value from the whole heatmap
+		m_img_neutral = (heatmap - m_neutral).max(casts::to<T>(0));
+		m_timings.lap(Stage::NORMALIZE);
+
+		this->detect_neutral(contacts);
+	}
+
+	/*!
+	 * Search for contacts in a capacitive heatmap of raw bytes.
+	 *
+	 * The bytes are mapped to the actual values of the heatmap using a table. Compared to
+	 * mapping the heatmap first and passing it to the other overload, the neutral value is
+	 * calculated from a histogram of the bytes, and mapping the heatmap, subtracting the
+	 * neutral value and clamping it happens in a single pass.
+	 *
+	 * @param[in] heatmap The raw heatmap to process.
+	 * @param[in] lut The value of each byte.
+	 * @param[out] contacts The list of detected contacts.
+	 */
+	template <class Derived>
+	void detect(const DenseBase<Derived> &heatmap,
+	            const std::array<T, 256> &lut,
+	            std::vector<Contact<T>> &contacts)
+	{
+		static_assert(std::is_same_v<typename DenseBase<Derived>::Scalar, u8>);
+
+		// The reference maps the heatmap first, and calculates the neutral value from it
+		if (m_config.reference) {
+			const auto map = [&](const u8 byte) { return lut[byte]; };
+
+			m_img_mapped = heatmap.derived().unaryExpr(map);
+			this->detect(m_img_mapped, contacts);
+			return;
+		}
+
+		this->resize(heatmap.rows(), heatmap.cols());
+		m_timings.start();
+
+		m_row_distance.clear();
+
+		if (m_config.neutral_value_algorithm == neutral::Algorithm::BASELINE) {
+			if (m_baseline.rows() != heatmap.rows() || m_baseline.cols() != heatmap.cols()) {
+				const T mode = neutral::calculate(heatmap,
+				                                  lut,
+				                                  neutral::Algorithm::MODE,
+				                                  casts::to<T>(0),
+				                                  m_config.neutral_value_percentile);
+
+				m_baseline.setConstant(heatmap.rows(), heatmap.cols(), mode);
+			}
+
+			m_timings.lap(Stage::NEUTRAL);
+
+			const T max = this->subtract_baseline(heatmap, [&](const Eigen::Index i) {
+				return lut[heatmap.coeff(i)];
+			});
+
+			m_timings.lap(Stage::NORMALIZE);
+
+			// Without any pixels above the activation threshold there are no contacts
+			if (max <= m_config.activation_threshold) {
+				this->detect_empty(contacts);
+				return;
+			}
+
+			this->detect_neutral(contacts);
+			return;
+		}
+
+		// The histogram is cheap enough to recalculate the neutral value for every frame
+		m_neutral = neutral::calculate(heatmap,
+		                               lut,
+		                               m_config.neutral_value_algorithm,
+		                               m_config.neutral_value_offset,
+		                               m_config.neutral_value_percentile);
+
+		m_timings.lap(Stage::NEUTRAL);
+
+		// Subtract the neutral value from the table instead of the whole heatmap
+		std::array<T, 256> neutral {};
+
+		for (usize i = 0; i < neutral.size(); i++)
+			neutral.at(i) = std::max(lut.at(i) - m_neutral, casts::to<T>(0));
+
+		/*
+		 * Only bytes between the smallest and the largest byte of the heatmap can occur.
+		 * If none of them is above the activation threshold, there can't be any contacts,
+		 * and the heatmap doesn't have to be mapped and blurred.
+		 */
+		const auto low = casts::to_eigen(heatmap.minCoeff());
+		const auto high = casts::to_eigen(heatmap.maxCoeff());
+
+		const auto begin = neutral.cbegin() + low;
+		const auto end = neutral.cbegin() + high + 1;
+
+		if (*std::max_element(begin, end) <= m_config.activation_threshold) {
+			m_timings.lap(Stage::NORMALIZE);
+			this->detect_empty(contacts);
+			return;
+		}
+
+		if (this->find_rows(heatmap, neutral, low, high)) {
+			// Only map the rows that the blur around a warm row reads from
+			for (Eigen::Index x = 0; x < heatmap.cols(); x++) {
+				for (const auto &[first, last] : m_row_runs) {
+					for (Eigen::Index y = first; y < last; y++)
+						m_img_neutral(y, x) = neutral[heatmap(y, x)];
+				}
+			}
+		} else {
+			const Eigen::Index size = heatmap.size();
+
+			for (Eigen::Index i = 0; i < size; i++)
+				m_img_neutral.coeffRef(i) = neutral[heatmap.coeff(i)];
+		}
+
+		m_timings.lap(Stage::NORMALIZE);
+
+		this->detect_neutral(contacts);
+	}
+
+	/*!
+	 * How often the storage for gaussian fitting had to grow.
+	 *
+	 * Once the detector has seen the largest number of clusters and the largest clusters
+	 * of the input, this should not increase anymore.
+	 *
+	 * @return The number of allocations for gaussian fitting.
+	 */
+	[[nodiscard]] usize fitting_allocations() const
+	{
+		return m_fitting_allocations;
+	}
+
+	/*!
+	 * How much time the detector spent in every stage.
+	 *
+	 * The timers are only compiled in if iptsd was built with the stage_timers option.
+	 *
+	 * @return The accumulated time of all frames since the detector was created.
+	 */
+	[[nodiscard]] const Timings &timings() const
+	{
+		return m_timings;
+	}
+
+	/*!
+	 * The neutral value that is currently subtracted from the heatmaps.
+	 *
+	 * If every pixel has its own neutral value, this is the average of all of them.
+	 *
+	 * @return The neutral value, or 0 if no heatmap was processed yet.
+	 */
+	[[nodiscard]] T neutral() const
+	{
+		if (m_config.neutral_value_algorithm != neutral::Algorithm::BASELINE)
+			return m_neutral;
+
+		if (m_baseline.size() == 0)
+			return casts::to<T>(0);
+
+		return m_baseline.mean();
+	}
+
+	/*!
+	 * Forgets the estimated neutral value of every pixel and the gaussians of the last frame.
+	 */
+	void reset()
+	{
+		m_counter = 0;
+		m_baseline.resize(0, 0);
+		m_fitting_seeds.clear();
+		m_incremental = false;
+	}
+
+	/*!
+	 * Allocates the internal buffers for heatmaps of a certain size, before the first one.
+	 *
+	 * The buffers are written once, so that processing the first heatmap doesn't have to
+	 * allocate memory or wait for the pages to be mapped.
+	 *
+	 * @param[in] rows The height of the heatmaps.
+	 * @param[in] cols The width of the heatmaps.
+	 * @param[in] contacts How many contacts to allocate storage for.
+	 */
+	void prepare(const Eigen::Index rows, const Eigen::Index cols, const usize contacts)
+	{
+		this->resize(rows, cols);
+
+		const usize height = casts::to_unsigned(rows);
+
+		m_row_distance.reserve(height);
+		m_row_runs.reserve(height);
+		m_row_active.reserve(height);
+		m_neutral_values.reserve(casts::to_unsigned(rows * cols));
+
+		m_maximas.reserve(contacts);
+		m_clusters.reserve(contacts);
+		m_spans.reserve(contacts);
+		m_fitting_seeds.reserve(contacts);
+
+		m_overlaps.temp.reserve(contacts);
+		m_overlaps.overlaps.reserve(contacts);
+		m_overlaps.order.reserve(contacts);
+		m_overlaps.dropped.reserve(contacts);
+
+		while (m_fitting_params.size() < contacts)
+			m_fitting_params.emplace_back();
+
+		m_fitting_temp.reserve(contacts);
+	}
+
+private:
+	/*!
+	 * Finds the rows of a heatmap of raw bytes that have to be processed.
+	 *
+	 * The blur can't raise a pixel above the largest pixel around it. Clusters only contain
+	 * pixels above the deactivation threshold, so they are at most one row away from a warm
+	 * row, i.e. a row that contains a pixel above the threshold. The pixels that gaussian
+	 * fitting and the cluster search look at are at most two rows away, and blurring those
+	 * only reads pixels that are at most three rows away. All other rows can be skipped.
+	 *
+	 * Whether a row is warm is decided from its bytes, without mapping them. The warm bytes
+	 * usually are the smallest or the largest ones, so the rows only have to be reduced to
+	 * their smallest or largest byte, which handles many pixels per instruction.
+	 *
+	 * @param[in] heatmap The raw heatmap to process.
+	 * @param[in] neutral The value of each byte, with the neutral value subtracted.
+	 * @param[in] low The smallest byte of the heatmap.
+	 * @param[in] high The largest byte of the heatmap.
+	 * @return Whether rows can be skipped. If so, @ref m_row_runs contains the rows to map.
+	 */
+	template <class Derived>
+	bool find_rows(const DenseBase<Derived> &heatmap,
+	               const std::array<T, 256> &neutral,
+	               const Eigen::Index low,
+	               const Eigen::Index high)
+	{
+		// Incremental detection compares the whole heatmap against the previous frame
+		if (m_config.incremental_tile_size > 0)
+			return false;
+
+		// The pyramid searches the warm pixels of the whole heatmap
+		if (this->pyramid())
+			return false;
+
+		const std::optional<T> cold = this->cold_threshold();
+
+		if (!cold.has_value())
+			return false;
+
+		const T threshold = cold.value();
+
+		const auto warm = [&](const Eigen::Index byte) {
+			return neutral.at(casts::to_unsigned(byte)) > threshold;
+		};
+
+		// Search the range of bytes that are warm
+		Eigen::Index first = low;
+
+		while (first <= high && !warm(first))
+			first++;
+
+		Eigen::Index last = first;
+
+		while (last <= high && warm(last))
+			last++;
+
+		for (Eigen::Index byte = last; byte <= high; byte++) {
+			if (warm(byte))
+				return false;
+		}
+
+		const Eigen::Index rows = heatmap.rows();
+
+		// Whether a row is warm, depending on its smallest or largest byte
+		std::function<bool(Eigen::Index)> row_warm {};
+
+		if (first == low) {
+			m_row_bytes = heatmap.rowwise().minCoeff();
+			row_warm = [&](const Eigen::Index y) { return m_row_bytes(y) < last; };
+		} else if (last == high + 1) {
+			m_row_bytes = heatmap.rowwise().maxCoeff();
+			row_warm = [&](const Eigen::Index y) { return m_row_bytes(y) >= first; };
+		} else {
+			return false;
+		}
+
+		m_row_distance.resize(casts::to_unsigned(rows));
+
+		// The distance to the closest warm row above, and then below
+		Eigen::Index distance = rows;
+
+		for (Eigen::Index y = 0; y < rows; y++) {
+			distance = row_warm(y) ? 0 : std::min(distance + 1, rows);
+			m_row_distance[casts::to_unsigned(y)] = distance;
+		}
+
+		distance = rows;
+
+		for (Eigen::Index y = rows - 1; y >= 0; y--) {
+			Eigen::Index &closest = m_row_distance[casts::to_unsigned(y)];
+
+			distance = closest == 0 ? 0 : std::min(distance + 1, rows);
+			closest = std::min(closest, distance);
+		}
+
+		m_row_runs.clear();
+
+		for (Eigen::Index y = 0; y < rows; y++) {
+			if (m_row_distance[casts::to_unsigned(y)] > 3)
+				continue;
+
+			if (!m_row_runs.empty() && m_row_runs.back().second == y)
+				m_row_runs.back().second = y + 1;
+			else
+				m_row_runs.emplace_back(y, y + 1);
+		}
+
+		return true;
+	}
+
+	/*!
+	 * The value that a pixel must not exceed so that neither it nor the blurred pixels
+	 * around it can be part of a cluster.
+	 *
+	 * The blur can't raise a pixel above the largest pixel around it, and clusters only
+	 * contain pixels above the deactivation threshold.
+	 *
+	 * @return The threshold, or null if every pixel can be part of a cluster.
+	 */
+	[[nodiscard]] std::optional<T> cold_threshold() const
+	{
+		const T athresh = m_config.activation_threshold;
+		const T dthresh = m_config.deactivation_threshold;
+		const T lowest = std::min(athresh, dthresh);
+
+		if (lowest <= 0)
+			return std::nullopt;
+
+		// Rounding errors of the blur must not be able to raise a pixel above the threshold
+		return lowest * gsl::narrow_cast<T>(0.99);
+	}
+
+	/*!
+	 * Blurs some rows of the heatmap.
+	 *
+	 * Rows that were skipped by @ref find_rows are set to zero instead. They can't contain
+	 * pixels above the deactivation threshold anyways.
+	 *
+	 * @param[in] first The first row that is blurred.
+	 * @param[in] last The row after the last row that is blurred.
+	 */
+	void blur_rows(const Eigen::Index first, const Eigen::Index last)
+	{
+		const auto &in = m_img_neutral;
+		const auto &kernel = m_kernel_blur;
+
+		if (m_row_distance.empty()) {
+			convolution::run_rows(in, kernel, m_img_blurred, first, last);
+			return;
+		}
+
+		const auto needed = [&](const Eigen::Index y) {
+			return m_row_distance[casts::to_unsigned(y)] <= 2;
+		};
+
+		Eigen::Index y = first;
+
+		while (y < last) {
+			const Eigen::Index start = y;
+			const bool blur = needed(y);
+
+			while (y < last && needed(y) == blur)
+				y++;
+
+			if (blur)
+				convolution::run_rows(in, kernel, m_img_blurred, start, y);
+			else
+				m_img_blurred.middleRows(start, y - start).setZero();
+		}
+	}
+
+	/*!
+	 * Subtracts the estimated neutral value of every pixel from a heatmap.
+	 *
+	 * Afterwards the estimates are updated using the values of the heatmap.
+	 *
+	 * @param[in] heatmap The heatmap to process.
+	 * @param[in] value Returns the actual value of the pixel at an index of the heatmap.
+	 * @return The largest pixel of the heatmap after the neutral value was subtracted.
+	 */
+	template <class Derived, class Func>
+	T subtract_baseline(const DenseBase<Derived> &heatmap, const Func &value)
+	{
+		const T offset = m_config.neutral_value_offset;
+		const T threshold = m_config.deactivation_threshold;
+		const T smoothing = m_config.neutral_value_smoothing;
+
+		const Eigen::Index size = heatmap.size();
+
+		auto max = casts::to<T>(0);
+
+		for (Eigen::Index i = 0; i < size; i++) {
+			const T delta = neutral::track_baseline(value(i),
+			                                        m_baseline.coeffRef(i),
+			                                        threshold,
+			                                        smoothing);
+
+			const T pixel = std::max(delta - offset, casts::to<T>(0));
+
+			m_img_neutral.coeffRef(i) = pixel;
+			max = std::max(max, pixel);
+		}
+
+		return max;
+	}
+
+	/*!
+	 * Prepares the internal buffers for a heatmap of a certain size.
+	 *
+	 * @param[in] rows The height of the heatmap.
+	 * @param[in] cols The width of the heatmap.
+	 */
+	void resize(const Eigen::Index rows, const Eigen::Index cols)
+	{
+		if (m_size.x() == cols && m_size.y() == rows)
+			return;
+
+		if constexpr (Rows != Eigen::Dynamic) {
+			if (rows != Rows || cols != Cols)
+				throw common::Error<Error::InvalidHeatmapSize> {};
+		}
+
+		// Both images are overwritten by the next frame, so they don't have to be kept.
+		// Zeroing them makes sure that their pages are already mapped.
+		m_img_neutral.setZero(rows, cols);
+		m_img_blurred.setZero(rows, cols);
+
+		m_fitting_temp.resize(rows, cols);
+
+		// The previous frame can't be compared against
+		m_incremental = false;
+
+		if (m_config.normalize)
+			m_input_diagonal = gsl::narrow_cast<T>(std::hypot(cols - 1, rows - 1));
+
+		m_size = Point {cols, rows};
+	}
+
+	/*!
+	 * Estimates the gaussian of a cluster from its moments, if it is too large for a finger.
+	 *
+	 * Large clusters are the most expensive to fit, but their contacts would be rejected by
+	 * the size check of the validation anyway. The moments only need one pass over the
+	 * pixels of the cluster, and are only calculated if the cluster can be large enough.
+	 *
+	 * @param[in,out] params The parameters of the cluster. The bounds must already be set.
+	 *                       If the cluster is too large, the mean and precision are set.
+	 * @return Whether the cluster is larger than the configured palm size.
+	 */
+	bool estimate_palm(gaussian::Parameters<TFit> &params) const
+	{
+		if (!m_config.palm_size.has_value())
+			return false;
+
+		const T diagonal = m_config.normalize ? m_input_diagonal : casts::to<T>(1);
+		const auto limit = gsl::narrow_cast<TFit>(m_config.palm_size.value() * diagonal);
+
+		// The diameter of the moments can't be larger than the diagonal of the bounds
+		if (params.bounds.sizes().template cast<TFit>().norm() <= limit)
+			return false;
+
+		Vector2<TFit> mean {};
+		Matrix2<TFit> cov {};
+
+		if (!moments::calculate(m_img_blurred, params.bounds, mean, cov))
+			return false;
+
+		// Only positive definite matrices describe an ellipse
+		if (cov(0, 0) <= 0 || cov.determinant() <= 0)
+			return false;
+
+		Eigen::SelfAdjointEigenSolver<Matrix2<TFit>> solver {};
+		solver.computeDirect(cov, Eigen::EigenvaluesOnly);
+
+		if (ellipse::size(solver.eigenvalues()).maxCoeff() <= limit)
+			return false;
+
+		params.mean = mean;
+		params.prec = cov.inverse();
+
+		return true;
+	}
+
+	/*!
+	 * Starts gaussian fitting from a gaussian of the previous frame.
+	 *
+	 * Of the gaussians whose mean is inside of the bounds, the one that is closest to the
+	 * center of the bounds is used. Every gaussian of the previous frame is only used once.
+	 *
+	 * @param[in,out] params The parameters to initialize. The bounds must already be set.
+	 */
+	void seed_fitting(gaussian::Parameters<TFit> &params)
+	{
+		const Eigen::AlignedBox<TFit, 2> bounds = params.bounds.template cast<TFit>();
+
+		auto best = m_fitting_seeds.end();
+		TFit distance = std::numeric_limits<TFit>::infinity();
+
+		for (auto it = m_fitting_seeds.begin(); it != m_fitting_seeds.end(); it++) {
+			const Vector2<TFit> &mean = it->first;
+
+			if (!bounds.contains(mean))
+				continue;
+
+			const TFit d = (mean - params.mean).squaredNorm();
+
+			if (d < distance) {
+				distance = d;
+				best = it;
+			}
+		}
+
+		if (best == m_fitting_seeds.end())
+			return;
+
+		params.mean = best->first;
+		params.prec = best->second;
+
+		// Remove the gaussian by replacing it with the last one
+		std::swap(*best, m_fitting_seeds.back());
+		m_fitting_seeds.pop_back();
+	}
+
+	/*!
+	 * Selects the pixels of a cluster that are used for gaussian fitting.
+	 *
+	 * Without masking, all pixels of the bounds are sampled. Otherwise, only the columns
+	 * between the first and the last pixel above the deactivation threshold are sampled,
+	 * extended by one pixel in every direction, like the bounds of the cluster. This keeps
+	 * the background around diagonal or elongated contacts out of the fit.
+	 *
+	 * @param[in,out] params The parameters to update. The bounds must already be set.
+	 */
+	void sample_columns(gaussian::Parameters<TFit> &params)
+	{
+		const Point &bmin = params.bounds.min();
+		const Point &bmax = params.bounds.max();
+
+		const Eigen::Index height = bmax.y() - bmin.y() + 1;
+
+		if (!m_config.fitting_mask) {
+			params.columns.col(0).head(height).setConstant(bmin.x());
+			params.columns.col(1).head(height).setConstant(bmax.x());
+			return;
+		}
+
+		const T dthresh = m_config.deactivation_threshold;
+
+		// Start with empty rows, the first column is behind the last one
+		params.columns.col(0).head(height).setConstant(bmax.x() + 1);
+		params.columns.col(1).head(height).setConstant(bmin.x() - 1);
+
+		for (Eigen::Index y = bmin.y(); y <= bmax.y(); y++) {
+			Eigen::Index first = bmax.x() + 1;
+			Eigen::Index last = bmin.x() - 1;
+
+			for (Eigen::Index x = bmin.x(); x <= bmax.x(); x++) {
+				if (m_img_blurred(y, x) <= dthresh)
+					continue;
+
+				first = std::min(first, x);
+				last = x;
+			}
+
+			if (first > last)
+				continue;
+
+			first = std::max(first - 1, bmin.x());
+			last = std::min(last + 1, bmax.x());
+
+			// Extend the row and its neighbours
+			const Eigen::Index top = std::max(y - 1, bmin.y()) - bmin.y();
+			const Eigen::Index bottom = std::min(y + 1, bmax.y()) - bmin.y();
+
+			for (Eigen::Index i = top; i <= bottom; i++) {
+				params.columns(i, 0) = std::min(params.columns(i, 0), first);
+				params.columns(i, 1) = std::max(params.columns(i, 1), last);
+			}
+		}
+	}
+
+	/*!
+	 * Blurs the heatmap and searches for local maximas in the blurred heatmap.
+	 *
+	 * The heatmap is blurred row by row. The maximas of a row can be found as soon as the
+	 * row below it was blurred, so the search happens while the rows are still in the cache,
+	 * instead of going over the whole blurred heatmap a second time.
+	 *
+	 * @param[in] threshold The activation threshold.
+	 * @param[in] find Whether to search for local maximas.
+	 * @return How many pixels of the blurred heatmap are above the activation threshold.
+	 */
+	Eigen::Index blur_and_find_maximas(const T threshold, const bool find)
+	{
+		if (m_config.reference)
+			return this->blur_reference(threshold, find);
+
+		if (common::ThreadPool *pool = this->strip_pool())
+			return this->blur_strips(threshold, find, *pool);
+
+		const Eigen::Index rows = m_img_neutral.rows();
+
+		Eigen::Index active = 0;
+		Eigen::Index previous = 0;
+
+		m_maximas.clear();
+
+		for (Eigen::Index y = 0; y < rows; y++) {
+			this->blur_rows(y, y + 1);
+
+			const Eigen::Index count = (m_img_blurred.row(y) > threshold).count();
+
+			// A row without active pixels can't contain a maximum
+			if (find && y > 0 && previous > 0)
+				maximas::find_row(m_img_blurred, threshold, y - 1, m_maximas);
+
+			active += count;
+			previous = count;
+		}
+
+		if (find && previous > 0)
+			maximas::find_row(m_img_blurred, threshold, rows - 1, m_maximas);
+
+		return active;
+	}
+
+	/*!
+	 * Blurs the whole heatmap and searches it for local maximas, one pixel at a time.
+	 *
+	 * This is the reference for @ref blur_and_find_maximas, using the generic convolution
+	 * and checking every pixel on its own.
+	 *
+	 * @param[in] threshold The activation threshold.
+	 * @param[in] find Whether to search for local maximas.
+	 * @return How many pixels of the blurred heatmap are above the activation threshold.
+	 */
+	Eigen::Index blur_reference(const T threshold, const bool find)
+	{
+		convolution::impl::run_generic(m_img_neutral, m_kernel_blur, m_img_blurred);
+
+		m_maximas.clear();
+
+		if (find) {
+			const Box whole = convolution::impl::whole(m_img_blurred);
+			maximas::find_block(m_img_blurred, threshold, whole, m_maximas);
+		}
+
+		return (m_img_blurred > threshold).count();
+	}
+
+	/*!
+	 * Blurs the heatmap and searches for local maximas in horizontal strips, in parallel.
+	 *
+	 * Blurring a strip reads the rows around it, but only writes its own rows. Searching a
+	 * row needs the blurred rows around it, so all strips are blurred before the search
+	 * starts. The maximas of every strip are joined in the order of the strips, so they are
+	 * the same as when searching the whole heatmap at once.
+	 *
+	 * @param[in] threshold The activation threshold.
+	 * @param[in] find Whether to search for local maximas.
+	 * @param[in] pool The threads that process the strips.
+	 * @return How many pixels of the blurred heatmap are above the activation threshold.
+	 */
+	Eigen::Index blur_strips(const T threshold, const bool find, common::ThreadPool &pool)
+	{
+		const Eigen::Index rows = m_img_neutral.rows();
+		const Eigen::Index strips = casts::to_eigen(pool.size());
+		const Eigen::Index height = (rows + strips - 1) / strips;
+
+		m_row_active.resize(casts::to_unsigned(rows));
+		m_maximas.clear();
 
-	// The heatmap with the neutral value subtracted.
-	Image<T> m_img_neutral {};
+		const auto range = [&](const usize task) {
+			const Eigen::Index first = std::min(casts::to_eigen(task) * height, rows);
+			return std::make_pair(first, std::min(first + height, rows));
+		};
 
-	// The blurred heatmap.
-	Image<T> m_img_blurred {};
+		pool.run(pool.size(), [&](const usize task, const usize /* unused */) {
+			const auto [first, last] = range(task);
 
-	// The kernel that is used for blurring.
-	Matrix3<T> m_kernel_blur = kernels::gaussian<T, 3, 3>(gsl::narrow_cast<T>(0.75));
+			if (first == last)
+				return;
 
-	// The list of local maximas.
-	std::vector<Point> m_maximas {};
+			this->blur_rows(first, last);
 
-	// The list of spanned clusters.
-	std::vector<Box> m_clusters {};
+			for (Eigen::Index y = first; y < last; y++) {
+				const auto row = casts::to_unsigned(y);
+				m_row_active[row] = (m_img_blurred.row(y) > threshold).count();
+			}
+		});
 
-	// Temporary storage for cluster spanning.
-	std::vector<Box> m_clusters_temp {};
+		const Eigen::Index active =
+			std::accumulate(m_row_active.begin(), m_row_active.end(), Eigen::Index {0});
 
-	// Input parameters for gaussian fitting.
-	std::vector<gaussian::Parameters<TFit>> m_fitting_params {};
+		if (!find || active == 0)
+			return active;
 
-	// Temporary storage for gaussian fitting.
-	Image<TFit> m_fitting_temp {};
+		pool.run(pool.size(), [&](const usize task, const usize /* unused */) {
+			const auto [first, last] = range(task);
 
-	// How many frames are left before the neutral value has to be recalculated.
-	usize m_counter = 0;
+			std::vector<Point> &maximas = m_strip_maximas[task];
+			maximas.clear();
 
-	// The cached neutral value of the heatmap.
-	T m_neutral = casts::to<T>(0);
+			// A row without active pixels can't contain a maximum
+			for (Eigen::Index y = first; y < last; y++) {
+				if (m_row_active[casts::to_unsigned(y)] > 0)
+					maximas::find_row(m_img_blurred, threshold, y, maximas);
+			}
+		});
 
-public:
-	Detector(Config<T> config) : m_config {std::move(config)} {};
+		for (const std::vector<Point> &maximas : m_strip_maximas)
+			m_maximas.insert(m_maximas.end(), maximas.begin(), maximas.end());
+
+		return active;
+	}
 
 	/*!
-	 * Search for contacts in a capacitive heatmap.
+	 * Spans a cluster from every local maximum, in parallel.
 	 *
-	 * This function uses a threshold based recursive descent to build
-	 * a list of connected clusters based on the (pre-processed) heatmap,
-	 * and then uses gaussian fitting to fit an ellipse onto these clusters.
+	 * The clusters are independent of each other, and every thread has its own temporary
+	 * storage, so they are the same as when spanning them one after another.
 	 *
-	 * @param[in] heatmap The heatmap to process.
-	 * @param[out] contacts The list of detected contacts.
+	 * @param[in] athresh The activation threshold.
+	 * @param[in] dthresh The deactivation threshold.
+	 * @param[in] pool The threads that span the clusters.
 	 */
-	template <int Rows, int Cols>
-	void detect(const ImageBase<T, Rows, Cols> &heatmap, std::vector<Contact<T>> &contacts)
+	void span_clusters(const T athresh, const T dthresh, common::ThreadPool &pool)
 	{
-		const Vector2<Eigen::Index> one = Vector2<Eigen::Index>::Ones();
+		m_spans.resize(m_maximas.size());
 
-		const Eigen::Index cols = heatmap.cols();
-		const Eigen::Index rows = heatmap.rows();
+		pool.run(m_maximas.size(), [&](const usize i, const usize thread) {
+			m_spans[i] = cluster::span(m_img_blurred,
+			                           m_maximas[i],
+			                           athresh,
+			                           dthresh,
+			                           m_strip_visited[thread],
+			                           m_strip_stacks[thread]);
+		});
+	}
 
-		const Vector2<Eigen::Index> dimensions {cols - 1, rows - 1};
+	/*!
+	 * The threads that process the current heatmap in strips, if it is large enough.
+	 *
+	 * @return The threads for gaussian fitting, or null to process the heatmap serially.
+	 */
+	[[nodiscard]] common::ThreadPool *strip_pool() const
+	{
+		const usize threshold = m_config.strip_threshold;
+		const auto pixels = casts::to_unsigned(m_img_neutral.size());
+
+		if (threshold == 0 || pixels < threshold)
+			return nullptr;
+
+		return m_fitting_pool.get();
+	}
+
+	/*!
+	 * Whether the current heatmap is large enough to be processed coarse to fine.
+	 *
+	 * Incremental detection expects the whole heatmap to be blurred, so it is not combined
+	 * with the pyramid.
+	 */
+	[[nodiscard]] bool pyramid() const
+	{
+		const usize threshold = m_config.pyramid_threshold;
+		const auto pixels = casts::to_unsigned(m_img_neutral.size());
+
+		if (threshold == 0 || pixels < threshold)
+			return false;
+
+		if (m_config.incremental_tile_size > 0)
+			return false;
+
+		return this->cold_threshold().has_value();
+	}
+
+	/*!
+	 * Blurs and searches only the parts of the heatmap that can contain clusters.
+	 *
+	 * The heatmap is downsampled by storing the largest pixel of every tile of 2x2 pixels.
+	 * Tiles whose largest pixel is above the @ref cold_threshold are warm. All pixels that
+	 * the cluster search looks at are at most two pixels away from a warm pixel, so they
+	 * are part of a warm tile or one of its neighbours. Only these windows are blurred and
+	 * searched for local maximas, the rest of the blurred heatmap is set to zero.
+	 *
+	 * @param[in] threshold The activation threshold.
+	 * @param[in] find Whether to search for local maximas.
+	 * @return How many pixels of the blurred heatmap are above the activation threshold.
+	 */
+	Eigen::Index blur_windows(const T threshold, const bool find)
+	{
+		const Eigen::Index size = PYRAMID_SCALE;
+		const T cold = this->cold_threshold().value();
+
+		const Eigen::Index cols = m_img_neutral.cols();
+		const Eigen::Index rows = m_img_neutral.rows();
+
+		tiles::maximum<PYRAMID_SCALE>(m_img_neutral, m_img_coarse);
+		tiles::spread(m_img_coarse, m_coarse_temp, m_img_around);
+
+		m_coarse_rows = m_img_around.rowwise().maxCoeff();
+
+		// Whether a tile is next to a warm tile
+		const auto window = [&](const Eigen::Index ty, const Eigen::Index tx) {
+			return m_img_around.coeff(ty, tx) > cold;
+		};
+
+		const Point count = tiles::count(rows, cols, size);
+
+		m_windows.clear();
+
+		// Join the tiles of every row of tiles into runs of windows
+		for (Eigen::Index ty = 0; ty < count.y(); ty++) {
+			if (m_coarse_rows(ty) <= cold)
+				continue;
+
+			Eigen::Index tx = 0;
+
+			while (tx < count.x()) {
+				if (!window(ty, tx)) {
+					tx++;
+					continue;
+				}
+
+				const Eigen::Index start = tx;
+
+				while (tx < count.x() && window(ty, tx))
+					tx++;
+
+				const Box first = tiles::pixels(Point {start, ty}, rows, cols, size);
+				const Box last = tiles::pixels(Point {tx - 1, ty}, rows, cols, size);
+
+				m_windows.emplace_back(first.min(), last.max());
+			}
+		}
+
+		Eigen::Index active = 0;
+
+		// Clearing everything at once is faster than clearing the pixels between the windows
+		m_img_blurred.setZero();
+
+		for (const Box &window : m_windows) {
+			const Point min = window.min();
+			const Point extent = window.sizes() + Point::Ones();
+
+			convolution::run_block(m_img_neutral, m_kernel_blur, m_img_blurred, window);
+
+			const auto pixels =
+				m_img_blurred.block(min.y(), min.x(), extent.y(), extent.x());
+
+			active += (pixels > threshold).count();
+		}
+
+		m_maximas.clear();
+
+		if (!find || active == 0)
+			return active;
+
+		// The search needs the neighbours of a window, so it starts once all are blurred
+		for (const Box &window : m_windows)
+			maximas::find_block(m_img_blurred, threshold, window, m_maximas);
+
+		// Use the same order as a search over the whole heatmap
+		std::sort(m_maximas.begin(), m_maximas.end(), &Detector::before);
+
+		return active;
+	}
+
+	/*!
+	 * Blurs the parts of the clusters that are outside of the windows of the pyramid.
+	 *
+	 * The bounds of a single cluster are always inside the windows, but when overlapping
+	 * clusters are merged, their bounds can reach between them. Gaussian fitting looks at
+	 * all pixels in the bounds, so they have to be the same as when blurring everything.
+	 */
+	void blur_clusters()
+	{
+		const Eigen::Index size = PYRAMID_SCALE;
+		const T cold = this->cold_threshold().value();
+
+		const Eigen::Index cols = m_img_neutral.cols();
+		const Eigen::Index rows = m_img_neutral.rows();
+
+		for (const Box &cluster : m_clusters) {
+			const Point min = cluster.min() / size;
+			const Point max = cluster.max() / size;
+
+			for (Eigen::Index ty = min.y(); ty <= max.y(); ty++) {
+				for (Eigen::Index tx = min.x(); tx <= max.x(); tx++) {
+					if (m_img_around(ty, tx) > cold)
+						continue;
+
+					const Point tile {tx, ty};
+					const Box pixels = tiles::pixels(tile, rows, cols, size);
+
+					convolution::run_block(m_img_neutral,
+					                       m_kernel_blur,
+					                       m_img_blurred,
+					                       pixels.intersection(cluster));
+				}
+			}
+		}
+	}
+
+	/*!
+	 * Compares the heatmap against the previous frame, and only blurs and searches the
+	 * tiles of the heatmap that have changed.
+	 *
+	 * Changing a pixel changes the blurred pixels around it, and the local maximas around
+	 * those. Both are recalculated for the changed tiles and their neighbours, which is
+	 * enough as long as the tiles are at least two pixels large. Afterwards, the heatmap is
+	 * the same as if it was blurred and searched at once.
+	 *
+	 * @param[in] threshold The activation threshold.
+	 * @param[in] find Whether to search for local maximas.
+	 */
+	void blur_changed_tiles(const T threshold, const bool find)
+	{
+		const Eigen::Index size = casts::to_eigen(m_config.incremental_tile_size);
+
+		const Eigen::Index cols = m_img_neutral.cols();
+		const Eigen::Index rows = m_img_neutral.rows();
+
+		tiles::diff(m_img_neutral, m_img_previous, size, m_tiles_dirty);
+		tiles::dilate(m_tiles_dirty, m_tiles_changed);
+
+		std::swap(m_maximas, m_maximas_last);
+		std::swap(m_spans, m_spans_last);
+
+		m_maximas.clear();
+
+		// The local maximas of unchanged tiles stay the same
+		if (find) {
+			for (const Point &point : m_maximas_last) {
+				if (!m_tiles_changed(point.y() / size, point.x() / size))
+					m_maximas.push_back(point);
+			}
+		}
+
+		const Point count = tiles::count(rows, cols, size);
+
+		// The pixels of a tile in one of the buffers
+		const auto block = [](auto &image, const Box &box) {
+			const Point extent = box.sizes() + Point::Ones();
+			return image.block(box.min().y(), box.min().x(), extent.y(), extent.x());
+		};
+
+		for (Eigen::Index ty = 0; ty < count.y(); ty++) {
+			for (Eigen::Index tx = 0; tx < count.x(); tx++) {
+				const Box box = tiles::pixels(Point {tx, ty}, rows, cols, size);
+
+				if (m_tiles_dirty(ty, tx))
+					block(m_img_previous, box) = block(m_img_neutral, box);
+
+				if (!m_tiles_changed(ty, tx))
+					continue;
+
+				convolution::run_block(m_img_neutral,
+				                       m_kernel_blur,
+				                       m_img_blurred,
+				                       box);
+			}
+		}
+
+		if (!find)
+			return;
+
+		// The search needs the neighbours of a tile, so it starts once all are blurred
+		for (Eigen::Index ty = 0; ty < count.y(); ty++) {
+			for (Eigen::Index tx = 0; tx < count.x(); tx++) {
+				if (!m_tiles_changed(ty, tx))
+					continue;
+
+				const Box box = tiles::pixels(Point {tx, ty}, rows, cols, size);
+				maximas::find_block(m_img_blurred, threshold, box, m_maximas);
+			}
+		}
+
+		// Use the same order as a search over the whole heatmap
+		std::sort(m_maximas.begin(), m_maximas.end(), &Detector::before);
+	}
 
-		const Eigen::Index bcols = m_img_neutral.cols();
-		const Eigen::Index brows = m_img_neutral.rows();
+	/*!
+	 * Spans a cluster from every local maximum, reusing the clusters of the previous frame.
+	 *
+	 * Spanning a cluster only looks at its pixels and their neighbours. If none of them
+	 * has changed, and the cluster was spanned from the same local maximum before, the
+	 * cluster of the previous frame is used.
+	 *
+	 * @param[in] athresh The activation threshold.
+	 * @param[in] dthresh The deactivation threshold.
+	 */
+	void span_changed_clusters(const T athresh, const T dthresh)
+	{
+		const Eigen::Index size = casts::to_eigen(m_config.incremental_tile_size);
+		const Point one = Point::Ones();
+
+		usize last = 0;
+
+		for (const Point &point : m_maximas) {
+			// Both lists are sorted, so they can be walked at the same time
+			while (last < m_maximas_last.size() && before(m_maximas_last[last], point))
+				last++;
+
+			if (last < m_maximas_last.size() && m_maximas_last[last] == point) {
+				const Box &cluster = m_spans_last[last];
+				const Box around {cluster.min() - one, cluster.max() + one};
+
+				if (!tiles::touches(m_tiles_changed, size, around)) {
+					m_spans.push_back(cluster);
+					continue;
+				}
+			}
+
+			m_spans.push_back(cluster::span(m_img_blurred,
+			                                point,
+			                                athresh,
+			                                dthresh,
+			                                m_visited,
+			                                m_span_stack));
+		}
+	}
+
+	/*!
+	 * Searches a gaussian of the previous frame that was fitted to the same pixels.
+	 *
+	 * The gaussians of overlapping clusters influence each other, so only clusters that
+	 * don't overlap any others, neither in this nor in the previous frame, can be reused.
+	 *
+	 * @param[in] index The index of the cluster.
+	 * @return The index of the gaussian that can be reused, if there is one.
+	 */
+	[[nodiscard]] std::optional<usize> find_fitted(const usize index) const
+	{
+		const Eigen::Index size = casts::to_eigen(m_config.incremental_tile_size);
+		const Box &cluster = m_clusters[index];
+
+		if (!m_isolated[index] || tiles::touches(m_tiles_changed, size, cluster))
+			return std::nullopt;
+
+		for (usize i = 0; i < m_fitted.size(); i++) {
+			const Fitted &fitted = m_fitted[i];
+
+			if (!fitted.isolated)
+				continue;
+
+			const Box &bounds = fitted.bounds;
+
+			if (bounds.min() == cluster.min() && bounds.max() == cluster.max())
+				return i;
+		}
+
+		return std::nullopt;
+	}
+
+	/*!
+	 * Checks which clusters don't overlap any other clusters.
+	 */
+	void find_isolated()
+	{
+		m_isolated.assign(m_clusters.size(), true);
+
+		for (usize i = 0; i < m_clusters.size(); i++) {
+			for (usize j = i + 1; j < m_clusters.size(); j++) {
+				if (!m_clusters[i].intersects(m_clusters[j]))
+					continue;
+
+				m_isolated[i] = false;
+				m_isolated[j] = false;
+			}
+		}
+	}
+
+	/*!
+	 * Restores the gaussians that were reused from the previous frame, and stores the
+	 * gaussians of all clusters for the next frame.
+	 */
+	void remember_fitted()
+	{
+		for (usize i = 0; i < m_clusters.size(); i++) {
+			if (!m_reused[i].has_value())
+				continue;
+
+			const Fitted &fitted = m_fitted[m_reused[i].value()];
+			gaussian::Parameters<TFit> &params = m_fitting_params[i];
 
-		// Resize the internal buffers if neccessary.
-		if (brows != rows || bcols != cols) {
-			m_img_neutral.conservativeResize(rows, cols);
-			m_img_blurred.conservativeResize(rows, cols);
-			m_fitting_temp.conservativeResize(rows, cols);
+			params.valid = fitted.valid;
+			params.scale = fitted.scale;
+			params.mean = fitted.mean;
+			params.prec = fitted.prec;
+		}
+
+		m_fitted.clear();
 
-			if (m_config.normalize)
-				m_input_diagonal = std::hypot(dimensions.x(), dimensions.y());
+		for (usize i = 0; i < m_clusters.size(); i++) {
+			const gaussian::Parameters<TFit> &params = m_fitting_params[i];
+
+			m_fitted.push_back(Fitted {
+				m_clusters[i],
+				m_isolated[i],
+				params.valid,
+				params.scale,
+				params.mean,
+				params.prec,
+			});
 		}
 
+		m_incremental = true;
+	}
+
+	/*!
+	 * Whether a point comes before another one, going through the heatmap row by row.
+	 *
+	 * @param[in] a The first point.
+	 * @param[in] b The second point.
+	 * @return Whether the first point comes first.
+	 */
+	static bool before(const Point &a, const Point &b)
+	{
+		return a.y() < b.y() || (a.y() == b.y() && a.x() < b.x());
+	}
+
+	/*!
+	 * Finishes a frame that can't contain any contacts.
+	 *
+	 * This skips everything that would only confirm that there are no contacts.
+	 *
+	 * @param[out] contacts The list of detected contacts, which will be empty.
+	 */
+	void detect_empty(std::vector<Contact<T>> &contacts)
+	{
 		contacts.clear();
 		m_clusters.clear();
-		m_fitting_params.clear();
 
-		// Recalculate the neutral value if neccessary
-		if (m_counter == 0) {
-			m_neutral = neutral::calculate(heatmap,
-			                               m_config.neutral_value_algorithm,
-			                               m_config.neutral_value_offset);
-		}
+		for (gaussian::Parameters<TFit> &params : m_fitting_params)
+			params.valid = false;
 
-		// Update counter
-		m_counter = (m_counter + 1) % m_config.neutral_value_backoff;
+		// There are no gaussians that the next frame could start from
+		m_fitting_seeds.clear();
 
-		// Subtract the neutral value from the whole heatmap
-		m_img_neutral = (heatmap - m_neutral).max(casts::to<T>(0));
+		// The heatmap was not processed, so it can't be compared against
+		m_incremental = false;
+	}
+
+	/*!
+	 * Search for contacts in the heatmap, after the neutral value was subtracted.
+	 *
+	 * @param[out] contacts The list of detected contacts.
+	 */
+	void detect_neutral(std::vector<Contact<T>> &contacts)
+	{
+		const Vector2<Eigen::Index> one = Vector2<Eigen::Index>::Ones();
+
+		const Eigen::Index cols = m_img_neutral.cols();
+		const Eigen::Index rows = m_img_neutral.rows();
+
+		const Vector2<Eigen::Index> dimensions {cols - 1, rows - 1};
 
-		// Blur the heatmap slightly
-		convolution::run(m_img_neutral, m_kernel_blur, m_img_blurred);
+		contacts.clear();
+		m_clusters.clear();
+
+		for (gaussian::Parameters<TFit> &params : m_fitting_params)
+			params.valid = false;
 
 		const T athresh = m_config.activation_threshold;
 		const T dthresh = m_config.deactivation_threshold;
 
-		// Search for local maximas
-		maximas::find(m_img_blurred, athresh, m_maximas);
+		const bool label = m_config.cluster_algorithm == cluster::Algorithm::LABEL;
 
-		// Iterate over the maximas and start building clusters
-		for (const Point &point : m_maximas) {
-			Box cluster = cluster::span(m_img_blurred, point, athresh, dthresh);
+		const bool tiled = m_config.incremental_tile_size > 0;
+		const bool incremental = m_incremental;
+		const bool pyramid = this->pyramid();
+
+		if (incremental) {
+			// Only blur the parts of the heatmap that have changed since the last frame
+			this->blur_changed_tiles(athresh, !label);
+			m_timings.lap(Stage::BLUR);
+		} else {
+			// Blur the heatmap slightly, and search for local maximas while doing so
+			const Eigen::Index active =
+				pyramid ? this->blur_windows(athresh, !label)
+				        : this->blur_and_find_maximas(athresh, !label);
+			m_timings.lap(Stage::BLUR);
+
+			// Without any active pixels there can't be any clusters
+			if (active == 0) {
+				this->detect_empty(contacts);
+				return;
+			}
+
+			if (tiled)
+				m_img_previous = m_img_neutral;
+		}
+
+		m_spans.clear();
+
+		// Large heatmaps are processed in parallel
+		common::ThreadPool *strips = incremental ? nullptr : this->strip_pool();
+
+		if (label) {
+			// Label all clusters at once
+			cluster::label(m_img_blurred, athresh, dthresh, m_labels, m_spans, strips);
+		} else if (incremental) {
+			// Only span the clusters that have changed since the last frame
+			this->span_changed_clusters(athresh, dthresh);
+		} else if (strips != nullptr) {
+			this->span_clusters(athresh, dthresh, *strips);
+		} else {
+			// Iterate over the maximas and start building clusters
+			for (const Point &point : m_maximas) {
+				m_spans.push_back(cluster::span(m_img_blurred,
+				                                point,
+				                                athresh,
+				                                dthresh,
+				                                m_visited,
+				                                m_span_stack));
+			}
+		}
 
+		for (Box cluster : m_spans) {
 			if (cluster.isEmpty())
 				continue;
 
@@ -150,37 +1553,120 @@ public:
 			m_clusters.push_back(std::move(cluster));
 		}
 
+		m_timings.lap(Stage::CLUSTER);
+
 		// Merge overlapping clusters
-		overlaps::merge(m_clusters, m_clusters_temp, 5);
+		overlaps::merge(m_clusters, m_overlaps, 5);
+
+		if (pyramid)
+			this->blur_clusters();
+
+		if (tiled)
+			this->find_isolated();
+
+		m_timings.lap(Stage::MERGE);
+
+		m_reused.assign(m_clusters.size(), std::nullopt);
+		m_palms.assign(m_clusters.size(), false);
 
 		// Prepare clusters for gaussian fitting
-		for (const Box &cluster : m_clusters) {
-			const Vector2<TFit> mean = cluster.cast<TFit>().center();
-			const Matrix2<TFit> prec = Matrix2<TFit>::Identity();
+		for (usize i = 0; i < m_clusters.size(); i++) {
+			const Box &cluster = m_clusters[i];
 
 			// min() and max() are inclusive so we need to add one
 			const Vector2<Eigen::Index> size = cluster.sizes() + one;
 
-			gaussian::Parameters<TFit> params {
-				true,
-				1,
-				mean,
-				prec,
-				cluster,
-				Image<TFit> {size.y(), size.x()},
-			};
+			if (i == m_fitting_params.size()) {
+				m_fitting_params.emplace_back();
+				m_fitting_allocations++;
+			}
+
+			gaussian::Parameters<TFit> &params = m_fitting_params[i];
+
+			params.valid = true;
+			params.scale = 1;
+			params.mean = cluster.cast<TFit>().center();
+			params.prec = Matrix2<TFit>::Identity();
+			params.bounds = cluster;
+
+			// Clusters that are too large for a finger are estimated instead of fitted
+			if (this->estimate_palm(params)) {
+				m_palms[i] = true;
+				params.valid = false;
+				continue;
+			}
+
+			if (m_config.fitting_warm_start)
+				this->seed_fitting(params);
+
+			// Gaussians whose pixels haven't changed don't have to be fitted again
+			if (incremental)
+				m_reused[i] = this->find_fitted(i);
+
+			if (m_reused[i].has_value()) {
+				params.valid = false;
+				continue;
+			}
+
+			// The weights only grow, so they don't have to be reallocated every frame
+			const Eigen::Index wrows = params.weights.rows();
+			const Eigen::Index wcols = params.weights.cols();
 
-			m_fitting_params.push_back(std::move(params));
+			if (wrows < size.y() || wcols < size.x()) {
+				const Eigen::Index rows = std::max(wrows, size.y());
+				const Eigen::Index cols = std::max(wcols, size.x());
+
+				params.weights.resize(rows, cols);
+				m_fitting_allocations++;
+			}
+
+			if (params.columns.rows() < size.y()) {
+				params.columns.resize(size.y(), 2);
+				m_fitting_allocations++;
+			}
+
+			this->sample_columns(params);
 		}
 
+		if (m_fitting_temp.reserve(m_clusters.size()))
+			m_fitting_allocations++;
+
+		// Only use multiple threads if there is enough work to make up for waking them
+		const bool parallel = m_clusters.size() >= m_config.fitting_thread_threshold;
+		common::ThreadPool *pool = parallel ? m_fitting_pool.get() : nullptr;
+
 		// Run gaussian fitting
-		gaussian::fit(m_fitting_params, m_img_blurred, m_fitting_temp, 3);
+		gaussian::fit(m_fitting_params,
+		              m_img_blurred,
+		              m_fitting_temp,
+		              3,
+		              gsl::narrow_cast<TFit>(m_config.fitting_tolerance),
+		              pool,
+		              m_config.reference);
+
+		if (tiled)
+			this->remember_fitted();
+
+		m_fitting_seeds.clear();
 
 		// Create a contact from every gaussian fitting parameter
-		for (const auto &p : m_fitting_params) {
-			if (!p.valid)
+		for (usize i = 0; i < m_fitting_params.size(); i++) {
+			const gaussian::Parameters<TFit> &p = m_fitting_params[i];
+			const bool palm = i < m_palms.size() && m_palms[i];
+
+			if (!p.valid && !palm)
 				continue;
 
+			// Only positive definite matrices can be used as a starting point
+			const bool definite = p.prec(0, 0) > 0 && p.prec.determinant() > 0;
+
+			if (m_config.fitting_warm_start && definite) {
+				if (m_fitting_seeds.size() == m_fitting_seeds.capacity())
+					m_fitting_allocations++;
+
+				m_fitting_seeds.emplace_back(p.mean, p.prec);
+			}
+
 			const Matrix2<TFit> cov = p.prec.inverse();
 
 			Eigen::SelfAdjointEigenSolver<Matrix2<TFit>> solver {};
@@ -201,7 +1687,12 @@ public:
 			                               size.template cast<T>(),
 			                               gsl::narrow_cast<T>(orientation),
 			                               m_config.normalize});
+
+			if (palm)
+				contacts.back().valid = false;
 		}
+
+		m_timings.lap(Stage::FIT);
 	}
 };
 
@@ -6,18 +6,27 @@
 #include "config.hpp"
 #include "contact.hpp"
 #include "detection/detector.hpp"
+#include "history.hpp"
 #include "stability/stabilizer.hpp"
+#include "timings.hpp"
 #include "tracking/tracker.hpp"
 #include "validation/validator.hpp"
 
+#include <common/casts.hpp>
+#include <common/tracing.hpp>
 #include <common/types.hpp>
 
+#include <array>
 #include <type_traits>
 #include <vector>
 
 namespace iptsd::contacts {
 
-template <class T, class TFit = T>
+/*
+ * If the size of the heatmaps is known at compile time, it can be passed as Rows and Cols,
+ * see @ref detection::Detector.
+ */
+template <class T, class TFit = T, int Rows = Eigen::Dynamic, int Cols = Eigen::Dynamic>
 class Finder {
 public:
 	static_assert(std::is_floating_point_v<T>);
@@ -25,10 +34,10 @@ public:
 
 private:
 	// Detects contacts in a capacitive heatmap.
-	detection::Detector<T, TFit> m_detector;
+	detection::Detector<T, TFit, Rows, Cols> m_detector;
 
 	// Tracks contacts over multiple frames.
-	tracking::Tracker<T> m_tracker {};
+	tracking::Tracker<T> m_tracker;
 
 	// Stabilizes size and movement of contacts.
 	stability::Stabilizer<T> m_stabilizer;
@@ -36,20 +45,65 @@ private:
 	// Validates size and aspect ratio of contacts.
 	validation::Validator<T> m_validator;
 
+	// The contacts from the previous frames, shared by all stages.
+	History<T> m_history {};
+
+	// How much time was spent in the stages that follow the detection.
+	Timings m_timings {};
+
 public:
 	Finder(Config<T> config)
 		: m_detector {config.detection},
+		  m_tracker {config.tracking},
 		  m_stabilizer {config.stability},
 		  m_validator {config.validation} {};
 
+	/*!
+	 * The contact detector that is used by the finder.
+	 *
+	 * @return A reference to the contact detector.
+	 */
+	[[nodiscard]] const detection::Detector<T, TFit, Rows, Cols> &detector() const
+	{
+		return m_detector;
+	}
+
+	/*!
+	 * How much time the finder spent in every stage of processing a heatmap.
+	 *
+	 * The timers are only compiled in if iptsd was built with the stage_timers option.
+	 *
+	 * @return The accumulated time of all frames since the finder was created.
+	 */
+	[[nodiscard]] Timings timings() const
+	{
+		Timings timings = m_detector.timings();
+		timings.add(m_timings);
+
+		return timings;
+	}
+
 	/*!
 	 * Resets the contact finder by clearing all stored previous frames.
 	 */
 	void reset()
 	{
+		m_detector.reset();
 		m_tracker.reset();
-		m_stabilizer.reset();
-		m_validator.reset();
+		m_history.clear();
+	}
+
+	/*!
+	 * Allocates the storage of all stages for heatmaps of a certain size.
+	 *
+	 * @param[in] rows The height of the heatmaps.
+	 * @param[in] cols The width of the heatmaps.
+	 * @param[in] contacts How many contacts to allocate storage for.
+	 */
+	void prepare(const Eigen::Index rows, const Eigen::Index cols, const usize contacts)
+	{
+		m_detector.prepare(rows, cols, contacts);
+		m_tracker.reserve(contacts);
 	}
 
 	/*!
@@ -63,14 +117,131 @@ public:
 	 *
 	 * @param[in] heatmap The capacitive heatmap to process.
 	 * @param[out] contacts The list of found contacts.
+	 * @param[in] elapsed The milliseconds since the previous heatmap, or 0 if unknown.
+	 */
+	template <int HRows, int HCols>
+	void find(const ImageBase<T, HRows, HCols> &heatmap,
+	          std::vector<Contact<T>> &contacts,
+	          const T elapsed = casts::to<T>(0))
+	{
+		this->detect(heatmap, contacts);
+		this->track(contacts, elapsed);
+	}
+
+	/*!
+	 * Extracts contacts from a capacitive heatmap of raw bytes.
+	 *
+	 * This works like the other overload, but the heatmap is mapped to its actual values
+	 * using a table while it is being processed.
+	 *
+	 * @param[in] heatmap The raw heatmap to process.
+	 * @param[in] lut The value of each byte.
+	 * @param[out] contacts The list of found contacts.
+	 * @param[in] elapsed The milliseconds since the previous heatmap, or 0 if unknown.
+	 */
+	template <class Derived>
+	void find(const DenseBase<Derived> &heatmap,
+	          const std::array<T, 256> &lut,
+	          std::vector<Contact<T>> &contacts,
+	          const T elapsed = casts::to<T>(0))
+	{
+		this->detect(heatmap, lut, contacts);
+		this->track(contacts, elapsed);
+	}
+
+	/*!
+	 * Runs only the detection phase of @ref find.
+	 *
+	 * The contacts of every heatmap have to be passed to @ref track once, in the order the
+	 * heatmaps were detected. The next heatmap can be detected before that, even on another
+	 * thread while the previous contacts are being tracked, as long as they are stored in
+	 * a separate list. @ref track only uses the tracking state, while the detector (and
+	 * everything read through @ref detector, like its neutral value) belongs to the thread
+	 * that is detecting, until the detection has finished.
+	 *
+	 * @param[in] heatmap The capacitive heatmap to process.
+	 * @param[out] contacts The list of found contacts.
 	 */
-	template <int Rows, int Cols>
-	void find(const ImageBase<T, Rows, Cols> &heatmap, std::vector<Contact<T>> &contacts)
+	template <int HRows, int HCols>
+	void detect(const ImageBase<T, HRows, HCols> &heatmap, std::vector<Contact<T>> &contacts)
 	{
+		const common::tracing::Span span {"detect"};
 		m_detector.detect(heatmap, contacts);
-		m_tracker.track(contacts);
-		m_stabilizer.stabilize(contacts);
-		m_validator.validate(contacts);
+	}
+
+	/*!
+	 * Runs only the detection phase of @ref find, on a heatmap of raw bytes.
+	 *
+	 * The same rules as for the other overload apply to passing the contacts to @ref track.
+	 *
+	 * @param[in] heatmap The raw heatmap to process.
+	 * @param[in] lut The value of each byte.
+	 * @param[out] contacts The list of found contacts.
+	 */
+	template <class Derived>
+	void detect(const DenseBase<Derived> &heatmap,
+	            const std::array<T, 256> &lut,
+	            std::vector<Contact<T>> &contacts)
+	{
+		const common::tracing::Span span {"detect"};
+		m_detector.detect(heatmap, lut, contacts);
+	}
+
+	/*!
+	 * Runs the phases of @ref find that follow the detection.
+	 *
+	 * The contacts are tracked, stabilized and validated against the previous frames.
+	 * This must not run concurrently with itself, but it can overlap with @ref detect.
+	 *
+	 * @param[in,out] contacts The contacts that were detected in the current frame.
+	 * @param[in] elapsed The milliseconds since the previous heatmap, or 0 if unknown.
+	 *                    Contacts are only extrapolated once the frame rate is known.
+	 */
+	void track(std::vector<Contact<T>> &contacts, const T elapsed = casts::to<T>(0))
+	{
+		if (contacts.empty()) {
+			this->forget();
+			return;
+		}
+
+		m_timings.start();
+
+		{
+			const common::tracing::Span span {"track"};
+			m_tracker.track(contacts, m_history, elapsed);
+		}
+
+		m_timings.lap(Stage::TRACK);
+
+		{
+			const common::tracing::Span span {"stabilize"};
+			m_stabilizer.stabilize(contacts, m_history);
+		}
+
+		m_timings.lap(Stage::STABILIZE);
+
+		{
+			const common::tracing::Span span {"validate"};
+			m_validator.validate(contacts, m_history);
+		}
+
+		m_timings.lap(Stage::VALIDATE);
+
+		m_history.push(contacts);
+	}
+
+private:
+	/*!
+	 * Handles a frame without any contacts.
+	 *
+	 * The contacts of the last frame have been lifted, so there is nothing that the next
+	 * frame could be compared against. Tracking, stabilizing and validating an empty list
+	 * would only have the same effect.
+	 */
+	void forget()
+	{
+		m_tracker.reset();
+		m_history.clear();
 	}
 };
 
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CONTACTS_HISTORY_HPP
+#define IPTSD_CONTACTS_HISTORY_HPP
+
+#include "contact.hpp"
+
+#include <common/types.hpp>
+
+#include <algorithm>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace iptsd::contacts {
+
+/*
+ * Stores the last frames of contacts, so that every contact can be compared against its
+ * previous states without searching through the frames.
+ *
+ * The frames are stored in a ring buffer, and the storage of the oldest frame is reused
+ * for the next one, so that no memory is allocated once the buffer has warmed up.
+ */
+template <class T>
+class History {
+public:
+	static_assert(std::is_floating_point_v<T>);
+
+private:
+	// The stored frames, the newest one is at m_head.
+	std::vector<std::vector<Contact<T>>> m_frames;
+
+	// The position of every contact in its frame, indexed by the index of the contact.
+	std::vector<std::vector<std::optional<usize>>> m_lookup;
+
+	// The position of the newest frame in the ring buffer.
+	usize m_head = 0;
+
+	// How many of the frames contain data.
+	usize m_size = 0;
+
+public:
+	/*!
+	 * Creates a new history of contacts.
+	 *
+	 * @param[in] capacity How many frames are stored, must be at least 1.
+	 */
+	History(const usize capacity = 1)
+		: m_frames(std::max(capacity, usize {1})),
+		  m_lookup(std::max(capacity, usize {1})) {};
+
+	/*!
+	 * Removes all stored frames.
+	 */
+	void clear()
+	{
+		m_size = 0;
+	}
+
+	/*!
+	 * How many frames are stored.
+	 *
+	 * @return The number of frames that can be accessed.
+	 */
+	[[nodiscard]] usize size() const
+	{
+		return m_size;
+	}
+
+	/*!
+	 * Stores a copy of a new frame, replacing the oldest frame if the history is full.
+	 *
+	 * @param[in] frame The contacts of the new frame.
+	 */
+	void push(const std::vector<Contact<T>> &frame)
+	{
+		m_head = (m_head + 1) % m_frames.size();
+		m_size = std::min(m_size + 1, m_frames.size());
+
+		std::vector<Contact<T>> &stored = m_frames[m_head];
+		std::vector<std::optional<usize>> &lookup = m_lookup[m_head];
+
+		stored.assign(frame.begin(), frame.end());
+		lookup.clear();
+
+		for (usize i = 0; i < stored.size(); i++) {
+			const std::optional<usize> &index = stored[i].index;
+
+			if (!index.has_value())
+				continue;
+
+			if (index.value() >= lookup.size())
+				lookup.resize(index.value() + 1);
+
+			lookup[index.value()] = i;
+		}
+	}
+
+	/*!
+	 * Returns one of the stored frames.
+	 *
+	 * @param[in] age How many frames to go back. A value of 0 returns the newest frame.
+	 * @return The contacts of the frame, or an empty list if it is not stored.
+	 */
+	[[nodiscard]] const std::vector<Contact<T>> &frame(const usize age = 0) const
+	{
+		static const std::vector<Contact<T>> empty {};
+
+		if (age >= m_size)
+			return empty;
+
+		return m_frames[this->slot(age)];
+	}
+
+	/*!
+	 * Searches a contact in one of the stored frames.
+	 *
+	 * @param[in] index The index of the contact.
+	 * @param[in] age How many frames to go back. A value of 0 searches the newest frame.
+	 * @return A pointer to the contact, or nullptr if it is not part of the frame.
+	 */
+	[[nodiscard]] const Contact<T> *find(const usize index, const usize age = 0) const
+	{
+		if (age >= m_size)
+			return nullptr;
+
+		const usize slot = this->slot(age);
+		const std::vector<std::optional<usize>> &lookup = m_lookup[slot];
+
+		if (index >= lookup.size() || !lookup[index].has_value())
+			return nullptr;
+
+		return &m_frames[slot][lookup[index].value()];
+	}
+
+private:
+	/*!
+	 * Calculates where a frame is stored in the ring buffer.
+	 *
+	 * @param[in] age How many frames to go back.
+	 * @return The position of the frame in the ring buffer.
+	 */
+	[[nodiscard]] usize slot(const usize age) const
+	{
+		return (m_head + m_frames.size() - age) % m_frames.size();
+	}
+};
+
+} // namespace iptsd::contacts
+
+#endif // IPTSD_CONTACTS_HISTORY_HPP
@@ -4,6 +4,7 @@
 #define IPTSD_CONTACTS_STABILITY_STABILIZER_HPP
 
 #include "../contact.hpp"
+#include "../history.hpp"
 #include "config.hpp"
 
 #include <common/casts.hpp>
@@ -12,7 +13,6 @@
 #include <gsl/gsl>
 
 #include <algorithm>
-#include <iterator>
 #include <type_traits>
 #include <vector>
 
@@ -26,35 +26,38 @@ public:
 private:
 	Config<T> m_config;
 
-	// The last frame.
-	std::vector<Contact<T>> m_last {};
+	// Whether any of the thresholds is set. The config doesn't change, so this is only
+	// checked once instead of for every contact.
+	bool m_enabled;
 
 public:
-	Stabilizer(Config<T> config) : m_config {std::move(config)} {};
-
-	/*!
-	 * Resets the stabilizer by clearing the stored previous frames.
-	 */
-	void reset()
-	{
-		m_last.clear();
-	}
+	Stabilizer(Config<T> config)
+		: m_config {std::move(config)},
+		  m_enabled {m_config.size_threshold.has_value() ||
+		             m_config.position_threshold.has_value() ||
+		             m_config.orientation_threshold.has_value()} {};
 
 	/*!
 	 * Stabilizes all contacts of a frame.
 	 *
 	 * @param[in,out] frame The list of contacts to stabilize.
+	 * @param[in] history The contacts from the previous frames.
 	 */
-	void stabilize(std::vector<Contact<T>> &frame)
+	void stabilize(std::vector<Contact<T>> &frame, const History<T> &history) const
 	{
-		// Stabilize contacts
-		for (Contact<T> &contact : frame)
-			this->stabilize_contact(contact);
+		// Without thresholds, tracked contacts are always stable and nothing is compared
+		if (!m_enabled) {
+			for (Contact<T> &contact : frame) {
+				if (contact.index.has_value())
+					contact.stable = true;
+			}
 
-		m_last.clear();
+			return;
+		}
 
-		// Save a copy of the new data
-		std::copy(frame.begin(), frame.end(), std::back_inserter(m_last));
+		// Stabilize contacts
+		for (Contact<T> &contact : frame)
+			this->stabilize_contact(contact, history);
 	}
 
 private:
@@ -62,8 +65,9 @@ private:
 	 * Stabilize a single contact.
 	 *
 	 * @param[in,out] contact The contact to stabilize.
+	 * @param[in] history The contacts from the previous frames.
 	 */
-	void stabilize_contact(Contact<T> &contact) const
+	void stabilize_contact(Contact<T> &contact, const History<T> &history) const
 	{
 		// Contacts that can't be tracked can't be stabilized.
 		if (!contact.index.has_value())
@@ -72,12 +76,12 @@ private:
 		contact.stable = true;
 
 		const usize index = contact.index.value();
-		const auto wrapper = Contact<T>::find_in_frame(index, m_last);
+		const Contact<T> *wrapper = history.find(index);
 
-		if (!wrapper.has_value())
+		if (wrapper == nullptr)
 			return;
 
-		const Contact<T> &last = wrapper.value();
+		const Contact<T> &last = *wrapper;
 
 		if (m_config.size_threshold.has_value())
 			this->stabilize_size(contact, last);
@@ -162,7 +166,7 @@ private:
 		 * TODO: Check if there is a better way to signal this (make orientation optional,
 		 * and / or applying the last stable value).
 		 */
-		if (aspect < 1.1) {
+		if (aspect < gsl::narrow_cast<T>(1.1)) {
 			current.orientation = 0;
 			return;
 		}
@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CONTACTS_TIMINGS_HPP
+#define IPTSD_CONTACTS_TIMINGS_HPP
+
+#include <common/buildopts.hpp>
+#include <common/chrono.hpp>
+#include <common/types.hpp>
+
+#include <array>
+
+namespace iptsd::contacts {
+
+/*
+ * The stages of processing a heatmap that are timed separately.
+ */
+enum class Stage : u8 {
+	// Calculating the neutral value of the heatmap.
+	NEUTRAL,
+
+	// Subtracting the neutral value from the heatmap.
+	NORMALIZE,
+
+	// Blurring the heatmap and searching for local maximas.
+	BLUR,
+
+	// Building clusters of pixels around the local maximas.
+	CLUSTER,
+
+	// Merging overlapping clusters.
+	MERGE,
+
+	// Fitting gaussians onto the clusters and creating contacts from them.
+	FIT,
+
+	// Assigning the indices of the last frame to the contacts.
+	TRACK,
+
+	// Stabilizing size and movement of the contacts.
+	STABILIZE,
+
+	// Validating size and aspect ratio of the contacts.
+	VALIDATE,
+};
+
+/*
+ * Accumulates how much time was spent in every stage of processing a heatmap.
+ *
+ * The timers only exist if iptsd was built with the stage_timers option. Otherwise
+ * all functions are empty, and the compiler removes the calls to them entirely.
+ */
+class Timings {
+public:
+	using clock = chrono::steady_clock;
+
+	// The number of stages that are timed.
+	static constexpr usize STAGES = 9;
+
+	// Whether the timers were compiled in.
+	static constexpr bool ENABLED = common::buildopts::StageTimers;
+
+private:
+	// The total time spent in every stage.
+	std::array<clock::duration, STAGES> m_durations {};
+
+	// When the stage that is currently running was started.
+	clock::time_point m_start {};
+
+public:
+	/*!
+	 * Starts timing the first stage.
+	 */
+	void start()
+	{
+		if constexpr (ENABLED)
+			m_start = clock::now();
+	}
+
+	/*!
+	 * Stops timing a stage, and starts timing the next one.
+	 *
+	 * @param[in] stage The stage that has finished.
+	 */
+	void lap(const Stage stage)
+	{
+		if constexpr (ENABLED) {
+			const clock::time_point now = clock::now();
+
+			m_durations.at(static_cast<usize>(stage)) += now - m_start;
+			m_start = now;
+		}
+	}
+
+	/*!
+	 * Adds the time that was measured by another instance.
+	 *
+	 * @param[in] other The timings to add.
+	 */
+	void add(const Timings &other)
+	{
+		for (usize i = 0; i < STAGES; i++)
+			m_durations.at(i) += other.m_durations.at(i);
+	}
+
+	/*!
+	 * Resets the time spent in all stages to zero.
+	 */
+	void clear()
+	{
+		m_durations.fill(clock::duration::zero());
+	}
+
+	/*!
+	 * How much time was spent in a stage.
+	 *
+	 * @param[in] stage The stage to query.
+	 * @return The total time, or zero if the timers were not compiled in.
+	 */
+	[[nodiscard]] clock::duration get(const Stage stage) const
+	{
+		return m_durations.at(static_cast<usize>(stage));
+	}
+
+	/*!
+	 * A human readable name for a stage.
+	 *
+	 * @param[in] stage The stage.
+	 * @return The name of the stage.
+	 */
+	static const char *name(const Stage stage)
+	{
+		switch (stage) {
+		case Stage::NEUTRAL:
+			return "Neutral";
+		case Stage::NORMALIZE:
+			return "Normalize";
+		case Stage::BLUR:
+			return "Blur";
+		case Stage::CLUSTER:
+			return "Cluster";
+		case Stage::MERGE:
+			return "Merge";
+		case Stage::FIT:
+			return "Fit";
+		case Stage::TRACK:
+			return "Track";
+		case Stage::STABILIZE:
+			return "Stabilize";
+		case Stage::VALIDATE:
+			return "Validate";
+		}
+
+		return "Unknown";
+	}
+};
+
+} // namespace iptsd::contacts
+
+#endif // IPTSD_CONTACTS_TIMINGS_HPP
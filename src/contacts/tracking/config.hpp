@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CONTACTS_TRACKING_CONFIG_HPP
+#define IPTSD_CONTACTS_TRACKING_CONFIG_HPP
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <gsl/gsl>
+
+#include <type_traits>
+
+namespace iptsd::contacts::tracking {
+
+template <class T>
+struct Config {
+public:
+	static_assert(std::is_floating_point_v<T>);
+
+public:
+	/*
+	 * Whether the velocity of every contact is tracked, and contacts are matched against
+	 * the position where the contacts of the last frame are expected to be now.
+	 */
+	bool prediction = false;
+
+	/*
+	 * How fast the tracked velocity follows the movement of a contact (Range 0 - 1).
+	 * A value of 1 means that only the movement since the last frame is used.
+	 */
+	T prediction_smoothing = gsl::narrow_cast<T>(0.5);
+
+	/*
+	 * How many milliseconds ahead the position of a moving contact is extrapolated.
+	 * A value of 0 means that the detected positions are not changed.
+	 */
+	T extrapolation = casts::to<T>(0);
+};
+
+} // namespace iptsd::contacts::tracking
+
+#endif // IPTSD_CONTACTS_TRACKING_CONFIG_HPP
@@ -8,42 +8,146 @@
 #include <common/casts.hpp>
 #include <common/types.hpp>
 
+#include <algorithm>
 #include <vector>
 
 namespace iptsd::contacts::tracking::distances {
 
+/*
+ * A contact from the current frame and a contact from the last frame.
+ */
+template <class T>
+struct Pair {
+	// The distance between both contacts.
+	T distance;
+
+	// The index of the contact in the current frame.
+	usize current;
+
+	// The index of the contact in the last frame.
+	usize last;
+};
+
+/*
+ * The positions of the contacts of a frame, with the coordinates stored in separate arrays.
+ *
+ * Computing the distance to one contact of the other frame then is a single operation on
+ * each array, which Eigen vectorizes.
+ */
+template <class T>
+struct Positions {
+	// The arrays only grow, only the first count entries are used.
+	Eigen::Array<T, Eigen::Dynamic, 1> x {};
+	Eigen::Array<T, Eigen::Dynamic, 1> y {};
+	Eigen::Index count = 0;
+
+	/*!
+	 * Allocates storage for the positions of a certain number of contacts.
+	 *
+	 * @param[in] size How many contacts fit into the arrays.
+	 */
+	void reserve(const Eigen::Index size)
+	{
+		if (x.size() >= size)
+			return;
+
+		x.setZero(size);
+		y.setZero(size);
+	}
+
+	/*!
+	 * Copies positions into the arrays.
+	 *
+	 * @param[in] positions The positions of the contacts.
+	 */
+	void assign(const std::vector<Vector2<T>> &positions)
+	{
+		const Eigen::Index size = casts::to_eigen(positions.size());
+
+		this->reserve(size);
+		count = size;
+
+		for (Eigen::Index i = 0; i < size; i++) {
+			const Vector2<T> &position = positions[casts::to_unsigned(i)];
+
+			x(i) = position.x();
+			y(i) = position.y();
+		}
+	}
+};
+
 /*!
  * Calculates the distances between all contacts from two different frames.
  *
  * If a contact is present in one frame but not in the other, the distance will
  * be set to the highest allowed value.
  *
- * @param[in] x The first frame (x axis in the output).
- * @param[in] y The second frame (y axis in the output).
- * @param[out] out The output data.
+ * @param[in] x The contacts of the first frame (x axis in the output).
+ * @param[in] y The positions of the contacts from the second frame (y axis in the output).
+ * @param[out] out The output data, with one row for every position and one column for
+ *                 every contact.
  */
 template <class Derived>
 void calculate(const std::vector<Contact<typename DenseBase<Derived>::Scalar>> &x,
-               const std::vector<Contact<typename DenseBase<Derived>::Scalar>> &y,
+               const Positions<typename DenseBase<Derived>::Scalar> &y,
                DenseBase<Derived> &out)
 {
 	using T = typename DenseBase<Derived>::Scalar;
 
 	const Eigen::Index sx = casts::to_eigen(x.size());
-	const Eigen::Index sy = casts::to_eigen(y.size());
+	const Eigen::Index sy = y.count;
 
-	out.derived().conservativeResize(sy, sx);
+	const auto yx = y.x.head(sy);
+	const auto yy = y.y.head(sy);
 
-	// Calculate the distances between current and previous inputs
-	for (Eigen::Index iy = 0; iy < sy; iy++) {
-		const Contact<T> &cy = y[casts::to_unsigned(iy)];
+	// Calculate the distances between current and previous inputs, one column at a time
+	for (Eigen::Index ix = 0; ix < sx; ix++) {
+		const Vector2<T> &px = x[casts::to_unsigned(ix)].mean;
 
-		for (Eigen::Index ix = 0; ix < sx; ix++) {
-			const Contact<T> &cx = x[casts::to_unsigned(ix)];
+		out.col(ix) = ((yx - px.x()).square() + (yy - px.y()).square()).sqrt();
+	}
+}
 
-			out(iy, ix) = gsl::narrow_cast<T>((cx.mean - cy.mean).hypotNorm());
+/*!
+ * Sorts all pairs of contacts from two frames by their distance.
+ *
+ * Pairs with the same distance are sorted column by column, which is the order in which
+ * Eigen searches for the smallest coefficient. Going through the sorted pairs therefore
+ * finds the same pairs as repeatedly searching the smallest remaining distance.
+ *
+ * @param[in] distances The distances between all contacts, see @ref calculate.
+ * @param[out] pairs All pairs of contacts, sorted by their distance.
+ */
+template <class Derived>
+void sort(const DenseBase<Derived> &distances,
+          std::vector<Pair<typename DenseBase<Derived>::Scalar>> &pairs)
+{
+	using T = typename DenseBase<Derived>::Scalar;
+
+	const Eigen::Index cols = distances.cols();
+	const Eigen::Index rows = distances.rows();
+
+	pairs.clear();
+
+	for (Eigen::Index ix = 0; ix < cols; ix++) {
+		for (Eigen::Index iy = 0; iy < rows; iy++) {
+			pairs.push_back(Pair<T> {
+				distances(iy, ix),
+				casts::to_unsigned(ix),
+				casts::to_unsigned(iy),
+			});
 		}
 	}
+
+	std::sort(pairs.begin(), pairs.end(), [](const Pair<T> &a, const Pair<T> &b) {
+		if (a.distance != b.distance)
+			return a.distance < b.distance;
+
+		if (a.current != b.current)
+			return a.current < b.current;
+
+		return a.last < b.last;
+	});
 }
 
 } // namespace iptsd::contacts::tracking::distances
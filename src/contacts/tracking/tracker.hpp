@@ -4,13 +4,15 @@
 #define IPTSD_CONTACTS_TRACKING_TRACKER_HPP
 
 #include "../contact.hpp"
+#include "../history.hpp"
+#include "config.hpp"
 #include "distances.hpp"
 
 #include <common/casts.hpp>
 #include <common/types.hpp>
 
 #include <algorithm>
-#include <iterator>
+#include <type_traits>
 #include <vector>
 
 namespace iptsd::contacts::tracking {
@@ -21,80 +23,289 @@ public:
 	static_assert(std::is_floating_point_v<T>);
 
 private:
-	// The last frame.
-	std::vector<Contact<T>> m_last {};
+	Config<T> m_config;
+
+	// The detected position of every contact from the last frame.
+	std::vector<Vector2<T>> m_positions {};
+
+	// The velocity of every contact from the last frame, in units per frame.
+	std::vector<Vector2<T>> m_velocities {};
+
+	// The positions where the contacts of the last frame are expected in the current frame.
+	std::vector<Vector2<T>> m_predicted {};
+
+	// The velocity of every contact from the current frame.
+	std::vector<Vector2<T>> m_current {};
+
+	// The measured time between two frames, in milliseconds. 0 until it was measured.
+	T m_interval = casts::to<T>(0);
+
+	// The expected positions of the contacts from the last frame, see @ref predict.
+	distances::Positions<T> m_expected {};
 
 	// The distances between all contacts from the current and the last frame.
+	// Only grows, the distances are stored in the top left corner.
 	Image<T> m_distances {};
 
+	// All pairs of contacts from the current and the last frame, sorted by their distance.
+	std::vector<distances::Pair<T>> m_pairs {};
+
+	// Which indices are used by the contacts of the last frame.
+	std::vector<bool> m_used {};
+
+	// Which contacts of the current frame have been assigned a contact of the last frame.
+	std::vector<bool> m_assigned_current {};
+
+	// Which contacts of the last frame have been assigned to a contact of the current frame.
+	std::vector<bool> m_assigned_last {};
+
+	// Longer times between two frames are pauses between touches, not the frame rate.
+	static constexpr T MAX_INTERVAL = casts::to<T>(50);
+
+	// How fast the measured time between two frames follows changes.
+	static constexpr T INTERVAL_GAIN = casts::to<T>(1) / casts::to<T>(8);
+
 public:
+	Tracker(Config<T> config) : m_config {std::move(config)} {};
+
 	/*!
-	 * Resets the tracker by clearing the stored copy of the last frame.
+	 * Resets the tracker by clearing the stored positions of the last frame.
 	 */
 	void reset()
 	{
-		m_last.clear();
+		m_positions.clear();
+		m_velocities.clear();
+	}
+
+	/*!
+	 * Allocates the storage for tracking a certain number of contacts.
+	 *
+	 * More contacts can still be tracked, but then the storage has to grow.
+	 *
+	 * @param[in] contacts How many contacts to allocate storage for.
+	 */
+	void reserve(const usize contacts)
+	{
+		const Eigen::Index size = casts::to_eigen(contacts);
+
+		m_positions.reserve(contacts);
+		m_velocities.reserve(contacts);
+		m_predicted.reserve(contacts);
+		m_current.reserve(contacts);
+		m_pairs.reserve(contacts * contacts);
+
+		m_expected.reserve(size);
+		this->grow(size, size);
 	}
 
 	/*!
 	 * Runs the contact tracking algorithm over the contacts from the current frame.
 	 *
+	 * The newest frame of the history has to be the last frame that was tracked,
+	 * with the contacts in the same order. Clearing the history requires a reset.
+	 *
 	 * @param[in,out] frame The list of contacts that will be tracked.
+	 * @param[in] history The contacts from the previous frames.
+	 * @param[in] elapsed The milliseconds since the previous frame, or 0 if unknown.
+	 *                    Extrapolation only happens once the frame rate was measured.
 	 */
-	void track(std::vector<Contact<T>> &frame)
+	void track(std::vector<Contact<T>> &frame,
+	           const History<T> &history,
+	           const T elapsed = casts::to<T>(0))
 	{
+		this->learn(elapsed);
+
+		const std::vector<Contact<T>> &last = history.frame();
+
+		this->mark_used_indices(last);
+
 		usize counter = 0;
 
 		// Assign unique indices to all contacts of the current frame.
 		for (Contact<T> &contact : frame) {
-			contact.index = this->find_new_index(counter);
-			counter = contact.index.value() + 1;
+			while (counter < m_used.size() && m_used[counter])
+				counter++;
+
+			contact.index = counter;
+			counter++;
 		}
 
-		if (!m_last.empty()) {
-			const usize min = std::min(frame.size(), m_last.size());
+		m_current.assign(frame.size(), Vector2<T>::Zero());
+
+		if (!m_positions.empty()) {
+			const usize min = std::min(frame.size(), m_positions.size());
 
 			// Calculate the distances between all contacts from the current and last
-			// frame
-			distances::calculate(frame, m_last, m_distances);
+			// frame, and sort them, so that the closest contacts are assigned first.
+			m_expected.assign(this->predict());
+
+			const Eigen::Index rows = casts::to_eigen(m_positions.size());
+			const Eigen::Index cols = casts::to_eigen(frame.size());
+
+			this->grow(rows, cols);
+			auto matrix = m_distances.topLeftCorner(rows, cols);
+
+			distances::calculate(frame, m_expected, matrix);
+			distances::sort(matrix, m_pairs);
+
+			m_assigned_current.assign(frame.size(), false);
+			m_assigned_last.assign(m_positions.size(), false);
+
+			usize assigned = 0;
 
 			// Copy the old indices back for the amount of contacts that can be tracked.
-			for (usize i = 0; i < min; i++) {
-				Eigen::Index y = 0;
-				Eigen::Index x = 0;
+			for (const distances::Pair<T> &pair : m_pairs) {
+				if (assigned == min)
+					break;
 
-				m_distances.minCoeff(&y, &x);
+				if (m_assigned_current[pair.current] || m_assigned_last[pair.last])
+					continue;
 
 				// Copy the index of the contact
-				frame[casts::to_unsigned(x)].index =
-					m_last[casts::to_unsigned(y)].index;
+				frame[pair.current].index = last[pair.last].index;
 
-				// Invalidate all entries containing these contacts
-				m_distances.row(y) = Eigen::NumTraits<T>::infinity();
-				m_distances.col(x) = Eigen::NumTraits<T>::infinity();
-			}
+				const Contact<T> &contact = frame[pair.current];
+				m_current[pair.current] = this->velocity(contact, pair.last);
+
+				m_assigned_current[pair.current] = true;
+				m_assigned_last[pair.last] = true;
 
-			m_last.clear();
+				assigned++;
+			}
 		}
 
-		// Save a copy of the new data
-		std::copy(frame.begin(), frame.end(), std::back_inserter(m_last));
+		// Save the detected positions
+		m_positions.clear();
+
+		for (const Contact<T> &contact : frame)
+			m_positions.push_back(contact.mean);
+
+		std::swap(m_velocities, m_current);
+
+		for (usize i = 0; i < frame.size(); i++)
+			frame[i].velocity = m_velocities[i];
+
+		if (m_config.extrapolation > 0)
+			this->extrapolate(frame);
 	}
 
 private:
 	/*!
-	 * Searches for an index that is not already used by a contact from the last frame.
+	 * Makes sure that the distance matrix can store a certain number of distances.
 	 *
-	 * @param[in] min The new index has to be at least this value.
-	 * @return A new unique index that was not used before.
+	 * @param[in] rows How many contacts the last frame has.
+	 * @param[in] cols How many contacts the current frame has.
 	 */
-	[[nodiscard]] usize find_new_index(usize min) const
+	void grow(const Eigen::Index rows, const Eigen::Index cols)
 	{
-		while (true) {
-			if (!Contact<T>::find_in_frame(min, m_last).has_value())
-				return min;
+		if (m_distances.rows() >= rows && m_distances.cols() >= cols)
+			return;
+
+		const Eigen::Index r = std::max(m_distances.rows(), rows);
+		const Eigen::Index c = std::max(m_distances.cols(), cols);
+
+		m_distances.setZero(r, c);
+	}
+
+	/*!
+	 * Marks the indices that are already used by a contact from the last frame.
+	 *
+	 * @param[in] last The contacts of the last frame.
+	 */
+	void mark_used_indices(const std::vector<Contact<T>> &last)
+	{
+		m_used.clear();
+
+		for (const Contact<T> &contact : last) {
+			if (!contact.index.has_value())
+				continue;
+
+			const usize index = contact.index.value();
+
+			if (index >= m_used.size())
+				m_used.resize(index + 1, false);
+
+			m_used[index] = true;
+		}
+	}
+
+	/*!
+	 * Returns the positions of the last frame that the current frame is matched against.
+	 *
+	 * If prediction is enabled, every contact is moved by its velocity, so that fast
+	 * moving contacts are matched with the position where they are expected to be now.
+	 *
+	 * @return The positions of the contacts from the last frame.
+	 */
+	const std::vector<Vector2<T>> &predict()
+	{
+		if (!m_config.prediction)
+			return m_positions;
+
+		m_predicted.clear();
+
+		for (usize i = 0; i < m_positions.size(); i++)
+			m_predicted.push_back(m_positions[i] + m_velocities[i]);
+
+		return m_predicted;
+	}
+
+	/*!
+	 * Updates the velocity of a contact that was found in the last frame.
+	 *
+	 * The velocity follows the movement of the contact since the last frame, smoothed by
+	 * a constant gain, so that noise in the detected positions is not amplified.
+	 *
+	 * @param[in] contact The contact from the current frame.
+	 * @param[in] last The index of the same contact in the last frame.
+	 * @return The new velocity of the contact.
+	 */
+	Vector2<T> velocity(const Contact<T> &contact, const usize last) const
+	{
+		const Vector2<T> &velocity = m_velocities[last];
+		const Vector2<T> delta = contact.mean - m_positions[last];
+
+		return velocity + (delta - velocity) * m_config.prediction_smoothing;
+	}
+
+	/*!
+	 * Updates the measured time between two frames.
+	 *
+	 * @param[in] elapsed The milliseconds since the previous frame, or 0 if unknown.
+	 */
+	void learn(const T elapsed)
+	{
+		if (elapsed <= 0 || elapsed > MAX_INTERVAL)
+			return;
+
+		if (m_interval <= 0)
+			m_interval = elapsed;
+		else
+			m_interval += (elapsed - m_interval) * INTERVAL_GAIN;
+	}
+
+	/*!
+	 * Moves all contacts to where they are expected to be in the future.
+	 *
+	 * The velocities are measured per frame, so the horizon is converted from milliseconds
+	 * into frames using the measured frame rate. The stored positions are not changed, so
+	 * that the velocities are always calculated from the detected positions.
+	 *
+	 * @param[in,out] frame The list of contacts to move.
+	 */
+	void extrapolate(std::vector<Contact<T>> &frame) const
+	{
+		if (m_interval <= 0)
+			return;
+
+		const T frames = m_config.extrapolation / m_interval;
+
+		for (usize i = 0; i < frame.size(); i++) {
+			Contact<T> &contact = frame[i];
+			contact.mean += m_velocities[i] * frames;
 
-			min++;
+			if (contact.normalized)
+				contact.mean = contact.mean.cwiseMax(0).cwiseMin(1);
 		}
 	}
 };
@@ -4,6 +4,7 @@
 #define IPTSD_CONTACTS_VALIDATION_VALIDATOR_HPP
 
 #include "../contact.hpp"
+#include "../history.hpp"
 #include "config.hpp"
 
 #include <common/types.hpp>
@@ -22,34 +23,34 @@ private:
 	// The config for the validity checking phase.
 	Config<T> m_config;
 
-	// The last frame.
-	std::vector<Contact<T>> m_last {};
+	// Whether any of the checks is enabled. The config doesn't change, so this is only
+	// checked once instead of for every contact.
+	bool m_enabled;
 
 public:
-	Validator(Config<T> config) : m_config {std::move(config)} {};
-
-	/*!
-	 * Resets the validator by clearing the stored copy of the last frame.
-	 */
-	void reset()
-	{
-		m_last.clear();
-	}
+	Validator(Config<T> config)
+		: m_config {std::move(config)},
+		  m_enabled {m_config.track_validity || m_config.size_limits.has_value() ||
+		             m_config.aspect_limits.has_value()} {};
 
 	/*!
 	 * Checks the validity for all contacts of a frame.
 	 *
 	 * @param[in,out] frame The list of contacts to validate.
+	 * @param[in] history The contacts from the previous frames.
 	 */
-	void validate(std::vector<Contact<T>> &frame)
+	void validate(std::vector<Contact<T>> &frame, const History<T> &history) const
 	{
-		for (Contact<T> &contact : frame)
-			contact.valid = this->check_contact(contact);
+		// Without any checks, every contact that wasn't rejected during detection is valid
+		if (!m_enabled) {
+			for (Contact<T> &contact : frame)
+				contact.valid = contact.valid.value_or(true);
 
-		m_last.clear();
+			return;
+		}
 
-		// Save a copy of the new data
-		std::copy(frame.begin(), frame.end(), std::back_inserter(m_last));
+		for (Contact<T> &contact : frame)
+			contact.valid = this->check_contact(contact, history);
 	}
 
 private:
@@ -57,10 +58,15 @@ private:
 	 * Checks a single contact.
 	 *
 	 * @param[in] contact The contact to check.
+	 * @param[in] history The contacts from the previous frames.
 	 * @return Whether the contact is valid.
 	 */
-	bool check_contact(const Contact<T> &contact)
+	bool check_contact(const Contact<T> &contact, const History<T> &history) const
 	{
+		// Contacts that were already rejected during detection stay invalid
+		if (!contact.valid.value_or(true))
+			return false;
+
 		// Don't invalidate unstable contacts
 		if (!contact.stable.value_or(true))
 			return true;
@@ -69,7 +75,7 @@ private:
 		 * If the state should be tracked and the contact was invalid in the
 		 * last frame, it is also invalid in the current frame.
 		 */
-		if (m_config.track_validity && !this->check_temporal(contact))
+		if (m_config.track_validity && !this->check_temporal(contact, history))
 			return false;
 
 		// Only do the size check if it is enabled
@@ -87,20 +93,21 @@ private:
 	 * Checks the temporal validity of a contact.
 	 *
 	 * @param[in] contact The contact to check.
+	 * @param[in] history The contacts from the previous frames.
 	 * @return Whether the contact was valid in the last frame.
 	 */
-	bool check_temporal(const Contact<T> &contact)
+	bool check_temporal(const Contact<T> &contact, const History<T> &history) const
 	{
 		// Contacts that can't be tracked are considered temporally valid.
 		if (!contact.index.has_value())
 			return true;
 
-		const auto wrapper = Contact<T>::find_in_frame(contact.index.value(), m_last);
+		const Contact<T> *wrapper = history.find(contact.index.value());
 
-		if (!wrapper.has_value())
+		if (wrapper == nullptr)
 			return true;
 
-		const Contact<T> &last = wrapper.value();
+		const Contact<T> &last = *wrapper;
 
 		if (!last.valid.has_value())
 			return true;
@@ -114,7 +121,7 @@ private:
 	 * @param[in] contact The contact to check.
 	 * @return Whether the size of the contact is within the valid range.
 	 */
-	bool check_size(const Contact<T> &contact)
+	bool check_size(const Contact<T> &contact) const
 	{
 		if (!m_config.size_limits.has_value())
 			return true;
@@ -132,7 +139,7 @@ private:
 	 * @param[in] contact The contact to check.
 	 * @return Whether the aspect ratio of the contact is within the valid range.
 	 */
-	bool check_aspect(const Contact<T> &contact)
+	bool check_aspect(const Contact<T> &contact) const
 	{
 		if (!m_config.aspect_limits.has_value())
 			return true;
@@ -7,21 +7,46 @@
 #include "device.hpp"
 #include "dft.hpp"
 #include "errors.hpp"
+#include "latency.hpp"
+#include "prediction.hpp"
+#include "stats.hpp"
 
+#include <common/buffer-pool.hpp>
 #include <common/casts.hpp>
+#include <common/chrono.hpp>
 #include <common/error.hpp>
+#include <common/thread-pool.hpp>
+#include <common/tracing.hpp>
 #include <common/types.hpp>
+#include <common/worker.hpp>
 #include <contacts/finder.hpp>
 #include <ipts/data.hpp>
 #include <ipts/parser.hpp>
 
+#include <gsl/gsl>
 #include <spdlog/spdlog.h>
 
-#include <functional>
+#include <array>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
 #include <vector>
 
 namespace iptsd::core {
 
+/*
+ * The contact finders that can be used by an application.
+ *
+ * Besides finders for any size of heatmaps, there are finders that are specialized for the
+ * heatmaps of legacy IPTS devices, which all use the same size (44 rows and 64 columns).
+ */
+using Finders = std::variant<contacts::Finder<f64>,
+                             contacts::Finder<f32>,
+                             contacts::Finder<f64, f64, 44, 64>,
+                             contacts::Finder<f32, f32, 44, 64>>;
+
 /*
  * The application class is the heart of iptsd.
  *
@@ -36,6 +61,48 @@ namespace iptsd::core {
  * need to be run by an application runner.
  */
 class Application {
+public:
+	using clock = chrono::steady_clock;
+
+private:
+	/*
+	 * Passes the data returned by the parser to the processing functions.
+	 */
+	class ParserSink : public ipts::BasicParser<ParserSink> {
+	private:
+		Application &m_app;
+
+	public:
+		explicit ParserSink(Application &app) : m_app {app} {}
+
+		// The older samples of a report are only needed for prediction.
+		[[nodiscard]] bool wants_stylus_batch() const
+		{
+			return m_app.m_config.stylus_batch || m_app.m_config.stylus_prediction > 0;
+		}
+
+		void operator()(const ipts::Heatmap &data)
+		{
+			m_app.process_heatmap(data);
+		}
+
+		void operator()(const gsl::span<const ipts::StylusData> batch)
+		{
+			if (batch.empty())
+				return;
+
+			if (m_app.m_config.stylus_batch)
+				m_app.process_stylus_batch(batch);
+			else
+				m_app.process_stylus(batch.back(), batch.first(batch.size() - 1));
+		}
+
+		void operator()(const ipts::DftWindow &data)
+		{
+			m_app.process_dft(data);
+		}
+	};
+
 protected:
 	/*
 	 * The configuration for this application.
@@ -61,20 +128,30 @@ protected:
 	/*
 	 * Parses incoming data and returns heatmap, stylus and DFT data.
 	 */
-	ipts::Parser m_parser {};
-
-	/*
-	 * Temporary storage for normalized heatmap data.
-	 */
-	Image<f64> m_heatmap {};
+	ParserSink m_parser {*this};
 
 	/*
 	 * The contact finder. This is where the magic happens.
 	 *
 	 * It accepts a normalized heatmap as the input, runs a gaussian-fitting based
 	 * blob detection, contact tracking, and decides whether a contact is stable and valid.
+	 *
+	 * Depending on the config, it runs with double or single precision. If there is a
+	 * finder that is specialized for the size of the heatmaps, it is selected once the
+	 * first heatmap arrives.
 	 */
-	contacts::Finder<f64> m_finder;
+	Finders m_finder;
+
+	/*
+	 * How many contacts the storage of the contact finder is allocated for at startup.
+	 * More contacts can be found, but then the storage has to grow while processing them.
+	 */
+	constexpr static usize PREPARED_CONTACTS = 16;
+
+	/*
+	 * The size of the heatmaps that the contact finder is specialized for, if it is.
+	 */
+	std::optional<std::pair<Eigen::Index, Eigen::Index>> m_finder_size = std::nullopt;
 
 	/*
 	 * The list of contacts that the contact finder has found in the current frame.
@@ -88,6 +165,171 @@ protected:
 	 */
 	DftStylus m_dft;
 
+	/*
+	 * Extrapolates the position of the stylus, to reduce the perceived latency.
+	 */
+	StylusPredictor m_predictor;
+
+	/*
+	 * Storage for the corrected samples of a stylus report.
+	 */
+	std::vector<ipts::StylusData> m_stylus_batch {};
+
+	/*
+	 * The time at which the data that is currently being processed was received.
+	 */
+	clock::time_point m_timestamp {};
+
+private:
+	/*
+	 * Whether heatmaps should be stored for later instead of being processed immediately.
+	 */
+	bool m_defer_heatmaps = false;
+
+	/*
+	 * The newest heatmap whose processing was deferred.
+	 */
+	std::optional<ipts::Heatmap> m_deferred = std::nullopt;
+
+	/*
+	 * Storage for the data of the deferred heatmap.
+	 */
+	std::vector<u8> m_deferred_data {};
+
+	/*
+	 * The time at which the deferred heatmap was received.
+	 */
+	clock::time_point m_deferred_timestamp {};
+
+	/*
+	 * The ID of the frame that contained the deferred heatmap, for tracing.
+	 */
+	u64 m_deferred_frame = 0;
+
+	/*
+	 * How many heatmaps were skipped because a newer one replaced them.
+	 */
+	usize m_dropped_heatmaps = 0;
+
+	/*
+	 * The heatmap that is currently being processed.
+	 */
+	ipts::Heatmap m_raw_heatmap {};
+
+	/*
+	 * The time at which the last heatmap whose contacts were tracked was received.
+	 */
+	clock::time_point m_tracked_timestamp {};
+
+	/*
+	 * The normalized and inverted value of every possible byte in a heatmap.
+	 */
+	struct Lut {
+		std::array<f64, 256> values {};
+
+		// The same table with single precision.
+		std::array<f32, 256> values_f32 {};
+
+		// The range of values that the table was built for.
+		std::optional<std::pair<u8, u8>> range = std::nullopt;
+	};
+
+	/*
+	 * The lookup table for the heatmap that is currently being processed.
+	 */
+	Lut m_lut {};
+
+	/*
+	 * The contacts found by the single precision contact finder.
+	 */
+	std::vector<contacts::Contact<f32>> m_contacts_f32 {};
+
+	/*
+	 * Whether heatmaps were dropped because the application didn't need any contacts.
+	 */
+	bool m_skipped_contacts = false;
+
+	/*
+	 * When the frame that is currently being processed passed the stages of processing.
+	 * This is only filled if latency statistics are enabled.
+	 */
+	FrameTimes m_times {};
+
+	/*
+	 * How long frames take from being read to being emitted.
+	 */
+	LatencyStats m_latency {};
+
+	/*
+	 * The statistics that are published while the application is running.
+	 */
+	StatsCollector m_stats {};
+
+	/*
+	 * The threads for fitting gaussians, if they are shared with other applications.
+	 */
+	std::shared_ptr<common::ThreadPool> m_fitting_pool = nullptr;
+
+	/*
+	 * A heatmap whose contacts are detected in the background.
+	 */
+	struct PipelinedFrame {
+		// The heatmap, pointing to the stored data or into the shared buffer.
+		ipts::Heatmap heatmap {};
+		std::vector<u8> data {};
+
+		// The buffer that contains the heatmap, if it is shared instead of copied.
+		common::BufferPool::Handle source {};
+
+		// When the heatmap passed the stages of processing.
+		FrameTimes times {};
+
+		// The ID of the frame that contained the heatmap, for tracing.
+		u64 trace = 0;
+
+		// The neutral value of the heatmap, since the detector can't be accessed later.
+		f64 neutral = 0;
+
+		// The lookup table for the range of the heatmap. The range of the next heatmap can
+		// differ, and it is detected while this one is tracked and emitted.
+		Lut lut {};
+
+		// The detected contacts, depending on the precision of the contact finder.
+		std::vector<contacts::Contact<f64>> contacts {};
+		std::vector<contacts::Contact<f32>> contacts_f32 {};
+	};
+
+	/*
+	 * Whether the next heatmap can be detected in the background, see @ref process_pipelined.
+	 */
+	bool m_pipeline_next = false;
+
+	/*
+	 * Whether the contacts of a heatmap are being detected in the background.
+	 */
+	bool m_pipeline_busy = false;
+
+	/*
+	 * The buffer of the data that is being processed, if it can be shared with the pipeline.
+	 */
+	const common::BufferPool::Handle *m_pipeline_source = nullptr;
+
+	/*
+	 * The heatmaps of the pipeline. While one is being detected, the other one is tracked.
+	 */
+	std::array<PipelinedFrame, 2> m_pipeline_frames {};
+
+	/*
+	 * The index of the frame that is being detected in the background.
+	 */
+	usize m_pipeline_index = 0;
+
+	/*
+	 * The thread that detects contacts in the background, if pipelining is enabled.
+	 * It accesses the other members, so it must be destroyed first.
+	 */
+	std::optional<common::Worker> m_pipeline = std::nullopt;
+
 public:
 	Application(const Config &config,
 	            const DeviceInfo &info,
@@ -95,15 +337,17 @@ public:
 		: m_config {config},
 		  m_info {info},
 		  m_metadata {metadata},
-		  m_finder {config.contacts()},
-		  m_dft {config, metadata}
+		  m_finder {create_finder<Eigen::Dynamic, Eigen::Dynamic>(config)},
+		  m_dft {config, metadata},
+		  m_predictor {config.stylus_prediction}
 	{
 		if (m_config.width == 0 || m_config.height == 0)
 			throw common::Error<Error::InvalidScreenSize> {};
 
-		m_parser.on_heatmap = [&](const auto &data) { this->process_heatmap(data); };
-		m_parser.on_stylus = [&](const auto &data) { this->process_stylus(data); };
-		m_parser.on_dft = [&](const auto &data) { this->process_dft(data); };
+		this->prepare();
+
+		if (m_config.runner_pipelined)
+			m_pipeline.emplace([this] { this->detect_pipelined(); });
 	}
 
 	virtual ~Application() = default;
@@ -112,10 +356,269 @@ public:
 	 * Parse and process an IPTS data buffer.
 	 *
 	 * @param[in] data The buffer to process.
+	 * @param[in] timestamp The time at which the buffer was received.
+	 */
+	void process(const gsl::span<u8> data, const clock::time_point timestamp = clock::now())
+	{
+		m_timestamp = timestamp;
+
+		{
+			const common::tracing::Span span {"parse"};
+			this->on_data(data);
+		}
+
+		// No newer data is waiting, so nothing may be left for later.
+		this->finish_pipelined();
+
+		if (!m_deferred.has_value())
+			return;
+
+		// The buffer didn't contain a newer heatmap, process the deferred one now.
+		const ipts::Heatmap heatmap = m_deferred.value();
+		m_deferred.reset();
+
+		// The heatmap belongs to an older frame than the data that was just parsed.
+		common::tracing::set_frame(m_deferred_frame);
+		const common::tracing::Span span {"deferred"};
+
+		m_timestamp = m_deferred_timestamp;
+		this->process_heatmap(heatmap);
+	}
+
+	/*!
+	 * Parse and process an IPTS data buffer while newer buffers are already waiting.
+	 *
+	 * Only the newest heatmap matters for touch processing, so if the buffer contains a
+	 * heatmap, it is stored instead of being processed. It is either replaced by a heatmap
+	 * from one of the next buffers, or processed once a buffer is passed to @ref process.
+	 * Stylus and DFT data are still processed immediately and in order.
+	 *
+	 * @param[in] data The buffer to process.
+	 * @param[in] timestamp The time at which the buffer was received.
+	 */
+	void process_stale(const gsl::span<u8> data, const clock::time_point timestamp = clock::now())
+	{
+		m_timestamp = timestamp;
+		m_defer_heatmaps = true;
+
+		const common::tracing::Span span {"parse"};
+
+		try {
+			this->on_data(data);
+		} catch (...) {
+			m_defer_heatmaps = false;
+			throw;
+		}
+
+		m_defer_heatmaps = false;
+	}
+
+	/*!
+	 * Parse and process an IPTS data buffer while newer buffers are already waiting.
+	 *
+	 * If the buffer contains a heatmap, its contacts are detected on another thread, while
+	 * the contacts of the previous heatmap are tracked and emitted on the calling thread.
+	 * The contacts of this heatmap are emitted by the next call, or by @ref finish_pipelined.
+	 *
+	 * Every heatmap is processed, in order. Detection only depends on earlier heatmaps,
+	 * and it always runs on the same thread, so the contacts are the same as when the
+	 * heatmaps are processed one by one. If pipelining is disabled in the config, this
+	 * works like @ref process.
+	 *
+	 * @param[in] data The buffer to process.
+	 * @param[in] timestamp The time at which the buffer was received.
 	 */
-	void process(const gsl::span<u8> data)
+	void process_pipelined(const gsl::span<u8> data,
+	                       const clock::time_point timestamp = clock::now())
 	{
-		this->on_data(data);
+		if (!m_pipeline.has_value()) {
+			this->process(data, timestamp);
+			return;
+		}
+
+		m_timestamp = timestamp;
+		m_pipeline_next = true;
+
+		const common::tracing::Span span {"parse"};
+
+		try {
+			this->on_data(data);
+		} catch (...) {
+			m_pipeline_next = false;
+			throw;
+		}
+
+		m_pipeline_next = false;
+	}
+
+	/*!
+	 * Parse and process an IPTS data buffer, overlapping detection with the next buffer.
+	 *
+	 * Unlike the other variant of this function, heatmaps are not copied. Instead, the
+	 * buffer is kept alive until its contacts have been emitted.
+	 *
+	 * @param[in] buffer The buffer containing the data.
+	 * @param[in] size How much data the buffer contains.
+	 * @param[in] timestamp The time at which the buffer was received.
+	 */
+	void process_pipelined(const common::BufferPool::Handle &buffer,
+	                       const usize size,
+	                       const clock::time_point timestamp = clock::now())
+	{
+		m_pipeline_source = &buffer;
+		const auto _reset = gsl::finally([&] { m_pipeline_source = nullptr; });
+
+		this->process_pipelined(buffer.data().first(size), timestamp);
+	}
+
+	/*!
+	 * Emits the contacts of the heatmap that is being detected in the background, if any.
+	 *
+	 * This has to be called once no more data is waiting, and before accessing the contact
+	 * finder, e.g. through @ref neutral or @ref stage_timings.
+	 */
+	void finish_pipelined()
+	{
+		if (!m_pipeline_busy)
+			return;
+
+		this->emit_pipelined(this->wait_pipelined());
+	}
+
+	/*!
+	 * Makes the contact finder use threads that are shared with other applications.
+	 *
+	 * All applications sharing the threads must process their data on the same thread.
+	 * This recreates the contact finder, so it should be called before processing starts.
+	 *
+	 * @param[in] pool The threads for fitting gaussians.
+	 */
+	void share_fitting_pool(std::shared_ptr<common::ThreadPool> pool)
+	{
+		this->finish_pipelined();
+
+		m_fitting_pool = std::move(pool);
+
+		m_finder = create_finder<Eigen::Dynamic, Eigen::Dynamic>(m_config, m_fitting_pool);
+		m_finder_size = std::nullopt;
+
+		this->prepare();
+	}
+
+	/*!
+	 * How many heatmaps were skipped because a newer heatmap was already available.
+	 */
+	[[nodiscard]] usize dropped_heatmaps() const
+	{
+		return m_dropped_heatmaps;
+	}
+
+	/*!
+	 * How many frames of the incoming data the parser skipped for a reason.
+	 *
+	 * @param[in] error Why the frames were skipped.
+	 */
+	[[nodiscard]] usize skipped_frames(const ipts::ParseError error) const
+	{
+		return m_parser.skipped(error);
+	}
+
+	/*!
+	 * Writes statistics about how long the processing of frames takes to the log.
+	 */
+	void log_latency() const
+	{
+		if (!m_config.runner_latency_stats) {
+			spdlog::info("Latency statistics are disabled");
+			return;
+		}
+
+		m_latency.log();
+	}
+
+	/*!
+	 * How often the contact finder had to allocate storage for gaussian fitting.
+	 *
+	 * This should only increase until the largest frame has been processed once.
+	 */
+	[[nodiscard]] usize fitting_allocations() const
+	{
+		const auto get = [](const auto &finder) {
+			return finder.detector().fitting_allocations();
+		};
+
+		return std::visit(get, m_finder);
+	}
+
+	/*!
+	 * How much time the contact finder spent in every stage of processing heatmaps.
+	 *
+	 * This is only measured if iptsd was built with the stage_timers option.
+	 */
+	[[nodiscard]] contacts::Timings stage_timings() const
+	{
+		return std::visit([](const auto &finder) { return finder.timings(); }, m_finder);
+	}
+
+	/*!
+	 * The statistics that are published while the application is running.
+	 *
+	 * They are only collected if live statistics are enabled in the config.
+	 */
+	[[nodiscard]] Stats live_stats() const
+	{
+		Stats stats = m_stats.get();
+		stats.dropped = m_dropped_heatmaps;
+
+		return stats;
+	}
+
+	/*!
+	 * The neutral value that the contact finder currently subtracts from the heatmaps.
+	 *
+	 * This reads from the detector, so it can't be used while a heatmap is detected in the
+	 * background. The neutral value of such a heatmap is stored with it by that thread.
+	 *
+	 * @return The neutral value (Range 0 - 1).
+	 */
+	[[nodiscard]] f64 neutral() const
+	{
+		const auto get = [](const auto &finder) {
+			return casts::to<f64>(finder.detector().neutral());
+		};
+
+		return std::visit(get, m_finder);
+	}
+
+	/*!
+	 * Resets the contact finder by clearing all stored previous frames.
+	 */
+	void reset_finder()
+	{
+		this->finish_pipelined();
+
+		std::visit([](auto &finder) { finder.reset(); }, m_finder);
+	}
+
+	/*!
+	 * The raw heatmap that is currently being processed.
+	 *
+	 * This is only valid while processing contacts, for example in @ref on_contacts.
+	 */
+	[[nodiscard]] const ipts::Heatmap &raw_heatmap() const
+	{
+		return m_raw_heatmap;
+	}
+
+	/*!
+	 * The normalized value of every possible byte in the raw heatmap.
+	 *
+	 * It is built for the range of the current heatmap, so that the normalized value of a
+	 * pixel in @ref raw_heatmap can be looked up.
+	 */
+	[[nodiscard]] const std::array<f64, 256> &lut() const
+	{
+		return m_lut.values;
 	}
 
 	/*!
@@ -148,6 +651,39 @@ protected:
 	 */
 	virtual void on_stylus(const ipts::StylusData & /* unused */) {};
 
+	/*!
+	 * For running application specific code that further processes all samples of a
+	 * stylus report at once. This is only used if batch processing is enabled.
+	 *
+	 * By default, the samples are passed to @ref on_stylus one by one.
+	 */
+	virtual void on_stylus_batch(const gsl::span<const ipts::StylusData> batch)
+	{
+		for (const ipts::StylusData &data : batch)
+			this->on_stylus(data);
+	}
+
+	/*!
+	 * Whether the application currently needs the contacts that are found in heatmaps.
+	 *
+	 * If not, heatmaps are dropped without running the contact finder, and the finder is
+	 * reset once contacts are needed again, so that they are not compared to an old frame.
+	 */
+	[[nodiscard]] virtual bool wants_contacts() const
+	{
+		return true;
+	}
+
+	/*!
+	 * Whether the application currently needs stylus data.
+	 *
+	 * If not, stylus reports and DFT windows are dropped without processing them.
+	 */
+	[[nodiscard]] virtual bool wants_stylus() const
+	{
+		return true;
+	}
+
 private:
 	/*!
 	 * Runs contact detection on an IPTS heatmap.
@@ -159,33 +695,190 @@ private:
 	 */
 	void process_heatmap(const ipts::Heatmap &data)
 	{
+		if (m_defer_heatmaps) {
+			this->defer_heatmap(data);
+			return;
+		}
+
+		// A newer heatmap superseded the deferred one.
+		if (m_deferred.has_value()) {
+			m_deferred.reset();
+			m_dropped_heatmaps++;
+		}
+
+		if (!this->wants_contacts()) {
+			this->finish_pipelined();
+
+			m_skipped_contacts = true;
+			return;
+		}
+
+		if (m_skipped_contacts) {
+			this->reset_finder();
+			m_skipped_contacts = false;
+		}
+
 		const Eigen::Index rows = casts::to_eigen(data.rows);
 		const Eigen::Index cols = casts::to_eigen(data.columns);
 
 		if (rows == 0 || cols == 0)
 			return;
 
-		// Make sure the heatmap buffer has the right size
-		if (m_heatmap.rows() != rows || m_heatmap.cols() != cols)
-			m_heatmap.conservativeResize(rows, cols);
+		// The contact finder can't be replaced while it is detecting in the background.
+		if (m_pipeline_next && this->finder_fits(rows, cols)) {
+			this->pipeline_heatmap(data);
+			return;
+		}
 
-		// Map the buffer to an Eigen container
-		const Eigen::Map<const Image<u8>> mapped {data.data.data(), rows, cols};
+		this->finish_pipelined();
+		this->stamp_parsed();
+
+		update_lut(m_lut, data.min, data.max);
 
-		const auto min = casts::to<f64>(data.min);
-		const auto max = casts::to<f64>(data.max);
+		this->select_finder(rows, cols);
 
-		// Normalize the heatmap to range [0, 1]
-		const auto norm = (mapped.cast<f64>() - min) / (max - min);
+		m_raw_heatmap = data;
 
-		// IPTS sends inverted heatmaps
-		m_heatmap = 1.0 - norm;
+		// Search for contacts, normalizing the heatmap on the fly
+		std::visit(
+			[&](auto &finder) {
+				this->detect_contacts(finder,
+				                      data,
+				                      m_lut,
+				                      m_contacts,
+				                      m_contacts_f32);
+				this->stamp(m_times.detected);
 
-		// Search for contacts
-		m_finder.find(m_heatmap, m_contacts);
+				this->track_contacts(finder, m_contacts, m_contacts_f32);
+			},
+			m_finder);
 
+		this->emit_contacts(m_contacts, m_config.runner_live_stats ? this->neutral() : 0);
+	}
+
+	/*!
+	 * Starts detecting the contacts of a heatmap in the background.
+	 *
+	 * The heatmap is still needed after the next buffer was processed. If its buffer comes
+	 * from a pool, a reference to it is kept. Otherwise the heatmap is copied, because the
+	 * buffer could be reused. While the contacts are detected, the previous heatmap is
+	 * finished.
+	 *
+	 * @param[in] data The heatmap to process.
+	 */
+	void pipeline_heatmap(const ipts::Heatmap &data)
+	{
+		PipelinedFrame *previous = nullptr;
+
+		if (m_pipeline_busy) {
+			previous = &this->wait_pipelined();
+			m_pipeline_index = 1 - m_pipeline_index;
+		}
+
+		PipelinedFrame &frame = m_pipeline_frames.at(m_pipeline_index);
+
+		this->stamp_parsed();
+		frame.times = m_times;
+		frame.trace = common::tracing::frame();
+
+		frame.heatmap = data;
+
+		if (m_pipeline_source != nullptr && m_pipeline_source->contains(data.data)) {
+			frame.source = *m_pipeline_source;
+		} else {
+			frame.data.assign(data.data.begin(), data.data.end());
+			frame.heatmap.data = gsl::span<u8> {frame.data};
+		}
+
+		// The current table is still needed for emitting the previous heatmap.
+		update_lut(frame.lut, data.min, data.max);
+
+		m_pipeline_busy = true;
+		m_pipeline->start();
+
+		if (previous != nullptr)
+			this->emit_pipelined(*previous);
+	}
+
+	/*!
+	 * Detects the contacts of the pipelined heatmap. This runs on the background thread.
+	 */
+	void detect_pipelined()
+	{
+		PipelinedFrame &frame = m_pipeline_frames.at(m_pipeline_index);
+		common::tracing::set_frame(frame.trace);
+
+		std::visit(
+			[&](auto &finder) {
+				this->detect_contacts(finder,
+				                      frame.heatmap,
+				                      frame.lut,
+				                      frame.contacts,
+				                      frame.contacts_f32);
+
+				if (m_config.runner_live_stats)
+					frame.neutral = casts::to<f64>(finder.detector().neutral());
+			},
+			m_finder);
+
+		this->stamp(frame.times.detected);
+	}
+
+	/*!
+	 * Waits until the contacts of the pipelined heatmap have been detected.
+	 *
+	 * @return The heatmap, which is ready to be tracked.
+	 */
+	PipelinedFrame &wait_pipelined()
+	{
+		m_pipeline_busy = false;
+		m_pipeline->wait();
+
+		return m_pipeline_frames.at(m_pipeline_index);
+	}
+
+	/*!
+	 * Tracks and emits the contacts of a heatmap that was detected in the background.
+	 *
+	 * @param[in] frame The heatmap and its detected contacts.
+	 */
+	void emit_pipelined(PipelinedFrame &frame)
+	{
+		// The heatmap belongs to an older frame than the data that is being processed.
+		const u64 current = common::tracing::frame();
+		const auto _trace = gsl::finally([&] { common::tracing::set_frame(current); });
+
+		common::tracing::set_frame(frame.trace);
+
+		m_times = frame.times;
+		m_raw_heatmap = frame.heatmap;
+
+		// The background thread only uses the tables of the pipelined frames.
+		if (m_lut.range != frame.lut.range)
+			m_lut = frame.lut;
+
+		std::visit(
+			[&](auto &finder) {
+				this->track_contacts(finder, frame.contacts, frame.contacts_f32);
+			},
+			m_finder);
+
+		this->emit_contacts(frame.contacts, frame.neutral);
+
+		// The buffer can be reused once nothing refers to the heatmap anymore.
+		frame.source.reset();
+	}
+
+	/*!
+	 * Hands off the contacts of a heatmap to the handler code.
+	 *
+	 * @param[in,out] contacts The tracked contacts, which are inverted if necessary.
+	 * @param[in] neutral The neutral value of the heatmap, for the live statistics.
+	 */
+	void emit_contacts(std::vector<contacts::Contact<f64>> &contacts, const f64 neutral)
+	{
 		// Invert contact coordinates if neccessary
-		for (contacts::Contact<f64> &contact : m_contacts) {
+		for (contacts::Contact<f64> &contact : contacts) {
 			if (m_config.invert_x)
 				contact.mean.x() = 1.0 - contact.mean.x();
 
@@ -197,25 +890,389 @@ private:
 		}
 
 		// Hand off the found contacts to the handler code.
-		this->on_contacts(m_contacts);
+		this->on_contacts(contacts);
+
+		if (!this->wants_times())
+			return;
+
+		m_times.emitted = clock::now();
+
+		if (m_config.runner_latency_stats)
+			m_latency.record_touch(m_times);
+
+		if (m_config.runner_live_stats)
+			m_stats.record_touch(m_times, contacts.size(), neutral);
+	}
+
+	/*!
+	 * Runs the detection phase of a contact finder on a heatmap.
+	 *
+	 * @param[in] finder The contact finder, which has to accept the size of the heatmap.
+	 * @param[in] data The heatmap to process.
+	 * @param[in] lut The lookup table for the range of the heatmap.
+	 * @param[out] contacts The detected contacts, if the finder uses double precision.
+	 * @param[out] contacts_f32 The detected contacts, if the finder uses single precision.
+	 */
+	template <class T, class TFit, int Rows, int Cols>
+	void detect_contacts(contacts::Finder<T, TFit, Rows, Cols> &finder,
+	                     const ipts::Heatmap &data,
+	                     const Lut &lut,
+	                     std::vector<contacts::Contact<f64>> &contacts,
+	                     std::vector<contacts::Contact<f32>> &contacts_f32)
+	{
+		const Eigen::Index rows = casts::to_eigen(data.rows);
+		const Eigen::Index cols = casts::to_eigen(data.columns);
+
+		// Map the buffer to an Eigen container
+		const Eigen::Map<const Image<u8, Rows, Cols>> mapped {data.data.data(), rows, cols};
+
+		if constexpr (std::is_same_v<T, f64>)
+			finder.detect(mapped, lut.values, contacts);
+		else
+			finder.detect(mapped, lut.values_f32, contacts_f32);
+	}
+
+	/*!
+	 * Runs the phases of a contact finder that follow the detection.
+	 *
+	 * @param[in] finder The contact finder that detected the contacts.
+	 * @param[in,out] contacts The contacts, which receive the tracked single precision
+	 *                         contacts if the finder uses single precision.
+	 * @param[in,out] contacts_f32 The detected contacts, if the finder uses single precision.
+	 */
+	template <class T, class TFit, int Rows, int Cols>
+	void track_contacts(contacts::Finder<T, TFit, Rows, Cols> &finder,
+	                    std::vector<contacts::Contact<f64>> &contacts,
+	                    std::vector<contacts::Contact<f32>> &contacts_f32)
+	{
+		// Contacts are extrapolated using the measured time between heatmaps
+		const milliseconds<f64> elapsed = m_times.read - m_tracked_timestamp;
+		m_tracked_timestamp = m_times.read;
+
+		if constexpr (std::is_same_v<T, f64>) {
+			finder.track(contacts, elapsed.count());
+			this->stamp(m_times.tracked);
+		} else {
+			finder.track(contacts_f32, gsl::narrow_cast<f32>(elapsed.count()));
+			this->stamp(m_times.tracked);
+
+			contacts.clear();
+
+			for (const contacts::Contact<f32> &contact : contacts_f32)
+				contacts.push_back(contact.cast<f64>());
+		}
+	}
+
+	/*!
+	 * Whether the current contact finder can process heatmaps of a certain size.
+	 *
+	 * @param[in] rows The height of the heatmap.
+	 * @param[in] cols The width of the heatmap.
+	 * @return Whether @ref select_finder would keep the current finder.
+	 */
+	[[nodiscard]] bool finder_fits(const Eigen::Index rows, const Eigen::Index cols) const
+	{
+		const std::pair<Eigen::Index, Eigen::Index> size {rows, cols};
+
+		// The legacy IPTS heatmap
+		if (size == std::pair<Eigen::Index, Eigen::Index> {44, 64})
+			return m_finder_size == size;
+
+		return !m_finder_size.has_value();
+	}
+
+	/*!
+	 * Allocates the storage for processing heatmaps, if their size is known from the metadata.
+	 *
+	 * This moves the allocations, and the page faults of touching the new memory for the
+	 * first time, from the first heatmap to startup.
+	 */
+	void prepare()
+	{
+		if (!m_metadata.has_value())
+			return;
+
+		const Eigen::Index rows = casts::to_eigen(m_metadata->dimensions.rows);
+		const Eigen::Index cols = casts::to_eigen(m_metadata->dimensions.columns);
+
+		if (rows == 0 || cols == 0)
+			return;
+
+		this->select_finder(rows, cols);
+
+		std::visit([&](auto &finder) { finder.prepare(rows, cols, PREPARED_CONTACTS); },
+		           m_finder);
+
+		m_contacts.reserve(PREPARED_CONTACTS);
+		m_contacts_f32.reserve(PREPARED_CONTACTS);
+
+		for (PipelinedFrame &frame : m_pipeline_frames) {
+			frame.data.reserve(casts::to_unsigned(rows * cols));
+			frame.contacts.reserve(PREPARED_CONTACTS);
+			frame.contacts_f32.reserve(PREPARED_CONTACTS);
+		}
+	}
+
+	/*!
+	 * Makes sure that the contact finder can process heatmaps of a certain size.
+	 *
+	 * If there is a finder that is specialized for the size, it replaces the current one.
+	 * Otherwise a finder for any size is used. This usually only happens once, when the
+	 * first heatmap arrives.
+	 *
+	 * @param[in] rows The height of the heatmap.
+	 * @param[in] cols The width of the heatmap.
+	 */
+	void select_finder(const Eigen::Index rows, const Eigen::Index cols)
+	{
+		const std::pair<Eigen::Index, Eigen::Index> size {rows, cols};
+
+		// The legacy IPTS heatmap
+		const bool legacy = size == std::pair<Eigen::Index, Eigen::Index> {44, 64};
+
+		if (legacy) {
+			if (m_finder_size == size)
+				return;
+
+			m_finder = create_finder<44, 64>(m_config, m_fitting_pool);
+			m_finder_size = size;
+			return;
+		}
+
+		if (!m_finder_size.has_value())
+			return;
+
+		m_finder = create_finder<Eigen::Dynamic, Eigen::Dynamic>(m_config, m_fitting_pool);
+		m_finder_size = std::nullopt;
+	}
+
+	/*!
+	 * Creates a contact finder with the precision selected by the config.
+	 *
+	 * @tparam Rows The height of the heatmaps, if the finder is specialized for it.
+	 * @tparam Cols The width of the heatmaps, if the finder is specialized for it.
+	 * @param[in] config The config of the application.
+	 * @param[in] pool Shared threads for fitting gaussians, or null to start new ones.
+	 * @return The contact finder.
+	 */
+	template <int Rows, int Cols>
+	static Finders create_finder(const Config &config,
+	                             const std::shared_ptr<common::ThreadPool> &pool = nullptr)
+	{
+		if (config.contacts_precision == "double") {
+			contacts::Config<f64> contacts = config.contacts<f64>();
+			contacts.detection.fitting_pool = pool;
+
+			return contacts::Finder<f64, f64, Rows, Cols> {contacts};
+		}
+
+		if (config.contacts_precision == "single") {
+			contacts::Config<f32> contacts = config.contacts<f32>();
+			contacts.detection.fitting_pool = pool;
+
+			return contacts::Finder<f32, f32, Rows, Cols> {contacts};
+		}
+
+		throw common::Error<Error::InvalidContactsPrecision> {};
+	}
+
+	/*!
+	 * Rebuilds the lookup table for normalizing heatmaps, if their range changed.
+	 *
+	 * IPTS usually sends data that goes from 255 (no contact) to 0 (contact).
+	 * The table maps it to data that goes from 0 (no contact) to 1 (contact).
+	 *
+	 * @param[in,out] lut The table to rebuild.
+	 * @param[in] min The lowest value of the heatmap.
+	 * @param[in] max The highest value of the heatmap.
+	 */
+	static void update_lut(Lut &lut, const u8 min, const u8 max)
+	{
+		const std::pair<u8, u8> range {min, max};
+
+		if (lut.range == range)
+			return;
+
+		const auto fmin = casts::to<f64>(min);
+		const auto fmax = casts::to<f64>(max);
+
+		for (usize i = 0; i < lut.values.size(); i++) {
+			// Normalize the heatmap to range [0, 1]
+			const f64 norm = (casts::to<f64>(i) - fmin) / (fmax - fmin);
+
+			// IPTS sends inverted heatmaps
+			lut.values.at(i) = 1.0 - norm;
+			lut.values_f32.at(i) = gsl::narrow_cast<f32>(lut.values.at(i));
+		}
+
+		lut.range = range;
+	}
+
+	/*!
+	 * Stores a heatmap so that it can be processed later.
+	 *
+	 * @param[in] data The heatmap to store.
+	 */
+	void defer_heatmap(const ipts::Heatmap &data)
+	{
+		if (m_deferred.has_value())
+			m_dropped_heatmaps++;
+
+		m_deferred_data.assign(data.data.begin(), data.data.end());
+		m_deferred_timestamp = m_timestamp;
+		m_deferred_frame = common::tracing::frame();
+
+		ipts::Heatmap copy = data;
+		copy.data = gsl::span<u8> {m_deferred_data};
+
+		m_deferred = copy;
 	}
 
 	/*!
 	 * Handles incoming IPTS stylus data.
 	 *
 	 * @param[in] data The data to process.
+	 * @param[in] history Older samples from the same report, which are only used for prediction.
+	 * @param[in] sampled Whether the data contains a new position of the stylus.
 	 */
-	void process_stylus(const ipts::StylusData &data)
+	void process_stylus(const ipts::StylusData &data,
+	                    const gsl::span<const ipts::StylusData> history = {},
+	                    const bool sampled = true)
+	{
+		if (!this->wants_stylus())
+			return;
+
+		this->stamp_parsed();
+
+		if (m_config.stylus_prediction > 0) {
+			for (const ipts::StylusData &sample : history)
+				m_predictor.update(this->correct_stylus(sample));
+		}
+
+		const ipts::StylusData corrected = this->correct_stylus(data);
+
+		// Hand off the stylus data to the handler code.
+		if (sampled)
+			this->on_stylus(this->predict_stylus(corrected));
+		else
+			this->on_stylus(this->hold_stylus(corrected));
+
+		this->record_stylus();
+	}
+
+	/*!
+	 * Handles all samples of an incoming IPTS stylus report.
+	 *
+	 * @param[in] batch The samples to process, ordered from oldest to newest.
+	 */
+	void process_stylus_batch(const gsl::span<const ipts::StylusData> batch)
+	{
+		if (!this->wants_stylus())
+			return;
+
+		this->stamp_parsed();
+
+		m_stylus_batch.clear();
+
+		for (const ipts::StylusData &data : batch)
+			m_stylus_batch.push_back(this->predict_stylus(this->correct_stylus(data)));
+
+		// Hand off the stylus data to the handler code.
+		this->on_stylus_batch(m_stylus_batch);
+
+		this->record_stylus();
+	}
+
+	/*!
+	 * Whether the times at which frames pass the stages of processing are needed.
+	 */
+	[[nodiscard]] bool wants_times() const
+	{
+		return m_config.runner_latency_stats || m_config.runner_live_stats;
+	}
+
+	/*!
+	 * Stores the current time, if latency or live statistics are enabled.
+	 *
+	 * @param[out] point Where the time is stored.
+	 */
+	void stamp(clock::time_point &point) const
+	{
+		if (this->wants_times())
+			point = clock::now();
+	}
+
+	/*!
+	 * Marks the data that is currently being processed as parsed.
+	 *
+	 * The time at which it was read is taken from the timestamp passed to @ref process.
+	 */
+	void stamp_parsed()
+	{
+		m_times.read = m_timestamp;
+		this->stamp(m_times.parsed);
+	}
+
+	/*!
+	 * Counts the stylus data that was just emitted, if latency or live statistics are enabled.
+	 */
+	void record_stylus()
+	{
+		if (!this->wants_times())
+			return;
+
+		m_times.emitted = clock::now();
+
+		if (m_config.runner_latency_stats)
+			m_latency.record_stylus(m_times);
+
+		if (m_config.runner_live_stats)
+			m_stats.record_stylus(m_times);
+	}
+
+	/*!
+	 * Corrects the position of the stylus based on the tip-transmitter distance.
+	 *
+	 * @param[in] data The stylus data to correct.
+	 * @return The corrected stylus data.
+	 */
+	[[nodiscard]] ipts::StylusData correct_stylus(const ipts::StylusData &data) const
 	{
 		ipts::StylusData corrected = data;
 
-		// Correct position based on tip-transmitter distance
 		const Vector2<f64> off = this->calculate_offset(data.altitude, data.azimuth);
 		corrected.x += off.x();
 		corrected.y += off.y();
 
-		// Hand off the stylus data to the handler code.
-		this->on_stylus(corrected);
+		return corrected;
+	}
+
+	/*!
+	 * Moves the stylus to where it is expected to be, if prediction is enabled.
+	 *
+	 * @param[in] data The corrected stylus data.
+	 * @return The stylus data with the predicted position.
+	 */
+	[[nodiscard]] ipts::StylusData predict_stylus(const ipts::StylusData &data)
+	{
+		if (m_config.stylus_prediction <= 0)
+			return data;
+
+		return m_predictor.predict(data, m_timestamp);
+	}
+
+	/*!
+	 * Moves the stylus by the same amount as the last prediction, if prediction is enabled.
+	 *
+	 * @param[in] data The corrected stylus data, which doesn't contain a new position.
+	 * @return The stylus data with the position that was predicted last.
+	 */
+	[[nodiscard]] ipts::StylusData hold_stylus(const ipts::StylusData &data) const
+	{
+		if (m_config.stylus_prediction <= 0)
+			return data;
+
+		return m_predictor.hold(data);
 	}
 
 	/*!
@@ -228,8 +1285,14 @@ private:
 	 */
 	void process_dft(const ipts::DftWindow &data)
 	{
+		if (!this->wants_stylus())
+			return;
+
 		m_dft.input(data);
-		this->process_stylus(m_dft.get_stylus());
+
+		// Only position windows measure the position, the others would repeat the last one.
+		const bool sampled = data.type == ipts::protocol::dft::Type::Position;
+		this->process_stylus(m_dft.get_stylus(), {}, sampled);
 	}
 
 	/*!
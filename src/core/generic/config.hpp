@@ -10,6 +10,7 @@
 #include <contacts/config.hpp>
 #include <ipts/parser.hpp>
 
+#include <algorithm>
 #include <optional>
 #include <string>
 
@@ -29,10 +30,30 @@ public:
 	bool touch_disable_on_palm = false;
 	bool touch_disable_on_stylus = false;
 	f64 touch_overshoot = 0.5;
+	bool touch_sync_to_display = false;
+	std::string touch_sync_device = "/dev/dri/card0";
+	f64 touch_sync_margin = 3;
 
 	// [Contacts]
 	std::string contacts_neutral = "mode";
+	std::string contacts_precision = "double";
+	std::string contacts_clustering = "span";
+	bool contacts_warm_start = false;
+	f64 contacts_fitting_tolerance = 0;
+	bool contacts_fitting_mask = false;
+	f64 contacts_palm_size = 0;
+	usize contacts_fitting_threads = 0;
+	usize contacts_fitting_thread_threshold = 4;
+	usize contacts_strip_threshold = 0;
+	usize contacts_pyramid_threshold = 0;
+	usize contacts_incremental_tile_size = 0;
+	bool contacts_reference = false; // Not loaded from files, only used to verify the others
+	bool contacts_prediction = false;
+	f64 contacts_prediction_smoothing = 0.5;
+	f64 contacts_extrapolation = 0;
 	f64 contacts_neutral_value = 0;
+	f64 contacts_neutral_percentile = 50;
+	f64 contacts_neutral_smoothing = 0.05;
 	f64 contacts_activation_threshold = 24;
 	f64 contacts_deactivation_threshold = 20;
 	f64 contacts_size_thresh_min = 0.1;
@@ -49,6 +70,8 @@ public:
 	// [Stylus]
 	bool stylus_disable = false;
 	f64 stylus_tip_distance = 0;
+	bool stylus_batch = false;
+	f64 stylus_prediction = 0;
 
 	// [DFT]
 	usize dft_position_min_amp = 50;
@@ -61,22 +84,44 @@ public:
 	usize dft_mpp2_contact_min_mag = 50000;
 	f64 dft_tilt_distance = 0.6;
 
+	// [Runner]
+	bool runner_threaded = false;
+	usize runner_queue_size = 16;
+	bool runner_drop_stale_heatmaps = false;
+	bool runner_pipelined = false;
+	usize runner_io_uring = 0;
+	f64 runner_reconnect_timeout = 10;
+	bool runner_hugepages = false;
+	i32 runner_realtime_priority = 0;
+	std::string runner_realtime_policy = "fifo";
+	i32 runner_reader_cpu = -1;
+	i32 runner_worker_cpu = -1;
+	bool runner_lock_memory = false;
+	bool runner_latency_stats = false;
+	bool runner_live_stats = false;
+	f64 runner_flight_recorder = 0;
+	std::string runner_flight_recorder_directory = "/tmp";
+
 public:
 	/*!
 	 * Generates a configuration object for the contact detection library.
 	 *
-	 * @return A config object for contact detection using doubles.
+	 * @tparam T The floating point type used for contact detection.
+	 * @return A config object for contact detection.
 	 */
-	[[nodiscard]] contacts::Config<f64> contacts() const
+	template <class T = f64>
+	[[nodiscard]] contacts::Config<T> contacts() const
 	{
-		contacts::Config<f64> config {};
+		contacts::Config<T> config {};
+
+		const auto cast = [](const f64 value) { return gsl::narrow_cast<T>(value); };
 
 		const f64 athresh = this->contacts_activation_threshold;
 		const f64 dthresh = this->contacts_deactivation_threshold;
 
 		config.detection.normalize = true;
-		config.detection.activation_threshold = athresh / 255.0;
-		config.detection.deactivation_threshold = dthresh / 255.0;
+		config.detection.activation_threshold = cast(athresh / 255.0);
+		config.detection.deactivation_threshold = cast(dthresh / 255.0);
 
 		using Algorithm = contacts::detection::neutral::Algorithm;
 
@@ -86,37 +131,88 @@ public:
 			config.detection.neutral_value_algorithm = Algorithm::AVERAGE;
 		else if (this->contacts_neutral == "constant")
 			config.detection.neutral_value_algorithm = Algorithm::CONSTANT;
+		else if (this->contacts_neutral == "percentile")
+			config.detection.neutral_value_algorithm = Algorithm::PERCENTILE;
+		else if (this->contacts_neutral == "baseline")
+			config.detection.neutral_value_algorithm = Algorithm::BASELINE;
 		else
 			throw common::Error<Error::InvalidNeutralValueAlgorithm> {};
 
 		const f64 nval_offset = this->contacts_neutral_value;
 
-		config.detection.neutral_value_offset = nval_offset / 255.0;
+		config.detection.neutral_value_offset = cast(nval_offset / 255.0);
 		config.detection.neutral_value_backoff = 16; // TODO: config option
 
+		const f64 nval_percentile = std::clamp(this->contacts_neutral_percentile, 0.0, 100.0);
+
+		config.detection.neutral_value_percentile = nval_percentile / 100.0;
+
+		const f64 nval_smoothing = std::clamp(this->contacts_neutral_smoothing, 0.0, 1.0);
+
+		config.detection.neutral_value_smoothing = cast(nval_smoothing);
+
+		using ClusterAlgorithm = contacts::detection::cluster::Algorithm;
+
+		if (this->contacts_clustering == "span")
+			config.detection.cluster_algorithm = ClusterAlgorithm::SPAN;
+		else if (this->contacts_clustering == "label")
+			config.detection.cluster_algorithm = ClusterAlgorithm::LABEL;
+		else
+			throw common::Error<Error::InvalidClusterAlgorithm> {};
+
+		const f64 fit_tolerance = std::max(this->contacts_fitting_tolerance, 0.0);
+
+		config.detection.fitting_warm_start = this->contacts_warm_start;
+		config.detection.fitting_tolerance = cast(fit_tolerance);
+		config.detection.fitting_mask = this->contacts_fitting_mask;
+		config.detection.fitting_threads = this->contacts_fitting_threads;
+		config.detection.fitting_thread_threshold = this->contacts_fitting_thread_threshold;
+		config.detection.strip_threshold = this->contacts_strip_threshold;
+		config.detection.pyramid_threshold = this->contacts_pyramid_threshold;
+		config.detection.reference = this->contacts_reference;
+
+		// The local maximas around a changed pixel can only be found with larger tiles
+		const usize tile_size = this->contacts_incremental_tile_size;
+		const usize tile_min = tile_size > 0 ? 2 : 0;
+
+		config.detection.incremental_tile_size = std::max(tile_size, tile_min);
+
+		const f64 pred_gain = std::clamp(this->contacts_prediction_smoothing, 0.0, 1.0);
+		const f64 extrapolation = std::max(this->contacts_extrapolation, 0.0);
+
+		config.tracking.prediction = this->contacts_prediction;
+		config.tracking.prediction_smoothing = cast(pred_gain);
+		config.tracking.extrapolation = cast(extrapolation);
+
 		const f64 diagonal = std::hypot(this->width, this->height);
 
+		// Only contacts that are rejected by the size check anyway are estimated
+		if (this->contacts_palm_size > 0) {
+			const f64 palm = std::max(this->contacts_palm_size, this->contacts_size_max);
+			config.detection.palm_size = cast(palm / diagonal);
+		}
+
 		config.validation.track_validity = true;
-		config.validation.size_limits = Vector2<f64> {
-			this->contacts_size_min / diagonal,
-			this->contacts_size_max / diagonal,
+		config.validation.size_limits = Vector2<T> {
+			cast(this->contacts_size_min / diagonal),
+			cast(this->contacts_size_max / diagonal),
 		};
-		config.validation.aspect_limits = Vector2<f64> {
-			this->contacts_aspect_min,
-			this->contacts_aspect_max,
+		config.validation.aspect_limits = Vector2<T> {
+			cast(this->contacts_aspect_min),
+			cast(this->contacts_aspect_max),
 		};
 
-		config.stability.size_threshold = Vector2<f64> {
-			this->contacts_size_thresh_min / diagonal,
-			this->contacts_size_thresh_max / diagonal,
+		config.stability.size_threshold = Vector2<T> {
+			cast(this->contacts_size_thresh_min / diagonal),
+			cast(this->contacts_size_thresh_max / diagonal),
 		};
-		config.stability.position_threshold = Vector2<f64> {
-			this->contacts_position_thresh_min / diagonal,
-			this->contacts_position_thresh_max / diagonal,
+		config.stability.position_threshold = Vector2<T> {
+			cast(this->contacts_position_thresh_min / diagonal),
+			cast(this->contacts_position_thresh_max / diagonal),
 		};
-		config.stability.orientation_threshold = Vector2<f64> {
-			this->contacts_orientation_thresh_min / 180,
-			this->contacts_orientation_thresh_max / 180,
+		config.stability.orientation_threshold = Vector2<T> {
+			cast(this->contacts_orientation_thresh_min / 180),
+			cast(this->contacts_orientation_thresh_max / 180),
 		};
 
 		return config;
@@ -6,10 +6,14 @@
 #include "config.hpp"
 
 #include <common/casts.hpp>
+#include <common/types.hpp>
 #include <ipts/data.hpp>
 #include <ipts/protocol/dft.hpp>
 
+#include <Eigen/Eigen>
+
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <optional>
 #include <utility>
@@ -18,12 +22,58 @@ namespace iptsd::core {
 
 class DftStylus {
 private:
+	/*
+	 * The three center components of a list of antenna measurements.
+	 */
+	struct Peak {
+		// The index of the center component.
+		f64 center;
+
+		// How far the critical point can be away from the center component.
+		f64 mind;
+		f64 maxd;
+
+		// The amplitudes of the outer components, relative to the center component.
+		f64 left;
+		f64 right;
+
+		// Whether the center component was strong enough to determine a position.
+		bool valid;
+	};
+
+	/*
+	 * The values that are derived from every row of a DFT window.
+	 *
+	 * All rows of a window are read once when it arrives, and the handlers for the
+	 * different window types only look at these values. The arrays are sized for the
+	 * largest possible window, so processing a window never allocates.
+	 *
+	 * Magnitudes are added up in 64 bit, two u32 magnitudes can overflow 32 bit.
+	 */
+	struct Sweep {
+		// How many rows the window contains.
+		usize rows = 0;
+
+		// The magnitude of both axes combined.
+		std::array<u64, ipts::protocol::dft::MAX_ROWS> magnitude {};
+
+		// The magnitude of the weaker axis.
+		std::array<u64, ipts::protocol::dft::MAX_ROWS> weakest {};
+
+		// The center component of both axes combined.
+		std::array<i32, ipts::protocol::dft::MAX_ROWS> real {};
+		std::array<i32, ipts::protocol::dft::MAX_ROWS> imag {};
+	};
+
 	Config m_config;
 	std::optional<const ipts::Metadata> m_metadata;
 
 	// The current state of the DFT stylus.
 	ipts::StylusData m_stylus;
 
+	// The values derived from the current DFT window.
+	Sweep m_sweep {};
+
 	i32 m_real = 0;
 	i32 m_imag = 0;
 	std::optional<u32> m_group = std::nullopt;
@@ -54,6 +104,8 @@ public:
 	 */
 	void input(const ipts::DftWindow &dft)
 	{
+		this->sweep(dft);
+
 		switch (dft.type) {
 		case ipts::protocol::dft::Type::Position:
 			this->handle_position(dft);
@@ -65,7 +117,7 @@ public:
 			this->handle_pressure(dft);
 			break;
 		case ipts::protocol::dft::Type::PositionMPP_2:
-			this->handle_position_mpp_2(dft);
+			this->handle_position_mpp_2();
 			break;
 		case ipts::protocol::dft::Type::BinaryMPP_2:
 			this->handle_dft_binary_mpp_2(dft);
@@ -87,6 +139,33 @@ public:
 	}
 
 private:
+	/*!
+	 * Reads all rows of a DFT window into the sweep.
+	 *
+	 * @param[in] dft The DFT window received from the IPTS hardware.
+	 */
+	void sweep(const ipts::DftWindow &dft)
+	{
+		constexpr u8 center = ipts::protocol::dft::NUM_COMPONENTS / 2;
+
+		// Rows beyond the maximum can't be stored, and are not used by any window type.
+		const usize rows = std::min(std::min(dft.x.size(), dft.y.size()),
+		                            usize {ipts::protocol::dft::MAX_ROWS});
+
+		m_sweep.rows = rows;
+
+		for (usize i = 0; i < rows; i++) {
+			const ipts::protocol::dft::Row &x = dft.x[i];
+			const ipts::protocol::dft::Row &y = dft.y[i];
+
+			m_sweep.magnitude[i] = casts::to<u64>(x.magnitude) + y.magnitude;
+			m_sweep.weakest[i] = std::min(x.magnitude, y.magnitude);
+
+			m_sweep.real[i] = x.real[center] + y.real[center];
+			m_sweep.imag[i] = x.imag[center] + y.imag[center];
+		}
+	}
+
 	/*!
 	 * Calculates the stylus position from a DFT window.
 	 *
@@ -94,13 +173,12 @@ private:
 	 */
 	void handle_position(const ipts::DftWindow &dft)
 	{
-		if (dft.x.size() <= 1) {
+		if (m_sweep.rows <= 1) {
 			this->lift();
 			return;
 		}
 
-		if (dft.x[0].magnitude <= m_config.dft_position_min_mag ||
-		    dft.y[0].magnitude <= m_config.dft_position_min_mag) {
+		if (m_sweep.weakest[0] <= m_config.dft_position_min_mag) {
 			this->lift();
 			return;
 		}
@@ -115,13 +193,10 @@ private:
 
 		m_group = dft.group;
 
-		m_real = dft.x[0].real[ipts::protocol::dft::NUM_COMPONENTS / 2] +
-		         dft.y[0].real[ipts::protocol::dft::NUM_COMPONENTS / 2];
-		m_imag = dft.x[0].imag[ipts::protocol::dft::NUM_COMPONENTS / 2] +
-		         dft.y[0].imag[ipts::protocol::dft::NUM_COMPONENTS / 2];
+		m_real = m_sweep.real[0];
+		m_imag = m_sweep.imag[0];
 
-		f64 x = this->interpolate_position(dft.x[0]);
-		f64 y = this->interpolate_position(dft.y[0]);
+		auto [x, y] = this->interpolate_position(dft.x[0], dft.y[0]);
 
 		if (std::isnan(x) || std::isnan(y)) {
 			this->lift();
@@ -139,11 +214,9 @@ private:
 		if (m_config.invert_y)
 			y = 1 - y;
 
-		if (dft.x[1].magnitude > m_config.dft_tilt_min_mag &&
-		    dft.y[1].magnitude > m_config.dft_tilt_min_mag) {
+		if (m_sweep.weakest[1] > m_config.dft_tilt_min_mag) {
 			// calculate tilt angle from relative position of secondary transmitter
-			f64 xt = this->interpolate_position(dft.x[1]);
-			f64 yt = this->interpolate_position(dft.y[1]);
+			auto [xt, yt] = this->interpolate_position(dft.x[1], dft.y[1]);
 
 			if (!std::isnan(xt) && !std::isnan(yt)) {
 				xt /= width - 1;
@@ -161,7 +234,12 @@ private:
 				xt *= m_config.width / m_config.dft_tilt_distance;
 				yt *= m_config.height / m_config.dft_tilt_distance;
 
-				const f64 azm = std::fmod(std::atan2(-yt, xt) + 2 * M_PI, 2 * M_PI);
+				// atan2 returns (-pi, pi], only negative angles need to be wrapped.
+				f64 azm = std::atan2(-yt, xt);
+
+				if (azm < 0)
+					azm += 2 * M_PI;
+
 				const f64 alt = std::asin(std::min(1.0, std::hypot(xt, yt)));
 
 				m_stylus.azimuth = azm;
@@ -180,7 +258,7 @@ private:
 	 */
 	void handle_button(const ipts::DftWindow &dft)
 	{
-		if (dft.x.empty())
+		if (m_sweep.rows == 0)
 			return;
 
 		// The position and button signals must be from the same group,
@@ -191,17 +269,14 @@ private:
 		bool button = false;
 		bool rubber = false;
 
-		// If mppv2 has decided on a button state use that, else use the magnitude decision.
-		if (m_mppv2_button_or_eraser.value_or(
-			    dft.x[0].magnitude > m_config.dft_button_min_mag &&
-			    dft.y[0].magnitude > m_config.dft_button_min_mag)) {
-			const i32 real = dft.x[0].real[ipts::protocol::dft::NUM_COMPONENTS / 2] +
-			                 dft.y[0].real[ipts::protocol::dft::NUM_COMPONENTS / 2];
-			const i32 imag = dft.x[0].imag[ipts::protocol::dft::NUM_COMPONENTS / 2] +
-			                 dft.y[0].imag[ipts::protocol::dft::NUM_COMPONENTS / 2];
+		const bool strong = m_sweep.weakest[0] > m_config.dft_button_min_mag;
 
+		// If mppv2 has decided on a button state use that, else use the magnitude decision.
+		if (m_mppv2_button_or_eraser.value_or(strong)) {
 			// same phase as position signal = eraser, opposite phase = button
-			const i32 val = m_real * real + m_imag * imag;
+			// Both factors can reach 2^16, so the products are calculated in 64 bit.
+			const i64 val = casts::to<i64>(m_real) * m_sweep.real[0] +
+			                casts::to<i64>(m_imag) * m_sweep.imag[0];
 
 			button = val < 0;
 			rubber = val > 0;
@@ -218,7 +293,7 @@ private:
 	 */
 	void handle_pressure(const ipts::DftWindow &dft)
 	{
-		if (dft.x.size() < ipts::protocol::dft::PRESSURE_ROWS)
+		if (m_sweep.rows < ipts::protocol::dft::PRESSURE_ROWS)
 			return;
 
 		const f64 p =
@@ -240,7 +315,7 @@ private:
 	 */
 	void handle_dft_binary_mpp_2(const ipts::DftWindow &dft)
 	{
-		if (dft.x.size() <= 5) { // not sure if this can happen?
+		if (m_sweep.rows <= 5) { // not sure if this can happen?
 			return;
 		}
 
@@ -254,8 +329,8 @@ private:
 
 		// Now, we can process the frame to determine button state.
 		// First, collapse x and y, they convey the same information.
-		const auto mag_4 = dft.x[4].magnitude + dft.y[4].magnitude;
-		const auto mag_5 = dft.x[5].magnitude + dft.y[5].magnitude;
+		const auto mag_4 = m_sweep.magnitude[4];
+		const auto mag_5 = m_sweep.magnitude[5];
 		const auto threshold = 2 * m_config.dft_mpp2_button_min_mag;
 
 		if (mag_4 < threshold && mag_5 < threshold) {
@@ -272,17 +347,17 @@ private:
 	 * Determines whether the pen is making contact with the screen, it can
 	 * only be used for MPP v2 pens.
 	 */
-	void handle_position_mpp_2(const ipts::DftWindow &dft)
+	void handle_position_mpp_2()
 	{
 		// Clearing the state in case we can't determine it.
 		m_mppv2_in_contact = std::nullopt;
 
-		if (dft.x.size() <= 3) { // not sure if this can happen?
+		if (m_sweep.rows <= 3) { // not sure if this can happen?
 			return;
 		}
 
-		const auto mag_2 = dft.x[2].magnitude + dft.y[2].magnitude;
-		const auto mag_3 = dft.x[3].magnitude + dft.y[3].magnitude;
+		const auto mag_2 = m_sweep.magnitude[2];
+		const auto mag_3 = m_sweep.magnitude[3];
 
 		const auto threshold = 2 * m_config.dft_mpp2_contact_min_mag;
 		if (mag_2 < threshold && mag_3 < threshold) {
@@ -295,55 +370,107 @@ private:
 	}
 
 	/*!
-	 * Interpolates the current stylus position from a list of antenna measurements.
+	 * Interpolates the position of a transmitter from the antenna measurements of both axes.
+	 *
+	 * The amplitudes of both axes are converted together, so that the expensive
+	 * exponentiation runs on a single SIMD vector instead of six separate calls.
+	 *
+	 * @param[in] x The measurements on the X axis.
+	 * @param[in] y The measurements on the Y axis.
+	 * @return The position of the transmitter on both axes, or NaN if it can't be determined.
+	 */
+	[[nodiscard]] std::pair<f64, f64>
+	interpolate_position(const ipts::protocol::dft::Row &x,
+	                     const ipts::protocol::dft::Row &y) const
+	{
+		const Peak px = this->find_peak(x);
+		const Peak py = this->find_peak(y);
+
+		// convert the amplitudes into something we can fit a parabola to
+		Eigen::Array4d amps {px.left, px.right, py.left, py.right};
+		amps = amps.pow(m_config.dft_position_exp);
+
+		return {fit_parabola(px, amps[0], amps[1]), fit_parabola(py, amps[2], amps[3])};
+	}
+
+	/*!
+	 * Finds the three center components of a list of antenna measurements.
+	 *
+	 * The amplitudes of the outer components are aligned to the phase of the center one,
+	 * and divided by its amplitude. The critical point of the parabola depends only on the
+	 * ratio between the amplitudes, so this saves exponentiating the center component.
 	 *
 	 * @param[in] row A list of measurements on one axis.
-	 * @return The position of the stylus on that axis.
+	 * @return The normalized amplitudes around the peak.
 	 */
-	[[nodiscard]] f64 interpolate_position(const ipts::protocol::dft::Row &row) const
+	[[nodiscard]] Peak find_peak(const ipts::protocol::dft::Row &row) const
 	{
+		static_assert(ipts::protocol::dft::NUM_COMPONENTS >= 5);
+
 		// assume the center component has the max amplitude
 		u8 maxi = ipts::protocol::dft::NUM_COMPONENTS / 2;
 
+		Peak peak {};
+
 		// off-screen components are always zero, don't use them
-		f64 mind = -0.5;
-		f64 maxd = 0.5;
+		peak.mind = -0.5;
+		peak.maxd = 0.5;
 
-		if (row.real.at(maxi - 1) == 0 && row.imag.at(maxi - 1) == 0) {
+		if (row.real[maxi - 1] == 0 && row.imag[maxi - 1] == 0) {
 			maxi++;
-			mind = -1;
-		} else if (row.real.at(maxi + 1) == 0 && row.imag.at(maxi + 1) == 0) {
+			peak.mind = -1;
+		} else if (row.real[maxi + 1] == 0 && row.imag[maxi + 1] == 0) {
 			maxi--;
-			maxd = 1;
+			peak.maxd = 1;
 		}
 
+		peak.center = row.first + maxi;
+
 		// get phase-aligned amplitudes of the three center components
-		const f64 amp = std::hypot(row.real.at(maxi), row.imag.at(maxi));
+		const f64 amp = std::hypot(row.real[maxi], row.imag[maxi]);
+
+		// Invalid peaks still go through the conversion, so they need harmless amplitudes.
+		peak.left = 1;
+		peak.right = 1;
 
 		if (amp < casts::to<f64>(m_config.dft_position_min_amp))
-			return casts::to<f64>(NAN);
+			return peak;
 
-		const f64 sin = row.real.at(maxi) / amp;
-		const f64 cos = row.imag.at(maxi) / amp;
+		peak.valid = true;
 
-		std::array<f64, 3> x = {
-			sin * row.real.at(maxi - 1) + cos * row.imag.at(maxi - 1),
-			amp,
-			sin * row.real.at(maxi + 1) + cos * row.imag.at(maxi + 1),
-		};
+		const f64 sin = row.real[maxi] / (amp * amp);
+		const f64 cos = row.imag[maxi] / (amp * amp);
 
-		// convert the amplitudes into something we can fit a parabola to
-		for (u8 i = 0; i < 3; i++)
-			x.at(i) = std::pow(x.at(i), m_config.dft_position_exp);
+		peak.left = sin * row.real[maxi - 1] + cos * row.imag[maxi - 1];
+		peak.right = sin * row.real[maxi + 1] + cos * row.imag[maxi + 1];
+
+		return peak;
+	}
+
+	/*!
+	 * Finds the critical point of a parabola through the three center components.
+	 *
+	 * @param[in] peak The center components.
+	 * @param[in] left The converted amplitude of the left component.
+	 * @param[in] right The converted amplitude of the right component.
+	 * @return The position of the critical point, or NaN if the parabola is open downwards.
+	 */
+	[[nodiscard]] static f64 fit_parabola(const Peak &peak, const f64 left, const f64 right)
+	{
+		if (!peak.valid)
+			return casts::to<f64>(NAN);
+
+		// The center component was normalized to 1, and stays 1 after the conversion.
+		const f64 center = 1;
 
 		// check orientation of fitted parabola
-		if (x[0] + x[2] <= 2 * x[1])
+		if (left + right <= 2 * center)
 			return casts::to<f64>(NAN);
 
 		// find critical point of fitted parabola
-		const f64 d = (x[0] - x[2]) / (2 * (x[0] - 2 * x[1] + x[2]));
+		const f64 d = (left - right) / (2 * (left - 2 * center + right));
 
-		return row.first + maxi + std::clamp(d, mind, maxd);
+		return peak.center + std::clamp(d, peak.mind, peak.maxd);
 	}
 
 	[[nodiscard]] f64 interpolate_frequency(const ipts::DftWindow &dft, const u8 rows) const
@@ -356,7 +483,7 @@ private:
 		u64 maxm = 0;
 
 		for (u8 i = 0; i < rows; i++) {
-			const u64 m = dft.x[i].magnitude + dft.y[i].magnitude;
+			const u64 m = m_sweep.magnitude[i];
 
 			if (m > maxm) {
 				maxm = m;
@@ -381,30 +508,30 @@ private:
 		/*
 		 * all components in a row have the same phase, and corresponding x and y rows also
 		 * have the same phase, so we can add everything together
+		 *
+		 * Only the three rows around the peak are needed, so they are not in the sweep.
+		 * The sums fit into 32 bit, but the products of the estimator don't.
 		 */
-		std::array<i32, 3> real {};
-		std::array<i32, 3> imag {};
+		std::array<i64, 3> real {};
+		std::array<i64, 3> imag {};
 
 		for (u8 i = 0; i < 3; i++) {
-			real.at(i) = 0;
-			imag.at(i) = 0;
+			const ipts::protocol::dft::Row &x = dft.x[maxi + i - 1];
+			const ipts::protocol::dft::Row &y = dft.y[maxi + i - 1];
 
 			for (u8 j = 0; j < ipts::protocol::dft::NUM_COMPONENTS; j++) {
-				const ipts::protocol::dft::Row &x = dft.x[maxi + i - 1];
-				const ipts::protocol::dft::Row &y = dft.y[maxi + i - 1];
-
 				real.at(i) += x.real.at(j) + y.real.at(j);
 				imag.at(i) += x.imag.at(j) + y.imag.at(j);
 			}
 		}
 
 		// interpolate using Eric Jacobsen's modified quadratic estimator
-		const i32 ra = real[0] - real[2];
-		const i32 rb = 2 * real[1] - real[0] - real[2];
-		const i32 ia = imag[0] - imag[2];
-		const i32 ib = 2 * imag[1] - imag[0] - imag[2];
+		const i64 ra = real[0] - real[2];
+		const i64 rb = 2 * real[1] - real[0] - real[2];
+		const i64 ia = imag[0] - imag[2];
+		const i64 ib = 2 * imag[1] - imag[0] - imag[2];
 
-		const f64 d = (ra * rb + ia * ib) / casts::to<f64>(rb * rb + ib * ib);
+		const f64 d = casts::to<f64>(ra * rb + ia * ib) / casts::to<f64>(rb * rb + ib * ib);
 
 		return (maxi + std::clamp(d, mind, maxd)) / (rows - 1);
 	}
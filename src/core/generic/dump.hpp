@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_GENERIC_DUMP_HPP
+#define IPTSD_CORE_GENERIC_DUMP_HPP
+
+#include "device.hpp"
+
+#include <common/types.hpp>
+
+#include <array>
+#include <limits>
+
+namespace iptsd::core::dump {
+
+/*
+ * The layout of binary dump files.
+ *
+ * Version 1 files (written by older versions of iptsd-dump) consist of a @ref DeviceInfo,
+ * a single byte indicating whether metadata is present and the optional @ref ipts::Metadata.
+ * They are followed by the frames, each consisting of a u64 with the size of the data, and
+ * the data itself, padded with zeros to @ref DeviceInfo::buffer_size.
+ *
+ * Version 2 files start with a @ref Header, followed by the same device information and
+ * metadata. Frames consist of a @ref FrameHeader and only the data that was actually received.
+ *
+ * Optionally, the frames are followed by an index for random access. The index starts with a
+ * @ref FrameHeader whose size is @ref END_OF_FRAMES, followed by one @ref IndexEntry per frame
+ * and an @ref IndexFooter at the very end of the file. Files without an index (e.g. because
+ * the recording was interrupted) can still be read sequentially.
+ */
+
+// clang-format off
+
+constexpr std::array<char, 8> MAGIC {'I', 'P', 'T', 'S', 'D', 'U', 'M', 'P'};
+constexpr std::array<char, 8> INDEX_MAGIC {'I', 'P', 'T', 'S', 'D', 'I', 'D', 'X'};
+
+// clang-format on
+
+/*!
+ * The frame size that marks the end of the frames and the beginning of the index.
+ */
+constexpr u32 END_OF_FRAMES = std::numeric_limits<u32>::max();
+
+constexpr u32 VERSION = 2;
+
+/*!
+ * The header of dump files starting with version 2.
+ *
+ * It has the same size as @ref DeviceInfo, so readers can read the first 16 bytes of a file
+ * and then decide whether they are looking at a version 1 or a newer file.
+ */
+struct [[gnu::packed]] Header {
+	std::array<char, 8> magic;
+	u32 version;
+	u32 reserved;
+};
+
+static_assert(sizeof(Header) == sizeof(DeviceInfo));
+
+/*!
+ * Precedes the data of every frame in version 2 files.
+ */
+struct [[gnu::packed]] FrameHeader {
+	//! The monotonic time at which the data was received, in nanoseconds.
+	u64 timestamp;
+
+	//! The size of the data following this header, in bytes.
+	u32 size;
+};
+
+static_assert(sizeof(FrameHeader) == 12);
+
+/*!
+ * Describes the location of a single frame in the file.
+ */
+struct [[gnu::packed]] IndexEntry {
+	//! The offset of the frame header from the beginning of the file, in bytes.
+	u64 offset;
+
+	//! The monotonic time at which the data was received, in nanoseconds.
+	u64 timestamp;
+};
+
+static_assert(sizeof(IndexEntry) == 16);
+
+/*!
+ * The last bytes of a file that contains an index.
+ */
+struct [[gnu::packed]] IndexFooter {
+	//! How many entries the index has.
+	u64 entries;
+
+	std::array<char, 8> magic;
+};
+
+static_assert(sizeof(IndexFooter) == 16);
+
+/*!
+ * Checks whether a header marks a dump file of version 2 or newer.
+ *
+ * @param[in] header The first bytes of the file.
+ * @return Whether the file is using a versioned format.
+ */
+inline bool is_versioned(const Header &header)
+{
+	return header.magic == MAGIC;
+}
+
+} // namespace iptsd::core::dump
+
+#endif // IPTSD_CORE_GENERIC_DUMP_HPP
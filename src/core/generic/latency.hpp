@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_GENERIC_LATENCY_HPP
+#define IPTSD_CORE_GENERIC_LATENCY_HPP
+
+#include <common/chrono.hpp>
+#include <common/histogram.hpp>
+#include <common/types.hpp>
+
+#include <spdlog/spdlog.h>
+
+namespace iptsd::core {
+
+/*
+ * The points in time at which one frame of data passed the stages of processing.
+ */
+struct FrameTimes {
+	using time_point = chrono::steady_clock::time_point;
+
+	// When the report was read from the device.
+	time_point read {};
+
+	// When the report was parsed into a heatmap or stylus data.
+	time_point parsed {};
+
+	// When the contacts of the heatmap were detected.
+	time_point detected {};
+
+	// When the contacts were tracked, stabilized and validated.
+	time_point tracked {};
+
+	// When the application finished emitting the data (e.g. to uinput).
+	time_point emitted {};
+};
+
+/*
+ * Collects how long frames spend in every stage of processing.
+ *
+ * The histograms can be read by a different thread than the one processing the data.
+ */
+class LatencyStats {
+private:
+	common::Histogram m_touch_parse {};
+	common::Histogram m_touch_detect {};
+	common::Histogram m_touch_track {};
+	common::Histogram m_touch_emit {};
+	common::Histogram m_touch_total {};
+
+	common::Histogram m_stylus_parse {};
+	common::Histogram m_stylus_emit {};
+	common::Histogram m_stylus_total {};
+
+public:
+	/*!
+	 * Counts a frame of touch data.
+	 *
+	 * @param[in] times When the frame passed the stages of processing.
+	 */
+	void record_touch(const FrameTimes &times)
+	{
+		m_touch_parse.record(times.parsed - times.read);
+		m_touch_detect.record(times.detected - times.parsed);
+		m_touch_track.record(times.tracked - times.detected);
+		m_touch_emit.record(times.emitted - times.tracked);
+		m_touch_total.record(times.emitted - times.read);
+	}
+
+	/*!
+	 * Counts a frame of stylus data. Stylus data is not detected or tracked.
+	 *
+	 * @param[in] times When the frame passed the stages of processing.
+	 */
+	void record_stylus(const FrameTimes &times)
+	{
+		m_stylus_parse.record(times.parsed - times.read);
+		m_stylus_emit.record(times.emitted - times.parsed);
+		m_stylus_total.record(times.emitted - times.read);
+	}
+
+	/*!
+	 * Writes the collected statistics to the log.
+	 */
+	void log() const
+	{
+		spdlog::info("{:<16} {:>8} {:>8} {:>8} {:>8} {:>8} {:>8}",
+		             "Latency (us)",
+		             "Frames",
+		             "Mean",
+		             "P50",
+		             "P90",
+		             "P99",
+		             "Max");
+
+		log_row("Touch  - Parse", m_touch_parse);
+		log_row("Touch  - Detect", m_touch_detect);
+		log_row("Touch  - Track", m_touch_track);
+		log_row("Touch  - Emit", m_touch_emit);
+		log_row("Touch  - Total", m_touch_total);
+
+		log_row("Stylus - Parse", m_stylus_parse);
+		log_row("Stylus - Emit", m_stylus_emit);
+		log_row("Stylus - Total", m_stylus_total);
+	}
+
+private:
+	/*!
+	 * Writes the statistics of one stage to the log.
+	 *
+	 * @param[in] name The name of the stage.
+	 * @param[in] histogram The durations of the stage.
+	 */
+	static void log_row(const char *name, const common::Histogram &histogram)
+	{
+		spdlog::info("{:<16} {:>8} {:>8} {:>8} {:>8} {:>8} {:>8}",
+		             name,
+		             histogram.count(),
+		             us(histogram.mean()),
+		             us(histogram.percentile(0.5)),
+		             us(histogram.percentile(0.9)),
+		             us(histogram.percentile(0.99)),
+		             us(histogram.max()));
+	}
+
+	/*!
+	 * Converts a duration to whole microseconds for printing.
+	 *
+	 * @param[in] duration The duration to convert.
+	 * @return The number of microseconds.
+	 */
+	static i64 us(const chrono::nanoseconds duration)
+	{
+		return chrono::duration_cast<chrono::microseconds>(duration).count();
+	}
+};
+
+} // namespace iptsd::core
+
+#endif // IPTSD_CORE_GENERIC_LATENCY_HPP
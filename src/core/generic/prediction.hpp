@@ -0,0 +1,251 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_GENERIC_PREDICTION_HPP
+#define IPTSD_CORE_GENERIC_PREDICTION_HPP
+
+#include <common/casts.hpp>
+#include <common/chrono.hpp>
+#include <common/types.hpp>
+#include <ipts/data.hpp>
+
+#include <algorithm>
+#include <array>
+
+namespace iptsd::core {
+
+/*
+ * Predicts where the stylus will be in the near future.
+ *
+ * A line is fitted through the most recent positions of the stylus, and the newest
+ * position is moved along it. This makes up for the time it takes to receive and process
+ * a stylus report, which is most noticeable when drawing.
+ *
+ * Extrapolating a sharp turn would overshoot into the wrong direction. If the newest
+ * movement doesn't follow the fitted line, the measured position is returned unchanged.
+ *
+ * The horizon is a duration, because the sample rate differs between styli. It is converted
+ * to samples using the time between two samples, which is learned from the timestamps of the
+ * reports and the number of samples they contained.
+ */
+class StylusPredictor {
+public:
+	using clock = chrono::steady_clock;
+
+private:
+	// How many positions the line is fitted through.
+	static constexpr usize HISTORY = 4;
+
+	// How many positions must be known before the position is extrapolated.
+	static constexpr usize MIN_HISTORY = 3;
+
+	// The cosine of the largest angle between the newest movement and the fitted line.
+	static constexpr f64 MAX_TURN = 0.7;
+
+	// Intervals longer than this are pauses between strokes, not the rate of the stylus.
+	static constexpr clock::duration MAX_INTERVAL = 50ms;
+
+	// How fast the measured sample rate follows changes (1 / GAIN).
+	static constexpr i64 GAIN = 8;
+
+	// How far ahead the position is extrapolated.
+	clock::duration m_horizon;
+
+	// The time between two samples, or zero if it was not measured yet.
+	clock::duration m_period {0};
+
+	// The timestamp of the last report, and how many samples were added since then.
+	clock::time_point m_stamped {};
+	i64 m_pending = 0;
+
+	// How far the last predicted position was moved from the measured one.
+	Vector2<f64> m_offset = Vector2<f64>::Zero();
+
+	// The most recent positions, as a ring buffer.
+	std::array<Vector2<f64>, HISTORY> m_history {};
+
+	// How many positions are stored, and where the next one will be stored.
+	usize m_size = 0;
+	usize m_next = 0;
+
+	// The serial number of the stylus that the positions belong to.
+	u32 m_serial = 0;
+
+public:
+	/*!
+	 * Creates a new predictor.
+	 *
+	 * @param[in] horizon How many milliseconds ahead the position is extrapolated.
+	 */
+	explicit StylusPredictor(const f64 horizon)
+		: m_horizon {chrono::duration_cast<clock::duration>(
+			  milliseconds<f64> {std::max(horizon, 0.0)})} {};
+
+	/*!
+	 * Adds a sample to the history, without predicting anything.
+	 *
+	 * This is used for the older samples of a stylus report, when only the newest one
+	 * is processed.
+	 *
+	 * @param[in] data The stylus sample.
+	 */
+	void update(const ipts::StylusData &data)
+	{
+		m_pending++;
+
+		// A new stroke starts when the stylus comes back or is switched.
+		if (!data.proximity || data.serial != m_serial) {
+			m_size = 0;
+			m_next = 0;
+			m_serial = data.serial;
+			m_offset = Vector2<f64>::Zero();
+		}
+
+		if (!data.proximity)
+			return;
+
+		m_history[m_next] = Vector2<f64> {data.x, data.y};
+
+		m_next = (m_next + 1) % HISTORY;
+		m_size = std::min(m_size + 1, HISTORY);
+	}
+
+	/*!
+	 * Adds a sample to the history and predicts where the stylus will be.
+	 *
+	 * @param[in] data The stylus sample.
+	 * @param[in] time When the report that contained the sample was received.
+	 * @return The sample, with the position that was predicted for it.
+	 */
+	[[nodiscard]] ipts::StylusData predict(const ipts::StylusData &data,
+	                                       const clock::time_point time)
+	{
+		this->update(data);
+		this->learn(time);
+
+		m_offset = Vector2<f64>::Zero();
+
+		if (m_horizon == clock::duration::zero() || m_period == clock::duration::zero())
+			return data;
+
+		if (m_size < MIN_HISTORY)
+			return data;
+
+		const Vector2<f64> velocity = this->fit();
+
+		const Vector2<f64> &newest = this->at(m_size - 1);
+		const Vector2<f64> step = newest - this->at(m_size - 2);
+
+		// Don't extrapolate if the stylus is turning, or not moving at all.
+		const f64 length = step.norm() * velocity.norm();
+
+		if (length == 0 || step.dot(velocity) < length * MAX_TURN)
+			return data;
+
+		const nanoseconds<f64> horizon = m_horizon;
+		const nanoseconds<f64> period = m_period;
+
+		const Vector2<f64> predicted = newest + (velocity * (horizon / period));
+
+		ipts::StylusData out = data;
+		out.x = std::clamp(predicted.x(), 0.0, 1.0);
+		out.y = std::clamp(predicted.y(), 0.0, 1.0);
+
+		m_offset = Vector2<f64> {out.x, out.y} - newest;
+
+		return out;
+	}
+
+	/*!
+	 * Applies the last prediction to data that doesn't contain a new position.
+	 *
+	 * Some DFT windows only update the buttons or the pressure of the stylus. Predicting
+	 * them would add the same position to the history again, and emitting them without
+	 * prediction would make the stylus jump back and forth between two positions.
+	 *
+	 * @param[in] data The stylus data, with the position of the last sample.
+	 * @return The data, moved to the position that was predicted for the last sample.
+	 */
+	[[nodiscard]] ipts::StylusData hold(const ipts::StylusData &data) const
+	{
+		if (!data.proximity || data.serial != m_serial || m_size == 0)
+			return data;
+
+		ipts::StylusData out = data;
+		out.x = std::clamp(data.x + m_offset.x(), 0.0, 1.0);
+		out.y = std::clamp(data.y + m_offset.y(), 0.0, 1.0);
+
+		return out;
+	}
+
+private:
+	/*!
+	 * Measures the time between two samples.
+	 *
+	 * All samples of a report share its timestamp, so the time between two reports is
+	 * divided by the number of samples that were added in between.
+	 *
+	 * @param[in] time When the report that contained the newest sample was received.
+	 */
+	void learn(const clock::time_point time)
+	{
+		if (time <= m_stamped)
+			return;
+
+		const clock::duration interval = (time - m_stamped) / std::max(m_pending, i64 {1});
+
+		m_stamped = time;
+		m_pending = 0;
+
+		if (interval > MAX_INTERVAL)
+			return;
+
+		if (m_period == clock::duration::zero())
+			m_period = interval;
+		else
+			m_period += (interval - m_period) / GAIN;
+	}
+
+	/*!
+	 * Returns a stored position.
+	 *
+	 * @param[in] index The index of the position, where 0 is the oldest one.
+	 * @return The position.
+	 */
+	[[nodiscard]] const Vector2<f64> &at(const usize index) const
+	{
+		return m_history[(m_next + HISTORY - m_size + index) % HISTORY];
+	}
+
+	/*!
+	 * Fits a line through the stored positions, using the method of least squares.
+	 *
+	 * @return The slope of the line, i.e. how far the stylus moves every sample.
+	 */
+	[[nodiscard]] Vector2<f64> fit() const
+	{
+		const f64 mean = casts::to<f64>(m_size - 1) / 2;
+
+		Vector2<f64> center = Vector2<f64>::Zero();
+
+		for (usize i = 0; i < m_size; i++)
+			center += this->at(i);
+
+		center /= casts::to<f64>(m_size);
+
+		Vector2<f64> covariance = Vector2<f64>::Zero();
+		f64 variance = 0;
+
+		for (usize i = 0; i < m_size; i++) {
+			const f64 t = casts::to<f64>(i) - mean;
+
+			covariance += (this->at(i) - center) * t;
+			variance += t * t;
+		}
+
+		return covariance / variance;
+	}
+};
+
+} // namespace iptsd::core
+
+#endif // IPTSD_CORE_GENERIC_PREDICTION_HPP
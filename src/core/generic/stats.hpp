@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_GENERIC_STATS_HPP
+#define IPTSD_CORE_GENERIC_STATS_HPP
+
+#include "latency.hpp"
+
+#include <common/casts.hpp>
+#include <common/chrono.hpp>
+#include <common/types.hpp>
+
+#include <algorithm>
+#include <array>
+#include <type_traits>
+
+namespace iptsd::core {
+
+/*
+ * A snapshot of the state of a running application, for monitoring it from the outside.
+ *
+ * This struct is shared with other processes, so it only contains plain values and must only
+ * change by appending new fields and incrementing @ref STATS_VERSION.
+ */
+struct Stats {
+	// The version of the layout of this struct.
+	u32 version;
+
+	u32 reserved;
+
+	// The monotonic time at which the last frame was processed, in nanoseconds.
+	// If this doesn't change, no data is arriving from the device.
+	u64 timestamp;
+
+	// How many heatmaps and stylus reports were processed in total.
+	u64 heatmaps;
+	u64 stylus;
+
+	// How many reports were dropped because newer ones were waiting or the queue was full.
+	u64 dropped;
+
+	// How many heatmaps were processed per second, over the last second.
+	f64 fps;
+
+	// Moving averages of the time heatmaps spent in every stage of processing, in microseconds.
+	f64 parse;
+	f64 detect;
+	f64 track;
+	f64 emit;
+	f64 total;
+
+	// How many heatmaps contained 0, 1, ... contacts. The last entry counts all larger ones.
+	std::array<u64, 11> contacts;
+
+	// The neutral value that is subtracted from the heatmaps (Range 0 - 255).
+	f64 neutral;
+};
+
+static_assert(std::is_trivially_copyable_v<Stats>);
+
+constexpr u32 STATS_VERSION = 1;
+
+/*
+ * Collects the statistics that are published while the application is running.
+ */
+class StatsCollector {
+private:
+	using clock = chrono::steady_clock;
+
+	// How much every new frame contributes to the moving averages.
+	static constexpr f64 SMOOTHING = 0.05;
+
+	// Over how much time the frames per second are averaged.
+	static constexpr clock::duration FPS_WINDOW = chrono::seconds {1};
+
+	Stats m_stats {};
+
+	// When the current window for counting frames per second started.
+	clock::time_point m_window {};
+
+	// How many heatmaps were processed in the current window.
+	u64 m_window_frames = 0;
+
+public:
+	StatsCollector()
+	{
+		m_stats.version = STATS_VERSION;
+	}
+
+	/*!
+	 * Counts a processed heatmap.
+	 *
+	 * @param[in] times When the heatmap passed the stages of processing.
+	 * @param[in] contacts How many contacts were found on the heatmap.
+	 * @param[in] neutral The neutral value of the heatmap (Range 0 - 1).
+	 */
+	void record_touch(const FrameTimes &times, const usize contacts, const f64 neutral)
+	{
+		const bool first = m_stats.heatmaps == 0;
+
+		m_stats.heatmaps++;
+		m_stats.timestamp = since_epoch(times.emitted);
+		m_stats.neutral = neutral * 255;
+
+		average(m_stats.parse, times.parsed - times.read, first);
+		average(m_stats.detect, times.detected - times.parsed, first);
+		average(m_stats.track, times.tracked - times.detected, first);
+		average(m_stats.emit, times.emitted - times.tracked, first);
+		average(m_stats.total, times.emitted - times.read, first);
+
+		m_stats.contacts.at(std::min(contacts, m_stats.contacts.size() - 1))++;
+
+		m_window_frames++;
+
+		if (first)
+			m_window = times.emitted;
+
+		const clock::duration elapsed = times.emitted - m_window;
+
+		if (elapsed >= FPS_WINDOW) {
+			const f64 time = chrono::duration_cast<seconds<f64>>(elapsed).count();
+
+			m_stats.fps = casts::to<f64>(m_window_frames) / time;
+			m_window = times.emitted;
+			m_window_frames = 0;
+		}
+	}
+
+	/*!
+	 * Counts a processed stylus report.
+	 *
+	 * @param[in] times When the report passed the stages of processing.
+	 */
+	void record_stylus(const FrameTimes &times)
+	{
+		m_stats.stylus++;
+		m_stats.timestamp = since_epoch(times.emitted);
+	}
+
+	/*!
+	 * The statistics that were collected so far.
+	 */
+	[[nodiscard]] const Stats &get() const
+	{
+		return m_stats;
+	}
+
+private:
+	/*!
+	 * Adds a duration to a moving average.
+	 *
+	 * @param[in,out] value The moving average, in microseconds.
+	 * @param[in] duration The duration to add.
+	 * @param[in] first Whether this is the first duration, which replaces the average.
+	 */
+	static void average(f64 &value, const clock::duration duration, const bool first)
+	{
+		const f64 us = chrono::duration_cast<microseconds<f64>>(duration).count();
+		value = first ? us : value + (SMOOTHING * (us - value));
+	}
+
+	/*!
+	 * Converts a point in time to nanoseconds since the epoch of the clock.
+	 *
+	 * @param[in] point The point in time.
+	 * @return The number of nanoseconds.
+	 */
+	static u64 since_epoch(const clock::time_point point)
+	{
+		const clock::duration epoch = point.time_since_epoch();
+		const auto ns = chrono::duration_cast<chrono::nanoseconds>(epoch);
+		return casts::to_unsigned(ns.count());
+	}
+};
+
+} // namespace iptsd::core
+
+#endif // IPTSD_CORE_GENERIC_STATS_HPP
@@ -20,6 +20,7 @@
 #include <optional>
 #include <string>
 #include <type_traits>
+#include <vector>
 
 namespace iptsd::core::linux {
 
@@ -74,6 +75,139 @@ public:
 		return m_config;
 	}
 
+	/*!
+	 * All files that configuration data could be loaded from.
+	 *
+	 * This includes device specific presets for all devices, not only the current one.
+	 *
+	 * @return The paths of all files that are considered when loading a config.
+	 */
+	[[nodiscard]] static std::vector<std::filesystem::path> files()
+	{
+		std::vector<std::filesystem::path> files {};
+
+		const auto add_dir = [&](const std::filesystem::path &path) {
+			if (!std::filesystem::exists(path))
+				return;
+
+			for (const auto &p : std::filesystem::directory_iterator(path)) {
+				if (p.is_regular_file())
+					files.push_back(p.path());
+			}
+		};
+
+		add_dir(common::buildopts::PresetDir);
+		add_dir("./etc/presets");
+
+		if (const char *config_file_path = std::getenv("IPTSD_CONFIG_FILE")) {
+			files.emplace_back(config_file_path);
+			return files;
+		}
+
+		if (std::filesystem::exists(common::buildopts::ConfigFile))
+			files.emplace_back(common::buildopts::ConfigFile);
+
+		add_dir(common::buildopts::ConfigDir);
+		return files;
+	}
+
+	/*!
+	 * Calls a function for every config option, with its section, name and storage.
+	 *
+	 * This is the single list of all options, which is used for loading config files,
+	 * as well as for storing and restoring configs in the startup cache.
+	 *
+	 * @param[in] config The config object whose options are passed to the function.
+	 * @param[in] func The function to call for every option.
+	 */
+	template <class C, class F>
+	static void for_each_option(C &config, F &&func)
+	{
+		// clang-format off
+
+		func("Config", "InvertX", config.invert_x);
+		func("Config", "InvertY", config.invert_y);
+		func("Config", "Width", config.width);
+		func("Config", "Height", config.height);
+
+		func("Touch", "Disable", config.touch_disable);
+		func("Touch", "DisableOnPalm", config.touch_disable_on_palm);
+		func("Touch", "DisableOnStylus", config.touch_disable_on_stylus);
+		func("Touch", "Overshoot", config.touch_overshoot);
+		func("Touch", "SyncToDisplay", config.touch_sync_to_display);
+		func("Touch", "SyncDevice", config.touch_sync_device);
+		func("Touch", "SyncMargin", config.touch_sync_margin);
+
+		func("Contacts", "Neutral", config.contacts_neutral);
+		func("Contacts", "NeutralValue", config.contacts_neutral_value);
+		func("Contacts", "NeutralPercentile", config.contacts_neutral_percentile);
+		func("Contacts", "NeutralSmoothing", config.contacts_neutral_smoothing);
+		func("Contacts", "ActivationThreshold", config.contacts_activation_threshold);
+		func("Contacts", "DeactivationThreshold", config.contacts_deactivation_threshold);
+		func("Contacts", "SizeThresholdMin", config.contacts_size_thresh_min);
+		func("Contacts", "SizeThresholdMax", config.contacts_size_thresh_max);
+		func("Contacts", "PositionThresholdMin", config.contacts_position_thresh_min);
+		func("Contacts", "PositionThresholdMax", config.contacts_position_thresh_max);
+		func("Contacts", "OrientationThresholdMin", config.contacts_orientation_thresh_min);
+		func("Contacts", "OrientationThresholdMax", config.contacts_orientation_thresh_max);
+		func("Contacts", "SizeMin", config.contacts_size_min);
+		func("Contacts", "SizeMax", config.contacts_size_max);
+		func("Contacts", "AspectMin", config.contacts_aspect_max);
+		func("Contacts", "AspectMax", config.contacts_aspect_max);
+		func("Contacts", "Precision", config.contacts_precision);
+		func("Contacts", "Clustering", config.contacts_clustering);
+		func("Contacts", "WarmStart", config.contacts_warm_start);
+		func("Contacts", "FittingTolerance", config.contacts_fitting_tolerance);
+		func("Contacts", "FittingMask", config.contacts_fitting_mask);
+		func("Contacts", "PalmSize", config.contacts_palm_size);
+		func("Contacts", "FittingThreads", config.contacts_fitting_threads);
+		func("Contacts",
+		     "FittingThreadThreshold",
+		     config.contacts_fitting_thread_threshold);
+		func("Contacts", "StripThreshold", config.contacts_strip_threshold);
+		func("Contacts", "PyramidThreshold", config.contacts_pyramid_threshold);
+		func("Contacts", "IncrementalTileSize", config.contacts_incremental_tile_size);
+		func("Contacts", "Prediction", config.contacts_prediction);
+		func("Contacts", "PredictionSmoothing", config.contacts_prediction_smoothing);
+		func("Contacts", "Extrapolation", config.contacts_extrapolation);
+
+		func("Stylus", "Disable", config.stylus_disable);
+		func("Stylus", "TipDistance", config.stylus_tip_distance);
+		func("Stylus", "Batch", config.stylus_batch);
+		func("Stylus", "Prediction", config.stylus_prediction);
+
+		func("DFT", "PositionMinAmp", config.dft_position_min_amp);
+		func("DFT", "PositionMinMag", config.dft_position_min_mag);
+		func("DFT", "PositionExp", config.dft_position_exp);
+		func("DFT", "ButtonMinMag", config.dft_button_min_mag);
+		func("DFT", "FreqMinMag", config.dft_freq_min_mag);
+		func("DFT", "TiltMinMag", config.dft_tilt_min_mag);
+		func("DFT", "TiltDistance", config.dft_tilt_distance);
+		func("DFT", "Mpp2ContactMinMag", config.dft_mpp2_contact_min_mag);
+		func("DFT", "Mpp2ButtonMinMag", config.dft_mpp2_button_min_mag);
+
+		func("Runner", "Threaded", config.runner_threaded);
+		func("Runner", "QueueSize", config.runner_queue_size);
+		func("Runner", "DropStaleHeatmaps", config.runner_drop_stale_heatmaps);
+		func("Runner", "Pipelined", config.runner_pipelined);
+		func("Runner", "IoUring", config.runner_io_uring);
+		func("Runner", "ReconnectTimeout", config.runner_reconnect_timeout);
+		func("Runner", "HugePages", config.runner_hugepages);
+		func("Runner", "RealtimePriority", config.runner_realtime_priority);
+		func("Runner", "RealtimePolicy", config.runner_realtime_policy);
+		func("Runner", "ReaderCpu", config.runner_reader_cpu);
+		func("Runner", "WorkerCpu", config.runner_worker_cpu);
+		func("Runner", "LockMemory", config.runner_lock_memory);
+		func("Runner", "LatencyStats", config.runner_latency_stats);
+		func("Runner", "LiveStats", config.runner_live_stats);
+		func("Runner", "FlightRecorder", config.runner_flight_recorder);
+		func("Runner",
+		     "FlightRecorderDirectory",
+		     config.runner_flight_recorder_directory);
+
+		// clang-format on
+	}
+
 private:
 	/*!
 	 * Load all configuration files from a directory.
@@ -140,45 +274,11 @@ private:
 		if (ini.ParseError() != 0)
 			throw common::Error<Error::ParsingFailed> {path.c_str()};
 
-		// clang-format off
+		for_each_option(m_config, [&](const auto &section, const auto &name, auto &value) {
+			this->get(ini, section, name, value);
+		});
 
-		this->get(ini, "Config", "InvertX", m_config.invert_x);
-		this->get(ini, "Config", "InvertY", m_config.invert_y);
-		this->get(ini, "Config", "Width", m_config.width);
-		this->get(ini, "Config", "Height", m_config.height);
-
-		this->get(ini, "Touch", "Disable", m_config.touch_disable);
-		this->get(ini, "Touch", "DisableOnPalm", m_config.touch_disable_on_palm);
-		this->get(ini, "Touch", "DisableOnStylus", m_config.touch_disable_on_stylus);
-		this->get(ini, "Touch", "Overshoot", m_config.touch_overshoot);
-
-		this->get(ini, "Contacts", "Neutral", m_config.contacts_neutral);
-		this->get(ini, "Contacts", "NeutralValue", m_config.contacts_neutral_value);
-		this->get(ini, "Contacts", "ActivationThreshold", m_config.contacts_activation_threshold);
-		this->get(ini, "Contacts", "DeactivationThreshold", m_config.contacts_deactivation_threshold);
-		this->get(ini, "Contacts", "SizeThresholdMin", m_config.contacts_size_thresh_min);
-		this->get(ini, "Contacts", "SizeThresholdMax", m_config.contacts_size_thresh_max);
-		this->get(ini, "Contacts", "PositionThresholdMin", m_config.contacts_position_thresh_min);
-		this->get(ini, "Contacts", "PositionThresholdMax", m_config.contacts_position_thresh_max);
-		this->get(ini, "Contacts", "OrientationThresholdMin", m_config.contacts_orientation_thresh_min);
-		this->get(ini, "Contacts", "OrientationThresholdMax", m_config.contacts_orientation_thresh_max);
-		this->get(ini, "Contacts", "SizeMin", m_config.contacts_size_min);
-		this->get(ini, "Contacts", "SizeMax", m_config.contacts_size_max);
-		this->get(ini, "Contacts", "AspectMin", m_config.contacts_aspect_max);
-		this->get(ini, "Contacts", "AspectMax", m_config.contacts_aspect_max);
-
-		this->get(ini, "Stylus", "Disable", m_config.stylus_disable);
-		this->get(ini, "Stylus", "TipDistance", m_config.stylus_tip_distance);
-
-		this->get(ini, "DFT", "PositionMinAmp", m_config.dft_position_min_amp);
-		this->get(ini, "DFT", "PositionMinMag", m_config.dft_position_min_mag);
-		this->get(ini, "DFT", "PositionExp", m_config.dft_position_exp);
-		this->get(ini, "DFT", "ButtonMinMag", m_config.dft_button_min_mag);
-		this->get(ini, "DFT", "FreqMinMag", m_config.dft_freq_min_mag);
-		this->get(ini, "DFT", "TiltMinMag", m_config.dft_tilt_min_mag);
-		this->get(ini, "DFT", "TiltDistance", m_config.dft_tilt_distance);
-		this->get(ini, "DFT", "Mpp2ContactMinMag", m_config.dft_mpp2_contact_min_mag);
-		this->get(ini, "DFT", "Mpp2ButtonMinMag", m_config.dft_mpp2_button_min_mag);
+		// clang-format off
 
 		// Legacy options that are kept for compatibility
 		this->get(ini, "DFT", "TipDistance", m_config.stylus_tip_distance);
@@ -4,23 +4,47 @@
 #define IPTSD_CORE_LINUX_DEVICE_RUNNER_HPP
 
 #include "config-loader.hpp"
+#include "device-watcher.hpp"
 #include "errors.hpp"
+#include "flight-recorder.hpp"
 #include "hidraw-device.hpp"
+#include "io-uring.hpp"
+#include "startup-cache.hpp"
+#include "stats-page.hpp"
+#include "syscalls.hpp"
 
+#include <common/buffer-pool.hpp>
 #include <common/casts.hpp>
 #include <common/chrono.hpp>
 #include <common/error.hpp>
+#include <common/spsc-ring.hpp>
+#include <common/thread-pool.hpp>
+#include <common/tracing.hpp>
 #include <core/generic/application.hpp>
 #include <ipts/data.hpp>
 #include <ipts/device.hpp>
+#include <ipts/parser.hpp>
 
+#include <fmt/format.h>
 #include <spdlog/spdlog.h>
 
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <csignal>
+#include <exception>
 #include <filesystem>
 #include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
 #include <thread>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace iptsd::core::linux {
@@ -30,7 +54,31 @@ class DeviceRunner {
 private:
 	static_assert(std::is_base_of_v<Application, T>);
 
+	/*
+	 * A slot in the queue between the reading and the processing thread.
+	 */
+	struct Slot {
+		// The buffer the report was read into, taken from the pool of the queue.
+		common::BufferPool::Handle buffer {};
+		usize size = 0;
+
+		// When the report was read from the device.
+		Application::clock::time_point timestamp {};
+
+		// The ID of the report, for tracing.
+		u64 frame = 0;
+	};
+
+	// The smallest page size, and how much of the stack is touched by @ref prefault.
+	static constexpr usize PREFAULT_STRIDE = 4096;
+	static constexpr usize PREFAULT_STACK = 128 * 1024;
+
 private:
+	// The cache for data about the device, and the data cached by a previous run.
+	// These are declared first, because they are filled while opening the device.
+	std::optional<StartupCache> m_cache = std::nullopt;
+	std::optional<StartupCache::Entry> m_cached = std::nullopt;
+
 	// The hidraw device serving as the source of data.
 	std::shared_ptr<HidrawDevice> m_device;
 
@@ -43,6 +91,67 @@ private:
 	// The target buffer for reading HID reports.
 	std::vector<u8> m_buffer {};
 
+	// The buffers of the queue. They can outlive their slot, while a heatmap is pipelined.
+	std::optional<common::BufferPool> m_pool = std::nullopt;
+
+	// The queue between the reading and the processing thread, if threaded mode is enabled.
+	std::optional<common::SpscRing<Slot>> m_queue = std::nullopt;
+
+	// Whether heatmaps should be skipped if newer reports are already waiting.
+	bool m_drop_stale = false;
+
+	// How many buffers are read into through io_uring, or 0 to use blocking reads.
+	usize m_uring_depth = 0;
+
+	// How long to wait for the device to come back after reading from it failed.
+	Application::clock::duration m_reconnect_timeout {};
+
+	// How many reports were dropped because the queue was full.
+	std::atomic<usize> m_overflows = 0;
+
+	// Whether the reading thread has stopped and won't produce new reports.
+	std::atomic_bool m_reader_done = false;
+
+	// Whether the processing thread encountered too many errors.
+	std::atomic_bool m_aborted = false;
+
+	// The real-time scheduling policy of the reading and processing thread.
+	int m_rt_policy = SCHED_FIFO;
+
+	// The real-time priority of the reading and processing thread, or 0 if disabled.
+	i32 m_rt_priority = 0;
+
+	// The CPU cores that the reading and processing thread are bound to, or -1 if not.
+	i32 m_reader_cpu = -1;
+	i32 m_worker_cpu = -1;
+
+	// Whether all memory of the process is locked before processing starts.
+	bool m_lock_memory = false;
+
+	// Whether the application collects latency statistics.
+	bool m_latency_stats = false;
+
+	// How many threads the application wants for fitting gaussians.
+	usize m_fitting_threads = 0;
+
+	// Whether the latency statistics should be logged by the processing thread.
+	std::atomic_bool m_latency_requested = false;
+
+	// How many reports were read from the device, for tracing.
+	u64 m_frames = 0;
+
+	// The shared memory object where live statistics are published, if enabled.
+	std::optional<StatsPage> m_stats_page = std::nullopt;
+
+	// The most recent reports of the device, if the flight recorder is enabled.
+	std::optional<FlightRecorder> m_recorder = std::nullopt;
+
+	// Where the flight recorder saves the reports.
+	std::filesystem::path m_recorder_directory {};
+
+	// Whether the reading thread should save the reports of the flight recorder.
+	std::atomic_bool m_recording_requested = false;
+
 	/*
 	 * deferred initialization
 	 */
@@ -53,7 +162,7 @@ private:
 public:
 	template <class... Args>
 	DeviceRunner(const std::filesystem::path &path, Args... args)
-		: m_device {std::make_shared<HidrawDevice>(path)},
+		: m_device {this->open(path)},
 		  m_ipts {m_device}
 	{
 		DeviceInfo info {};
@@ -61,13 +170,85 @@ public:
 		info.product = m_device->product();
 		info.buffer_size = m_ipts.buffer_size();
 
-		const std::optional<const ipts::Metadata> meta = m_ipts.metadata();
+		const bool cached = m_cached.has_value();
+
+		using Metadata = std::optional<const ipts::Metadata>;
+		const Metadata meta = cached ? Metadata {m_cached->metadata} : m_ipts.metadata();
 
-		const ConfigLoader loader {info, meta};
-		m_application.emplace(loader.config(), info, meta, args...);
+		const Config config = cached ? m_cached->config : ConfigLoader {info, meta}.config();
+
+		if (cached) {
+			spdlog::info("Loaded device information from startup cache");
+		} else {
+			StartupCache::Entry entry {};
+			entry.reports = m_device->descriptor();
+			entry.metadata = meta;
+			entry.config = config;
+
+			m_cache->store(entry);
+		}
+
+		m_cache.reset();
+		m_cached.reset();
+
+		m_application.emplace(config, info, meta, args...);
 
 		m_buffer.resize(casts::to<usize>(info.buffer_size));
 
+		if (config.runner_threaded && config.runner_queue_size > 0) {
+			const usize size = config.runner_queue_size;
+
+			// One buffer for every slot, the heatmaps of the pipeline and the next read
+			m_pool.emplace(size + 3, m_buffer.size());
+			m_queue.emplace(size);
+			m_drop_stale = config.runner_drop_stale_heatmaps;
+		}
+
+		// Older kernels can't register more than 1024 buffers (UIO_MAXIOV).
+		m_uring_depth = std::min(config.runner_io_uring, usize {1024});
+
+		const seconds<f64> timeout {std::max(config.runner_reconnect_timeout, 0.0)};
+		m_reconnect_timeout = chrono::duration_cast<Application::clock::duration>(timeout);
+
+		const std::string &policy = config.runner_realtime_policy;
+
+		if (policy == "fifo")
+			m_rt_policy = SCHED_FIFO;
+		else if (policy == "rr")
+			m_rt_policy = SCHED_RR;
+		else
+			throw common::Error<Error::InvalidSchedulingPolicy> {policy};
+
+		m_rt_priority = config.runner_realtime_priority;
+		m_reader_cpu = config.runner_reader_cpu;
+		m_worker_cpu = config.runner_worker_cpu;
+		m_lock_memory = config.runner_lock_memory;
+		m_latency_stats = config.runner_latency_stats;
+		m_fitting_threads = config.contacts_fitting_threads;
+
+		if (config.runner_live_stats) {
+			const std::string name = "/iptsd-" + path.filename().string();
+
+			try {
+				m_stats_page.emplace(name);
+				spdlog::info("Publishing live statistics in /dev/shm{}", name);
+			} catch (const std::exception &e) {
+				spdlog::warn(e.what());
+			}
+		}
+
+		if (config.runner_flight_recorder > 0) {
+			using duration = Application::clock::duration;
+			const seconds<f64> time {config.runner_flight_recorder};
+
+			m_recorder_directory = config.runner_flight_recorder_directory;
+			m_recorder.emplace(info, meta, chrono::duration_cast<duration>(time));
+
+			spdlog::info("Keeping the last {:.0f} s of reports in memory ({} KiB)",
+			             time.count(),
+			             m_recorder->capacity() / 1024);
+		}
+
 		const u16 vendor = info.vendor;
 		const u16 product = info.product;
 
@@ -89,6 +270,27 @@ public:
 		return m_application.value();
 	}
 
+	/*!
+	 * How many reports are currently waiting in the queue of the processing thread.
+	 *
+	 * @return The queue depth, or zero if threaded mode is not enabled.
+	 */
+	[[nodiscard]] usize queue_depth() const
+	{
+		if (!m_queue.has_value())
+			return 0;
+
+		return m_queue->size();
+	}
+
+	/*!
+	 * How many reports were dropped because the queue of the processing thread was full.
+	 */
+	[[nodiscard]] usize queue_overflows() const
+	{
+		return m_overflows.load(std::memory_order_relaxed);
+	}
+
 	/*!
 	 * Stops the loop that reads from the device.
 	 *
@@ -99,12 +301,179 @@ public:
 		m_should_stop = true;
 	}
 
+	/*!
+	 * Requests that the latency statistics of the application are logged.
+	 *
+	 * They are logged by the thread that processes the data, after the current frame.
+	 * This function is designed to be called from a signal handler (e.g. for SIGUSR1).
+	 */
+	void request_latency()
+	{
+		m_latency_requested = true;
+	}
+
+	/*!
+	 * Requests that the reports of the flight recorder are saved to a file.
+	 *
+	 * They are saved by the thread that reads from the device, after the next report.
+	 * This function is designed to be called from a signal handler (e.g. for SIGUSR2).
+	 */
+	void request_recording()
+	{
+		m_recording_requested = true;
+	}
+
+	/*!
+	 * Saves the reports of the flight recorder to a new file, if it is enabled.
+	 *
+	 * The file is named after the device and the current time. Failing to save it is
+	 * not an error, since this usually happens while something else already went wrong.
+	 */
+	void save_recording() const
+	{
+		if (!m_recorder.has_value())
+			return;
+
+		const auto now = chrono::system_clock::now().time_since_epoch();
+		const auto time = chrono::duration_cast<chrono::seconds>(now).count();
+
+		const std::string device = m_device->path().filename().string();
+		const std::filesystem::path path =
+			m_recorder_directory / fmt::format("iptsd-{}-{}.bin", device, time);
+
+		try {
+			const usize count = m_recorder->save(path);
+			spdlog::info("Saved the last {} reports to {}", count, path.c_str());
+		} catch (const std::exception &e) {
+			spdlog::error(e.what());
+		}
+	}
+
 	/*!
 	 * Starts reading from the device in an endless loop.
 	 *
 	 * Touch data that is read will be passed to the application that is being executed.
 	 */
 	bool run()
+	{
+		this->start();
+
+		if (m_lock_memory)
+			this->lock_memory();
+
+		if (m_queue.has_value())
+			this->run_threaded();
+		else if (m_uring_depth == 0 || !this->run_uring())
+			this->run_direct();
+
+		// The loop only ends on its own if something went wrong
+		if (!m_should_stop)
+			this->save_recording();
+
+		spdlog::info("Stopping");
+
+		this->finish();
+
+		return m_should_stop;
+	}
+
+	/*
+	 * The functions below are used by @ref MultiDeviceRunner, which reads from multiple
+	 * devices on one thread instead of calling @ref run.
+	 */
+
+	/*!
+	 * The file descriptor of the device, for waiting until data arrives.
+	 */
+	[[nodiscard]] int fd() const
+	{
+		return m_device->fd();
+	}
+
+	/*!
+	 * The path of the hidraw node that the device was opened through most recently.
+	 */
+	[[nodiscard]] const std::filesystem::path &path() const
+	{
+		return m_device->path();
+	}
+
+	/*!
+	 * How long to wait for the device to come back after it was disconnected.
+	 *
+	 * @return The timeout, or zero if disconnected devices are not waited for.
+	 */
+	[[nodiscard]] Application::clock::duration reconnect_timeout() const
+	{
+		return std::max(m_reconnect_timeout, Application::clock::duration::zero());
+	}
+
+	/*!
+	 * Tries to open the device again through a hidraw node.
+	 *
+	 * The application keeps its state, see @ref reconnect. If this fails, the device stays
+	 * connected through its old node, even if it can't be read from anymore. The file
+	 * descriptor changes if the device was opened again.
+	 *
+	 * @param[in] node The path to the hidraw node.
+	 * @return Whether the node belongs to the device, and the device accepted multitouch mode.
+	 */
+	bool reopen(const std::filesystem::path &node)
+	{
+		try {
+			m_device->reopen(node);
+			m_ipts.set_mode(ipts::Mode::Multitouch);
+		} catch (const std::exception &e) {
+			spdlog::debug(e.what());
+			return false;
+		}
+
+		return true;
+	}
+
+	/*!
+	 * How many threads the application wants for fitting gaussians.
+	 */
+	[[nodiscard]] usize fitting_threads() const
+	{
+		return m_fitting_threads;
+	}
+
+	/*!
+	 * Whether the config of the device enables threaded mode.
+	 */
+	[[nodiscard]] bool threaded() const
+	{
+		return m_queue.has_value();
+	}
+
+	/*!
+	 * Makes the application use threads for fitting gaussians that are shared with others.
+	 *
+	 * @param[in] pool The shared threads.
+	 */
+	void share_fitting_pool(std::shared_ptr<common::ThreadPool> pool)
+	{
+		this->application().share_fitting_pool(std::move(pool));
+	}
+
+	/*!
+	 * Prepares the calling thread for reading from the device and processing its data.
+	 *
+	 * This applies the memory locking and real-time scheduling options of the device.
+	 */
+	void prepare_thread()
+	{
+		if (m_lock_memory)
+			this->lock_memory();
+
+		this->enter_realtime(m_reader_cpu);
+	}
+
+	/*!
+	 * Switches the device to multitouch mode and signals the start of the data flow.
+	 */
+	void start()
 	{
 		if (!m_application.has_value())
 			throw common::Error<Error::RunnerInitError> {};
@@ -114,6 +483,284 @@ public:
 
 		// Signal the application that the data flow has started.
 		m_application->on_start();
+	}
+
+	/*!
+	 * Signals the end of the data flow and switches the device back to singletouch mode.
+	 */
+	void finish()
+	{
+		if (m_latency_stats)
+			m_application->log_latency();
+
+		this->log_skipped();
+
+		// Signal the application that the data flow has stopped.
+		m_application->on_stop();
+
+		try {
+			// Disable multitouch mode
+			m_ipts.set_mode(ipts::Mode::Singletouch);
+		} catch (const std::exception &e) {
+			spdlog::error(e.what());
+		}
+	}
+
+	/*!
+	 * Writes how many frames of the data the parser could not process to the log.
+	 */
+	void log_skipped() const
+	{
+		const usize truncated = m_application->skipped_frames(ipts::ParseError::Truncated);
+		const usize frames = m_application->skipped_frames(ipts::ParseError::UnknownFrame);
+		const usize reports = m_application->skipped_frames(ipts::ParseError::UnknownReport);
+
+		if (truncated > 0)
+			spdlog::warn("Skipped {} malformed frames", truncated);
+
+		spdlog::debug("Skipped {} frames and {} reports of unknown type", frames, reports);
+	}
+
+	/*!
+	 * Reads one report from the device and processes it on the calling thread.
+	 *
+	 * This blocks until the device sends a report.
+	 */
+	void process_next()
+	{
+		const u64 frame = ++m_frames;
+
+		const isize size = this->read(m_buffer, frame);
+		const auto timestamp = Application::clock::now();
+
+		const gsl::span<u8> data {m_buffer.data(), casts::to_unsigned(size)};
+
+		// Does this report contain touch data?
+		if (!m_ipts.is_touch_data(data))
+			return;
+
+		this->record(data, timestamp);
+
+		common::tracing::set_frame(frame);
+		m_application->process(data, timestamp);
+
+		this->publish_stats();
+
+		this->log_requested_latency();
+	}
+
+private:
+	/*!
+	 * Opens the hidraw device and restores its parsed HID descriptor from the cache.
+	 *
+	 * @param[in] path The path to the hidraw device.
+	 * @return The opened device.
+	 */
+	std::shared_ptr<HidrawDevice> open(const std::filesystem::path &path)
+	{
+		const auto device = std::make_shared<HidrawDevice>(path);
+
+		m_cache.emplace(device->vendor(), device->product(), device->raw_descriptor());
+		m_cached = m_cache->load();
+
+		if (m_cached.has_value())
+			device->set_descriptor(m_cached->reports);
+
+		return device;
+	}
+
+	/*!
+	 * Locks all current and future memory of the process.
+	 *
+	 * Everything that is allocated up to this point, like the buffers for reading from
+	 * the device, can't be swapped out later. Afterwards, the buffers and the stack of the
+	 * calling thread are touched, so that the first frames don't have to fault them in.
+	 */
+	void lock_memory()
+	{
+		try {
+			syscalls::mlockall(MCL_CURRENT | MCL_FUTURE);
+		} catch (const std::exception &e) {
+			spdlog::warn(e.what());
+			return;
+		}
+
+		this->prefault();
+	}
+
+	/*!
+	 * Writes to every page of the buffers for reading from the device.
+	 *
+	 * The stack of the calling thread is grown as well. Threads that are started later get
+	 * a stack that is mapped at once, which is locked through MCL_FUTURE.
+	 */
+	void prefault()
+	{
+		for (usize i = 0; i < m_buffer.size(); i += PREFAULT_STRIDE)
+			m_buffer[i] = 0;
+
+		if (m_pool.has_value())
+			m_pool->prefault(PREFAULT_STRIDE);
+
+		// Written through a volatile pointer, so that the writes can't be optimized out.
+		std::array<u8, PREFAULT_STACK> stack {};
+		volatile u8 *touch = stack.data();
+
+		for (usize i = 0; i < stack.size(); i += PREFAULT_STRIDE)
+			touch[i] = 0; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	}
+
+	/*!
+	 * Applies the real-time scheduling options to the calling thread.
+	 *
+	 * Failing to do so (e.g. because of missing permissions) is not an error, the thread
+	 * simply keeps running with its current scheduling.
+	 *
+	 * @param[in] cpu The CPU core that the thread is bound to, or -1 to not bind it.
+	 */
+	void enter_realtime(const i32 cpu) const
+	{
+		try {
+			if (cpu >= 0)
+				syscalls::pthread_setaffinity(pthread_self(), cpu);
+
+			if (m_rt_priority > 0) {
+				struct sched_param param {};
+				param.sched_priority = m_rt_priority;
+
+				syscalls::pthread_setschedparam(pthread_self(), m_rt_policy, param);
+			}
+		} catch (const std::exception &e) {
+			spdlog::warn(e.what());
+		}
+	}
+
+	/*!
+	 * Logs the latency statistics of the application, if that was requested.
+	 */
+	void log_requested_latency()
+	{
+		if (m_latency_requested.exchange(false))
+			m_application->log_latency();
+	}
+
+	/*!
+	 * Stores a report in the flight recorder, and saves it if that was requested.
+	 *
+	 * This is called by the thread reading from the device, for every report.
+	 *
+	 * @param[in] data The report.
+	 * @param[in] timestamp When the report was read.
+	 */
+	void record(const gsl::span<const u8> data, const Application::clock::time_point timestamp)
+	{
+		if (!m_recorder.has_value())
+			return;
+
+		m_recorder->record(data, timestamp);
+
+		if (m_recording_requested.exchange(false))
+			this->save_recording();
+	}
+
+	/*!
+	 * Publishes the live statistics of the application, if that was requested.
+	 *
+	 * This is called by the thread processing the data, after every report.
+	 */
+	void publish_stats()
+	{
+		if (!m_stats_page.has_value())
+			return;
+
+		Stats stats = m_application->live_stats();
+		stats.dropped += m_overflows.load(std::memory_order_relaxed);
+
+		m_stats_page->write(stats);
+	}
+
+	/*!
+	 * Reads a report from the device.
+	 *
+	 * @param[out] buffer The buffer to read into.
+	 * @param[in] frame The ID of the report, for tracing.
+	 * @return The size of the report, in bytes.
+	 */
+	isize read(const gsl::span<u8> buffer, const u64 frame)
+	{
+		const common::tracing::Span span {"read", frame};
+		return m_device->read(buffer);
+	}
+
+	/*!
+	 * Waits for the device to come back after reading from it failed.
+	 *
+	 * When the device is reset (e.g. while resuming from suspend), its hidraw node is
+	 * removed and created again, possibly under a different name. Instead of starting from
+	 * scratch, only the node is opened again, and the device is switched back to multitouch
+	 * mode. The application keeps its state, and the input devices stay alive.
+	 *
+	 * @return Whether the device was reconnected before the timeout ran out.
+	 */
+	bool reconnect()
+	{
+		if (m_reconnect_timeout <= Application::clock::duration::zero())
+			return false;
+
+		const auto start = Application::clock::now();
+		const std::filesystem::path path = m_device->path();
+
+		// Without inotify, the nodes are checked in fixed intervals instead.
+		std::optional<DeviceWatcher> watcher = std::nullopt;
+
+		try {
+			watcher.emplace(path.parent_path());
+		} catch (const std::exception &e) {
+			spdlog::warn(e.what());
+		}
+
+		spdlog::info("Waiting for {} to come back", path.c_str());
+
+		std::vector<std::filesystem::path> nodes {};
+
+		while (!m_should_stop) {
+			// The old node might still exist, if only the connection to it was lost.
+			nodes.push_back(path);
+
+			for (const std::filesystem::path &node : nodes) {
+				if (!this->reopen(node))
+					continue;
+
+				const milliseconds<f64> time = Application::clock::now() - start;
+				const f64 ms = time.count();
+
+				spdlog::info("Reconnected to {} after {:.0f} ms", node.c_str(), ms);
+				return true;
+			}
+
+			if (Application::clock::now() - start >= m_reconnect_timeout)
+				break;
+
+			nodes.clear();
+
+			if (watcher.has_value())
+				nodes = watcher->wait(100ms);
+			else
+				std::this_thread::sleep_for(100ms);
+		}
+
+		if (!m_should_stop)
+			spdlog::error("{} did not come back", path.c_str());
+
+		return false;
+	}
+
+	/*!
+	 * Reads from the device and processes the data on the same thread.
+	 */
+	void run_direct()
+	{
+		this->enter_realtime(m_reader_cpu);
 
 		usize errors = 0;
 
@@ -124,21 +771,285 @@ public:
 			}
 
 			try {
-				const isize size = m_device->read(m_buffer);
-				const gsl::span<u8> data {m_buffer.data(),
-				                          casts::to_unsigned(size)};
+				this->process_next();
+			} catch (const common::Error<Error::SyscallReadFailed> &e) {
+				spdlog::warn(e.what());
 
-				// Does this report contain touch data?
-				if (!m_ipts.is_touch_data(m_buffer))
+				// Only the first failed read waits for the device to come back.
+				if (errors == 0 && this->reconnect())
 					continue;
 
-				m_application->process(data);
+				std::this_thread::sleep_for(100ms);
+
+				errors++;
+				continue;
 			} catch (const std::exception &e) {
+				// Only failed reads need to wait for the device.
+				spdlog::warn(e.what());
+
+				errors++;
+				continue;
+			}
+
+			// Reset error count.
+			errors = 0;
+		}
+	}
+
+	/*!
+	 * Reads from the device through io_uring and processes the data on the same thread.
+	 *
+	 * Only one read is queued at a time, because reads that run at the same time can complete
+	 * in a different order than the reports arrived. Once a read has completed, the next one is
+	 * queued into another buffer before the report is processed, so that the kernel already
+	 * waits for the next report in the meantime. The buffers are used in turn.
+	 *
+	 * @return Whether io_uring was available. If not, nothing was read from the device.
+	 */
+	bool run_uring()
+	{
+		// The report that is processed and the one that is read need separate buffers.
+		std::vector<std::vector<u8>> buffers(std::max(m_uring_depth, usize {2}), m_buffer);
+		std::optional<IoUring> ring = std::nullopt;
+
+		try {
+			// One entry for the read, and one for cancelling it.
+			ring.emplace(2);
+		} catch (const std::exception &e) {
+			spdlog::warn(e.what());
+			spdlog::warn("io_uring is not available, falling back to blocking reads");
+			return false;
+		}
+
+		if (!ring->reads_current_position()) {
+			spdlog::warn("io_uring can't read at the current position, "
+			             "falling back to blocking reads");
+			return false;
+		}
+
+		if (!ring->register_buffers(buffers))
+			spdlog::debug("Failed to register buffers with io_uring");
+
+		// The value that is passed with the cancellation of a read.
+		constexpr u64 cancel = ~u64 {0};
+
+		// The buffer that the queued read goes into, and the one for the read after it.
+		std::optional<usize> reading = std::nullopt;
+		usize next = 0;
+
+		const auto queue = [&]() {
+			const int fd = m_device->fd();
+
+			// At most a read and its cancellation are queued, so there is room.
+			ring->read(fd, buffers[next], gsl::narrow<u16>(next), next);
+
+			reading = next;
+			next = (next + 1) % buffers.size();
+		};
+
+		this->enter_realtime(m_reader_cpu);
+
+		usize errors = 0;
+
+		// Whether a read failed, so the device needs a moment to recover.
+		bool failed = false;
+
+		const auto complete = [&](const u64 data, const i32 result) {
+			if (data == cancel)
+				return;
+
+			reading = std::nullopt;
+
+			// Read the next report while this one is processed.
+			if (result >= 0 && !m_should_stop) {
+				queue();
+				ring->submit(0);
+			}
+
+			try {
+				this->process_read(buffers[data], result);
+				errors = 0;
+			} catch (const common::Error<Error::SyscallReadFailed> &e) {
 				spdlog::warn(e.what());
 
+				// No read is queued, so the device can be reopened.
+				// Only the first failed read waits for the device to come back.
+				if (errors > 0 || !this->reconnect()) {
+					failed = true;
+					errors++;
+				}
+			} catch (const std::exception &e) {
+				spdlog::warn(e.what());
+				errors++;
+			}
+		};
+
+		/*
+		 * Closing the ring does not wait for a queued read to stop writing into its buffer,
+		 * so it is cancelled, and all completions are collected before the buffers go away.
+		 */
+		const auto drain = [&]() {
+			if (!reading.has_value())
+				return;
+
+			ring->cancel(reading.value(), cancel);
+
+			while (reading.has_value()) {
+				ring->submit(1);
+				ring->reap([&](const u64 data, const i32 /* unused */) {
+					if (data != cancel)
+						reading = std::nullopt;
+				});
+			}
+		};
+
+		try {
+			while (!m_should_stop && errors < 50) {
+				if (!reading.has_value())
+					queue();
+
+				// Returns early if a signal arrives, so that stopping is noticed.
+				ring->submit(1);
+
+				ring->reap(complete);
+
 				// Sleep for a moment to let the device get back into normal state.
+				if (std::exchange(failed, false))
+					std::this_thread::sleep_for(100ms);
+			}
+		} catch (const std::exception & /* unused */) {
+			drain();
+			throw;
+		}
+
+		drain();
+
+		if (errors >= 50)
+			spdlog::error("Encountered 50 continuous errors, aborting...");
+
+		return true;
+	}
+
+	/*!
+	 * Processes a report that was read through io_uring.
+	 *
+	 * @param[in] buffer The buffer that the report was read into.
+	 * @param[in] result The size of the report, or a negated error code if reading failed.
+	 */
+	void process_read(std::vector<u8> &buffer, const i32 result)
+	{
+		if (result < 0) {
+			const std::error_code error {-result, std::system_category()};
+			throw common::Error<Error::SyscallReadFailed> {error.message()};
+		}
+
+		const u64 frame = ++m_frames;
+		const auto timestamp = Application::clock::now();
+
+		const gsl::span<u8> data {buffer.data(), casts::to_unsigned(result)};
+
+		// Does this report contain touch data?
+		if (!m_ipts.is_touch_data(data))
+			return;
+
+		this->record(data, timestamp);
+
+		common::tracing::set_frame(frame);
+		m_application->process(data, timestamp);
+
+		this->publish_stats();
+
+		this->log_requested_latency();
+	}
+
+	/*!
+	 * Reads from the device on the current thread and processes the data on a second one.
+	 *
+	 * Reading stays on the calling thread, so that signals (e.g. Ctrl-C) keep interrupting
+	 * the blocking read call. The processing thread has all signals blocked.
+	 */
+	void run_threaded()
+	{
+		m_overflows = 0;
+		m_reader_done = false;
+		m_aborted = false;
+
+		sigset_t all {};
+		sigset_t old {};
+
+		sigfillset(&all);
+		syscalls::pthread_sigmask(SIG_BLOCK, &all, &old);
+
+		std::thread worker {[&] {
+			this->enter_realtime(m_worker_cpu);
+			this->process_queue();
+		}};
+
+		syscalls::pthread_sigmask(SIG_SETMASK, &old);
+
+		this->enter_realtime(m_reader_cpu);
+
+		usize errors = 0;
+
+		while (!m_should_stop && !m_aborted) {
+			if (errors >= 50) {
+				spdlog::error("Encountered 50 continuous errors, aborting...");
+				break;
+			}
+
+			try {
+				Slot *slot = m_queue->acquire();
+
+				// The buffer is kept if the last report was dropped.
+				if (slot != nullptr && !slot->buffer)
+					slot->buffer = m_pool->acquire();
+
+				if (slot != nullptr && !slot->buffer)
+					slot = nullptr;
+
+				// If the queue is full, read into the scratch buffer and drop the report.
+				gsl::span<u8> buffer {m_buffer};
+
+				if (slot != nullptr)
+					buffer = slot->buffer.data();
+
+				const u64 frame = ++m_frames;
+
+				const isize size = this->read(buffer, frame);
+				const auto timestamp = Application::clock::now();
+
+				const gsl::span<u8> data {buffer.data(), casts::to_unsigned(size)};
+
+				// Does this report contain touch data?
+				if (!m_ipts.is_touch_data(data))
+					continue;
+
+				this->record(data, timestamp);
+
+				if (slot == nullptr) {
+					m_overflows.fetch_add(1, std::memory_order_relaxed);
+					continue;
+				}
+
+				slot->size = casts::to_unsigned(size);
+				slot->timestamp = timestamp;
+				slot->frame = frame;
+				m_queue->commit();
+			} catch (const common::Error<Error::SyscallReadFailed> &e) {
+				spdlog::warn(e.what());
+
+				// Only the first failed read waits for the device to come back.
+				if (errors == 0 && this->reconnect())
+					continue;
+
 				std::this_thread::sleep_for(100ms);
 
+				errors++;
+				continue;
+			} catch (const std::exception &e) {
+				// Only failed reads need to wait for the device.
+				spdlog::warn(e.what());
+
 				errors++;
 				continue;
 			}
@@ -147,19 +1058,74 @@ public:
 			errors = 0;
 		}
 
-		spdlog::info("Stopping");
+		m_reader_done = true;
+		m_queue->notify();
 
-		// Signal the application that the data flow has stopped.
-		m_application->on_stop();
+		worker.join();
 
-		try {
-			// Disable multitouch mode
-			m_ipts.set_mode(ipts::Mode::Singletouch);
-		} catch (const std::exception &e) {
-			spdlog::error(e.what());
-		}
+		const usize overflows = m_overflows.load();
+		if (overflows > 0)
+			spdlog::warn("Dropped {} reports because the processing queue was full", overflows);
 
-		return m_should_stop;
+		const usize dropped = m_application->dropped_heatmaps();
+		if (dropped > 0)
+			spdlog::info("Skipped {} outdated heatmaps", dropped);
+	}
+
+	/*!
+	 * Processes the reports queued by the reading thread until it stops.
+	 */
+	void process_queue()
+	{
+		usize errors = 0;
+
+		while (true) {
+			this->log_requested_latency();
+
+			Slot *slot = m_queue->front();
+
+			if (slot == nullptr) {
+				if (m_reader_done)
+					break;
+
+				m_queue->wait_for(100ms);
+				continue;
+			}
+
+			const gsl::span<u8> data = slot->buffer.data().first(slot->size);
+			common::tracing::set_frame(slot->frame);
+
+			try {
+				const bool waiting = m_queue->size() > 1;
+
+				// If newer reports are waiting, the heatmap of this one is already outdated.
+				// Otherwise, its processing can overlap with the next one.
+				if (m_drop_stale && waiting)
+					m_application->process_stale(data, slot->timestamp);
+				else if (waiting)
+					m_application->process_pipelined(slot->buffer,
+					                                 slot->size,
+					                                 slot->timestamp);
+				else
+					m_application->process(data, slot->timestamp);
+
+				this->publish_stats();
+				errors = 0;
+			} catch (const std::exception &e) {
+				spdlog::warn(e.what());
+				errors++;
+			}
+
+			// The pipeline keeps its own reference if it still needs the buffer.
+			slot->buffer.reset();
+			m_queue->pop();
+
+			if (errors >= 50) {
+				spdlog::error("Encountered 50 continuous errors, aborting...");
+				m_aborted = true;
+				break;
+			}
+		}
 	}
 };
 
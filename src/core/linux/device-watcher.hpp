@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_DEVICE_WATCHER_HPP
+#define IPTSD_CORE_LINUX_DEVICE_WATCHER_HPP
+
+#include "syscalls.hpp"
+
+#include <common/casts.hpp>
+#include <common/chrono.hpp>
+#include <common/types.hpp>
+
+#include <gsl/gsl>
+
+#include <poll.h>
+#include <sys/inotify.h>
+
+#include <array>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+namespace iptsd::core::linux {
+
+/*
+ * Waits for hidraw device nodes to be created in a directory.
+ *
+ * When a device is reset (e.g. while resuming from suspend), the kernel removes its node
+ * and creates a new one. The new node is reported as soon as udev has created it, or has
+ * changed its permissions, instead of checking for it in fixed intervals.
+ */
+class DeviceWatcher {
+private:
+	int m_fd = -1;
+
+	// The watched directory.
+	std::filesystem::path m_dir;
+
+	// Buffer for the events of the inotify instance.
+	std::array<u8, 4096> m_buffer {};
+
+public:
+	/*!
+	 * Starts watching a directory.
+	 *
+	 * @param[in] dir The directory that contains the device nodes, usually /dev.
+	 */
+	explicit DeviceWatcher(const std::filesystem::path &dir)
+		: m_fd {syscalls::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)},
+		  m_dir {dir}
+	{
+		try {
+			syscalls::inotify_add_watch(m_fd, m_dir, IN_CREATE | IN_ATTRIB);
+		} catch (const std::exception & /* unused */) {
+			syscalls::close(m_fd);
+			throw;
+		}
+	}
+
+	DeviceWatcher(const DeviceWatcher &) = delete;
+	DeviceWatcher &operator=(const DeviceWatcher &) = delete;
+
+	~DeviceWatcher()
+	{
+		try {
+			syscalls::close(m_fd);
+		} catch (const std::exception & /* unused */) {
+			// ignored
+		}
+	}
+
+	/*!
+	 * The file descriptor of the inotify instance, for waiting until nodes are created.
+	 */
+	[[nodiscard]] int fd() const
+	{
+		return m_fd;
+	}
+
+	/*!
+	 * Waits until hidraw device nodes were created or changed.
+	 *
+	 * Returns early if a signal arrives, so that the caller can check whether it should stop.
+	 *
+	 * @param[in] timeout How long to wait at most.
+	 * @return The paths of the nodes. Empty if nothing happened before the timeout.
+	 */
+	std::vector<std::filesystem::path> wait(const milliseconds<i32> timeout)
+	{
+		std::vector<std::filesystem::path> nodes {};
+
+		std::array<struct pollfd, 1> fds {};
+		fds[0].fd = m_fd;
+		fds[0].events = POLLIN;
+
+		if (syscalls::poll(fds, timeout.count()) == 0)
+			return nodes;
+
+		const isize size = ::read(m_fd, m_buffer.data(), m_buffer.size());
+		if (size <= 0)
+			return nodes;
+
+		usize offset = 0;
+
+		while (offset + sizeof(struct inotify_event) <= casts::to_unsigned(size)) {
+			struct inotify_event event {};
+			std::memcpy(&event, &m_buffer.at(offset), sizeof(event));
+
+			const usize header = offset + sizeof(event);
+			offset = header + event.len;
+
+			if (offset > casts::to_unsigned(size))
+				break;
+
+			if (event.len == 0)
+				continue;
+
+			// The name is padded with null bytes.
+			const u8 *data = &m_buffer.at(header);
+			const char *name = reinterpret_cast<const char *>(data); // NOLINT
+			const std::string_view node {name, ::strnlen(name, event.len)};
+
+			if (node.rfind("hidraw", 0) == 0)
+				nodes.push_back(m_dir / node);
+		}
+
+		return nodes;
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_DEVICE_WATCHER_HPP
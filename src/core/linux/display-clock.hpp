@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_DISPLAY_CLOCK_HPP
+#define IPTSD_CORE_LINUX_DISPLAY_CLOCK_HPP
+
+#include "syscalls.hpp"
+
+#include <common/chrono.hpp>
+#include <common/types.hpp>
+
+#include <drm/drm.h>
+#include <fcntl.h>
+
+#include <exception>
+#include <filesystem>
+#include <optional>
+
+namespace iptsd::core::linux {
+
+/*
+ * Follows the refreshes of a display, using the vertical blanking counter of its DRM device.
+ *
+ * Asking the kernel for the time of the last refresh does not take long, but it still is a
+ * system call, and it enables the vblank interrupt for a short time. The clock is synced
+ * only once per second, and the refreshes in between are calculated from the refresh rate
+ * that was measured. Only the first display of the device is followed.
+ *
+ * The timestamps of the kernel use CLOCK_MONOTONIC, which is also used by the steady clock.
+ */
+class DisplayClock {
+public:
+	using clock = chrono::steady_clock;
+
+	// How often the clock is synced to the display.
+	constexpr static clock::duration SYNC_INTERVAL = 1000ms;
+
+private:
+	/*
+	 * A refresh of the display.
+	 */
+	struct Vblank {
+		// How many times the display was refreshed before.
+		u32 sequence = 0;
+
+		// When the refresh happened.
+		clock::time_point time {};
+	};
+
+private:
+	int m_fd = -1;
+
+	// The last refresh that the kernel reported.
+	std::optional<Vblank> m_last = std::nullopt;
+
+	// The time between two refreshes, or zero if it was not measured yet.
+	clock::duration m_period {0};
+
+	// When the clock was synced the last time.
+	clock::time_point m_synced {};
+
+public:
+	/*!
+	 * Opens the DRM device of a display.
+	 *
+	 * @param[in] path The device node of the DRM device, for example /dev/dri/card0.
+	 */
+	explicit DisplayClock(const std::filesystem::path &path)
+		: m_fd {syscalls::open(path, O_RDONLY | O_CLOEXEC)}
+	{
+		m_synced = clock::now();
+		m_last = this->query();
+	}
+
+	DisplayClock(const DisplayClock &) = delete;
+	DisplayClock &operator=(const DisplayClock &) = delete;
+
+	~DisplayClock()
+	{
+		try {
+			syscalls::close(m_fd);
+		} catch (const std::exception & /* unused */) {
+			// ignored
+		}
+	}
+
+	/*!
+	 * Syncs the clock to the display, if the last sync was long enough ago.
+	 *
+	 * If the display is off, the refreshes are calculated from the last sync.
+	 *
+	 * @param[in] now The current time.
+	 */
+	void sync(const clock::time_point now)
+	{
+		if (now - m_synced < SYNC_INTERVAL)
+			return;
+
+		m_synced = now;
+
+		const std::optional<Vblank> vblank = this->query();
+
+		if (!vblank.has_value())
+			return;
+
+		// The counter can wrap around, which is fine for unsigned integers.
+		if (m_last.has_value()) {
+			const u32 refreshes = vblank->sequence - m_last->sequence;
+
+			if (refreshes > 0 && vblank->time > m_last->time)
+				m_period = (vblank->time - m_last->time) / refreshes;
+		}
+
+		m_last = vblank;
+	}
+
+	/*!
+	 * The time between two refreshes of the display.
+	 *
+	 * @return The refresh period, or zero if it is not known yet.
+	 */
+	[[nodiscard]] clock::duration period() const
+	{
+		return m_period;
+	}
+
+	/*!
+	 * Calculates when the display will refresh next.
+	 *
+	 * @param[in] after The time after which the refresh happens.
+	 * @return The time of the refresh, or null if the refresh rate of the display is unknown.
+	 */
+	[[nodiscard]] std::optional<clock::time_point> next(const clock::time_point after) const
+	{
+		if (!m_last.has_value() || m_period == clock::duration::zero())
+			return std::nullopt;
+
+		const clock::time_point last = m_last->time;
+
+		if (after < last)
+			return last;
+
+		const auto refreshes = (after - last) / m_period;
+		return last + (refreshes + 1) * m_period;
+	}
+
+private:
+	/*!
+	 * Asks the kernel when the display was refreshed the last time.
+	 *
+	 * @return The last refresh, or null if the display is off.
+	 */
+	[[nodiscard]] std::optional<Vblank> query() const
+	{
+		// A relative wait for zero refreshes returns immediately.
+		union drm_wait_vblank vblank {};
+		vblank.request.type = _DRM_VBLANK_RELATIVE;
+		vblank.request.sequence = 0;
+
+		try {
+			syscalls::ioctl(m_fd, DRM_IOCTL_WAIT_VBLANK, &vblank);
+		} catch (const std::exception & /* unused */) {
+			return std::nullopt;
+		}
+
+		const chrono::seconds sec {vblank.reply.tval_sec};
+		const chrono::microseconds usec {vblank.reply.tval_usec};
+
+		const clock::duration time = sec + usec;
+		return Vblank {vblank.reply.sequence, clock::time_point {time}};
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_DISPLAY_CLOCK_HPP
@@ -0,0 +1,386 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_DUMP_WRITER_HPP
+#define IPTSD_CORE_LINUX_DUMP_WRITER_HPP
+
+#include "syscalls.hpp"
+
+#include <common/casts.hpp>
+#include <common/chrono.hpp>
+#include <common/spsc-ring.hpp>
+#include <common/types.hpp>
+#include <core/generic/device.hpp>
+#include <core/generic/dump.hpp>
+#include <ipts/data.hpp>
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <filesystem>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace iptsd::core::linux {
+
+/*
+ * Writes binary dump files in the current format version.
+ *
+ * Data is collected in large blocks and only written to the file once a block is full,
+ * so that recording doesn't cause a syscall for every received report.
+ *
+ * The blocks can be written by a background thread, so that a slow disk doesn't stall the
+ * thread that receives the reports. Frames only have to be copied into the current block.
+ * If all blocks are still waiting to be written, new frames are dropped and counted.
+ *
+ * The location of every frame is remembered, so that @ref finish can append an index.
+ */
+class DumpWriter {
+private:
+	/*
+	 * A block of data that is written to the file at once.
+	 */
+	struct Block {
+		std::vector<u8> data {};
+
+		// How many bytes of the block are used.
+		usize size = 0;
+	};
+
+private:
+	// The file descriptor of the output file.
+	int m_fd = -1;
+
+	// Whether the file descriptor was opened by the writer and has to be closed.
+	bool m_owns_fd = false;
+
+	// The only block, if the data is written on the calling thread.
+	Block m_buffer {};
+
+	// The blocks that are waiting to be written by the background thread, if enabled.
+	std::optional<common::SpscRing<Block>> m_queue = std::nullopt;
+
+	// The block that data is added to, or null if all blocks are waiting to be written.
+	Block *m_block = nullptr;
+
+	// How many bytes have been written in total, including the current block.
+	u64 m_offset = 0;
+
+	// The location of every frame that was written.
+	std::vector<dump::IndexEntry> m_index {};
+
+	// How many frames were dropped because no block was free.
+	usize m_overflows = 0;
+
+	// Whether the background thread should exit once all blocks are written.
+	std::atomic_bool m_stop = false;
+
+	// Whether writing failed on the background thread, and the error that caused it.
+	std::atomic_bool m_failed = false;
+	std::exception_ptr m_error = nullptr;
+
+	// The background thread that writes the blocks.
+	std::thread m_thread {};
+
+public:
+	/*!
+	 * Creates a new dump file.
+	 *
+	 * @param[in] path The file to write to. "-" writes to the standard output.
+	 * @param[in] buffer_size How many bytes are collected before writing them to the file.
+	 * @param[in] blocks How many blocks of buffer_size bytes are written by a background
+	 *                   thread. A value of 0 writes the data on the calling thread.
+	 */
+	DumpWriter(const std::filesystem::path &path,
+	           const usize buffer_size = 1024 * 1024,
+	           const usize blocks = 0)
+	{
+		if (path == "-") {
+			m_fd = STDOUT_FILENO;
+		} else {
+			m_fd = syscalls::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			m_owns_fd = true;
+		}
+
+		if (blocks == 0) {
+			m_buffer.data.resize(buffer_size);
+			m_block = &m_buffer;
+			return;
+		}
+
+		m_queue.emplace(blocks, Block {std::vector<u8>(buffer_size), 0});
+		m_thread = std::thread {[this] { this->loop(); }};
+	}
+
+	DumpWriter(const DumpWriter &) = delete;
+	DumpWriter &operator=(const DumpWriter &) = delete;
+
+	~DumpWriter()
+	{
+		try {
+			this->flush();
+		} catch (const std::exception & /* unused */) {
+			// ignored
+		}
+
+		if (m_thread.joinable()) {
+			m_stop.store(true);
+			m_queue->notify();
+			m_thread.join();
+		}
+
+		if (!m_owns_fd)
+			return;
+
+		try {
+			syscalls::close(m_fd);
+		} catch (const std::exception & /* unused */) {
+			// ignored
+		}
+	}
+
+	/*!
+	 * How many frames were dropped, because the background thread couldn't keep up.
+	 */
+	[[nodiscard]] usize overflows() const
+	{
+		return m_overflows;
+	}
+
+	/*!
+	 * Writes the file header, including information about the device.
+	 *
+	 * @param[in] info Information about the device that produced the data.
+	 * @param[in] metadata The metadata of the device, if it exists.
+	 */
+	void write_header(const DeviceInfo &info, const std::optional<const ipts::Metadata> &metadata)
+	{
+		dump::Header header {};
+		header.magic = dump::MAGIC;
+		header.version = dump::VERSION;
+
+		this->append(header);
+		this->append(info);
+
+		const u8 has_meta = metadata.has_value() ? 1 : 0;
+		this->append(has_meta);
+
+		if (metadata.has_value())
+			this->append(metadata.value());
+	}
+
+	/*!
+	 * Writes a frame of data.
+	 *
+	 * If the data is written by a background thread and no block is free, the frame is
+	 * dropped instead of waiting for the background thread.
+	 *
+	 * @param[in] data The data that was received from the device.
+	 * @param[in] timestamp The monotonic time at which the data was received, in nanoseconds.
+	 */
+	void write_frame(const gsl::span<const u8> data, const u64 timestamp)
+	{
+		dump::FrameHeader header {};
+		header.timestamp = timestamp;
+		header.size = casts::to<u32>(data.size());
+
+		// The frame is either stored completely, or not at all.
+		if (!this->reserve(sizeof(header) + data.size(), false)) {
+			m_overflows++;
+			return;
+		}
+
+		dump::IndexEntry entry {};
+		entry.offset = m_offset;
+		entry.timestamp = timestamp;
+
+		m_index.push_back(entry);
+
+		this->append(header);
+		this->append(data);
+	}
+
+	/*!
+	 * Writes the index of all frames and flushes the buffer.
+	 *
+	 * After this, no more frames can be written.
+	 */
+	void finish()
+	{
+		dump::FrameHeader marker {};
+		marker.timestamp = 0;
+		marker.size = dump::END_OF_FRAMES;
+
+		this->append(marker);
+
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+		this->append(gsl::span {reinterpret_cast<const u8 *>(m_index.data()),
+		                        m_index.size() * sizeof(dump::IndexEntry)});
+
+		dump::IndexFooter footer {};
+		footer.entries = m_index.size();
+		footer.magic = dump::INDEX_MAGIC;
+
+		this->append(footer);
+		this->flush();
+
+		m_index.clear();
+	}
+
+	/*!
+	 * Writes all buffered data to the file, or hands it to the background thread.
+	 */
+	void flush()
+	{
+		this->check_error();
+
+		if (m_block == nullptr || m_block->size == 0)
+			return;
+
+		if (m_queue.has_value()) {
+			m_queue->commit();
+			m_block = nullptr;
+			return;
+		}
+
+		this->write_all(gsl::span<const u8> {m_block->data.data(), m_block->size});
+		m_block->size = 0;
+	}
+
+private:
+	/*!
+	 * Adds a value to the buffer.
+	 *
+	 * @param[in] value The value to add.
+	 */
+	template <class T>
+	void append(const T &value)
+	{
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+		this->append(gsl::span {reinterpret_cast<const u8 *>(&value), sizeof(value)});
+	}
+
+	/*!
+	 * Adds data to the buffer, writing the buffer to the file if it is full.
+	 *
+	 * @param[in] data The data to add.
+	 */
+	void append(const gsl::span<const u8> data)
+	{
+		this->reserve(data.size(), true);
+
+		const auto offset = casts::to_signed(m_block->size);
+		std::copy(data.begin(), data.end(), m_block->data.begin() + offset);
+
+		m_block->size += data.size();
+		m_offset += data.size();
+	}
+
+	/*!
+	 * Makes sure that the current block has enough space left for some data.
+	 *
+	 * If the current block is full, it is flushed and the next block is used. Data that
+	 * doesn't fit into a block at all makes the block grow.
+	 *
+	 * @param[in] size How many bytes are needed.
+	 * @param[in] wait Whether to wait for the background thread if no block is free.
+	 * @return Whether the current block has enough space left.
+	 */
+	bool reserve(const usize size, const bool wait)
+	{
+		if (m_block != nullptr && m_block->size + size <= m_block->data.size())
+			return true;
+
+		this->flush();
+
+		if (m_block == nullptr)
+			m_block = wait ? this->wait_for_block() : m_queue->acquire();
+
+		if (m_block == nullptr)
+			return false;
+
+		m_block->size = 0;
+
+		if (m_block->data.size() < size)
+			m_block->data.resize(size);
+
+		return true;
+	}
+
+	/*!
+	 * Waits until the background thread has written a block.
+	 *
+	 * This is only used for the header and the index, frames are dropped instead.
+	 *
+	 * @return The block that is free now.
+	 */
+	Block *wait_for_block()
+	{
+		while (true) {
+			this->check_error();
+
+			Block *block = m_queue->acquire();
+
+			if (block != nullptr)
+				return block;
+
+			std::this_thread::sleep_for(1ms);
+		}
+	}
+
+	/*!
+	 * Rethrows the error that happened on the background thread, if there was one.
+	 */
+	void check_error() const
+	{
+		if (m_failed.load(std::memory_order_acquire))
+			std::rethrow_exception(m_error);
+	}
+
+	/*!
+	 * The loop of the background thread, that writes blocks until the writer is destroyed.
+	 */
+	void loop()
+	{
+		while (true) {
+			if (!m_queue->wait_for(100ms)) {
+				if (m_stop.load())
+					return;
+
+				continue;
+			}
+
+			const Block *block = m_queue->front();
+			const gsl::span<const u8> data {block->data.data(), block->size};
+
+			try {
+				this->write_all(data);
+			} catch (...) {
+				m_error = std::current_exception();
+				m_failed.store(true, std::memory_order_release);
+				return;
+			}
+
+			m_queue->pop();
+		}
+	}
+
+	/*!
+	 * Writes data to the file, retrying until everything has been written.
+	 *
+	 * @param[in] data The data to write.
+	 */
+	void write_all(gsl::span<const u8> data) const
+	{
+		while (!data.empty()) {
+			const isize ret = syscalls::write(m_fd, data);
+			data = data.subspan(casts::to_unsigned(ret));
+		}
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_DUMP_WRITER_HPP
@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_ENERGY_METER_HPP
+#define IPTSD_CORE_LINUX_ENERGY_METER_HPP
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace iptsd::core::linux {
+
+/*
+ * Measures the energy used by the CPU, through the RAPL counters of the powercap interface.
+ *
+ * The counters cover entire CPU packages, so everything that runs on the system at the same
+ * time is included. Reading them is too slow to do for every report, and they only update
+ * about once per millisecond, so the energy is measured over a whole run instead.
+ *
+ * Most kernels only allow root to read the counters.
+ */
+class EnergyMeter {
+private:
+	/*
+	 * A powercap zone, usually one CPU package.
+	 */
+	struct Zone {
+		std::filesystem::path path;
+
+		// The value at which the counter wraps around, in microjoules.
+		u64 range = 0;
+
+		// The value of the counter when the measurement was started.
+		u64 start = 0;
+	};
+
+	std::vector<Zone> m_zones {};
+
+public:
+	/*!
+	 * Searches for the RAPL zones of all CPU packages.
+	 *
+	 * @param[in] root The directory of the powercap interface.
+	 */
+	explicit EnergyMeter(const std::filesystem::path &root = "/sys/class/powercap")
+	{
+		const std::string prefix = "intel-rapl:";
+		std::error_code ec {};
+
+		for (const std::filesystem::directory_entry &entry :
+		     std::filesystem::directory_iterator {root, ec}) {
+			const std::string name = entry.path().filename().string();
+
+			// Subzones (intel-rapl:0:0) are already included in their package.
+			if (name.rfind(prefix, 0) != 0)
+				continue;
+
+			if (name.find(':', prefix.size()) != std::string::npos)
+				continue;
+
+			const std::filesystem::path path = entry.path() / "energy_uj";
+
+			const std::optional<u64> range = read(entry.path() / "max_energy_range_uj");
+			const std::optional<u64> start = read(path);
+
+			if (!range.has_value() || !start.has_value())
+				continue;
+
+			m_zones.push_back(Zone {path, range.value(), start.value()});
+		}
+
+		std::sort(m_zones.begin(), m_zones.end(), [](const Zone &a, const Zone &b) {
+			return a.path < b.path;
+		});
+	}
+
+	/*!
+	 * Whether any zones were found that can be read.
+	 */
+	[[nodiscard]] bool available() const
+	{
+		return !m_zones.empty();
+	}
+
+	/*!
+	 * Starts a new measurement.
+	 */
+	void start()
+	{
+		for (Zone &zone : m_zones)
+			zone.start = read(zone.path).value_or(zone.start);
+	}
+
+	/*!
+	 * How much energy was used since the measurement was started.
+	 *
+	 * The counters may wrap around once, if they wrap around more often the result is wrong.
+	 *
+	 * @return The energy in joules.
+	 */
+	[[nodiscard]] f64 joules() const
+	{
+		u64 total = 0;
+
+		for (const Zone &zone : m_zones) {
+			const u64 now = read(zone.path).value_or(zone.start);
+
+			if (now >= zone.start)
+				total += now - zone.start;
+			else
+				total += zone.range - zone.start + now;
+		}
+
+		return casts::to<f64>(total) / 1e6;
+	}
+
+private:
+	/*!
+	 * Reads a number from a file in sysfs.
+	 *
+	 * @param[in] path The file to read.
+	 * @return The number, or null if the file could not be read.
+	 */
+	static std::optional<u64> read(const std::filesystem::path &path)
+	{
+		std::ifstream file {path};
+		u64 value = 0;
+
+		if (!(file >> value))
+			return std::nullopt;
+
+		return value;
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_ENERGY_METER_HPP
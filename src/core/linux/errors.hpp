@@ -13,6 +13,10 @@ enum class Error : u8 {
 	ParsingFailed,
 	ParsingTypeNotImplemented,
 	RunnerInitError,
+	UnsupportedDumpVersion,
+	DumpIndexMissing,
+	DumpFrameOutOfRange,
+	DeviceChanged,
 
 	SyscallOpenFailed,
 	SyscallReadFailed,
@@ -20,6 +24,22 @@ enum class Error : u8 {
 	SyscallCloseFailed,
 	SyscallIoctlFailed,
 	SyscallSigactionFailed,
+	SyscallSigmaskFailed,
+	SyscallStatFailed,
+	SyscallTruncateFailed,
+	SyscallMmapFailed,
+	SyscallMadviseFailed,
+	SyscallSchedulingFailed,
+	SyscallAffinityFailed,
+	SyscallMlockFailed,
+	SyscallEpollFailed,
+	SyscallIoUringFailed,
+	SyscallInotifyFailed,
+	SyscallPollFailed,
+	SyscallPerfEventFailed,
+	SyscallGetrusageFailed,
+
+	InvalidSchedulingPolicy,
 };
 
 inline std::string format_as(Error err)
@@ -31,6 +51,14 @@ inline std::string format_as(Error err)
 		return "core: linux: Parsing not implemented for type {}!";
 	case Error::RunnerInitError:
 		return "core: linux: Runner initialization failed!";
+	case Error::UnsupportedDumpVersion:
+		return "core: linux: Unsupported dump file version {}!";
+	case Error::DumpIndexMissing:
+		return "core: linux: Dump file has no frame index!";
+	case Error::DumpFrameOutOfRange:
+		return "core: linux: Frame {} is out of range, dump file has {} frames!";
+	case Error::DeviceChanged:
+		return "core: linux: {} is not the device that was disconnected!";
 	case Error::SyscallOpenFailed:
 		return "core: linux: Opening file {} failed: {}";
 	case Error::SyscallReadFailed:
@@ -43,6 +71,36 @@ inline std::string format_as(Error err)
 		return "core: linux: IOCTL {} failed: {}";
 	case Error::SyscallSigactionFailed:
 		return "core: linux: Sigaction for signal {} failed: {}";
+	case Error::SyscallSigmaskFailed:
+		return "core: linux: Changing the signal mask failed: {}";
+	case Error::SyscallStatFailed:
+		return "core: linux: Querying file status failed: {}";
+	case Error::SyscallTruncateFailed:
+		return "core: linux: Changing the size of a file failed: {}";
+	case Error::SyscallMmapFailed:
+		return "core: linux: Mapping memory failed: {}";
+	case Error::SyscallMadviseFailed:
+		return "core: linux: Passing memory usage advice failed: {}";
+	case Error::SyscallSchedulingFailed:
+		return "core: linux: Changing the scheduling policy failed: {}";
+	case Error::SyscallAffinityFailed:
+		return "core: linux: Binding the thread to CPU {} failed: {}";
+	case Error::SyscallMlockFailed:
+		return "core: linux: Locking memory failed: {}";
+	case Error::SyscallEpollFailed:
+		return "core: linux: Waiting for file events failed: {}";
+	case Error::SyscallIoUringFailed:
+		return "core: linux: Setting up io_uring failed: {}";
+	case Error::SyscallInotifyFailed:
+		return "core: linux: Watching for file changes failed: {}";
+	case Error::SyscallPollFailed:
+		return "core: linux: Polling file descriptors failed: {}";
+	case Error::SyscallPerfEventFailed:
+		return "core: linux: Opening performance counters failed: {}";
+	case Error::SyscallGetrusageFailed:
+		return "core: linux: Failed to get resource usage: {}";
+	case Error::InvalidSchedulingPolicy:
+		return "core: linux: Invalid scheduling policy {}!";
 	default:
 		return "core: linux: Invalid error code!";
 	}
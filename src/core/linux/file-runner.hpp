@@ -4,18 +4,29 @@
 #define IPTSD_CORE_LINUX_FILE_RUNNER_HPP
 
 #include "config-loader.hpp"
+#include "errors.hpp"
+#include "mapped-file.hpp"
 
 #include <common/casts.hpp>
+#include <common/chrono.hpp>
+#include <common/error.hpp>
 #include <common/reader.hpp>
 #include <core/generic/application.hpp>
+#include <core/generic/dump.hpp>
 #include <ipts/data.hpp>
 
+#include <gsl/gsl>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <atomic>
+#include <exception>
 #include <filesystem>
-#include <fstream>
+#include <limits>
+#include <optional>
+#include <thread>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace iptsd::core::linux {
@@ -26,15 +37,31 @@ private:
 	static_assert(std::is_base_of_v<Application, T>);
 
 private:
-	// The contents of the file.
-	std::vector<u8> m_file {};
+	// The contents of the file, mapped into memory.
+	MappedFile m_file;
 
 	// Information about the device that produced the data.
 	DeviceInfo m_info {};
 
+	// The version of the dump format.
+	u32 m_version = 1;
+
 	// Whether the loop for reading from the file should stop.
 	std::atomic_bool m_should_stop = false;
 
+	// The location of all frames, if the file contains an index.
+	std::vector<dump::IndexEntry> m_index {};
+
+	// How many frames are processed by run(), starting at the current position.
+	usize m_limit = std::numeric_limits<usize>::max();
+
+	// Whether frames are processed with the same timing as they were recorded.
+	bool m_realtime = false;
+
+	// The recorded and the actual time of the first frame, when pacing the frames.
+	std::optional<std::pair<Application::clock::time_point, Application::clock::time_point>>
+		m_pacing = std::nullopt;
+
 	/*
 	 * deferred initialization
 	 */
@@ -45,16 +72,24 @@ private:
 
 public:
 	template <class... Args>
-	FileRunner(const std::filesystem::path &path, Args... args)
+	FileRunner(const std::filesystem::path &path, Args... args) : m_file {path}
 	{
-		std::ifstream ifs {};
-		ifs.open(path, std::ios::in | std::ios::binary);
+		m_reader = Reader {m_file.data()};
+
+		// Version 1 files have no header and start with the device info directly.
+		Reader peek = m_reader.value();
+		const auto header = peek.read<dump::Header>();
+
+		if (dump::is_versioned(header)) {
+			const u32 version = header.version;
 
-		std::noskipws(ifs);
-		m_file = std::vector<u8> {std::istream_iterator<u8>(ifs),
-		                          std::istream_iterator<u8>()};
+			if (version != dump::VERSION)
+				throw common::Error<Error::UnsupportedDumpVersion> {version};
+
+			m_version = version;
+			m_reader = peek;
+		}
 
-		m_reader = Reader {m_file};
 		m_info = m_reader->read<DeviceInfo>();
 
 		std::optional<ipts::Metadata> meta = std::nullopt;
@@ -63,8 +98,16 @@ public:
 		if (has_meta)
 			meta = m_reader->read<ipts::Metadata>();
 
+		if (m_version > 1)
+			this->load_index();
+
 		const ConfigLoader loader {m_info, meta};
-		m_application.emplace(loader.config(), m_info, meta, args...);
+		const Config config = loader.config();
+
+		if (config.runner_hugepages)
+			m_file.advise_hugepages();
+
+		m_application.emplace(config, m_info, meta, args...);
 
 		const u16 vendor = m_info.vendor;
 		const u16 product = m_info.product;
@@ -87,6 +130,50 @@ public:
 		return m_application.value();
 	}
 
+	/*!
+	 * How many frames the file contains.
+	 *
+	 * @return The amount of frames in the index, or zero if the file has no index.
+	 */
+	[[nodiscard]] usize frames() const
+	{
+		return m_index.size();
+	}
+
+	/*!
+	 * Selects which frames are processed by @ref run.
+	 *
+	 * This requires the file to contain an index.
+	 *
+	 * @param[in] first The index of the first frame to process.
+	 * @param[in] count How many frames to process at most.
+	 */
+	void seek(const usize first, const usize count = std::numeric_limits<usize>::max())
+	{
+		if (m_index.empty())
+			throw common::Error<Error::DumpIndexMissing> {};
+
+		if (first >= m_index.size())
+			throw common::Error<Error::DumpFrameOutOfRange> {first, m_index.size()};
+
+		const u64 offset = m_index[first].offset;
+
+		m_reader = Reader {m_file.data().subspan(casts::to<usize>(offset))};
+		m_limit = count;
+	}
+
+	/*!
+	 * Enables or disables pacing the frames according to their recorded timestamps.
+	 *
+	 * Version 1 files don't store timestamps and are always processed as fast as possible.
+	 *
+	 * @param[in] realtime Whether to wait between frames like the device did.
+	 */
+	void set_realtime(const bool realtime)
+	{
+		m_realtime = realtime;
+	}
+
 	/*!
 	 * Stops the loop that reads from the file.
 	 *
@@ -113,37 +200,177 @@ public:
 		// Signal the application that the data flow has started.
 		m_application->on_start();
 
-		while (!m_should_stop && local.size() > 0) {
+		bool leftover = false;
+		m_pacing.reset();
+
+		for (usize i = 0; i < m_limit && !m_should_stop && local.size() > 0; i++) {
 			try {
 				/*
 				 * Abort if there is not enough data left.
 				 */
-				if (local.size() < (sizeof(u64) + m_info.buffer_size))
+				if (!this->process_frame(local)) {
+					leftover = local.size() > 0;
 					break;
-
-				const auto size = local.read<u64>();
-
-				/*
-				 * This is an error baked into the format.
-				 * The writer should simply write as many bytes as it just received,
-				 * instead of writing the entire buffer all the time.
-				 */
-				Reader buffer = local.sub(casts::to<usize>(m_info.buffer_size));
-
-				m_application->process(buffer.subspan<u8>(casts::to<usize>(size)));
+				}
 			} catch (const std::exception &e) {
 				spdlog::warn(e.what());
 			}
 		}
 
-		if (!m_should_stop && local.size() > 0)
+		if (leftover)
 			spdlog::warn("Leftover data at end of input");
 
+		try {
+			m_application->finish_pipelined();
+		} catch (const std::exception &e) {
+			spdlog::warn(e.what());
+		}
+
 		// Signal the application that the data flow has stopped.
 		m_application->on_stop();
 
 		return m_should_stop;
 	}
+
+private:
+	/*!
+	 * Loads the index from the end of the file, if it contains one.
+	 *
+	 * A broken index is ignored, the frames can still be read sequentially.
+	 */
+	void load_index()
+	{
+		const gsl::span<u8> data = m_file.data();
+
+		if (data.size() < sizeof(dump::FrameHeader) + sizeof(dump::IndexFooter))
+			return;
+
+		Reader tail {data.subspan(data.size() - sizeof(dump::IndexFooter))};
+		const auto footer = tail.read<dump::IndexFooter>();
+
+		if (footer.magic != dump::INDEX_MAGIC)
+			return;
+
+		const u64 count = footer.entries;
+		const usize entries = casts::to<usize>(count);
+		const usize available = data.size() - sizeof(dump::FrameHeader) - sizeof(footer);
+
+		if (entries > available / sizeof(dump::IndexEntry)) {
+			spdlog::warn("Ignoring invalid frame index");
+			return;
+		}
+
+		// The index is preceded by a frame header marking the end of the frames.
+		const usize start = available - (entries * sizeof(dump::IndexEntry));
+
+		Reader index {data.subspan(start)};
+		const auto marker = index.read<dump::FrameHeader>();
+
+		if (marker.size != dump::END_OF_FRAMES) {
+			spdlog::warn("Ignoring invalid frame index");
+			return;
+		}
+
+		m_index.resize(entries);
+
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+		index.read(gsl::span {reinterpret_cast<u8 *>(m_index.data()),
+		                      entries * sizeof(dump::IndexEntry)});
+
+		const bool valid = std::all_of(m_index.begin(), m_index.end(), [&](const auto &e) {
+			return e.offset < start;
+		});
+
+		if (!valid) {
+			spdlog::warn("Ignoring invalid frame index");
+			m_index.clear();
+		}
+	}
+
+	/*!
+	 * Waits until a frame is due, according to the time at which it was recorded.
+	 *
+	 * @param[in] timestamp The recorded timestamp of the frame.
+	 */
+	void pace(const Application::clock::time_point timestamp)
+	{
+		using clock = Application::clock;
+
+		if (!m_pacing.has_value()) {
+			m_pacing = std::make_pair(timestamp, clock::now());
+			return;
+		}
+
+		const auto &[recorded, started] = m_pacing.value();
+		std::this_thread::sleep_until(started + (timestamp - recorded));
+	}
+
+	/*!
+	 * Reads the next frame from the file and passes it to the application.
+	 *
+	 * @param[in] reader The remaining data of the file.
+	 * @return Whether there was enough data left for a full frame.
+	 */
+	bool process_frame(Reader &reader)
+	{
+		if (m_version == 1) {
+			if (reader.size() < (sizeof(u64) + m_info.buffer_size))
+				return false;
+
+			const auto size = reader.read<u64>();
+
+			/*
+			 * This is an error baked into the format.
+			 * The writer should simply write as many bytes as it just received,
+			 * instead of writing the entire buffer all the time.
+			 */
+			Reader buffer = reader.sub(casts::to<usize>(m_info.buffer_size));
+
+			this->process(buffer.subspan<u8>(casts::to<usize>(size)));
+			return true;
+		}
+
+		if (reader.size() < sizeof(dump::FrameHeader))
+			return false;
+
+		const auto header = reader.read<dump::FrameHeader>();
+
+		// The rest of the file is the index.
+		if (header.size == dump::END_OF_FRAMES) {
+			reader.skip(reader.size());
+			return false;
+		}
+
+		if (reader.size() < header.size)
+			return false;
+
+		const chrono::nanoseconds ns {header.timestamp};
+		const Application::clock::time_point timestamp {ns};
+
+		if (m_realtime)
+			this->pace(timestamp);
+
+		this->process(reader.subspan<u8>(header.size), timestamp);
+		return true;
+	}
+
+	/*!
+	 * Passes a frame to the application.
+	 *
+	 * Unless the frames are paced, the next frame is always available right away, so
+	 * processing of the frames can overlap.
+	 *
+	 * @param[in] data The data of the frame.
+	 * @param[in] timestamp The time at which the frame was recorded.
+	 */
+	void process(const gsl::span<u8> data,
+	             const Application::clock::time_point timestamp = Application::clock::now())
+	{
+		if (m_realtime)
+			m_application->process(data, timestamp);
+		else
+			m_application->process_pipelined(data, timestamp);
+	}
 };
 
 } // namespace iptsd::core::linux
@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_FLIGHT_RECORDER_HPP
+#define IPTSD_CORE_LINUX_FLIGHT_RECORDER_HPP
+
+#include "dump-writer.hpp"
+
+#include <common/casts.hpp>
+#include <common/chrono.hpp>
+#include <common/types.hpp>
+#include <core/generic/device.hpp>
+#include <ipts/data.hpp>
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace iptsd::core::linux {
+
+/*
+ * Keeps the most recent reports of a device in memory, to save them as a dump file later.
+ *
+ * All memory is allocated when the recorder is created. Recording a report only copies
+ * it into the oldest slot, so the recorder can stay enabled all the time. Once something
+ * went wrong, @ref save writes the reports of the last seconds to a file, which can then
+ * be replayed like a recording of iptsd-dump.
+ */
+class FlightRecorder {
+public:
+	using clock = chrono::steady_clock;
+
+	// How many reports per second the slots are allocated for.
+	constexpr static usize REPORTS_PER_SECOND = 250;
+
+private:
+	/*
+	 * A report that was recorded.
+	 */
+	struct Frame {
+		usize size = 0;
+		clock::time_point timestamp {};
+	};
+
+private:
+	// Information about the device, for the header of the dump.
+	DeviceInfo m_info;
+	std::optional<const ipts::Metadata> m_metadata;
+
+	// How long reports are kept.
+	clock::duration m_duration;
+
+	// The maximum size of a report.
+	usize m_size;
+
+	// The data of every slot, one after another.
+	std::vector<u8> m_data;
+
+	// The size and timestamp of every slot.
+	std::vector<Frame> m_frames;
+
+	// How many reports were recorded in total.
+	usize m_recorded = 0;
+
+public:
+	/*!
+	 * Allocates the memory for recording reports.
+	 *
+	 * @param[in] info Information about the device.
+	 * @param[in] metadata The metadata of the device, if it exists.
+	 * @param[in] duration How long reports are kept.
+	 */
+	FlightRecorder(const DeviceInfo &info,
+	               const std::optional<const ipts::Metadata> &metadata,
+	               const clock::duration duration)
+		: m_info {info},
+		  m_metadata {metadata},
+		  m_duration {duration},
+		  m_size {casts::to<usize>(info.buffer_size)}
+	{
+		const seconds<f64> time = duration;
+		const f64 reports = std::ceil(time.count() * REPORTS_PER_SECOND);
+
+		const auto slots = gsl::narrow_cast<usize>(reports);
+
+		m_frames.resize(std::max(slots, usize {1}));
+		m_data.resize(m_frames.size() * m_size);
+	}
+
+	/*!
+	 * How much memory the recorder uses for storing reports.
+	 */
+	[[nodiscard]] usize capacity() const
+	{
+		return m_data.size();
+	}
+
+	/*!
+	 * Stores a report, replacing the oldest one if all slots are used.
+	 *
+	 * @param[in] data The report that was received from the device.
+	 * @param[in] timestamp When the report was received.
+	 */
+	void record(const gsl::span<const u8> data, const clock::time_point timestamp)
+	{
+		const usize slot = m_recorded % m_frames.size();
+		const usize size = std::min(data.size(), m_size);
+
+		const auto offset = casts::to_signed(slot * m_size);
+		std::copy_n(data.begin(), size, m_data.begin() + offset);
+
+		m_frames[slot] = Frame {size, timestamp};
+		m_recorded++;
+	}
+
+	/*!
+	 * Writes the reports of the last seconds to a dump file, from oldest to newest.
+	 *
+	 * @param[in] path The file to write to.
+	 * @return How many reports were written.
+	 */
+	usize save(const std::filesystem::path &path) const
+	{
+		const usize count = std::min(m_recorded, m_frames.size());
+		const usize first = m_recorded - count;
+
+		DumpWriter writer {path};
+		writer.write_header(m_info, m_metadata);
+
+		clock::time_point newest {};
+		usize written = 0;
+
+		if (count > 0)
+			newest = m_frames[(m_recorded - 1) % m_frames.size()].timestamp;
+
+		for (usize i = first; i < m_recorded; i++) {
+			const usize slot = i % m_frames.size();
+			const Frame &frame = m_frames[slot];
+
+			// Older reports are still stored if they arrived slower than expected.
+			if (newest - frame.timestamp > m_duration)
+				continue;
+
+			const auto ns = chrono::duration_cast<chrono::nanoseconds>(
+				frame.timestamp.time_since_epoch());
+
+			const gsl::span<const u8> data {&m_data[slot * m_size], frame.size};
+			writer.write_frame(data, casts::to<u64>(ns.count()));
+
+			written++;
+		}
+
+		writer.finish();
+		return written;
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_FLIGHT_RECORDER_HPP
@@ -3,9 +3,11 @@
 #ifndef IPTSD_CORE_LINUX_HIDRAW_DEVICE_HPP
 #define IPTSD_CORE_LINUX_HIDRAW_DEVICE_HPP
 
+#include "errors.hpp"
 #include "syscalls.hpp"
 
 #include <common/casts.hpp>
+#include <common/error.hpp>
 #include <common/types.hpp>
 #include <hid/device.hpp>
 #include <hid/parser.hpp>
@@ -16,7 +18,11 @@
 
 #include <linux/hidraw.h>
 
+#include <algorithm>
+#include <exception>
 #include <filesystem>
+#include <optional>
+#include <utility>
 #include <vector>
 
 namespace iptsd::core::linux {
@@ -29,7 +35,8 @@ private:
 	struct hidraw_devinfo m_devinfo {};
 	struct hidraw_report_descriptor m_desc {};
 
-	std::vector<hid::Report> m_reports {};
+	// The parsed HID descriptor. Parsing is deferred until it is needed.
+	std::optional<std::vector<hid::Report>> m_reports = std::nullopt;
 
 public:
 	HidrawDevice(const std::filesystem::path &path)
@@ -43,8 +50,6 @@ public:
 
 		m_desc.size = desc_size;
 		syscalls::ioctl(m_fd, HIDIOCGRDESC, &m_desc);
-
-		hid::parse(gsl::span<u8> {&m_desc.value[0], desc_size}, m_reports);
 	}
 
 	~HidrawDevice() override
@@ -56,6 +61,22 @@ public:
 		}
 	}
 
+	/*!
+	 * The file descriptor of the hidraw device node, for waiting until data arrives.
+	 */
+	[[nodiscard]] int fd() const
+	{
+		return m_fd;
+	}
+
+	/*!
+	 * The path of the hidraw device node.
+	 */
+	[[nodiscard]] const std::filesystem::path &path() const
+	{
+		return m_path;
+	}
+
 	/*!
 	 * The "name", aka. the path of the hidraw device node.
 	 */
@@ -93,7 +114,83 @@ public:
 	 */
 	const std::vector<hid::Report> &descriptor() override
 	{
-		return m_reports;
+		if (!m_reports.has_value()) {
+			std::vector<hid::Report> reports {};
+			hid::parse(this->raw_descriptor(), reports);
+
+			m_reports = std::move(reports);
+		}
+
+		return m_reports.value();
+	}
+
+	/*!
+	 * The binary HID descriptor, as returned by the kernel.
+	 */
+	[[nodiscard]] gsl::span<u8> raw_descriptor()
+	{
+		return gsl::span<u8> {&m_desc.value[0], m_desc.size};
+	}
+
+	/*!
+	 * Replaces the parsed HID descriptor, e.g. with a copy that was cached previously.
+	 *
+	 * @param[in] reports The reports defined by the descriptor of this device.
+	 */
+	void set_descriptor(std::vector<hid::Report> reports)
+	{
+		m_reports = std::move(reports);
+	}
+
+	/*!
+	 * Replaces the opened device node, e.g. after the device was reset by a suspend.
+	 *
+	 * The new node must belong to the same device, with the same IDs and HID descriptor,
+	 * so that everything that was derived from the old node stays valid.
+	 * If it doesn't, the old node is kept.
+	 *
+	 * @param[in] path The path to the new hidraw device node.
+	 */
+	void reopen(const std::filesystem::path &path)
+	{
+		const int fd = syscalls::open(path, O_RDWR);
+
+		struct hidraw_devinfo devinfo {};
+		struct hidraw_report_descriptor desc {};
+
+		try {
+			u32 desc_size = 0;
+
+			syscalls::ioctl(fd, HIDIOCGRAWINFO, &devinfo);
+			syscalls::ioctl(fd, HIDIOCGRDESCSIZE, &desc_size);
+
+			desc.size = desc_size;
+			syscalls::ioctl(fd, HIDIOCGRDESC, &desc);
+		} catch (const std::exception & /* unused */) {
+			syscalls::close(fd);
+			throw;
+		}
+
+		const gsl::span<u8> old = this->raw_descriptor();
+		const gsl::span<u8> raw {&desc.value[0], desc.size};
+
+		const bool same = devinfo.vendor == m_devinfo.vendor &&
+		                  devinfo.product == m_devinfo.product &&
+		                  std::equal(raw.begin(), raw.end(), old.begin(), old.end());
+
+		if (!same) {
+			syscalls::close(fd);
+			throw common::Error<Error::DeviceChanged> {path.c_str()};
+		}
+
+		try {
+			syscalls::close(m_fd);
+		} catch (const std::exception & /* unused */) {
+			// ignored
+		}
+
+		m_fd = fd;
+		m_path = path;
 	}
 
 	/*!
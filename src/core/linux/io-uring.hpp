@@ -0,0 +1,357 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_IO_URING_HPP
+#define IPTSD_CORE_LINUX_IO_URING_HPP
+
+#include "syscalls.hpp"
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <gsl/gsl>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <exception>
+#include <vector>
+
+namespace iptsd::core::linux {
+
+/*
+ * A minimal io_uring instance for queueing reads from a file descriptor.
+ *
+ * Reads are queued with @ref read and handed to the kernel together with @ref submit, which
+ * can also wait for them to complete. Completed reads are collected in batches with @ref reap.
+ * Reads that are still running can be stopped with @ref cancel.
+ *
+ * The rings are accessed directly through the kernel interface, so no additional library
+ * is needed. The indices that are shared with the kernel are accessed through the atomic
+ * builtins of the compiler, like liburing does. Creating the instance fails if the kernel
+ * does not support io_uring, or its use was restricted (e.g. through the
+ * kernel.io_uring_disabled sysctl).
+ */
+class IoUring {
+private:
+	int m_fd = -1;
+
+	struct io_uring_params m_params {};
+
+	// The mapped submission and completion rings, and the array of submission entries.
+	void *m_sq = nullptr;
+	void *m_cq = nullptr;
+	struct io_uring_sqe *m_sqes = nullptr;
+
+	usize m_sq_size = 0;
+	usize m_cq_size = 0;
+	usize m_sqes_size = 0;
+
+	// How many requests were queued, but not yet handed to the kernel.
+	u32 m_pending = 0;
+
+	// Whether buffers were registered with the kernel.
+	bool m_fixed = false;
+
+public:
+	/*!
+	 * Creates an io_uring instance.
+	 *
+	 * @param[in] entries How many requests can be queued at the same time.
+	 */
+	explicit IoUring(const u32 entries)
+	{
+		m_fd = syscalls::io_uring_setup(entries, m_params);
+
+		try {
+			this->map();
+		} catch (const std::exception & /* unused */) {
+			this->unmap();
+			syscalls::close(m_fd);
+			throw;
+		}
+	}
+
+	IoUring(const IoUring &) = delete;
+	IoUring &operator=(const IoUring &) = delete;
+
+	~IoUring()
+	{
+		this->unmap();
+
+		try {
+			syscalls::close(m_fd);
+		} catch (const std::exception & /* unused */) {
+			// ignored
+		}
+	}
+
+	/*!
+	 * Whether the kernel can read from the current position of a file descriptor.
+	 *
+	 * Without this (before Linux 5.6), reads that are queued with @ref read fail.
+	 */
+	[[nodiscard]] bool reads_current_position() const
+	{
+		return (m_params.features & IORING_FEAT_RW_CUR_POS) != 0;
+	}
+
+	/*!
+	 * Registers buffers with the kernel, so that they don't have to be mapped for every read.
+	 *
+	 * @param[in] buffers The buffers that will be read into.
+	 * @return Whether the buffers were registered. If not, reads still work, but are slower.
+	 */
+	bool register_buffers(std::vector<std::vector<u8>> &buffers)
+	{
+		std::vector<struct iovec> iovecs {};
+
+		for (std::vector<u8> &buffer : buffers)
+			iovecs.push_back(iovec {buffer.data(), buffer.size()});
+
+		try {
+			syscalls::io_uring_register(m_fd,
+			                            IORING_REGISTER_BUFFERS,
+			                            iovecs.data(),
+			                            casts::to<u32>(iovecs.size()));
+		} catch (const std::exception & /* unused */) {
+			return false;
+		}
+
+		m_fixed = true;
+		return true;
+	}
+
+	/*!
+	 * Queues a read from a file descriptor at its current position.
+	 *
+	 * Blocking reads are handed to kernel threads, so multiple reads from the same file
+	 * descriptor can complete in any order.
+	 *
+	 * @param[in] fd The file descriptor to read from.
+	 * @param[in] buffer The buffer to read into. Must stay valid until the read completes.
+	 * @param[in] index The index of the buffer, if buffers were registered.
+	 * @param[in] data An arbitrary value that is passed back when the read completes.
+	 * @return Whether the read was queued. If not, the submission ring is full.
+	 */
+	bool read(const int fd, const gsl::span<u8> buffer, const u16 index, const u64 data)
+	{
+		struct io_uring_sqe *sqe = this->acquire();
+
+		if (sqe == nullptr)
+			return false;
+
+		sqe->opcode = m_fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+		sqe->fd = fd;
+		sqe->addr = reinterpret_cast<u64>(buffer.data()); // NOLINT
+		sqe->len = casts::to<u32>(buffer.size());
+		sqe->user_data = data;
+
+		// Read from the current position, see reads_current_position().
+		sqe->off = ~u64 {0};
+
+		if (m_fixed)
+			sqe->buf_index = index;
+
+		this->push();
+		return true;
+	}
+
+	/*!
+	 * Queues the cancellation of a request that was queued earlier.
+	 *
+	 * The cancelled request still completes, usually with -ECANCELED or -EINTR. Until it
+	 * has been reaped, the kernel can still write to its buffer.
+	 *
+	 * @param[in] target The value that was passed with the request that is cancelled.
+	 * @param[in] data An arbitrary value that is passed back when the cancellation completes.
+	 * @return Whether the cancellation was queued. If not, the submission ring is full.
+	 */
+	bool cancel(const u64 target, const u64 data)
+	{
+		struct io_uring_sqe *sqe = this->acquire();
+
+		if (sqe == nullptr)
+			return false;
+
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = target;
+		sqe->user_data = data;
+
+		this->push();
+		return true;
+	}
+
+	/*!
+	 * Hands all queued requests to the kernel.
+	 *
+	 * @param[in] wait How many completions to wait for. Returns early if a signal arrives.
+	 */
+	void submit(const u32 wait)
+	{
+		const u32 flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+		const int submitted = syscalls::io_uring_enter(m_fd, m_pending, wait, flags);
+
+		m_pending -= casts::to<u32>(submitted);
+	}
+
+	/*!
+	 * Collects all completed requests.
+	 *
+	 * @param[in] callback Called with the value passed to @ref read and the result of the read,
+	 *                     i.e. the number of bytes that were read, or a negated errno value.
+	 * @return How many requests had completed.
+	 */
+	template <class F>
+	usize reap(F &&callback)
+	{
+		u32 *head = this->cq_field(m_params.cq_off.head);
+
+		const u32 mask = *this->cq_field(m_params.cq_off.ring_mask);
+		const u32 *end = this->cq_field(m_params.cq_off.tail);
+		const u32 tail = __atomic_load_n(end, __ATOMIC_ACQUIRE);
+
+		const auto *cqes = static_cast<const struct io_uring_cqe *>(
+			this->offset(m_cq, m_params.cq_off.cqes));
+
+		usize count = 0;
+
+		for (u32 i = *head; i != tail; i++) {
+			const struct io_uring_cqe &cqe = cqes[i & mask];
+
+			callback(cqe.user_data, cqe.res);
+			count++;
+		}
+
+		__atomic_store_n(head, tail, __ATOMIC_RELEASE);
+		return count;
+	}
+
+private:
+	/*!
+	 * Maps the rings that are shared with the kernel.
+	 */
+	void map()
+	{
+		m_sq_size = m_params.sq_off.array + (m_params.sq_entries * sizeof(u32));
+		m_cq_size = m_params.cq_off.cqes +
+		            (m_params.cq_entries * sizeof(struct io_uring_cqe));
+
+		const bool single = (m_params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+		if (single)
+			m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+
+		m_sq = syscalls::mmap(nullptr,
+		                      m_sq_size,
+		                      PROT_READ | PROT_WRITE,
+		                      MAP_SHARED | MAP_POPULATE,
+		                      m_fd,
+		                      IORING_OFF_SQ_RING);
+
+		if (single) {
+			m_cq = m_sq;
+		} else {
+			m_cq = syscalls::mmap(nullptr,
+			                      m_cq_size,
+			                      PROT_READ | PROT_WRITE,
+			                      MAP_SHARED | MAP_POPULATE,
+			                      m_fd,
+			                      IORING_OFF_CQ_RING);
+		}
+
+		m_sqes_size = m_params.sq_entries * sizeof(struct io_uring_sqe);
+
+		void *sqes = syscalls::mmap(nullptr,
+		                            m_sqes_size,
+		                            PROT_READ | PROT_WRITE,
+		                            MAP_SHARED | MAP_POPULATE,
+		                            m_fd,
+		                            IORING_OFF_SQES);
+
+		m_sqes = static_cast<struct io_uring_sqe *>(sqes);
+	}
+
+	/*!
+	 * Unmaps the rings that were mapped by @ref map.
+	 */
+	void unmap()
+	{
+		try {
+			if (m_sqes != nullptr)
+				syscalls::munmap(m_sqes, m_sqes_size);
+
+			if (m_cq != nullptr && m_cq != m_sq)
+				syscalls::munmap(m_cq, m_cq_size);
+
+			if (m_sq != nullptr)
+				syscalls::munmap(m_sq, m_sq_size);
+		} catch (const std::exception & /* unused */) {
+			// ignored
+		}
+
+		m_sqes = nullptr;
+		m_cq = nullptr;
+		m_sq = nullptr;
+	}
+
+	/*!
+	 * Takes the next free entry of the submission ring.
+	 *
+	 * @return The cleared entry, or nullptr if the ring is full. It is queued by @ref push.
+	 */
+	struct io_uring_sqe *acquire()
+	{
+		const u32 mask = *this->sq_field(m_params.sq_off.ring_mask);
+		const u32 *head = this->sq_field(m_params.sq_off.head);
+		const u32 *tail = this->sq_field(m_params.sq_off.tail);
+
+		if (*tail - __atomic_load_n(head, __ATOMIC_ACQUIRE) >= m_params.sq_entries)
+			return nullptr;
+
+		const u32 slot = *tail & mask;
+
+		u32 *array = this->sq_field(m_params.sq_off.array);
+		array[slot] = slot;
+
+		struct io_uring_sqe &sqe = m_sqes[slot];
+		sqe = {};
+
+		return &sqe;
+	}
+
+	/*!
+	 * Queues the entry that was taken by @ref acquire.
+	 */
+	void push()
+	{
+		u32 *tail = this->sq_field(m_params.sq_off.tail);
+
+		__atomic_store_n(tail, *tail + 1, __ATOMIC_RELEASE);
+		m_pending++;
+	}
+
+	/*!
+	 * Calculates the address of a field inside of a mapped ring.
+	 */
+	[[nodiscard]] static void *offset(void *ring, const u32 offset)
+	{
+		return static_cast<u8 *>(ring) + offset; // NOLINT
+	}
+
+	[[nodiscard]] u32 *sq_field(const u32 offset) const
+	{
+		return static_cast<u32 *>(IoUring::offset(m_sq, offset));
+	}
+
+	[[nodiscard]] u32 *cq_field(const u32 offset) const
+	{
+		return static_cast<u32 *>(IoUring::offset(m_cq, offset));
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_IO_URING_HPP
@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_MAPPED_FILE_HPP
+#define IPTSD_CORE_LINUX_MAPPED_FILE_HPP
+
+#include "syscalls.hpp"
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <gsl/gsl>
+#include <spdlog/spdlog.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <filesystem>
+
+namespace iptsd::core::linux {
+
+/*
+ * Maps the contents of a file into memory.
+ *
+ * The mapping is private, so the data can be modified in place without changing the file.
+ * Pages are only copied once they are written to, everything else is served directly from
+ * the page cache.
+ */
+class MappedFile {
+private:
+	void *m_addr = nullptr;
+	usize m_size = 0;
+
+public:
+	MappedFile(const std::filesystem::path &path)
+	{
+		const int fd = syscalls::open(path, O_RDONLY);
+
+		// The mapping stays valid after the file descriptor has been closed.
+		const auto _close = gsl::finally([&] {
+			try {
+				syscalls::close(fd);
+			} catch (const std::exception & /* unused */) {
+				// ignored
+			}
+		});
+
+		struct stat info {};
+		syscalls::fstat(fd, info);
+
+		m_size = casts::to_unsigned(info.st_size);
+
+		// Empty mappings are not allowed.
+		if (m_size == 0)
+			return;
+
+		m_addr = syscalls::mmap(nullptr,
+		                        m_size,
+		                        PROT_READ | PROT_WRITE,
+		                        MAP_PRIVATE | MAP_NORESERVE,
+		                        fd);
+
+		try {
+			syscalls::madvise(m_addr, m_size, MADV_SEQUENTIAL);
+		} catch (const std::exception &e) {
+			spdlog::debug(e.what());
+		}
+	}
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	~MappedFile()
+	{
+		if (m_addr == nullptr)
+			return;
+
+		try {
+			syscalls::munmap(m_addr, m_size);
+		} catch (const std::exception & /* unused */) {
+			// ignored
+		}
+	}
+
+	/*!
+	 * The contents of the file.
+	 */
+	[[nodiscard]] gsl::span<u8> data() const
+	{
+		return gsl::span<u8> {static_cast<u8 *>(m_addr), m_size};
+	}
+
+	/*!
+	 * Asks the kernel to back the mapping with huge pages, if possible.
+	 *
+	 * This is only a hint. If the kernel doesn't support huge pages for the file,
+	 * the mapping will continue to use normal pages.
+	 */
+	void advise_hugepages() const
+	{
+		if (m_addr == nullptr)
+			return;
+
+		try {
+			syscalls::madvise(m_addr, m_size, MADV_HUGEPAGE);
+		} catch (const std::exception &e) {
+			spdlog::debug(e.what());
+		}
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_MAPPED_FILE_HPP
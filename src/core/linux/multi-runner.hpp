@@ -0,0 +1,578 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_MULTI_RUNNER_HPP
+#define IPTSD_CORE_LINUX_MULTI_RUNNER_HPP
+
+#include "device-runner.hpp"
+#include "device-watcher.hpp"
+#include "errors.hpp"
+#include "syscalls.hpp"
+
+#include <common/casts.hpp>
+#include <common/chrono.hpp>
+#include <common/error.hpp>
+#include <common/thread-pool.hpp>
+#include <common/types.hpp>
+#include <core/generic/application.hpp>
+
+#include <gsl/gsl>
+#include <spdlog/spdlog.h>
+
+#include <sys/epoll.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace iptsd::core::linux {
+
+/*
+ * Reads from multiple devices on a single thread.
+ *
+ * Every device gets its own @ref DeviceRunner, with its own config and application state.
+ * Instead of blocking in a read call for every device, one epoll instance waits until any
+ * of the devices has data, and the report is processed right away on the same thread.
+ *
+ * If the applications of more than one device use threads for fitting gaussians, one pool
+ * of threads is shared between them. The data of the devices is never processed concurrently,
+ * so the threads would otherwise be idle most of the time. Devices that are configured to fit
+ * on the processing thread keep doing so.
+ *
+ * A device that fails to process a report is not waited for until a delay has passed, which
+ * grows with every error in a row. This keeps a broken device from starving the others.
+ *
+ * When a device is disconnected (e.g. while resuming from suspend), it is opened again once
+ * its node comes back, like @ref DeviceRunner does with a single device. Waiting for it
+ * doesn't block the other devices.
+ *
+ * The memory locking and real-time scheduling options are taken from the first device.
+ * Threaded mode is not supported, all devices are processed directly.
+ */
+template <class T>
+class MultiDeviceRunner {
+private:
+	static_assert(std::is_base_of_v<Application, T>);
+
+	// How many errors in a row a device can have before it is no longer read from.
+	static constexpr usize MAX_ERRORS = 50;
+
+	// How long a device is not read from after an error, and how far that grows.
+	static constexpr Application::clock::duration RETRY_DELAY = 100ms;
+	static constexpr Application::clock::duration MAX_RETRY_DELAY = 2s;
+
+	// How often the old node of a disconnected device is checked.
+	static constexpr Application::clock::duration RECONNECT_INTERVAL = 100ms;
+
+	// The value that epoll reports for new device nodes, instead of the index of a device.
+	static constexpr u64 WATCHER = ~u64 {0};
+
+	/*
+	 * The state of a device while the loop is running.
+	 */
+	struct Status {
+		// How many errors the device had in a row.
+		usize errors = 0;
+
+		// When the device is read from again, or checked for coming back.
+		std::optional<Application::clock::time_point> paused = std::nullopt;
+
+		// When the device was disconnected, if it is waited for to come back.
+		std::optional<Application::clock::time_point> lost = std::nullopt;
+
+		// Whether the device is no longer read from.
+		bool removed = false;
+	};
+
+	// The paths of the devices.
+	std::vector<std::filesystem::path> m_paths;
+
+	// The runners of all devices. They are never moved, so that epoll can refer to them.
+	std::vector<std::unique_ptr<DeviceRunner<T>>> m_runners {};
+
+	// The threads for fitting gaussians that are shared by all devices, if enabled.
+	std::shared_ptr<common::ThreadPool> m_fitting_pool = nullptr;
+
+	// The epoll instance that waits for data from all devices.
+	int m_epoll = -1;
+
+	// Reports new device nodes, if disconnected devices are waited for and inotify works.
+	std::optional<DeviceWatcher> m_watcher = std::nullopt;
+
+	// Whether the loop for reading from the devices should stop.
+	std::atomic_bool m_should_stop = false;
+
+public:
+	template <class... Args>
+	MultiDeviceRunner(std::vector<std::filesystem::path> paths, Args... args)
+		: m_paths {std::move(paths)}
+	{
+		if (m_paths.empty())
+			throw common::Error<Error::RunnerInitError> {};
+
+		for (const std::filesystem::path &path : m_paths)
+			m_runners.push_back(std::make_unique<DeviceRunner<T>>(path, args...));
+
+		usize threads = 0;
+		usize sharing = 0;
+
+		for (const auto &runner : m_runners) {
+			if (runner->fitting_threads() > 0) {
+				threads = std::max(threads, runner->fitting_threads());
+				sharing++;
+			}
+
+			if (runner->threaded())
+				spdlog::warn("Ignoring threaded mode with multiple devices");
+		}
+
+		if (sharing > 1) {
+			m_fitting_pool = std::make_shared<common::ThreadPool>(threads, true);
+
+			for (const auto &runner : m_runners) {
+				if (runner->fitting_threads() > 0)
+					runner->share_fitting_pool(m_fitting_pool);
+			}
+
+			spdlog::info("Sharing {} fitting threads between {} devices",
+			             threads,
+			             sharing);
+		}
+
+		m_epoll = syscalls::epoll_create1(EPOLL_CLOEXEC);
+
+		try {
+			for (usize i = 0; i < m_runners.size(); i++)
+				this->add(i);
+		} catch (const std::exception & /* unused */) {
+			this->close();
+			throw;
+		}
+
+		for (const auto &runner : m_runners) {
+			if (runner->reconnect_timeout() > Application::clock::duration::zero()) {
+				this->watch_nodes();
+				break;
+			}
+		}
+	}
+
+	MultiDeviceRunner(const MultiDeviceRunner &) = delete;
+	MultiDeviceRunner &operator=(const MultiDeviceRunner &) = delete;
+
+	~MultiDeviceRunner()
+	{
+		this->close();
+	}
+
+	/*!
+	 * How many devices are being read from.
+	 */
+	[[nodiscard]] usize size() const
+	{
+		return m_runners.size();
+	}
+
+	/*!
+	 * The application instance of one of the devices.
+	 *
+	 * @param[in] index The index of the device, in the order they were passed in.
+	 * @return A reference to the application instance of the device.
+	 */
+	T &application(const usize index)
+	{
+		return m_runners.at(index)->application();
+	}
+
+	/*!
+	 * Stops the loop that reads from the devices.
+	 *
+	 * This function is designed to be called from a signal handler (e.g. for Ctrl-C).
+	 */
+	void stop()
+	{
+		m_should_stop = true;
+	}
+
+	/*!
+	 * Requests that the latency statistics of all applications are logged.
+	 *
+	 * This function is designed to be called from a signal handler (e.g. for SIGUSR1).
+	 */
+	void request_latency()
+	{
+		for (const auto &runner : m_runners)
+			runner->request_latency();
+	}
+
+	/*!
+	 * Requests that the flight recorders of all devices are saved.
+	 *
+	 * This function is designed to be called from a signal handler (e.g. for SIGUSR2).
+	 */
+	void request_recording()
+	{
+		for (const auto &runner : m_runners)
+			runner->request_recording();
+	}
+
+	/*!
+	 * Starts reading from all devices in an endless loop.
+	 *
+	 * The loop ends when it is stopped, or when no device can be read from anymore.
+	 *
+	 * @return Whether the loop was stopped, instead of running out of devices.
+	 */
+	bool run()
+	{
+		usize started = 0;
+
+		try {
+			for (const auto &runner : m_runners) {
+				runner->start();
+				started++;
+			}
+		} catch (const std::exception & /* unused */) {
+			for (usize i = 0; i < started; i++)
+				m_runners[i]->finish();
+
+			throw;
+		}
+
+		m_runners.front()->prepare_thread();
+
+		this->run_loop();
+
+		spdlog::info("Stopping");
+
+		for (const auto &runner : m_runners)
+			runner->finish();
+
+		return m_should_stop;
+	}
+
+private:
+	/*!
+	 * Waits for data from any device and processes it, until stopped.
+	 */
+	void run_loop()
+	{
+		std::array<struct epoll_event, 8> events {};
+		std::vector<Status> status(m_runners.size());
+
+		const auto active = [&]() {
+			return std::any_of(status.begin(), status.end(), [](const Status &device) {
+				return !device.removed;
+			});
+		};
+
+		while (!m_should_stop && active()) {
+			const int timeout = this->resume(status);
+
+			// Returns zero if a signal interrupted the wait, or the timeout ran out.
+			const int count = syscalls::epoll_wait(m_epoll, events, timeout);
+			const usize ready = casts::to_unsigned(count);
+
+			for (const struct epoll_event &event : gsl::span {events}.first(ready)) {
+				if (event.data.u64 == WATCHER) {
+					this->discover(status);
+					continue;
+				}
+
+				const usize index = event.data.u64;
+				const std::filesystem::path &path = m_paths[index];
+
+				Status &device = status[index];
+
+				// These are reported even while the device is paused.
+				if ((event.events & (EPOLLERR | EPOLLHUP)) != 0) {
+					this->disconnect(index, device);
+					continue;
+				}
+
+				try {
+					m_runners[index]->process_next();
+					device.errors = 0;
+					continue;
+				} catch (const std::exception &e) {
+					spdlog::warn(e.what());
+					device.errors++;
+				}
+
+				if (device.errors < MAX_ERRORS) {
+					const auto delay = backoff(device.errors);
+
+					this->watch(index, 0);
+					device.paused = Application::clock::now() + delay;
+					continue;
+				}
+
+				spdlog::error("Removing {} after {} continuous errors",
+				              path.c_str(),
+				              MAX_ERRORS);
+
+				m_runners[index]->save_recording();
+				this->remove(index);
+				device.removed = true;
+			}
+		}
+	}
+
+	/*!
+	 * Stops reading from a device that was disconnected, and waits for it to come back.
+	 *
+	 * @param[in] index The index of the device.
+	 * @param[in,out] device The state of the device.
+	 */
+	void disconnect(const usize index, Status &device)
+	{
+		const DeviceRunner<T> &runner = *m_runners[index];
+		const auto now = Application::clock::now();
+
+		spdlog::error("Device {} was disconnected", runner.path().c_str());
+
+		this->remove(index);
+
+		device.errors = 0;
+		device.paused = std::nullopt;
+
+		if (runner.reconnect_timeout() <= Application::clock::duration::zero()) {
+			device.removed = true;
+			return;
+		}
+
+		spdlog::info("Waiting for {} to come back", runner.path().c_str());
+
+		device.lost = now;
+		device.paused = now + RECONNECT_INTERVAL;
+	}
+
+	/*!
+	 * Tries to open a disconnected device again, and continues reading from it if that worked.
+	 *
+	 * @param[in] index The index of the device.
+	 * @param[in,out] device The state of the device.
+	 * @param[in] nodes Hidraw nodes that were created since the device was disconnected.
+	 * @return Whether the device was reconnected.
+	 */
+	bool reconnect(const usize index,
+	               Status &device,
+	               const std::vector<std::filesystem::path> &nodes)
+	{
+		DeviceRunner<T> &runner = *m_runners[index];
+
+		// The old node might still exist, if only the connection to it was lost.
+		bool reopened = runner.reopen(runner.path());
+
+		for (const std::filesystem::path &node : nodes) {
+			if (reopened)
+				break;
+
+			reopened = runner.reopen(node);
+		}
+
+		if (!reopened)
+			return false;
+
+		const milliseconds<f64> time = Application::clock::now() - device.lost.value();
+		const f64 ms = time.count();
+
+		spdlog::info("Reconnected to {} after {:.0f} ms", runner.path().c_str(), ms);
+
+		device.lost = std::nullopt;
+		device.paused = std::nullopt;
+
+		try {
+			this->add(index);
+		} catch (const std::exception &e) {
+			spdlog::error(e.what());
+			device.removed = true;
+		}
+
+		return true;
+	}
+
+	/*!
+	 * Tries to open the disconnected devices through the nodes that were just created.
+	 *
+	 * @param[in,out] status The state of all devices.
+	 */
+	void discover(std::vector<Status> &status)
+	{
+		const std::vector<std::filesystem::path> nodes = m_watcher->wait(0ms);
+
+		for (usize i = 0; i < status.size(); i++) {
+			if (status[i].lost.has_value())
+				this->reconnect(i, status[i], nodes);
+		}
+	}
+
+	/*!
+	 * How long a device is paused after a number of errors in a row.
+	 *
+	 * @param[in] errors How many errors the device had in a row.
+	 */
+	[[nodiscard]] static Application::clock::duration backoff(const usize errors)
+	{
+		// Doubling more often than this would exceed the maximum anyways.
+		const usize doublings = std::min(errors - 1, usize {5});
+		const auto factor = casts::to<Application::clock::rep>(usize {1} << doublings);
+
+		return std::min(RETRY_DELAY * factor, MAX_RETRY_DELAY);
+	}
+
+	/*!
+	 * Waits for data from the devices again, once their delay after an error has passed.
+	 *
+	 * Disconnected devices are checked for coming back in the same way, until their
+	 * reconnect timeout runs out.
+	 *
+	 * @param[in,out] status The state of all devices.
+	 * @return How many milliseconds epoll can wait until the next device can be resumed.
+	 */
+	int resume(std::vector<Status> &status)
+	{
+		const Application::clock::time_point now = Application::clock::now();
+		std::optional<Application::clock::duration> next = std::nullopt;
+
+		for (usize i = 0; i < status.size(); i++) {
+			Status &device = status[i];
+
+			if (!device.paused.has_value())
+				continue;
+
+			Application::clock::duration left = device.paused.value() - now;
+
+			if (left > Application::clock::duration::zero()) {
+				next = std::min(next.value_or(left), left);
+				continue;
+			}
+
+			device.paused = std::nullopt;
+
+			if (!device.lost.has_value()) {
+				this->watch(i, EPOLLIN);
+				continue;
+			}
+
+			if (this->reconnect(i, device, {}))
+				continue;
+
+			if (now - device.lost.value() >= m_runners[i]->reconnect_timeout()) {
+				spdlog::error("{} did not come back", m_runners[i]->path().c_str());
+
+				device.lost = std::nullopt;
+				device.removed = true;
+				continue;
+			}
+
+			left = RECONNECT_INTERVAL;
+
+			device.paused = now + left;
+			next = std::min(next.value_or(left), left);
+		}
+
+		if (!next.has_value())
+			return -1;
+
+		// Round up, so that the device can be resumed once epoll returns.
+		const auto ms = chrono::ceil<chrono::milliseconds>(next.value());
+		return casts::to<int>(ms.count());
+	}
+
+	/*!
+	 * Changes the events that are waited for on a device.
+	 *
+	 * @param[in] index The index of the device.
+	 * @param[in] events The events to wait for, or 0 to pause the device.
+	 */
+	void watch(const usize index, const u32 events)
+	{
+		struct epoll_event event {};
+		event.events = events;
+		event.data.u64 = index;
+
+		try {
+			syscalls::epoll_ctl(m_epoll, EPOLL_CTL_MOD, m_runners[index]->fd(), &event);
+		} catch (const std::exception &e) {
+			spdlog::warn(e.what());
+		}
+	}
+
+	/*!
+	 * Starts waiting for data from a device.
+	 *
+	 * @param[in] index The index of the device.
+	 */
+	void add(const usize index)
+	{
+		struct epoll_event event {};
+		event.events = EPOLLIN;
+		event.data.u64 = index;
+
+		syscalls::epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_runners[index]->fd(), &event);
+	}
+
+	/*!
+	 * Starts waiting for new device nodes, to notice when disconnected devices come back.
+	 *
+	 * Without inotify, the old nodes of disconnected devices are still checked in intervals.
+	 */
+	void watch_nodes()
+	{
+		try {
+			m_watcher.emplace(m_runners.front()->path().parent_path());
+
+			struct epoll_event event {};
+			event.events = EPOLLIN;
+			event.data.u64 = WATCHER;
+
+			syscalls::epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_watcher->fd(), &event);
+		} catch (const std::exception &e) {
+			spdlog::warn(e.what());
+			m_watcher.reset();
+		}
+	}
+
+	/*!
+	 * Stops waiting for data from a device.
+	 *
+	 * @param[in] index The index of the device.
+	 */
+	void remove(const usize index)
+	{
+		const int fd = m_runners[index]->fd();
+
+		try {
+			syscalls::epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+		} catch (const std::exception &e) {
+			spdlog::warn(e.what());
+		}
+	}
+
+	/*!
+	 * Closes the epoll instance.
+	 */
+	void close()
+	{
+		if (m_epoll < 0)
+			return;
+
+		try {
+			syscalls::close(m_epoll);
+		} catch (const std::exception & /* unused */) {
+			// ignored
+		}
+
+		m_epoll = -1;
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_MULTI_RUNNER_HPP
@@ -0,0 +1,256 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_PERF_COUNTERS_HPP
+#define IPTSD_CORE_LINUX_PERF_COUNTERS_HPP
+
+#include "syscalls.hpp"
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <gsl/gsl>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <string_view>
+
+namespace iptsd::core::linux {
+
+/*
+ * Counts hardware events of the calling thread, like instructions and cache misses.
+ *
+ * All counters are opened as one group, so that they are always counted at the same time
+ * and can be read together with a single system call. Counters that the CPU or kernel do
+ * not support are left out. Only events in user space are counted, because that is what
+ * unprivileged users are allowed to measure by default (kernel.perf_event_paranoid = 2).
+ */
+class PerfCounters {
+public:
+	enum Counter : u8 {
+		Instructions,
+		Cycles,
+		L1Misses,
+		LlcMisses,
+		BranchMisses,
+	};
+
+	constexpr static usize COUNTERS = 5;
+
+	// The value of every counter, indexed by @ref Counter.
+	using Values = std::array<u64, COUNTERS>;
+
+private:
+	// The file descriptor of every counter, or -1 if it is not supported.
+	std::array<int, COUNTERS> m_fds {};
+
+	// The id the kernel assigned to every counter, to find its value in a group read.
+	std::array<u64, COUNTERS> m_ids {};
+
+	// The first counter that was opened, all others belong to its group.
+	int m_leader = -1;
+
+	// How long the group was enabled, and how long it was actually counting, in nanoseconds.
+	u64 m_enabled = 0;
+	u64 m_running = 0;
+
+public:
+	/*!
+	 * Opens all supported counters and starts counting.
+	 *
+	 * Fails if none of the counters could be opened.
+	 */
+	PerfCounters()
+	{
+		m_fds.fill(-1);
+
+		for (usize i = 0; i < COUNTERS; i++) {
+			const auto counter = static_cast<Counter>(i);
+			struct perf_event_attr attr = PerfCounters::attributes(counter);
+
+			// The group is started at once, through its leader.
+			attr.disabled = m_leader == -1 ? 1 : 0;
+
+			try {
+				m_fds[i] = syscalls::perf_event_open(attr, 0, -1, m_leader, 0);
+			} catch (const std::exception & /* unused */) {
+				// Every counter is optional, except for the first one that works.
+				if (i + 1 == COUNTERS && m_leader == -1)
+					throw;
+
+				continue;
+			}
+
+			if (m_leader == -1)
+				m_leader = m_fds[i];
+
+			syscalls::ioctl(m_fds[i], PERF_EVENT_IOC_ID, &m_ids[i]);
+		}
+
+		syscalls::ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		syscalls::ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	}
+
+	PerfCounters(const PerfCounters &) = delete;
+	PerfCounters &operator=(const PerfCounters &) = delete;
+
+	~PerfCounters()
+	{
+		for (const int fd : m_fds) {
+			if (fd == -1)
+				continue;
+
+			try {
+				syscalls::close(fd);
+			} catch (const std::exception & /* unused */) {
+				// Nothing can be done about it.
+			}
+		}
+	}
+
+	/*!
+	 * Whether a counter is supported.
+	 *
+	 * @param[in] counter The counter to check.
+	 */
+	[[nodiscard]] bool available(const Counter counter) const
+	{
+		return m_fds.at(counter) != -1;
+	}
+
+	/*!
+	 * Whether the group was ever counting since it was started.
+	 *
+	 * If there are not enough hardware counters (e.g. because another program measures
+	 * them too), the group can be left out completely and all values stay zero.
+	 * This is updated by @ref read.
+	 */
+	[[nodiscard]] bool scheduled() const
+	{
+		return m_running > 0;
+	}
+
+	/*!
+	 * Whether the group had to share the hardware counters with other events.
+	 *
+	 * The values returned by @ref read are then extrapolated from the time the group was
+	 * actually counting. This is updated by @ref read.
+	 */
+	[[nodiscard]] bool multiplexed() const
+	{
+		return m_running < m_enabled;
+	}
+
+	/*!
+	 * Reads the current value of all counters.
+	 *
+	 * If the group was not counting all the time, the values are scaled up to the whole
+	 * time it was enabled, like perf stat does.
+	 *
+	 * @return The values, counters that are not supported are always zero.
+	 */
+	[[nodiscard]] Values read()
+	{
+		// The count, the enabled and running time, and a value and id for every counter.
+		std::array<u64, 3 + 2 * COUNTERS> buffer {};
+		syscalls::read(m_leader, gsl::span<u64> {buffer});
+
+		m_enabled = buffer[1];
+		m_running = buffer[2];
+
+		Values values {};
+
+		if (m_running == 0)
+			return values;
+
+		const f64 scale = casts::to<f64>(m_enabled) / casts::to<f64>(m_running);
+		const usize count = std::min<usize>(buffer[0], COUNTERS);
+
+		for (usize i = 0; i < count; i++) {
+			u64 value = buffer[3 + 2 * i];
+			const u64 id = buffer[4 + 2 * i];
+
+			if (m_running < m_enabled)
+				value = gsl::narrow_cast<u64>(casts::to<f64>(value) * scale);
+
+			for (usize j = 0; j < COUNTERS; j++) {
+				if (m_fds[j] != -1 && m_ids[j] == id)
+					values[j] = value;
+			}
+		}
+
+		return values;
+	}
+
+	/*!
+	 * A name for a counter, for printing.
+	 *
+	 * @param[in] counter The counter.
+	 */
+	[[nodiscard]] static std::string_view name(const Counter counter)
+	{
+		switch (counter) {
+		case Instructions:
+			return "instructions";
+		case Cycles:
+			return "cycles";
+		case L1Misses:
+			return "l1d_misses";
+		case LlcMisses:
+			return "llc_misses";
+		case BranchMisses:
+			return "branch_misses";
+		default:
+			return "unknown";
+		}
+	}
+
+private:
+	/*!
+	 * Describes a counter for the kernel.
+	 *
+	 * @param[in] counter The counter to describe.
+	 * @return The attributes for opening the counter.
+	 */
+	[[nodiscard]] static struct perf_event_attr attributes(const Counter counter)
+	{
+		struct perf_event_attr attr {};
+
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+		                   PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		switch (counter) {
+		case Instructions:
+			attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+			break;
+		case Cycles:
+			attr.config = PERF_COUNT_HW_CPU_CYCLES;
+			break;
+		case L1Misses:
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			break;
+		case LlcMisses:
+			// On most CPUs, this counts misses of the last level cache.
+			attr.config = PERF_COUNT_HW_CACHE_MISSES;
+			break;
+		case BranchMisses:
+			attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+			break;
+		}
+
+		return attr;
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_PERF_COUNTERS_HPP
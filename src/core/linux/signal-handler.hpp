@@ -35,14 +35,16 @@ public:
 	 * Sets up a signal handler.
 	 *
 	 * @param[in] callback The user defined function to call when the signal is received.
+	 * @param[in] flags The flags passed to sigaction (e.g. SA_RESTART).
 	 */
 	template <class F>
-	static void setup(F &&callback)
+	static void setup(F &&callback, const int flags)
 	{
 		struct sigaction sig {};
 
 		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
 		sig.sa_handler = SignalStub<Signal>::handler;
+		sig.sa_flags = flags;
 
 		// unregister handler before we replace it
 		if (s_seat.m_handler)
@@ -105,14 +107,18 @@ public:
 /*!
  * Registers a user defined signal handler.
  *
+ * By default, blocking system calls are interrupted by the signal. Passing SA_RESTART
+ * resumes them instead.
+ *
  * @tparam Signal The signal that should be handled differently.
  * @param[in] callback The user defined function that is called when the signal is received.
+ * @param[in] flags The flags passed to sigaction.
  * @return A guard object that will remove the signal handler once it moves out of scope.
  */
 template <int Signal, class F>
-[[nodiscard]] impl::SignalGuard<Signal> signal(F &&callback)
+[[nodiscard]] impl::SignalGuard<Signal> signal(F &&callback, const int flags = 0)
 {
-	impl::SignalStub<Signal>::setup(std::forward<F>(callback));
+	impl::SignalStub<Signal>::setup(std::forward<F>(callback), flags);
 	return {};
 }
 
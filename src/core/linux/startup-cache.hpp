@@ -0,0 +1,368 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_STARTUP_CACHE_HPP
+#define IPTSD_CORE_LINUX_STARTUP_CACHE_HPP
+
+#include "config-loader.hpp"
+
+#include <common/buildopts.hpp>
+#include <common/casts.hpp>
+#include <common/reader.hpp>
+#include <common/types.hpp>
+#include <core/generic/config.hpp>
+#include <hid/report.hpp>
+#include <ipts/data.hpp>
+
+#include <fmt/format.h>
+#include <gsl/gsl>
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+
+namespace iptsd::core::linux {
+
+/*
+ * Caches the information that is gathered about a device when iptsd starts.
+ *
+ * This includes the parsed HID descriptor, the IPTS metadata and the merged config. Loading
+ * these requires parsing the descriptor, querying a feature report from the device and parsing
+ * every preset that iptsd ships, which noticeably delays resuming from suspend.
+ *
+ * A cache file is specific to one vendor, product and HID descriptor. It is invalidated when
+ * any of the config files is added, removed or modified.
+ */
+class StartupCache {
+public:
+	/*
+	 * The data that is stored in the cache.
+	 */
+	struct Entry {
+		std::vector<hid::Report> reports {};
+		std::optional<ipts::Metadata> metadata = std::nullopt;
+		Config config {};
+	};
+
+private:
+	static constexpr std::array<char, 8> MAGIC {'I', 'P', 'T', 'S', 'D', 'C', 'H', 'E'};
+	static constexpr u32 VERSION = 1;
+
+	/*
+	 * The beginning of a cache file.
+	 */
+	struct [[gnu::packed]] Header {
+		std::array<char, 8> magic;
+		u32 version;
+		u32 reserved;
+
+		// The hash of the binary HID descriptor.
+		u64 descriptor;
+
+		// The hash of the names, sizes and modification times of all config files.
+		u64 stamp;
+	};
+
+	// The file where the cache is stored.
+	std::filesystem::path m_path {};
+
+	// The hash of the binary HID descriptor.
+	u64 m_descriptor = 0;
+
+	// The hash of the names, sizes and modification times of all config files.
+	u64 m_stamp = 0;
+
+public:
+	/*!
+	 * Locates the cache for a device.
+	 *
+	 * @param[in] vendor The vendor ID of the device.
+	 * @param[in] product The product ID of the device.
+	 * @param[in] descriptor The binary HID descriptor of the device.
+	 */
+	StartupCache(const u16 vendor, const u16 product, const gsl::span<const u8> descriptor)
+		: m_descriptor {hash(descriptor)},
+		  m_stamp {config_stamp()}
+	{
+		const std::string name =
+			fmt::format("{:04X}-{:04X}-{:016X}.bin", vendor, product, m_descriptor);
+
+		m_path = std::filesystem::path {common::buildopts::CacheDir} / name;
+	}
+
+	/*!
+	 * Loads the cached data for the device.
+	 *
+	 * @return The cached data, or null if there is no valid cache.
+	 */
+	[[nodiscard]] std::optional<Entry> load() const
+	{
+		std::error_code ec {};
+
+		if (!std::filesystem::is_regular_file(m_path, ec))
+			return std::nullopt;
+
+		std::ifstream file {m_path, std::ios::binary};
+		std::vector<u8> data {std::istreambuf_iterator<char> {file}, {}};
+
+		try {
+			return this->deserialize(data);
+		} catch (const std::exception &e) {
+			spdlog::debug("Ignoring invalid startup cache {}: {}", m_path.c_str(), e.what());
+			return std::nullopt;
+		}
+	}
+
+	/*!
+	 * Stores the data for the device in the cache.
+	 *
+	 * Failing to write the cache (e.g. because the directory doesn't exist or is not
+	 * writable) is not an error, the data will simply be loaded from scratch again.
+	 *
+	 * @param[in] entry The data to store.
+	 */
+	void store(const Entry &entry) const
+	{
+		const std::vector<u8> data = this->serialize(entry);
+
+		std::filesystem::path temp = m_path;
+		temp += ".tmp";
+
+		{
+			std::ofstream file {temp, std::ios::binary | std::ios::trunc};
+
+			if (!file) {
+				spdlog::debug("Failed to write startup cache {}", m_path.c_str());
+				return;
+			}
+
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+			file.write(reinterpret_cast<const char *>(data.data()),
+			           casts::to<std::streamsize>(data.size()));
+
+			if (!file) {
+				spdlog::debug("Failed to write startup cache {}", m_path.c_str());
+				return;
+			}
+		}
+
+		// Replace the old cache atomically, so that readers never see a partial file.
+		std::error_code ec {};
+		std::filesystem::rename(temp, m_path, ec);
+
+		if (ec)
+			spdlog::debug("Failed to write startup cache {}: {}", m_path.c_str(), ec.message());
+	}
+
+private:
+	/*!
+	 * Converts the data for the device into the binary representation of the cache.
+	 *
+	 * @param[in] entry The data to convert.
+	 * @return The contents of the cache file.
+	 */
+	[[nodiscard]] std::vector<u8> serialize(const Entry &entry) const
+	{
+		std::vector<u8> data {};
+
+		Header header {};
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.descriptor = m_descriptor;
+		header.stamp = m_stamp;
+
+		append(data, header);
+		append(data, casts::to<u32>(entry.reports.size()));
+
+		for (const hid::Report &report : entry.reports) {
+			const std::optional<u8> id = report.id();
+
+			append(data, report.type());
+			append(data, casts::to<u8>(id.has_value() ? 1 : 0));
+			append(data, id.value_or(0));
+			append(data, report.size());
+			append(data, casts::to<u32>(report.usages().size()));
+
+			for (const hid::Usage &usage : report.usages())
+				append(data, usage);
+		}
+
+		append(data, casts::to<u8>(entry.metadata.has_value() ? 1 : 0));
+
+		if (entry.metadata.has_value())
+			append(data, entry.metadata.value());
+
+		ConfigLoader::for_each_option(entry.config,
+		                              [&](const auto & /* section */,
+		                                  const auto & /* name */,
+		                                  const auto &value) { append(data, value); });
+
+		return data;
+	}
+
+	/*!
+	 * Restores the data for the device from the binary representation of the cache.
+	 *
+	 * @param[in] buffer The contents of the cache file.
+	 * @return The cached data, or null if the cache is outdated.
+	 */
+	[[nodiscard]] std::optional<Entry> deserialize(std::vector<u8> &buffer) const
+	{
+		Reader reader {buffer};
+		Entry entry {};
+
+		const auto header = reader.read<Header>();
+		const u32 version = header.version;
+
+		if (header.magic != MAGIC || version != VERSION)
+			return std::nullopt;
+
+		if (header.descriptor != m_descriptor || header.stamp != m_stamp)
+			return std::nullopt;
+
+		const auto reports = reader.read<u32>();
+
+		for (u32 i = 0; i < reports; i++) {
+			const auto type = reader.read<hid::ReportType>();
+			const auto has_id = reader.read<u8>();
+			const auto id = reader.read<u8>();
+			const auto size = reader.read<u64>();
+			const auto count = reader.read<u32>();
+
+			std::unordered_set<hid::Usage> usages {};
+
+			for (u32 j = 0; j < count; j++)
+				usages.insert(reader.read<hid::Usage>());
+
+			const std::optional<u8> report_id =
+				has_id ? std::optional<u8> {id} : std::nullopt;
+
+			entry.reports.emplace_back(type, report_id, 1, casts::to<u32>(size), usages);
+		}
+
+		const auto has_meta = reader.read<u8>();
+
+		if (has_meta)
+			entry.metadata = reader.read<ipts::Metadata>();
+
+		ConfigLoader::for_each_option(
+			entry.config,
+			[&](const auto & /* section */, const auto & /* name */, auto &value) {
+				read(reader, value);
+			});
+
+		if (reader.size() > 0)
+			return std::nullopt;
+
+		return entry;
+	}
+
+	/*!
+	 * Appends the binary representation of a value to a buffer.
+	 *
+	 * @param[in] data The buffer to append to.
+	 * @param[in] value The value to append.
+	 */
+	template <class T>
+	static void append(std::vector<u8> &data, const T &value)
+	{
+		if constexpr (std::is_same_v<T, std::string>) {
+			append(data, casts::to<u32>(value.size()));
+			data.insert(data.end(), value.begin(), value.end());
+		} else {
+			static_assert(std::is_trivially_copyable_v<T>);
+
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+			const auto *bytes = reinterpret_cast<const u8 *>(&value);
+
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+			data.insert(data.end(), bytes, bytes + sizeof(T));
+		}
+	}
+
+	/*!
+	 * Reads a value that was stored using @ref append.
+	 *
+	 * @param[in] reader The data to read from.
+	 * @param[out] value The value that was read.
+	 */
+	template <class T>
+	static void read(Reader &reader, T &value)
+	{
+		if constexpr (std::is_same_v<T, std::string>) {
+			const auto size = reader.read<u32>();
+			const gsl::span<u8> chars = reader.subspan<u8>(size);
+
+			value.assign(chars.begin(), chars.end());
+		} else {
+			value = reader.read<T>();
+		}
+	}
+
+	/*!
+	 * Calculates a stamp that changes whenever one of the config files changes.
+	 *
+	 * The stamp also covers the list of config options, so that a cache that was
+	 * written by a different version of iptsd is not used.
+	 *
+	 * @return A hash of the config options and the metadata of all config files.
+	 */
+	[[nodiscard]] static u64 config_stamp()
+	{
+		std::vector<u8> data {};
+
+		Config config {};
+		ConfigLoader::for_each_option(config,
+		                              [&](const std::string_view section,
+		                                  const std::string_view name,
+		                                  const auto &value) {
+			                              data.insert(data.end(), section.begin(), section.end());
+			                              data.insert(data.end(), name.begin(), name.end());
+			                              append(data, sizeof(value));
+		                              });
+
+		for (const std::filesystem::path &path : ConfigLoader::files()) {
+			std::error_code ec {};
+
+			const std::string name = path.string();
+			const auto mtime = std::filesystem::last_write_time(path, ec);
+			const auto size = std::filesystem::file_size(path, ec);
+
+			data.insert(data.end(), name.begin(), name.end());
+			append(data, mtime.time_since_epoch().count());
+			append(data, size);
+		}
+
+		return hash(data);
+	}
+
+	/*!
+	 * Calculates the 64 bit FNV-1a hash of some data.
+	 *
+	 * @param[in] data The data to hash.
+	 * @return The hash of the data.
+	 */
+	[[nodiscard]] static u64 hash(const gsl::span<const u8> data)
+	{
+		u64 hash = 0xCBF29CE484222325;
+
+		for (const u8 byte : data) {
+			hash ^= byte;
+			hash *= 0x100000001B3;
+		}
+
+		return hash;
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_STARTUP_CACHE_HPP
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_STATS_PAGE_HPP
+#define IPTSD_CORE_LINUX_STATS_PAGE_HPP
+
+#include "syscalls.hpp"
+
+#include <common/types.hpp>
+#include <core/generic/stats.hpp>
+
+#include <gsl/gsl>
+
+#include <sys/mman.h>
+
+#include <atomic>
+#include <exception>
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace iptsd::core::linux {
+
+/*
+ * Publishes the statistics of a running application in a shared memory object.
+ *
+ * The object is created as /dev/shm/<name> and contains a @ref Page. Its contents are
+ * protected by a sequence lock. The writer never waits for readers, instead readers retry
+ * if the statistics were updated while they were copying them.
+ *
+ * Readers map the object read-only and call @ref read, or implement the same protocol:
+ * Load the sequence number, and retry while it is odd. Copy the statistics, and retry if the
+ * sequence number has changed in the meantime.
+ */
+class StatsPage {
+public:
+	struct Page {
+		// Incremented before and after every update. Odd while an update is in progress.
+		std::atomic<u32> sequence;
+
+		u32 reserved;
+
+		Stats stats;
+	};
+
+	static_assert(std::atomic<u32>::is_always_lock_free);
+
+private:
+	// The name of the shared memory object.
+	std::string m_name;
+
+	// The mapped shared memory object.
+	Page *m_page = nullptr;
+
+public:
+	/*!
+	 * Creates the shared memory object, replacing one that already exists.
+	 *
+	 * @param[in] name The name of the object, e.g. "/iptsd-hidraw0".
+	 */
+	explicit StatsPage(std::string name) : m_name {std::move(name)}
+	{
+		::shm_unlink(m_name.c_str());
+
+		// Everyone can read the statistics, but only iptsd can change them.
+		const int fd = syscalls::shm_open(m_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+
+		// The mapping stays valid after the file descriptor has been closed.
+		const auto _close = gsl::finally([&] {
+			try {
+				syscalls::close(fd);
+			} catch (const std::exception & /* unused */) {
+				// ignored
+			}
+		});
+
+		syscalls::ftruncate(fd, sizeof(Page));
+
+		void *addr = syscalls::mmap(nullptr,
+		                            sizeof(Page),
+		                            PROT_READ | PROT_WRITE,
+		                            MAP_SHARED,
+		                            fd);
+
+		// The object was just truncated, so the page is filled with zeros.
+		m_page = static_cast<Page *>(addr);
+	}
+
+	StatsPage(const StatsPage &) = delete;
+	StatsPage &operator=(const StatsPage &) = delete;
+
+	~StatsPage()
+	{
+		try {
+			syscalls::munmap(m_page, sizeof(Page));
+		} catch (const std::exception & /* unused */) {
+			// ignored
+		}
+
+		::shm_unlink(m_name.c_str());
+	}
+
+	/*!
+	 * Updates the published statistics.
+	 *
+	 * There must only be a single thread that calls this function.
+	 *
+	 * @param[in] stats The new statistics.
+	 */
+	void write(const Stats &stats)
+	{
+		const u32 sequence = m_page->sequence.load(std::memory_order_relaxed);
+
+		m_page->sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		m_page->stats = stats;
+
+		m_page->sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	/*!
+	 * Reads consistent statistics from a mapped page.
+	 *
+	 * @param[in] page The mapped page.
+	 * @param[in] attempts How often reading is retried if the page is being updated.
+	 * @return The statistics, or nothing if all attempts overlapped with an update.
+	 */
+	static std::optional<Stats> read(const Page &page, const usize attempts = 100)
+	{
+		for (usize i = 0; i < attempts; i++) {
+			const u32 before = page.sequence.load(std::memory_order_acquire);
+
+			if (before % 2 != 0)
+				continue;
+
+			const Stats stats = page.stats;
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			const u32 after = page.sequence.load(std::memory_order_relaxed);
+
+			if (before == after)
+				return stats;
+		}
+
+		return std::nullopt;
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_STATS_PAGE_HPP
@@ -0,0 +1,333 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_STREAM_RUNNER_HPP
+#define IPTSD_CORE_LINUX_STREAM_RUNNER_HPP
+
+#include "config-loader.hpp"
+#include "errors.hpp"
+#include "syscalls.hpp"
+
+#include <common/casts.hpp>
+#include <common/chrono.hpp>
+#include <common/error.hpp>
+#include <common/types.hpp>
+#include <core/generic/application.hpp>
+#include <core/generic/device.hpp>
+#include <core/generic/dump.hpp>
+#include <ipts/data.hpp>
+
+#include <gsl/gsl>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace iptsd::core::linux {
+
+/*
+ * Replays a recording from a stream, like a pipe or the standard input.
+ *
+ * Unlike @ref FileRunner, the data is not mapped into memory. Instead, one frame at a time
+ * is read into a reusable buffer, so the memory usage does not depend on the size of the
+ * recording. Because streams can't be rewound, the data can only be processed once.
+ */
+template <class T>
+class StreamRunner {
+private:
+	static_assert(std::is_base_of_v<Application, T>);
+
+private:
+	// The stream that the data is read from.
+	int m_fd = -1;
+
+	// Whether the file descriptor was opened by the runner and has to be closed.
+	bool m_owns_fd = false;
+
+	// Information about the device that produced the data.
+	DeviceInfo m_info {};
+
+	// The version of the dump format.
+	u32 m_version = 1;
+
+	// Whether the loop for reading from the stream should stop.
+	std::atomic_bool m_should_stop = false;
+
+	// The target buffer for reading frames.
+	std::vector<u8> m_buffer {};
+
+	// The size of the data in the current frame.
+	usize m_frame_size = 0;
+
+	// The time at which the current frame was recorded.
+	Application::clock::time_point m_frame_timestamp {};
+
+	/*
+	 * deferred initialization
+	 */
+
+	// The application that is being executed.
+	std::optional<T> m_application = std::nullopt;
+
+public:
+	/*!
+	 * Opens a stream for replaying.
+	 *
+	 * @param[in] path The file to read from. "-" reads from the standard input.
+	 */
+	template <class... Args>
+	StreamRunner(const std::filesystem::path &path, Args... args)
+	{
+		if (path == "-") {
+			m_fd = STDIN_FILENO;
+		} else {
+			m_fd = syscalls::open(path, O_RDONLY);
+			m_owns_fd = true;
+		}
+
+		dump::Header header {};
+		if (!this->read_exact(gsl::span {&header, 1}))
+			throw common::Error<Error::RunnerInitError> {};
+
+		if (dump::is_versioned(header)) {
+			const u32 version = header.version;
+
+			if (version != dump::VERSION)
+				throw common::Error<Error::UnsupportedDumpVersion> {version};
+
+			m_version = version;
+
+			if (!this->read_exact(gsl::span {&m_info, 1}))
+				throw common::Error<Error::RunnerInitError> {};
+		} else {
+			// Version 1 files have no header and start with the device info directly.
+			std::memcpy(&m_info, &header, sizeof(m_info));
+		}
+
+		std::optional<ipts::Metadata> meta = std::nullopt;
+
+		u8 has_meta = 0;
+		if (!this->read_exact(gsl::span {&has_meta, 1}))
+			throw common::Error<Error::RunnerInitError> {};
+
+		if (has_meta) {
+			ipts::Metadata m {};
+
+			if (!this->read_exact(gsl::span {&m, 1}))
+				throw common::Error<Error::RunnerInitError> {};
+
+			meta = m;
+		}
+
+		const ConfigLoader loader {m_info, meta};
+		m_application.emplace(loader.config(), m_info, meta, args...);
+
+		m_buffer.resize(casts::to<usize>(m_info.buffer_size));
+
+		const u16 vendor = m_info.vendor;
+		const u16 product = m_info.product;
+
+		spdlog::info("Streaming from device {:04X}:{:04X}", vendor, product);
+	}
+
+	StreamRunner(const StreamRunner &) = delete;
+	StreamRunner &operator=(const StreamRunner &) = delete;
+
+	~StreamRunner()
+	{
+		if (!m_owns_fd)
+			return;
+
+		try {
+			syscalls::close(m_fd);
+		} catch (const std::exception & /* unused */) {
+			// ignored
+		}
+	}
+
+	/*!
+	 * The application instance that is being run.
+	 *
+	 * Can be used to access collected data or to reset a state.
+	 *
+	 * @return A reference to the application instance that is being run.
+	 */
+	T &application()
+	{
+		if (!m_application.has_value())
+			throw common::Error<Error::RunnerInitError> {};
+
+		return m_application.value();
+	}
+
+	/*!
+	 * Stops the loop that reads from the stream.
+	 *
+	 * This function is designed to be called from a signal handler (e.g. for Ctrl-C).
+	 */
+	void stop()
+	{
+		m_should_stop = true;
+	}
+
+	/*!
+	 * Starts reading from the stream until no data is left.
+	 *
+	 * Touch data that is read will be passed to the application that is being executed.
+	 * Calling this function again after the stream has ended will not process any data.
+	 */
+	bool run()
+	{
+		if (!m_application.has_value())
+			throw common::Error<Error::RunnerInitError> {};
+
+		// Signal the application that the data flow has started.
+		m_application->on_start();
+
+		bool leftover = false;
+
+		while (!m_should_stop) {
+			usize size = 0;
+
+			/*
+			 * Frames have no markers that could be searched for. After a frame was only
+			 * read partially, the next one can't be found, so the rest of the stream
+			 * is skipped. Errors while processing a complete frame don't affect others.
+			 */
+			try {
+				if (!this->read_frame(size, leftover))
+					break;
+			} catch (const std::exception &e) {
+				spdlog::error(e.what());
+
+				leftover = true;
+				break;
+			}
+
+			const usize length = std::min(m_frame_size, size);
+
+			try {
+				m_application->process(gsl::span<u8> {m_buffer.data(), length},
+				                       m_frame_timestamp);
+			} catch (const std::exception &e) {
+				spdlog::warn(e.what());
+			}
+		}
+
+		if (leftover)
+			spdlog::warn("Leftover data at end of input");
+
+		// Signal the application that the data flow has stopped.
+		m_application->on_stop();
+
+		return m_should_stop;
+	}
+
+private:
+	/*!
+	 * Reads the next frame into the buffer.
+	 *
+	 * @param[out] size How many bytes of the buffer were filled.
+	 * @param[out] leftover Whether the stream ended with an incomplete or corrupted frame.
+	 * @return Whether a complete frame was read.
+	 */
+	bool read_frame(usize &size, bool &leftover)
+	{
+		if (!this->read_frame_header(size))
+			return false;
+
+		/*
+		 * Recorded frames always fit into the buffer of the device. A larger size means
+		 * that the stream is corrupted, and the frames after it can't be found either.
+		 */
+		if (size > m_buffer.size()) {
+			spdlog::warn("Frame of {} bytes is larger than the buffer", size);
+
+			leftover = true;
+			return false;
+		}
+
+		if (!this->read_exact(gsl::span<u8> {m_buffer.data(), size})) {
+			leftover = true;
+			return false;
+		}
+
+		return true;
+	}
+
+	/*!
+	 * Reads the header of the next frame.
+	 *
+	 * @param[out] size How many bytes have to be read for the frame.
+	 * @return Whether a frame header was read before the stream or the frames ended.
+	 */
+	bool read_frame_header(usize &size)
+	{
+		if (m_version == 1) {
+			u64 length = 0;
+
+			if (!this->read_exact(gsl::span {&length, 1}))
+				return false;
+
+			// See FileRunner, the writer always wrote the entire buffer.
+			m_frame_size = casts::to<usize>(length);
+			m_frame_timestamp = Application::clock::now();
+			size = casts::to<usize>(m_info.buffer_size);
+
+			return true;
+		}
+
+		dump::FrameHeader header {};
+
+		if (!this->read_exact(gsl::span {&header, 1}))
+			return false;
+
+		// The index can't be used without seeking, so it is ignored.
+		if (header.size == dump::END_OF_FRAMES)
+			return false;
+
+		const chrono::nanoseconds timestamp {header.timestamp};
+
+		m_frame_size = header.size;
+		m_frame_timestamp = Application::clock::time_point {timestamp};
+		size = header.size;
+
+		return true;
+	}
+
+	/*!
+	 * Fills a buffer with data from the stream.
+	 *
+	 * Pipes can return less data than requested, so this reads until the buffer is full.
+	 *
+	 * @param[in] dest The buffer to fill.
+	 * @return Whether the buffer was filled completely before the stream ended.
+	 */
+	template <class D>
+	bool read_exact(const gsl::span<D> dest)
+	{
+		const gsl::span<u8> bytes {reinterpret_cast<u8 *>(dest.data()), dest.size_bytes()};
+
+		usize offset = 0;
+
+		while (offset < bytes.size()) {
+			const isize ret = syscalls::read(m_fd, bytes.subspan(offset));
+
+			// End of stream
+			if (ret == 0)
+				return false;
+
+			offset += casts::to_unsigned(ret);
+		}
+
+		return true;
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_STREAM_RUNNER_HPP
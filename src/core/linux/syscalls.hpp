@@ -11,12 +11,24 @@
 #include <gsl/gsl>
 
 #include <linux/input.h>
+#include <linux/io_uring.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 
 #include <cerrno>
 #include <csignal> // IWYU pragma: keep
 #include <fcntl.h>
 #include <filesystem>
+#include <string>
 #include <system_error>
 #include <unistd.h>
 
@@ -35,10 +47,10 @@ inline std::string last_error()
 
 } // namespace impl
 
-inline int open(const std::filesystem::path &file, const int args)
+inline int open(const std::filesystem::path &file, const int args, const mode_t mode = 0)
 {
 	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
-	const int ret = ::open(file.c_str(), args);
+	const int ret = ::open(file.c_str(), args, mode);
 	if (ret == -1)
 		throw common::Error<Error::SyscallOpenFailed> {file.c_str(), impl::last_error()};
 
@@ -106,6 +118,271 @@ inline int sigaction(const int sig, const struct sigaction *act, struct sigactio
 	return ret;
 }
 
+inline int shm_open(const std::string &name, const int args, const mode_t mode = 0)
+{
+	const int ret = ::shm_open(name.c_str(), args, mode);
+	if (ret == -1)
+		throw common::Error<Error::SyscallOpenFailed> {name, impl::last_error()};
+
+	return ret;
+}
+
+inline int ftruncate(const int fd, const off_t length)
+{
+	const int ret = ::ftruncate(fd, length);
+	if (ret == -1)
+		throw common::Error<Error::SyscallTruncateFailed> {impl::last_error()};
+
+	return ret;
+}
+
+inline int fstat(const int fd, struct stat &buf)
+{
+	const int ret = ::fstat(fd, &buf);
+	if (ret == -1)
+		throw common::Error<Error::SyscallStatFailed> {impl::last_error()};
+
+	return ret;
+}
+
+inline void *mmap(void *addr,
+                  const usize length,
+                  const int prot,
+                  const int flags,
+                  const int fd,
+                  const off_t offset = 0)
+{
+	void *ret = ::mmap(addr, length, prot, flags, fd, offset);
+	if (ret == MAP_FAILED)
+		throw common::Error<Error::SyscallMmapFailed> {impl::last_error()};
+
+	return ret;
+}
+
+inline int munmap(void *addr, const usize length)
+{
+	const int ret = ::munmap(addr, length);
+	if (ret == -1)
+		throw common::Error<Error::SyscallMmapFailed> {impl::last_error()};
+
+	return ret;
+}
+
+inline int madvise(void *addr, const usize length, const int advice)
+{
+	const int ret = ::madvise(addr, length, advice);
+	if (ret == -1)
+		throw common::Error<Error::SyscallMadviseFailed> {impl::last_error()};
+
+	return ret;
+}
+
+inline int pthread_sigmask(const int how, const sigset_t *set, sigset_t *oset = nullptr)
+{
+	// pthread_sigmask returns the error code instead of setting errno.
+	const int ret = ::pthread_sigmask(how, set, oset);
+	if (ret != 0) {
+		throw common::Error<Error::SyscallSigmaskFailed> {
+			std::error_code {ret, std::system_category()}.message(),
+		};
+	}
+
+	return ret;
+}
+
+inline int pthread_setschedparam(const pthread_t thread,
+                                 const int policy,
+                                 const struct sched_param &param)
+{
+	// pthread_setschedparam returns the error code instead of setting errno.
+	const int ret = ::pthread_setschedparam(thread, policy, &param);
+	if (ret != 0) {
+		throw common::Error<Error::SyscallSchedulingFailed> {
+			std::error_code {ret, std::system_category()}.message(),
+		};
+	}
+
+	return ret;
+}
+
+inline int pthread_setaffinity(const pthread_t thread, const int cpu)
+{
+	// CPU_SET does not check its index, so it would write past the end of the set.
+	if (cpu < 0 || cpu >= CPU_SETSIZE) {
+		throw common::Error<Error::SyscallAffinityFailed> {
+			cpu,
+			std::error_code {EINVAL, std::system_category()}.message(),
+		};
+	}
+
+	cpu_set_t set {};
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	// pthread_setaffinity_np returns the error code instead of setting errno.
+	const int ret = ::pthread_setaffinity_np(thread, sizeof(set), &set);
+	if (ret != 0) {
+		throw common::Error<Error::SyscallAffinityFailed> {
+			cpu,
+			std::error_code {ret, std::system_category()}.message(),
+		};
+	}
+
+	return ret;
+}
+
+inline int mlockall(const int flags)
+{
+	const int ret = ::mlockall(flags);
+	if (ret == -1)
+		throw common::Error<Error::SyscallMlockFailed> {impl::last_error()};
+
+	return ret;
+}
+
+inline int epoll_create1(const int flags)
+{
+	const int ret = ::epoll_create1(flags);
+	if (ret == -1)
+		throw common::Error<Error::SyscallEpollFailed> {impl::last_error()};
+
+	return ret;
+}
+
+inline int epoll_ctl(const int epfd, const int op, const int fd, struct epoll_event *event)
+{
+	const int ret = ::epoll_ctl(epfd, op, fd, event);
+	if (ret == -1)
+		throw common::Error<Error::SyscallEpollFailed> {impl::last_error()};
+
+	return ret;
+}
+
+/*!
+ * Waits for events on an epoll instance.
+ *
+ * Being interrupted by a signal is not an error, so that the caller can check whether
+ * it should stop. epoll_wait is never restarted by SA_RESTART.
+ *
+ * @return The number of events that were stored in the buffer.
+ */
+inline int epoll_wait(const int epfd, gsl::span<struct epoll_event> events, const int timeout)
+{
+	const int ret = ::epoll_wait(epfd, events.data(), gsl::narrow<int>(events.size()), timeout);
+
+	if (ret == -1 && errno == EINTR)
+		return 0;
+
+	if (ret == -1)
+		throw common::Error<Error::SyscallEpollFailed> {impl::last_error()};
+
+	return ret;
+}
+
+inline int inotify_init1(const int flags)
+{
+	const int ret = ::inotify_init1(flags);
+	if (ret == -1)
+		throw common::Error<Error::SyscallInotifyFailed> {impl::last_error()};
+
+	return ret;
+}
+
+inline int inotify_add_watch(const int fd, const std::filesystem::path &path, const u32 mask)
+{
+	const int ret = ::inotify_add_watch(fd, path.c_str(), mask);
+	if (ret == -1)
+		throw common::Error<Error::SyscallInotifyFailed> {impl::last_error()};
+
+	return ret;
+}
+
+/*!
+ * Waits for events on file descriptors.
+ *
+ * Being interrupted by a signal is not an error, so that the caller can check whether
+ * it should stop.
+ *
+ * @return The number of file descriptors that have events.
+ */
+inline int poll(gsl::span<struct pollfd> fds, const int timeout)
+{
+	const int ret = ::poll(fds.data(), fds.size(), timeout);
+
+	if (ret == -1 && errno == EINTR)
+		return 0;
+
+	if (ret == -1)
+		throw common::Error<Error::SyscallPollFailed> {impl::last_error()};
+
+	return ret;
+}
+
+inline int io_uring_setup(const u32 entries, struct io_uring_params &params)
+{
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+	const long ret = ::syscall(__NR_io_uring_setup, entries, &params);
+	if (ret == -1)
+		throw common::Error<Error::SyscallIoUringFailed> {impl::last_error()};
+
+	return gsl::narrow<int>(ret);
+}
+
+/*!
+ * Submits requests to an io_uring and optionally waits for them to complete.
+ *
+ * Being interrupted by a signal is not an error, so that the caller can check whether
+ * it should stop.
+ *
+ * @return The number of requests that were submitted.
+ */
+inline int io_uring_enter(const int fd, const u32 submit, const u32 wait, const u32 flags)
+{
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+	const long ret = ::syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0);
+
+	if (ret == -1 && errno == EINTR)
+		return 0;
+
+	if (ret == -1)
+		throw common::Error<Error::SyscallIoUringFailed> {impl::last_error()};
+
+	return gsl::narrow<int>(ret);
+}
+
+inline int io_uring_register(const int fd, const u32 opcode, const void *arg, const u32 count)
+{
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+	const long ret = ::syscall(__NR_io_uring_register, fd, opcode, arg, count);
+	if (ret == -1)
+		throw common::Error<Error::SyscallIoUringFailed> {impl::last_error()};
+
+	return gsl::narrow<int>(ret);
+}
+
+inline int perf_event_open(struct perf_event_attr &attr,
+                           const pid_t pid,
+                           const int cpu,
+                           const int group,
+                           const unsigned long flags)
+{
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+	const long ret = ::syscall(__NR_perf_event_open, &attr, pid, cpu, group, flags);
+	if (ret == -1)
+		throw common::Error<Error::SyscallPerfEventFailed> {impl::last_error()};
+
+	return gsl::narrow<int>(ret);
+}
+
+inline int getrusage(const int who, struct rusage &usage)
+{
+	const int ret = ::getrusage(who, &usage);
+	if (ret == -1)
+		throw common::Error<Error::SyscallGetrusageFailed> {impl::last_error()};
+
+	return ret;
+}
+
 } // namespace iptsd::core::linux::syscalls
 
 #endif // IPTSD_CORE_LINUX_SYSCALLS_HPP
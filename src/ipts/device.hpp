@@ -7,6 +7,7 @@
 #include "descriptor.hpp"
 #include "parser.hpp"
 
+#include <common/casts.hpp>
 #include <common/error.hpp>
 #include <common/types.hpp>
 #include <hid/device.hpp>
@@ -15,6 +16,7 @@
 #include <gsl/gsl>
 
 #include <algorithm>
+#include <array>
 #include <functional>
 #include <memory>
 #include <optional>
@@ -47,6 +49,23 @@ enum class Mode : u8 {
 	Multitouch = 1,
 };
 
+enum class ReportKind : u8 {
+	Unknown,
+	TouchData,
+	Modesetting,
+	Metadata,
+};
+
+/*
+ * What the device sends or expects for one report ID.
+ */
+struct Route {
+	ReportKind kind = ReportKind::Unknown;
+
+	// The size of the report in bytes, excluding the report ID.
+	usize size = 0;
+};
+
 class Device {
 public:
 	using Error = impl::DeviceError;
@@ -61,19 +80,40 @@ private:
 	// All reports of the HID descriptor that contain touch data
 	std::vector<hid::Report> m_touch_data_reports;
 
+	// The feature reports for switching modes and fetching metadata, if they exist.
+	std::optional<hid::Report> m_modesetting_report;
+	std::optional<hid::Report> m_metadata_report;
+
+	// The kind and size of every report ID, so that buffers can be classified in O(1).
+	std::array<Route, 256> m_routes {};
+
 public:
 	Device(std::shared_ptr<hid::Device> hid)
 		: m_hid {std::move(hid)},
 		  m_descriptor {m_hid->descriptor()},
-		  m_touch_data_reports {m_descriptor.find_touch_data_reports()}
+		  m_touch_data_reports {m_descriptor.find_touch_data_reports()},
+		  m_modesetting_report {m_descriptor.find_modesetting_report()},
+		  m_metadata_report {m_descriptor.find_metadata_report()}
 	{
 		// Check if the device can switch modes
-		if (!m_descriptor.find_modesetting_report().has_value())
+		if (!m_modesetting_report.has_value())
 			throw common::Error<Error::InvalidDevice> {m_hid->name()};
 
 		// Check if the device can send touch data.
-		if (m_descriptor.find_touch_data_reports().empty())
+		if (m_touch_data_reports.empty())
 			throw common::Error<Error::InvalidDevice> {m_hid->name()};
+
+		this->add_route(m_modesetting_report.value(), ReportKind::Modesetting);
+
+		if (m_metadata_report.has_value())
+			this->add_route(m_metadata_report.value(), ReportKind::Metadata);
+
+		/*
+		 * Buffers that are read from the device are always input reports, so touch data
+		 * takes precedence if a feature report happens to use the same ID.
+		 */
+		for (const hid::Report &report : m_touch_data_reports)
+			this->add_route(report, ReportKind::TouchData);
 	};
 
 	/*!
@@ -91,12 +131,25 @@ public:
 	 */
 	[[nodiscard]] usize buffer_size() const
 	{
-		u64 size = 0;
+		usize size = 0;
 
-		for (const hid::Report &report : m_touch_data_reports)
-			size = std::max(size, report.size());
+		for (const Route &route : m_routes) {
+			if (route.kind == ReportKind::TouchData)
+				size = std::max(size, route.size);
+		}
+
+		return size;
+	}
 
-		return casts::to<usize>(size / 8);
+	/*!
+	 * Looks up what the device sends or expects for a report ID.
+	 *
+	 * @param[in] id The ID of the report.
+	 * @return The kind and size of the report.
+	 */
+	[[nodiscard]] const Route &route(const u8 id) const
+	{
+		return m_routes[id];
 	}
 
 	/*!
@@ -108,15 +161,14 @@ public:
 	{
 		std::optional<Metadata> metadata = std::nullopt;
 
-		const std::optional<hid::Report> report = m_descriptor.find_metadata_report();
-		if (!report.has_value())
+		if (!m_metadata_report.has_value())
 			return std::nullopt;
 
-		const std::optional<u8> id = report->id();
+		const std::optional<u8> id = m_metadata_report->id();
 		if (!id.has_value())
 			return std::nullopt;
 
-		std::vector<u8> buffer((report->size() / 8) + 1);
+		std::vector<u8> buffer((m_metadata_report->size() / 8) + 1);
 		buffer[0] = id.value();
 
 		m_hid->get_feature(buffer);
@@ -137,11 +189,10 @@ public:
 	 */
 	void set_mode(const Mode mode) const
 	{
-		const std::optional<hid::Report> report = m_descriptor.find_modesetting_report();
-		if (!report.has_value())
+		if (!m_modesetting_report.has_value())
 			throw common::Error<Error::InvalidDevice> {m_hid->name()};
 
-		const std::optional<u8> id = report->id();
+		const std::optional<u8> id = m_modesetting_report->id();
 		if (!id.has_value())
 			throw common::Error<Error::InvalidSetModeReport> {m_hid->name()};
 
@@ -160,10 +211,27 @@ public:
 		if (buffer.empty())
 			return false;
 
-		return std::any_of(
-			m_touch_data_reports.cbegin(),
-			m_touch_data_reports.cend(),
-			[&](const hid::Report &report) { return report.id() == buffer[0]; });
+		return m_routes[buffer[0]].kind == ReportKind::TouchData;
+	}
+
+private:
+	/*!
+	 * Adds a report from the HID descriptor to the routing table.
+	 *
+	 * Reports without an ID can't be told apart from each other, so they are not added.
+	 *
+	 * @param[in] report The report to add.
+	 * @param[in] kind What the report is used for.
+	 */
+	void add_route(const hid::Report &report, const ReportKind kind)
+	{
+		const std::optional<u8> id = report.id();
+		if (!id.has_value())
+			return;
+
+		Route &route = m_routes[id.value()];
+		route.kind = kind;
+		route.size = casts::to<usize>(report.size() / 8);
 	}
 };
 
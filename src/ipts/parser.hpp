@@ -18,29 +18,62 @@
 
 #include <gsl/gsl>
 
+#include <algorithm>
+#include <array>
 #include <functional>
 #include <optional>
+#include <type_traits>
+#include <vector>
 
 namespace iptsd::ipts {
 
-class Parser {
-public:
-	// The callback that is invoked when stylus data was parsed.
-	std::function<void(const StylusData &)> on_stylus;
+/*
+ * Why a part of the data was skipped by the parser.
+ */
+enum class ParseError : u8 {
+	// Nothing was skipped.
+	None,
 
-	// The callback that is invoked when a capacitive heatmap was parsed.
-	std::function<void(const Heatmap &)> on_heatmap;
+	// A frame claims to be larger than the data that contains it.
+	Truncated,
 
-	// The callback that is invoked when a DFT window was parsed.
-	std::function<void(const DftWindow &)> on_dft;
+	// A HID or legacy frame has a type that is not known.
+	UnknownFrame,
 
-	// The callback that is invoked when a metadata report was parsed.
-	std::function<void(const Metadata &)> on_metadata;
+	// A report frame has a type that is not processed.
+	UnknownReport,
+};
 
+/*
+ * Parses IPTS touch data and passes the results to a sink.
+ *
+ * The sink is the class deriving from this one (CRTP). For every type of data it wants to
+ * receive (@ref StylusData or a batch of them, @ref Heatmap, @ref DftWindow and
+ * @ref Metadata), it provides an overload of operator(). Because the sink is known at
+ * compile time, these calls can be inlined, and data that the sink doesn't handle is never
+ * assembled.
+ *
+ * Malformed data never throws. Frames that can't be parsed are skipped and counted, and the
+ * rest of the data is still parsed, as long as the boundaries of the following frames are
+ * known. This keeps devices that regularly send odd reports from slowing down processing.
+ *
+ * @tparam Derived The class that receives the parsed data.
+ */
+template <class Derived>
+class BasicParser {
 private:
 	protocol::heatmap::Dimensions m_dim {};
 	protocol::dft::Metadata m_dft_meta {};
 
+	// Storage for all samples of a stylus report.
+	std::vector<StylusData> m_stylus {};
+
+	// How many frames were skipped for every reason.
+	std::array<usize, 4> m_skipped {};
+
+	// The first reason why something was skipped while parsing the current data.
+	ParseError m_error = ParseError::None;
+
 public:
 	/*!
 	 * Parses IPTS touch data from a HID report buffer.
@@ -48,10 +81,11 @@ public:
 	 * The data must have a three byte header, consisting of the report ID and a timestamp.
 	 *
 	 * @param[in] data The data to parse.
+	 * @return The first reason why a part of the data was skipped, if any.
 	 */
-	void parse(const gsl::span<u8> data)
+	ParseError parse(const gsl::span<u8> data)
 	{
-		this->parse<protocol::hid::ReportHeader>(data);
+		return this->parse<protocol::hid::ReportHeader>(data);
 	}
 
 	/*!
@@ -59,20 +93,65 @@ public:
 	 *
 	 * @tparam T The type (and size) of the header.
 	 * @param[in] data The data to parse.
+	 * @return The first reason why a part of the data was skipped, if any.
 	 */
 	template <class T>
-	void parse(const gsl::span<u8> data)
+	ParseError parse(const gsl::span<u8> data)
+	{
+		return this->parse_with_header(data, sizeof(T));
+	}
+
+	/*!
+	 * How many frames were skipped for a reason, since the parser was created.
+	 *
+	 * @param[in] error The reason.
+	 */
+	[[nodiscard]] usize skipped(const ParseError error) const
+	{
+		return m_skipped.at(static_cast<usize>(error));
+	}
+
+	/*!
+	 * Whether all samples of a stylus report are passed to a sink that accepts a batch.
+	 *
+	 * Sinks can hide this function to decide at runtime. If it returns false, only the last
+	 * sample of a report is converted, and passed to the sink as a batch of one sample.
+	 */
+	[[nodiscard]] bool wants_stylus_batch() const
 	{
-		this->parse_with_header(data, sizeof(T));
+		return true;
 	}
 
 private:
-	void parse_with_header(const gsl::span<u8> data, const usize header)
+	ParseError parse_with_header(const gsl::span<u8> data, const usize header)
 	{
 		Reader reader(data);
-		reader.skip(header);
+		m_error = ParseError::None;
+
+		if (reader.fits(header)) {
+			reader.skip_unchecked(header);
+			this->parse_hid_frame(reader);
+		} else {
+			this->skip(ParseError::Truncated);
+		}
 
-		this->parse_hid_frame(reader);
+		return m_error;
+	}
+
+	/*!
+	 * Counts a frame that was skipped.
+	 *
+	 * @param[in] error Why the frame was skipped.
+	 * @return False, for returning from a parsing function whose frame was cut off.
+	 */
+	bool skip(const ParseError error)
+	{
+		m_skipped.at(static_cast<usize>(error))++;
+
+		if (m_error == ParseError::None)
+			m_error = error;
+
+		return false;
 	}
 
 	/*!
@@ -82,11 +161,19 @@ private:
 	 * For more information, see @ref protocol::hid::Frame
 	 *
 	 * @param[in] reader The chunk of data allocated to the HID frame.
+	 * @return Whether the end of the frame is known, so that parsing can continue after it.
 	 */
-	void parse_hid_frame(Reader &reader)
+	bool parse_hid_frame(Reader &reader)
 	{
-		const auto frame = reader.read<protocol::hid::Frame>();
-		Reader sub = reader.sub(frame.size - sizeof(frame));
+		if (!reader.fits(sizeof(protocol::hid::Frame)))
+			return this->skip(ParseError::Truncated);
+
+		const auto frame = reader.read_unchecked<protocol::hid::Frame>();
+
+		if (frame.size < sizeof(frame) || !reader.fits(frame.size - sizeof(frame)))
+			return this->skip(ParseError::Truncated);
+
+		Reader sub = reader.sub_unchecked(frame.size - sizeof(frame));
 
 		switch (frame.type) {
 		case protocol::hid::FrameType::Hid:
@@ -111,14 +198,17 @@ private:
 			 * So let's just ignore these packets.
 			 */
 			if (reader.size() == 4)
-				return;
+				return true;
 
 			this->parse_report_frames(sub);
 			break;
 		default:
 			// TODO: Add handler for unknown data and wire up debug tools
+			this->skip(ParseError::UnknownFrame);
 			break;
 		}
+
+		return true;
 	}
 
 	/*!
@@ -128,8 +218,10 @@ private:
 	 */
 	void parse_hid_frames(Reader &reader)
 	{
-		while (reader.size() > 0)
-			this->parse_hid_frame(reader);
+		while (reader.size() > 0) {
+			if (!this->parse_hid_frame(reader))
+				break;
+		}
 	}
 
 	/*!
@@ -142,11 +234,27 @@ private:
 	 */
 	void parse_legacy_frame(Reader &reader)
 	{
-		const auto header = reader.read<protocol::legacy::Header>();
+		if (!reader.fits(sizeof(protocol::legacy::Header))) {
+			this->skip(ParseError::Truncated);
+			return;
+		}
+
+		const auto header = reader.read_unchecked<protocol::legacy::Header>();
 
 		for (u32 i = 0; i < header.elements; i++) {
-			const auto group = reader.read<protocol::legacy::ReportGroup>();
-			Reader sub = reader.sub(group.size);
+			if (!reader.fits(sizeof(protocol::legacy::ReportGroup))) {
+				this->skip(ParseError::Truncated);
+				return;
+			}
+
+			const auto group = reader.read_unchecked<protocol::legacy::ReportGroup>();
+
+			if (!reader.fits(group.size)) {
+				this->skip(ParseError::Truncated);
+				return;
+			}
+
+			Reader sub = reader.sub_unchecked(group.size);
 
 			switch (group.type) {
 			case protocol::legacy::GroupType::Stylus:
@@ -155,6 +263,7 @@ private:
 				break;
 			default:
 				// TODO: Add handler for unknown data and wire up debug tools
+				this->skip(ParseError::UnknownFrame);
 				break;
 			}
 		}
@@ -164,21 +273,28 @@ private:
 	 * Parses an IPTS metadata frame.
 	 *
 	 * Metadata frames are returned by a HID feature report on devices that natively support
-	 * HID. Once the data is parsed, the @ref on_metadata callback will be invoked.
+	 * HID. Once the data is parsed, it will be passed to the sink.
 	 *
 	 * @param[in] reader The chunk of data allocated to the metadata frame.
 	 */
-	void parse_metadata_frame(Reader &reader) const
+	void parse_metadata_frame(Reader &reader)
 	{
 		Metadata m {};
 
-		m.dimensions = reader.read<protocol::metadata::Dimensions>();
-		m.unknown_byte = reader.read<u8>();
-		m.transform = reader.read<protocol::metadata::Transform>();
-		m.unknown = reader.read<protocol::metadata::Unknown>();
+		const usize size = sizeof(m.dimensions) + sizeof(m.unknown_byte) +
+		                   sizeof(m.transform) + sizeof(m.unknown);
 
-		if (this->on_metadata)
-			this->on_metadata(m);
+		if (!reader.fits(size)) {
+			this->skip(ParseError::Truncated);
+			return;
+		}
+
+		m.dimensions = reader.read_unchecked<protocol::metadata::Dimensions>();
+		m.unknown_byte = reader.read_unchecked<u8>();
+		m.transform = reader.read_unchecked<protocol::metadata::Transform>();
+		m.unknown = reader.read_unchecked<protocol::metadata::Unknown>();
+
+		this->emit(m);
 	}
 
 	/*!
@@ -188,11 +304,19 @@ private:
 	 * data from the touchscreen, such as stylus coordinates or capacitive heatmaps.
 	 *
 	 * @param[in] reader The chunk of data allocated to the report frame.
+	 * @return Whether the end of the frame is known, so that parsing can continue after it.
 	 */
-	void parse_report_frame(Reader &reader)
+	bool parse_report_frame(Reader &reader)
 	{
-		const auto frame = reader.read<protocol::report::Frame>();
-		Reader sub = reader.sub(frame.size);
+		if (!reader.fits(sizeof(protocol::report::Frame)))
+			return this->skip(ParseError::Truncated);
+
+		const auto frame = reader.read_unchecked<protocol::report::Frame>();
+
+		if (!reader.fits(frame.size))
+			return this->skip(ParseError::Truncated);
+
+		Reader sub = reader.sub_unchecked(frame.size);
 
 		switch (frame.type) {
 		case protocol::report::Type::StylusMPP_1_0:
@@ -215,8 +339,11 @@ private:
 			break;
 		default:
 			// TODO: Add handler for unknown data and wire up debug tools
+			this->skip(ParseError::UnknownReport);
 			break;
 		}
+
+		return true;
 	}
 
 	/*!
@@ -226,8 +353,10 @@ private:
 	 */
 	void parse_report_frames(Reader &reader)
 	{
-		while (reader.size() > 0)
-			this->parse_report_frame(reader);
+		while (reader.size() > 0) {
+			if (!this->parse_report_frame(reader))
+				break;
+		}
 	}
 
 	/*!
@@ -235,24 +364,89 @@ private:
 	 *
 	 * These support 1024 levels of pressure, and have no tilt information.
 	 *
+	 * @param[in] reader The chunk of data allocated to the report frame.
+	 */
+	void parse_stylus_mpp_1_0(Reader &reader)
+	{
+		this->parse_stylus<protocol::stylus::SampleMPP_1_0>(reader);
+	}
+
+	/*!
+	 * Parses an MPP (Microsoft Pen Protocol) 1.51 stylus report.
+	 *
+	 * These support 4096 levels of pressure, and have tilt information.
+	 *
+	 * @param[in] reader The chunk of data allocated to the report frame.
+	 */
+	void parse_stylus_mpp_1_51(Reader &reader)
+	{
+		this->parse_stylus<protocol::stylus::SampleMPP_1_51>(reader);
+	}
+
+	/*!
+	 * Parses the samples of a stylus report.
+	 *
 	 * Stylus reports can contains multiple samples of the stylus state from a 5
-	 * millisecond window. Only the last sample is processed, the others are dropped to
-	 * prevent a jittering output.
+	 * millisecond window. If the sink accepts a batch (a span of @ref StylusData) and
+	 * wants all samples (see @ref wants_stylus_batch), all samples are passed to it.
+	 * Otherwise, only the last sample is converted and processed, and the others are
+	 * dropped to prevent a jittering output.
 	 *
+	 * @tparam S The type of the samples in the report.
 	 * @param[in] reader The chunk of data allocated to the report frame.
 	 */
-	void parse_stylus_mpp_1_0(Reader &reader) const
+	template <class S>
+	void parse_stylus(Reader &reader)
 	{
-		const auto report = reader.read<protocol::stylus::Report>();
+		if (!reader.fits(sizeof(protocol::stylus::Report))) {
+			this->skip(ParseError::Truncated);
+			return;
+		}
 
-		for (u8 i = 0; i < report.samples - 1; i++)
-			reader.skip(sizeof(protocol::stylus::SampleMPP_1_0));
+		const auto report = reader.read_unchecked<protocol::stylus::Report>();
 
-		const auto sample = reader.read<protocol::stylus::SampleMPP_1_0>();
+		// Check the bounds for all samples at once.
+		const usize samples = std::max<usize>(report.samples, 1);
 
-		if (!this->on_stylus)
+		if (!reader.fits(samples * sizeof(S))) {
+			this->skip(ParseError::Truncated);
 			return;
+		}
+
+		if constexpr (handles<gsl::span<const StylusData>>) {
+			const Derived &sink = static_cast<const Derived &>(*this);
+
+			if (sink.wants_stylus_batch()) {
+				m_stylus.resize(samples);
+
+				for (StylusData &data : m_stylus)
+					data = convert_sample(report, reader.read_unchecked<S>());
+
+				this->emit(gsl::span<const StylusData> {m_stylus});
+			} else {
+				reader.skip_unchecked((samples - 1) * sizeof(S));
+
+				const auto sample = reader.read_unchecked<S>();
+				const StylusData data = convert_sample(report, sample);
+
+				this->emit(gsl::span<const StylusData> {&data, 1});
+			}
+		} else if constexpr (handles<StylusData>) {
+			reader.skip_unchecked((samples - 1) * sizeof(S));
+			this->emit(convert_sample(report, reader.read_unchecked<S>()));
+		}
+	}
 
+	/*!
+	 * Converts a MPP 1.0 stylus sample.
+	 *
+	 * @param[in] report The report the sample belongs to.
+	 * @param[in] sample The sample to convert.
+	 * @return The normalized state of the stylus.
+	 */
+	static StylusData convert_sample(const protocol::stylus::Report &report,
+	                                 const protocol::stylus::SampleMPP_1_0 &sample)
+	{
 		StylusData data {};
 		data.serial = report.serial;
 
@@ -275,32 +469,19 @@ private:
 		data.azimuth = 0;
 		data.timestamp = 0;
 
-		this->on_stylus(data);
+		return data;
 	}
 
 	/*!
-	 * Parses an MPP (Microsoft Pen Protocol) 1.51 stylus report.
-	 *
-	 * These support 4096 levels of pressure, and have tilt information.
+	 * Converts a MPP 1.51 stylus sample.
 	 *
-	 * Stylus reports can contains multiple samples of the stylus state from a 5
-	 * millisecond window. Only the last sample is processed, the others are dropped to
-	 * prevent a jittering output.
-	 *
-	 * @param[in] reader The chunk of data allocated to the report frame.
+	 * @param[in] report The report the sample belongs to.
+	 * @param[in] sample The sample to convert.
+	 * @return The normalized state of the stylus.
 	 */
-	void parse_stylus_mpp_1_51(Reader &reader) const
+	static StylusData convert_sample(const protocol::stylus::Report &report,
+	                                 const protocol::stylus::SampleMPP_1_51 &sample)
 	{
-		const auto report = reader.read<protocol::stylus::Report>();
-
-		for (u8 i = 0; i < report.samples - 1; i++)
-			reader.skip(sizeof(protocol::stylus::SampleMPP_1_51));
-
-		const auto sample = reader.read<protocol::stylus::SampleMPP_1_51>();
-
-		if (!this->on_stylus)
-			return;
-
 		StylusData data {};
 		data.serial = report.serial;
 		data.timestamp = sample.timestamp;
@@ -326,7 +507,7 @@ private:
 		data.altitude /= 18000.0 / M_PI;
 		data.azimuth /= 18000.0 / M_PI;
 
-		this->on_stylus(data);
+		return data;
 	}
 
 	/*!
@@ -342,7 +523,12 @@ private:
 	 */
 	void parse_heatmap_dimensions(Reader &reader)
 	{
-		m_dim = reader.read<protocol::heatmap::Dimensions>();
+		if (!reader.fits(sizeof(protocol::heatmap::Dimensions))) {
+			this->skip(ParseError::Truncated);
+			return;
+		}
+
+		m_dim = reader.read_unchecked<protocol::heatmap::Dimensions>();
 
 		// On newer devices, z_max may be 0, lets use a sane value instead.
 		if (m_dim.z_max == 0)
@@ -358,7 +544,7 @@ private:
 	 *
 	 * @param[in] reader The chunk of data allocated to the report.
 	 */
-	void parse_heatmap_data(Reader &reader) const
+	void parse_heatmap_data(Reader &reader)
 	{
 		Heatmap heatmap {};
 
@@ -367,10 +553,16 @@ private:
 		heatmap.min = m_dim.z_min;
 		heatmap.max = m_dim.z_max;
 
-		heatmap.data = reader.subspan<u8>(casts::to<usize>(m_dim.rows) * m_dim.columns);
+		const usize size = casts::to<usize>(m_dim.rows) * m_dim.columns;
 
-		if (this->on_heatmap)
-			this->on_heatmap(heatmap);
+		if (!reader.fits(size)) {
+			this->skip(ParseError::Truncated);
+			return;
+		}
+
+		heatmap.data = reader.subspan_unchecked<u8>(size);
+
+		this->emit(heatmap);
 	}
 
 	/*!
@@ -381,10 +573,21 @@ private:
 	 *
 	 * @param[in] reader The chunk of data allocated to the frame.
 	 */
-	void parse_heatmap_frame(Reader &reader) const
+	void parse_heatmap_frame(Reader &reader)
 	{
-		const auto header = reader.read<protocol::heatmap::Frame>();
-		Reader sub = reader.sub(header.size);
+		if (!reader.fits(sizeof(protocol::heatmap::Frame))) {
+			this->skip(ParseError::Truncated);
+			return;
+		}
+
+		const auto header = reader.read_unchecked<protocol::heatmap::Frame>();
+
+		if (!reader.fits(header.size)) {
+			this->skip(ParseError::Truncated);
+			return;
+		}
+
+		Reader sub = reader.sub_unchecked(header.size);
 
 		this->parse_heatmap_data(sub);
 	}
@@ -399,13 +602,24 @@ private:
 	 *
 	 * @param[in] reader The chunk of data allocated to the report.
 	 */
-	void parse_dft_window(Reader &reader) const
+	void parse_dft_window(Reader &reader)
 	{
 		DftWindow dft {};
-		const auto window = reader.read<protocol::dft::Window>();
 
-		dft.x = reader.subspan<protocol::dft::Row>(window.num_rows);
-		dft.y = reader.subspan<protocol::dft::Row>(window.num_rows);
+		if (!reader.fits(sizeof(protocol::dft::Window))) {
+			this->skip(ParseError::Truncated);
+			return;
+		}
+
+		const auto window = reader.read_unchecked<protocol::dft::Window>();
+
+		if (!reader.fits(2 * sizeof(protocol::dft::Row) * window.num_rows)) {
+			this->skip(ParseError::Truncated);
+			return;
+		}
+
+		dft.x = reader.subspan_unchecked<protocol::dft::Row>(window.num_rows);
+		dft.y = reader.subspan_unchecked<protocol::dft::Row>(window.num_rows);
 
 		dft.type = window.data_type;
 		dft.width = m_dim.columns;
@@ -416,8 +630,7 @@ private:
 			dft.group = casts::unpack(m_dft_meta.group_counter);
 		}
 
-		if (this->on_dft)
-			this->on_dft(dft);
+		this->emit(dft);
 	}
 
 	/*!
@@ -429,7 +642,94 @@ private:
 	 */
 	void parse_dft_metadata(Reader &reader)
 	{
-		m_dft_meta = reader.read<protocol::dft::Metadata>();
+		if (!reader.fits(sizeof(protocol::dft::Metadata))) {
+			this->skip(ParseError::Truncated);
+			return;
+		}
+
+		m_dft_meta = reader.read_unchecked<protocol::dft::Metadata>();
+	}
+
+	/*!
+	 * Whether the sink has a handler for a type of data.
+	 *
+	 * @tparam T The type of the data.
+	 */
+	template <class T>
+	static constexpr bool handles = std::is_invocable_v<Derived &, const T &>;
+
+	/*!
+	 * Passes parsed data to the sink, if it has a handler for it.
+	 *
+	 * @param[in] data The parsed data.
+	 */
+	template <class T>
+	void emit(const T &data)
+	{
+		if constexpr (handles<T>)
+			static_cast<Derived &>(*this)(data);
+	}
+};
+
+/*
+ * Parses IPTS touch data and passes the results to callbacks that can be set at runtime.
+ *
+ * This is more flexible, but slower than implementing a sink for @ref BasicParser.
+ */
+class Parser : public BasicParser<Parser> {
+public:
+	// The callback that is invoked when stylus data was parsed.
+	std::function<void(const StylusData &)> on_stylus;
+
+	// The callback that is invoked with all samples of a stylus report, if set.
+	// Otherwise, only the last sample is passed to @ref on_stylus.
+	std::function<void(gsl::span<const StylusData>)> on_stylus_batch;
+
+	// The callback that is invoked when a capacitive heatmap was parsed.
+	std::function<void(const Heatmap &)> on_heatmap;
+
+	// The callback that is invoked when a DFT window was parsed.
+	std::function<void(const DftWindow &)> on_dft;
+
+	// The callback that is invoked when a metadata report was parsed.
+	std::function<void(const Metadata &)> on_metadata;
+
+public:
+	[[nodiscard]] bool wants_stylus_batch() const
+	{
+		return static_cast<bool>(this->on_stylus_batch);
+	}
+
+	void operator()(const StylusData &data) const
+	{
+		if (this->on_stylus)
+			this->on_stylus(data);
+	}
+
+	void operator()(const gsl::span<const StylusData> batch) const
+	{
+		if (this->on_stylus_batch)
+			this->on_stylus_batch(batch);
+		else if (this->on_stylus && !batch.empty())
+			this->on_stylus(batch.back());
+	}
+
+	void operator()(const Heatmap &data) const
+	{
+		if (this->on_heatmap)
+			this->on_heatmap(data);
+	}
+
+	void operator()(const DftWindow &data) const
+	{
+		if (this->on_dft)
+			this->on_dft(data);
+	}
+
+	void operator()(const Metadata &data) const
+	{
+		if (this->on_metadata)
+			this->on_metadata(data);
 	}
 };
 
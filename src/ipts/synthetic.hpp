@@ -0,0 +1,320 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_IPTS_SYNTHETIC_HPP
+#define IPTSD_IPTS_SYNTHETIC_HPP
+
+#include "data.hpp"
+#include "protocol/heatmap.hpp"
+#include "protocol/hid.hpp"
+#include "protocol/report.hpp"
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace iptsd::ipts::synthetic {
+
+/*
+ * Describes the heatmaps that are generated.
+ *
+ * All intensities use the scale of the raw heatmap (0 - 255), where higher values mean a
+ * stronger signal, so they can be compared directly with the contact detection thresholds.
+ */
+struct Config {
+	// The size of the heatmap.
+	u8 rows = 46;
+	u8 columns = 68;
+
+	// How many fingers and palms are touching the screen.
+	usize contacts = 5;
+	usize palms = 0;
+
+	// The standard deviation of the noise that is added to every pixel.
+	f64 noise = 1;
+
+	// The signal of the background, and how far it drifts up and down.
+	f64 baseline = 8;
+	f64 drift = 0;
+
+	// How many frames it takes the background to drift up, down and back.
+	usize drift_period = 600;
+
+	// How many pixels fingers move per frame. Palms move at a quarter of this speed.
+	f64 speed = 0.5;
+
+	// The standard deviation (Unit: pixels) and the peak signal of a finger.
+	f64 contact_size = 1.2;
+	f64 contact_strength = 60;
+
+	// The standard deviation (Unit: pixels) and the peak signal of a palm.
+	f64 palm_size = 4;
+	f64 palm_strength = 120;
+
+	// The seed of the random number generator. The same config always creates the same data.
+	u32 seed = 0;
+};
+
+/*
+ * Generates heatmaps with moving fingers and palms, and encodes them like IPTS devices do.
+ */
+class Generator {
+private:
+	/*
+	 * A gaussian shaped touch that moves over the screen.
+	 */
+	struct Blob {
+		// The center of the touch, in pixels.
+		Vector2<f64> position;
+
+		// How many pixels the touch moves every frame.
+		Vector2<f64> velocity;
+
+		// The standard deviation of the touch on both axes, in pixels.
+		Vector2<f64> sigma;
+
+		// The signal at the center of the touch.
+		f64 strength;
+	};
+
+	Config m_config;
+
+	std::mt19937 m_rng;
+	std::normal_distribution<f64> m_noise;
+
+	std::vector<Blob> m_blobs {};
+
+	// The signal of every pixel, before it is converted to the IPTS format.
+	std::vector<f64> m_signal {};
+
+	// The bytes of the most recent heatmap.
+	std::vector<u8> m_data {};
+
+	// How many heatmaps were generated.
+	usize m_frame = 0;
+
+public:
+	explicit Generator(const Config &config)
+		: m_config {config},
+		  m_rng {config.seed},
+		  m_noise {0, std::max(config.noise, 0.0)}
+	{
+		const usize size = casts::to<usize>(config.rows) * config.columns;
+
+		m_signal.resize(size);
+		m_data.resize(size);
+
+		for (usize i = 0; i < config.contacts; i++) {
+			const Vector2<f64> sigma {config.contact_size, config.contact_size};
+			this->spawn(sigma, config.contact_strength, config.speed);
+		}
+
+		// Palms are not round, and much slower than fingers.
+		for (usize i = 0; i < config.palms; i++) {
+			const Vector2<f64> sigma {config.palm_size, config.palm_size * 0.7};
+			this->spawn(sigma, config.palm_strength, config.speed / 4);
+		}
+	}
+
+	/*!
+	 * Moves all touches and generates the next heatmap.
+	 *
+	 * Like on IPTS devices, a value of 255 means no signal, and 0 is the strongest signal.
+	 *
+	 * @return The heatmap. It stays valid until the next call.
+	 */
+	Heatmap next()
+	{
+		const usize period = std::max(m_config.drift_period, usize {1});
+		const f64 phase = casts::to<f64>(m_frame % period) / casts::to<f64>(period);
+
+		const f64 baseline =
+			m_config.baseline + m_config.drift * std::sin(2 * M_PI * phase);
+
+		std::fill(m_signal.begin(), m_signal.end(), baseline);
+
+		for (Blob &blob : m_blobs) {
+			this->render(blob);
+			this->move(blob);
+		}
+
+		for (usize i = 0; i < m_signal.size(); i++) {
+			f64 value = m_signal[i];
+
+			if (m_config.noise > 0)
+				value += m_noise(m_rng);
+
+			value = std::clamp(std::round(value), 0.0, 255.0);
+			m_data[i] = gsl::narrow_cast<u8>(255 - gsl::narrow_cast<i32>(value));
+		}
+
+		m_frame++;
+
+		Heatmap heatmap {};
+		heatmap.rows = m_config.rows;
+		heatmap.columns = m_config.columns;
+		heatmap.min = 0;
+		heatmap.max = 255;
+		heatmap.data = m_data;
+
+		return heatmap;
+	}
+
+	/*!
+	 * Encodes the most recent heatmap in the format that IPTS devices send over HID.
+	 *
+	 * The data consists of a HID report header and a HID frame containing two report frames,
+	 * one with the dimensions of the heatmap, and one with the heatmap data.
+	 *
+	 * @param[out] buffer The encoded data. Its previous contents are discarded.
+	 */
+	void encode(std::vector<u8> &buffer) const
+	{
+		const usize size = m_data.size();
+
+		buffer.clear();
+
+		protocol::hid::ReportHeader header {};
+		header.timestamp = gsl::narrow_cast<u16>(m_frame);
+
+		protocol::hid::Frame frame {};
+		frame.type = protocol::hid::FrameType::Reports;
+		frame.size = casts::to<u32>(sizeof(protocol::hid::Frame) +
+		                            (2 * sizeof(protocol::report::Frame)) +
+		                            sizeof(protocol::heatmap::Dimensions) + size);
+
+		protocol::report::Frame dim_report {};
+		dim_report.type = protocol::report::Type::HeatmapDimensions;
+		dim_report.size = sizeof(protocol::heatmap::Dimensions);
+
+		protocol::heatmap::Dimensions dim {};
+		dim.rows = m_config.rows;
+		dim.columns = m_config.columns;
+		dim.y_max = gsl::narrow_cast<u8>(m_config.rows - 1);
+		dim.x_max = gsl::narrow_cast<u8>(m_config.columns - 1);
+		dim.z_min = 0;
+		dim.z_max = 255;
+
+		protocol::report::Frame data_report {};
+		data_report.type = protocol::report::Type::HeatmapData;
+		data_report.size = casts::to<u16>(size);
+
+		append(buffer, header);
+		append(buffer, frame);
+		append(buffer, dim_report);
+		append(buffer, dim);
+		append(buffer, data_report);
+
+		buffer.insert(buffer.end(), m_data.begin(), m_data.end());
+	}
+
+private:
+	/*!
+	 * Places a new touch at a random position, moving in a random direction.
+	 *
+	 * @param[in] sigma The standard deviation of the touch on both axes.
+	 * @param[in] strength The signal at the center of the touch.
+	 * @param[in] speed How many pixels the touch moves every frame.
+	 */
+	void spawn(const Vector2<f64> &sigma, const f64 strength, const f64 speed)
+	{
+		const f64 width = casts::to<f64>(m_config.columns - 1);
+		const f64 height = casts::to<f64>(m_config.rows - 1);
+
+		std::uniform_real_distribution<f64> xs {0, width};
+		std::uniform_real_distribution<f64> ys {0, height};
+		std::uniform_real_distribution<f64> angles {0, 2 * M_PI};
+
+		const f64 angle = angles(m_rng);
+
+		Blob blob {};
+		blob.position = Vector2<f64> {xs(m_rng), ys(m_rng)};
+		blob.velocity = Vector2<f64> {std::cos(angle), std::sin(angle)} * speed;
+		blob.sigma = sigma;
+		blob.strength = strength;
+
+		m_blobs.push_back(blob);
+	}
+
+	/*!
+	 * Adds the signal of a touch to the heatmap.
+	 *
+	 * Only pixels that are closer than four standard deviations are changed.
+	 *
+	 * @param[in] blob The touch to add.
+	 */
+	void render(const Blob &blob)
+	{
+		const i32 rows = m_config.rows;
+		const i32 cols = m_config.columns;
+
+		const Vector2<f64> min = blob.position - (blob.sigma * 4);
+		const Vector2<f64> max = blob.position + (blob.sigma * 4);
+
+		const i32 x0 = std::max(gsl::narrow_cast<i32>(std::floor(min.x())), 0);
+		const i32 y0 = std::max(gsl::narrow_cast<i32>(std::floor(min.y())), 0);
+		const i32 x1 = std::min(gsl::narrow_cast<i32>(std::ceil(max.x())), cols - 1);
+		const i32 y1 = std::min(gsl::narrow_cast<i32>(std::ceil(max.y())), rows - 1);
+
+		for (i32 y = y0; y <= y1; y++) {
+			for (i32 x = x0; x <= x1; x++) {
+				const Vector2<f64> pixel {casts::to<f64>(x), casts::to<f64>(y)};
+				const Vector2<f64> d = pixel - blob.position;
+				const f64 distance = d.cwiseQuotient(blob.sigma).squaredNorm();
+				const usize index = casts::to_unsigned((y * cols) + x);
+
+				m_signal[index] += blob.strength * std::exp(-distance / 2);
+			}
+		}
+	}
+
+	/*!
+	 * Moves a touch, bouncing it off the edges of the screen.
+	 *
+	 * @param[in,out] blob The touch to move.
+	 */
+	void move(Blob &blob) const
+	{
+		const Vector2<f64> size {
+			casts::to<f64>(m_config.columns - 1),
+			casts::to<f64>(m_config.rows - 1),
+		};
+
+		blob.position += blob.velocity;
+
+		for (Eigen::Index i = 0; i < 2; i++) {
+			if (blob.position[i] < 0) {
+				blob.position[i] = -blob.position[i];
+				blob.velocity[i] = -blob.velocity[i];
+			}
+
+			if (blob.position[i] > size[i]) {
+				blob.position[i] = (2 * size[i]) - blob.position[i];
+				blob.velocity[i] = -blob.velocity[i];
+			}
+		}
+	}
+
+	/*!
+	 * Appends the bytes of a protocol structure to a buffer.
+	 *
+	 * @param[in,out] buffer The buffer to append to.
+	 * @param[in] value The structure to append.
+	 */
+	template <class T>
+	static void append(std::vector<u8> &buffer, const T &value)
+	{
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+		const u8 *bytes = reinterpret_cast<const u8 *>(&value);
+		buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+	}
+};
+
+} // namespace iptsd::ipts::synthetic
+
+#endif // IPTSD_IPTS_SYNTHETIC_HPP
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "iptsd.h"
+
+#include "library.hpp"
+
+#include <common/types.hpp>
+#include <core/generic/config.hpp>
+#include <core/generic/device.hpp>
+#include <core/linux/config-loader.hpp>
+#include <ipts/data.hpp>
+#include <ipts/parser.hpp>
+
+#include <gsl/gsl>
+#include <spdlog/spdlog.h>
+
+#include <exception>
+#include <optional>
+#include <vector>
+
+struct iptsd_context {
+	iptsd::lib::Library library;
+};
+
+namespace iptsd::lib {
+namespace {
+
+/*!
+ * Parses the metadata feature report of a device.
+ *
+ * @param[in] report The feature report, including the report ID. Can be empty.
+ * @return The metadata of the device, or null if the report does not contain any.
+ */
+std::optional<const ipts::Metadata> parse_metadata(const gsl::span<const u8> report)
+{
+	std::optional<ipts::Metadata> metadata = std::nullopt;
+
+	if (report.empty())
+		return std::nullopt;
+
+	// The parser works in place, but the report belongs to the caller.
+	std::vector<u8> buffer {report.begin(), report.end()};
+
+	ipts::Parser parser {};
+	parser.on_metadata = [&](const ipts::Metadata &m) { metadata = m; };
+	parser.parse<u8>(buffer);
+
+	return metadata;
+}
+
+iptsd_context *create(const u16 vendor,
+                      const u16 product,
+                      const gsl::span<const u8> report)
+{
+	core::DeviceInfo info {};
+	info.vendor = vendor;
+	info.product = product;
+
+	const std::optional<const ipts::Metadata> metadata = parse_metadata(report);
+	const core::linux::ConfigLoader loader {info, metadata};
+	const core::Config config = loader.config();
+
+	return new iptsd_context {Library {config, info, metadata}}; // NOLINT
+}
+
+} // namespace
+} // namespace iptsd::lib
+
+iptsd_context *iptsd_context_new(const uint16_t vendor,
+                                 const uint16_t product,
+                                 const uint8_t *metadata,
+                                 const size_t size)
+{
+	try {
+		const gsl::span<const u8> report {metadata, metadata != nullptr ? size : 0};
+		return iptsd::lib::create(vendor, product, report);
+	} catch (const std::exception &e) {
+		spdlog::error(e.what());
+		return nullptr;
+	}
+}
+
+void iptsd_context_free(iptsd_context *context)
+{
+	delete context; // NOLINT
+}
+
+int iptsd_process(iptsd_context *context, uint8_t *data, const size_t size, iptsd_frame *frame)
+{
+	if (context == nullptr || data == nullptr || frame == nullptr)
+		return -1;
+
+	try {
+		context->library.process_into(gsl::span<u8> {data, size}, *frame);
+		return 0;
+	} catch (const std::exception &e) {
+		spdlog::warn(e.what());
+		return -1;
+	}
+}
+
+void iptsd_reset(iptsd_context *context)
+{
+	if (context == nullptr)
+		return;
+
+	try {
+		context->library.reset_finder();
+	} catch (const std::exception &e) {
+		spdlog::warn(e.what());
+	}
+}
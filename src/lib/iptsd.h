@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef IPTSD_LIB_IPTSD_H
+#define IPTSD_LIB_IPTSD_H
+
+/*
+ * The public interface of libiptsd.
+ *
+ * libiptsd runs the same processing as the iptsd daemon, but instead of forwarding the
+ * results to uinput devices, they are written into storage that is owned by the caller.
+ * This allows e.g. a compositor to read the touchscreen directly and skip the round trip
+ * through the kernel and libinput.
+ *
+ * The caller reads the reports from the hidraw device and is responsible for switching the
+ * device into multitouch mode. Every report is passed to @ref iptsd_process, which parses
+ * it in place and returns the contacts and the stylus state of it. No memory is allocated
+ * and no callbacks are invoked while processing a report, once the first heatmap of every
+ * size has been seen.
+ *
+ * A context must only be used by one thread at a time.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IPTSD_EXPORT __attribute__((visibility("default")))
+
+/*
+ * The processing state of one device.
+ */
+struct iptsd_context;
+
+/*
+ * A contact that was found on the touchscreen.
+ */
+struct iptsd_contact {
+	/* The center of the contact, in the range [0, 1]. */
+	double x;
+	double y;
+
+	/* The diameters of the major and minor axis, in the range [0, 1]. */
+	double major;
+	double minor;
+
+	/* The orientation of the major axis, in the range [0, 1). */
+	double orientation;
+
+	/* A temporally stable index of the contact, or -1 if it is not tracked. */
+	int32_t index;
+
+	/* Whether the contact is a finger, and not e.g. a palm. */
+	bool valid;
+
+	/* Whether the contact has not moved more than expected since the last frame. */
+	bool stable;
+};
+
+/*
+ * The state of the stylus.
+ */
+struct iptsd_stylus {
+	bool proximity;
+	bool contact;
+	bool button;
+	bool rubber;
+
+	/* The position of the stylus, in the range [0, 1]. */
+	double x;
+	double y;
+
+	/* The pressure of the tip, in the range [0, 1]. */
+	double pressure;
+
+	/* The tilt of the stylus, in radians. */
+	double altitude;
+	double azimuth;
+
+	uint32_t serial;
+};
+
+/*
+ * The results of processing one report.
+ */
+struct iptsd_frame {
+	/* Storage for the contacts, owned by the caller. */
+	struct iptsd_contact *contacts;
+
+	/* How many contacts fit into the storage. */
+	size_t capacity;
+
+	/* Whether the report contained a heatmap, and the contacts were updated. */
+	bool has_contacts;
+
+	/* How many contacts were written into the storage. */
+	size_t count;
+
+	/* Whether more contacts were found than fit into the storage. */
+	bool truncated;
+
+	/* Whether the report contained stylus data, and the stylus state was updated. */
+	bool has_stylus;
+
+	/* The newest state of the stylus. */
+	struct iptsd_stylus stylus;
+};
+
+/*!
+ * Creates the processing state for a device, using the iptsd configuration files.
+ *
+ * @param[in] vendor The vendor ID of the device.
+ * @param[in] product The product ID of the device.
+ * @param[in] metadata The metadata feature report of the device including the report ID,
+ *                     or NULL if the device doesn't support it.
+ * @param[in] size The size of the metadata feature report.
+ * @return The new context, or NULL if it could not be created.
+ */
+IPTSD_EXPORT struct iptsd_context *iptsd_context_new(uint16_t vendor,
+                                                     uint16_t product,
+                                                     const uint8_t *metadata,
+                                                     size_t size);
+
+/*!
+ * Destroys a context that was created with @ref iptsd_context_new.
+ *
+ * @param[in] context The context to destroy. Can be NULL.
+ */
+IPTSD_EXPORT void iptsd_context_free(struct iptsd_context *context);
+
+/*!
+ * Processes a report that was read from the hidraw device.
+ *
+ * The report is parsed directly from the buffer, which is not accessed anymore once the
+ * function returns. The contacts and the stylus state are written into the frame, whose
+ * storage for contacts must have been set up by the caller.
+ *
+ * @param[in] context The context of the device that the report was read from.
+ * @param[in] data The report.
+ * @param[in] size The size of the report.
+ * @param[in,out] frame The storage for the results.
+ * @return Zero on success, or a negative value if the report could not be processed.
+ */
+IPTSD_EXPORT int iptsd_process(struct iptsd_context *context,
+                               uint8_t *data,
+                               size_t size,
+                               struct iptsd_frame *frame);
+
+/*!
+ * Forgets all contacts of previous reports.
+ *
+ * This should be called when reports were skipped, e.g. because the device was suspended.
+ *
+ * @param[in] context The context to reset.
+ */
+IPTSD_EXPORT void iptsd_reset(struct iptsd_context *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IPTSD_LIB_IPTSD_H */
@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_LIB_LIBRARY_HPP
+#define IPTSD_LIB_LIBRARY_HPP
+
+#include "iptsd.h"
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+#include <contacts/contact.hpp>
+#include <core/generic/application.hpp>
+#include <core/generic/config.hpp>
+#include <core/generic/device.hpp>
+#include <ipts/data.hpp>
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+namespace iptsd::lib {
+
+/*
+ * Writes the results of processing a report into storage that is owned by the caller.
+ */
+class Library : public core::Application {
+private:
+	// The storage of the report that is currently being processed.
+	iptsd_frame *m_frame = nullptr;
+
+public:
+	Library(const core::Config &config,
+	        const core::DeviceInfo &info,
+	        const std::optional<const ipts::Metadata> &metadata)
+		: core::Application(config, info, metadata) {};
+
+	/*!
+	 * Processes a report and writes the results into a frame.
+	 *
+	 * @param[in] data The report to process.
+	 * @param[in,out] frame The storage for the results.
+	 */
+	void process_into(const gsl::span<u8> data, iptsd_frame &frame)
+	{
+		frame.has_contacts = false;
+		frame.has_stylus = false;
+
+		m_frame = &frame;
+		auto _reset = gsl::finally([&] { m_frame = nullptr; });
+
+		this->process(data);
+	}
+
+protected:
+	void on_contacts(const std::vector<contacts::Contact<f64>> &contacts) override
+	{
+		if (m_frame == nullptr)
+			return;
+
+		const usize count = std::min(contacts.size(), m_frame->capacity);
+		const gsl::span<iptsd_contact> out {m_frame->contacts, count};
+
+		for (usize i = 0; i < count; i++) {
+			const contacts::Contact<f64> &contact = contacts[i];
+
+			out[i].x = contact.mean.x();
+			out[i].y = contact.mean.y();
+			out[i].major = contact.size.x();
+			out[i].minor = contact.size.y();
+			out[i].orientation = contact.orientation;
+			out[i].index = contact.index.has_value() ? casts::to<i32>(*contact.index) : -1;
+			out[i].valid = contact.valid.value_or(true);
+			out[i].stable = contact.stable.value_or(true);
+		}
+
+		m_frame->has_contacts = true;
+		m_frame->count = count;
+		m_frame->truncated = count < contacts.size();
+	}
+
+	void on_stylus(const ipts::StylusData &data) override
+	{
+		if (m_frame == nullptr)
+			return;
+
+		iptsd_stylus &stylus = m_frame->stylus;
+
+		stylus.proximity = data.proximity;
+		stylus.contact = data.contact;
+		stylus.button = data.button;
+		stylus.rubber = data.rubber;
+		stylus.x = data.x;
+		stylus.y = data.y;
+		stylus.pressure = data.pressure;
+		stylus.altitude = data.altitude;
+		stylus.azimuth = data.azimuth;
+		stylus.serial = data.serial;
+
+		m_frame->has_stylus = true;
+	}
+};
+
+} // namespace iptsd::lib
+
+#endif // IPTSD_LIB_LIBRARY_HPP